@@ -216,13 +216,29 @@ static int bloom_fini(arguments_t args)
 }
 
 
+static int bloom_migrate(arguments_t args, arguments_t old)
+{
+	/* same bins and addresses: share the filter of the running computation */
+
+	if (GET_ARG_1(char *, old) == NULL)
+		return -EINVAL;
+
+	SET_ARG_0(args, GET_ARG_0(unsigned int, old));
+	SET_ARG_1(args, GET_ARG_1(char *, old));
+	SET_ARG_2(args, GET_ARG_2(__be32, old));
+
+	pr_devel("[PFQ|init] bloom filter: memory migrated@%p!\n", GET_ARG_1(char *, args));
+	return 0;
+}
+
+
 struct pfq_lang_function_descr bloom_functions[] = {
 
-	{"bloom",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom,			bloom_init,	bloom_fini},
-	{"bloom_src",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom_src,		bloom_init,	bloom_fini},
-	{"bloom_dst",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom_dst,		bloom_init,	bloom_fini},
-	{"bloom_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_filter,		bloom_init,	bloom_fini},
-	{"bloom_src_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_src_filter,	bloom_init,	bloom_fini},
-	{"bloom_dst_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_dst_filter,	bloom_init,	bloom_fini},
+	{"bloom",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom,			bloom_init,	bloom_fini,	bloom_migrate},
+	{"bloom_src",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom_src,		bloom_init,	bloom_fini,	bloom_migrate},
+	{"bloom_dst",		"CInt -> [Word32] -> CInt -> Qbuff -> Bool",		bloom_dst,		bloom_init,	bloom_fini,	bloom_migrate},
+	{"bloom_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_filter,		bloom_init,	bloom_fini,	bloom_migrate},
+	{"bloom_src_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_src_filter,	bloom_init,	bloom_fini,	bloom_migrate},
+	{"bloom_dst_filter",	"CInt -> [Word32] -> CInt -> Qbuff -> Action Qbuff",	bloom_dst_filter,	bloom_init,	bloom_fini,	bloom_migrate},
 	{ NULL }};
 
@@ -0,0 +1,283 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+
+/*
+ * duplicate suppression (span/tap aggregation): the invariant part of the
+ * IP header (TTL/hop limit and checksum are skipped) and the first
+ * Q_DEDUP_PAYLOAD bytes after it are hashed into a set-associative table
+ * shared by the cpus, as the copies of a packet may be received by
+ * different cpus. Each entry packs the fingerprint of the packet and the
+ * time it was seen (in units of 1024 ns of the global monotonic clock, as
+ * the entries are compared across cpus); a packet whose
+ * fingerprint is in the table within the window is dropped. Non-IP
+ * packets are passed...
+ */
+
+struct dedup
+{
+	uint32_t	window;		/* in units of 1024 ns */
+	uint32_t	seed;
+	uint64_t	*slot;		/* Q_DEDUP_SLOTS: fingerprint << 32 | time */
+};
+
+
+#define DEDUP(args)		GET_ARG_7(struct dedup *, args)
+
+#define DEDUP_FP(v)		((uint32_t)((v) >> 32))
+#define DEDUP_TIME(v)		((uint32_t)(v))
+
+
+static bool
+dedup_hash(struct dedup const *d, struct qbuff * buff, uint32_t *h1, uint32_t *fp)
+{
+	uint8_t _data[Q_DEDUP_PAYLOAD];
+	const uint8_t *data;
+	uint32_t w[10];
+	int ipproto, off, len, n;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		w[0] = (uint32_t)ip->ihl << 24 | (uint32_t)ip->tos << 16 | be16_to_cpu(ip->tot_len);
+		w[1] = (uint32_t)be16_to_cpu(ip->id) << 16 | be16_to_cpu(ip->frag_off);
+		w[2] = ip->protocol;
+		w[3] = (__force uint32_t)ip->saddr;
+		w[4] = (__force uint32_t)ip->daddr;
+		n = 5;
+
+		ipproto = IPPROTO_IP;
+		off = ip->ihl<<2;
+		len = (int)be16_to_cpu(ip->tot_len) - off;
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		w[0] = be32_to_cpu(*(__be32 const *)ip6);
+		w[1] = (uint32_t)be16_to_cpu(ip6->payload_len) << 16 | ip6->nexthdr;
+		memcpy(&w[2], &ip6->saddr, sizeof(ip6->saddr));
+		memcpy(&w[6], &ip6->daddr, sizeof(ip6->daddr));
+		n = 10;
+
+		ipproto = IPPROTO_IPV6;
+		off = sizeof(struct ipv6hdr);
+		len = (int)be16_to_cpu(ip6->payload_len);
+	} break;
+	default:
+		return false;
+	}
+
+	*fp = jhash2(w, n, ~d->seed);
+	*h1 = jhash2(w, n, d->seed);
+
+	len = min3(len, (int)Q_DEDUP_PAYLOAD, (int)qbuff_len(buff) - buff->monad->ipoff - off);
+	if (len > 0) {
+		data = qbuff_generic_ip_header_pointer(buff, ipproto, off, len, _data);
+		if (data)
+			*h1 = jhash(data, len, *h1);
+	}
+
+	/* the fingerprint depends on both, and is never 0 (free entry) */
+
+	*fp = jhash_2words(*h1, *fp, d->seed) | 1;
+	return true;
+}
+
+
+static inline uint32_t
+dedup_clock(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)
+	return (uint32_t)(ktime_get_mono_fast_ns() >> 10);
+#else
+	return (uint32_t)(ktime_to_ns(ktime_get()) >> 10);
+#endif
+}
+
+
+/* age of an entry, with a signed delta: an entry stamped by another cpu
+ * after this one read the clock is just seen, while one far in the future
+ * is an old entry whose time wrapped around... */
+
+static inline uint32_t
+dedup_age(struct dedup const *d, uint32_t now, uint64_t v)
+{
+	const int32_t age = (int32_t)(now - DEDUP_TIME(v));
+
+	if (age >= 0)
+		return (uint32_t)age;
+
+	return (uint32_t)-age < d->window ? 0 : ~0U;
+}
+
+
+/*
+ * lookup and insert: a copy within the window is a duplicate, otherwise
+ * the packet takes its own (expired) entry, or the oldest of the set...
+ */
+
+static bool
+dedup_seen(struct qbuff * buff, struct dedup *d)
+{
+	uint64_t *set, *victim, old, v;
+	uint32_t h1, fp, now, age, oldest = 0;
+	int i;
+
+	if (!dedup_hash(d, buff, &h1, &fp))
+		return false;
+
+	now = dedup_clock();
+
+	set = &d->slot[(h1 & (Q_DEDUP_SLOTS / Q_DEDUP_WAYS - 1)) * Q_DEDUP_WAYS];
+	victim = set;
+
+	for(i = 0; i < Q_DEDUP_WAYS; i++)
+	{
+		v = READ_ONCE(set[i]);
+		age = v ? dedup_age(d, now, v) : ~0U;
+
+		if (DEDUP_FP(v) == fp) {
+			if (age < d->window)
+				goto duplicate;
+			victim = &set[i];
+			break;
+		}
+
+		if (age > oldest) {
+			oldest = age;
+			victim = &set[i];
+		}
+	}
+
+	old = READ_ONCE(*victim);
+	if (old && DEDUP_FP(old) != fp && dedup_age(d, now, old) < d->window)
+		local_inc(&get_group_shed_stats(buff)->dedup_coll);
+
+	v = cmpxchg64(victim, old, (uint64_t)fp << 32 | now);
+	if (v != old && DEDUP_FP(v) == fp)
+		goto duplicate;	/* a copy inserted by another cpu meanwhile */
+
+	return false;
+
+duplicate:
+	local_inc(&get_group_shed_stats(buff)->dedup);
+	return true;
+}
+
+
+static ActionQbuff
+dedup(arguments_t args, struct qbuff * buff)
+{
+	if (dedup_seen(buff, DEDUP(args)))
+		return Drop(buff);
+	return Pass(buff);
+}
+
+
+static int dedup_init(arguments_t args)
+{
+	const uint64_t window = GET_ARG_0(uint64_t, args);
+	struct dedup *d;
+
+	if (window == 0 || window > Q_DEDUP_MAX_WINDOW) {
+		printk(KERN_INFO "[PFQ|init] dedup: bad window %llu usec (max %d)!\n", window, Q_DEDUP_MAX_WINDOW);
+		return -EINVAL;
+	}
+
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	if (d == NULL) {
+		printk(KERN_INFO "[PFQ|init] dedup: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	d->window = (uint32_t)DIV_ROUND_UP(window * NSEC_PER_USEC, 1024);
+	d->seed = get_random_int();
+	d->slot = vzalloc(sizeof(uint64_t) * Q_DEDUP_SLOTS);
+	if (d->slot == NULL) {
+		printk(KERN_INFO "[PFQ|init] dedup: out of memory!\n");
+		kfree(d);
+		return -ENOMEM;
+	}
+
+	SET_ARG_7(args, d);
+
+	pr_devel("[PFQ|init] dedup: window=%llu usec, %d entries\n", window, Q_DEDUP_SLOTS);
+	return 0;
+}
+
+
+static int dedup_fini(arguments_t args)
+{
+	struct dedup *d = DEDUP(args);
+
+	if (d) {
+		vfree(d->slot);
+		kfree(d);
+	}
+
+	SET_ARG_7(args, (struct dedup *)NULL);
+	return 0;
+}
+
+
+static int dedup_migrate(arguments_t args, arguments_t old)
+{
+	/* same window: keep the packets seen by the running computation */
+
+	if (DEDUP(old) == NULL)
+		return -EINVAL;
+
+	SET_ARG_7(args, DEDUP(old));
+	return 0;
+}
+
+
+struct pfq_lang_function_descr dedup_functions[] = {
+
+	{ "dedup",	"Word64 -> Qbuff -> Action Qbuff",	dedup,	dedup_init,	dedup_fini,	dedup_migrate },
+
+	{ NULL }};
@@ -26,9 +26,14 @@
 #include <lang/symtable.h>
 #include <lang/signature.h>
 #include <lang/module.h>
+#include <lang/native.h>
 
+#include <pfq/bitops.h>
 #include <pfq/global.h>
 #include <pfq/printk.h>
+#include <pfq/qbuff.h>
+
+#include <linux/jhash.h>
 
 
 const char *
@@ -142,7 +147,7 @@ strdup_user(const char __user *str)
 static inline ActionQbuff
 pfq_lang_bind(struct qbuff * buff, struct pfq_lang_functional_node *node)
 {
-	return EVAL_FUNCTION((function_t){&node->fun}, buff);
+	return native_eval_function((function_t){&node->fun}, buff);
 }
 
 
@@ -153,18 +158,83 @@ pfq_lang_run(struct qbuff * buff, struct pfq_lang_computation_tree *prg)
 }
 
 
+/*
+ * run the computation a node at a time over the buffs selected by mask,
+ * and return the mask of buffs that are not dropped.
+ */
+
+unsigned __int128
+pfq_lang_run_batch(struct pfq_qbuff_queue *queue, unsigned __int128 mask, struct pfq_lang_computation_tree *prg)
+{
+	struct pfq_lang_functional *fun;
+
+	for(fun = &prg->entry_point->fun; fun && mask; fun = fun->link)
+	{
+		unsigned __int128 run = mask;
+		struct qbuff *buff;
+		size_t n;
+
+		for_each_qbuff_with_mask(run, queue, buff, n)
+		{
+			ActionQbuff ret = unlikely(fun->profile) ? native_eval_profile(fun, buff) : native_eval(fun, buff);
+			if (!ret.qbuff || is_drop(buff->monad->fanout))
+				mask &= ~((unsigned __int128)1 << n);
+		}
+	}
+
+	return mask;
+}
+
+
 struct pfq_lang_computation_tree *
 pfq_lang_computation_alloc (struct pfq_lang_computation_descr const *descr)
 {
-        struct pfq_lang_computation_tree * c = kzalloc(sizeof(size_t) + descr->size * sizeof(struct pfq_lang_functional_node),
+        struct pfq_lang_computation_tree * c = kzalloc(sizeof(struct pfq_lang_computation_tree) +
+						       descr->size * sizeof(struct pfq_lang_functional_node),
 						  GFP_KERNEL);
-	if (c)
-		c->size = descr->size;
+	if (!c)
+		return NULL;
+
+	c->size = descr->size;
+
+	/* per-node counters: no cost at all when profiling is disabled */
+
+	if (global->lang_profile && descr->size) {
+		c->profile = __alloc_percpu(descr->size * sizeof(struct pfq_lang_profile),
+					    __alignof__(struct pfq_lang_profile));
+		if (!c->profile)
+			printk(KERN_INFO "[PFQ] computation: could not allocate the profile counters!\n");
+	}
 
         return c;
 }
 
 
+void
+pfq_lang_computation_free(struct pfq_lang_computation_tree *comp)
+{
+	if (comp)
+		free_percpu(comp->profile);
+	kfree(comp);
+}
+
+
+void
+pfq_lang_computation_profile(struct pfq_lang_computation_tree const *comp, size_t n, struct pfq_lang_node_profile *p)
+{
+	struct pfq_lang_profile __percpu *prof = comp->profile ? comp->profile + n : NULL;
+
+	memset(p, 0, sizeof(*p));
+
+	if (prof && n < comp->size) {
+		p->run    = (unsigned long)sparse_read(prof, run);
+		p->pass   = (unsigned long)sparse_read(prof, pass);
+		p->drop   = (unsigned long)sparse_read(prof, drop);
+		p->cycles = (unsigned long)sparse_read(prof, cycles);
+	}
+}
+
+
 void *
 pfq_lang_context_alloc(struct pfq_lang_computation_descr const *descr)
 {
@@ -396,7 +466,7 @@ pfq_lang_check_computation_descr(struct pfq_lang_computation_descr const *descr)
 
 static void *
 resolve_user_symbol(struct symtable *table, const char __user *symb, const char **signature,
-		    init_ptr_t *init, fini_ptr_t *fini)
+		    init_ptr_t *init, fini_ptr_t *fini, migrate_ptr_t *migrate, int *op)
 {
 	struct symtable_entry *entry;
         char *symbol;
@@ -416,6 +486,8 @@ resolve_user_symbol(struct symtable *table, const char __user *symb, const char
         *signature = entry->signature;
 	*init = entry->init;
 	*fini = entry->fini;
+	*migrate = entry->migrate;
+	*op   = pfq_lang_native_op(entry->function);
 
         kfree(symbol);
         return entry->function;
@@ -428,7 +500,7 @@ pfq_lang_computation_init(struct pfq_lang_computation_tree *comp)
 	size_t n;
 	for (n = 0; n < comp->size; n++)
 	{
-		if (comp->node[n].init) {
+		if (comp->node[n].init && !comp->node[n].initialized) {
 
 			pr_devel("[PFQ] %zu: initializing computation %pF...\n", n, comp->node[n].init);
 
@@ -443,6 +515,117 @@ pfq_lang_computation_init(struct pfq_lang_computation_tree *comp)
 	return 0;
 }
 
+/*
+ * the digest only rules out most of the candidates: the arguments are
+ * compared byte by byte (functions by index, symbol and arguments digest).
+ */
+
+static bool
+pfq_lang_same_arguments(struct pfq_lang_functional_node const *node, struct pfq_lang_functional_node const *prev)
+{
+	size_t i, j;
+
+	for(i = 0; i < sizeof(node->user_arg)/sizeof(node->user_arg[0]); i++)
+	{
+		struct pfq_lang_user_arg const *a = &node->user_arg[i];
+		struct pfq_lang_user_arg const *b = &prev->user_arg[i];
+
+		if (a->size != b->size || a->nelem != b->nelem || a->value != b->value)
+			return false;
+
+		if (a->nelem) {	/* vector of strings */
+			for(j = 0; j < a->nelem; j++)
+			{
+				if (strcmp(((char * const *)a->addr)[j], ((char * const *)b->addr)[j]))
+					return false;
+			}
+			continue;
+		}
+
+		if (a->size) {
+			if (memcmp(a->addr, b->addr, a->size))
+				return false;
+			continue;
+		}
+
+		if (a->addr && b->addr) { /* function */
+			struct pfq_lang_functional_node const *fa = a->addr, *fb = b->addr;
+			if (fa->fun.run != fb->fun.run || fa->digest != fb->digest)
+				return false;
+		}
+		else if (a->addr != b->addr)
+			return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * carry the state of the running computation over to the new one: a function
+ * that declares a migrate hook takes the state of an old instance with the
+ * same symbol and arguments, instead of being initialized from scratch. The
+ * state is shared while both computations run, and belongs to the new one.
+ */
+
+int
+pfq_lang_computation_migrate(struct pfq_lang_computation_tree *comp, struct pfq_lang_computation_tree *old)
+{
+	size_t n, m;
+	int ret = 0;
+
+	for (n = 0; n < comp->size; n++)
+	{
+		struct pfq_lang_functional_node *node = &comp->node[n];
+
+		if (!node->migrate || node->initialized)
+			continue;
+
+		for (m = 0; m < old->size; m++)
+		{
+			struct pfq_lang_functional_node *prev = &old->node[m];
+
+			if (!prev->initialized || prev->fun.run != node->fun.run || prev->digest != node->digest)
+				continue;
+
+			if (!pfq_lang_same_arguments(node, prev))
+				continue;
+
+			if (node->migrate(&node->fun, &prev->fun) < 0) {
+				printk(KERN_INFO "[PFQ] computation_migrate: error in function (%zu)!\n", n);
+				break;
+			}
+
+			pr_devel("[PFQ] %zu: state migrated from function %zu\n", n, m);
+
+			prev->initialized = false;
+			node->initialized = true;
+			node->origin = prev;
+			ret++;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+
+void
+pfq_lang_computation_unmigrate(struct pfq_lang_computation_tree *comp)
+{
+	size_t n;
+
+	for (n = 0; n < comp->size; n++)
+	{
+		if (comp->node[n].origin) {
+			comp->node[n].origin->initialized = true;
+			comp->node[n].initialized = false;
+			comp->node[n].origin = NULL;
+		}
+	}
+}
+
+
 int
 pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp)
 {
@@ -474,6 +657,165 @@ get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, str
 }
 
 
+/*
+ * link-time optimizer: only the native view of the computation (op and link)
+ * is rewritten, the interpreted one (run and next) is left untouched.
+ */
+
+static int
+static_predicate(struct pfq_lang_functional *pred)
+{
+	return pred->op == native_true  ?  1 :
+	       pred->op == native_false ?  0 : -1;
+}
+
+
+static int
+optimize_predicate(struct pfq_lang_functional *pred)
+{
+	int p1, p2;
+
+	switch(pred->op)
+	{
+	case native_has_vid: {
+		const int vid = GET_ARG(int, pred);
+		return vid < 0 || vid > Q_VLAN_VID_MASK ? native_false : pred->op;
+	}
+	case native_less:
+	case native_any_bit:
+		return GET_ARG_1(uint64_t, pred) == 0 ? native_false : pred->op;
+	case native_not:
+		p1 = static_predicate(GET_ARG(predicate_t, pred).fun);
+		return p1 < 0 ? pred->op : p1 ? native_false : native_true;
+	case native_and:
+		p1 = static_predicate(GET_ARG_0(predicate_t, pred).fun);
+		p2 = static_predicate(GET_ARG_1(predicate_t, pred).fun);
+		return p1 == 0 || p2 == 0 ? native_false :
+		       p1 == 1 && p2 == 1 ? native_true  : pred->op;
+	case native_or:
+		p1 = static_predicate(GET_ARG_0(predicate_t, pred).fun);
+		p2 = static_predicate(GET_ARG_1(predicate_t, pred).fun);
+		return p1 == 1 || p2 == 1 ? native_true  :
+		       p1 == 0 && p2 == 0 ? native_false : pred->op;
+	case native_xor:
+		p1 = static_predicate(GET_ARG_0(predicate_t, pred).fun);
+		p2 = static_predicate(GET_ARG_1(predicate_t, pred).fun);
+		return p1 < 0 || p2 < 0 ? pred->op : p1 != p2 ? native_true : native_false;
+	}
+
+	return pred->op;
+}
+
+
+static int
+optimize_control(struct pfq_lang_functional *fun)
+{
+	int p;
+
+	switch(fun->op)
+	{
+	case native_filter:
+		p = static_predicate(GET_ARG(predicate_t, fun).fun);
+		return p < 0 ? fun->op : p ? native_unit : native_drop;
+	case native_when:
+		p = static_predicate(GET_ARG_0(predicate_t, fun).fun);
+		return p < 0 ? fun->op : p ? native_then : native_unit;
+	case native_unless:
+		p = static_predicate(GET_ARG_0(predicate_t, fun).fun);
+		return p < 0 ? fun->op : p ? native_unit : native_then;
+	case native_conditional:
+		p = static_predicate(GET_ARG_0(predicate_t, fun).fun);
+		return p < 0 ? fun->op : p ? native_then : native_else;
+	}
+
+	return fun->op;
+}
+
+
+static void
+pfq_lang_computation_optimize(struct pfq_lang_computation_tree *comp)
+{
+	bool again;
+	size_t n;
+
+	/* fold the predicates known at link time (up to a fixed point, as
+	 * combinators may refer to predicates that follow them) and
+	 * short-circuit the control functions over them */
+
+	do {
+		again = false;
+		for(n = 0; n < comp->size; n++)
+		{
+			struct pfq_lang_functional *fun = &comp->node[n].fun;
+			int op = optimize_control(fun);
+			if (op == fun->op)
+				op = optimize_predicate(fun);
+			if (op != fun->op) {
+				pr_devel("[PFQ] %zu: optimizer: op %d -> %d (constant predicate)\n", n, fun->op, op);
+				fun->op = op;
+				again = true;
+			}
+		}
+	}
+	while (again);
+
+	/* superinstructions: ip >-> udp|tcp [>-> steer_flow] ... */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_lang_functional *fun = &comp->node[n].fun, *l4 = fun->next;
+		bool udp;
+
+		if (fun->op != native_ip || !l4 || (l4->op != native_udp && l4->op != native_tcp))
+			continue;
+
+		udp = l4->op == native_udp;
+
+		if (l4->next && l4->next->op == native_steer_flow) {
+			fun->op   = udp ? native_ip_udp_steer_flow : native_ip_tcp_steer_flow;
+			fun->link = l4->next->link;
+		}
+		else {
+			fun->op   = udp ? native_ip_udp : native_ip_tcp;
+			fun->link = l4->link;
+		}
+
+		pr_devel("[PFQ] %zu: optimizer: fused into op %d\n", n, fun->op);
+	}
+
+	/* ... and udp|tcp >-> steer_flow */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_lang_functional *fun = &comp->node[n].fun;
+
+		if ((fun->op != native_udp && fun->op != native_tcp) || !fun->next || fun->next->op != native_steer_flow)
+			continue;
+
+		fun->op   = fun->op == native_udp ? native_udp_steer_flow : native_tcp_steer_flow;
+		fun->link = fun->next->link;
+
+		pr_devel("[PFQ] %zu: optimizer: fused into op %d\n", n, fun->op);
+	}
+
+	/* kleisli compositions: drop the identities and the code that
+	 * follows a function that always drops */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_lang_functional *fun = &comp->node[n].fun;
+
+		if (fun->op == native_drop) {
+			fun->link = NULL;
+			continue;
+		}
+
+		while (fun->link && fun->link->op == native_unit)
+			fun->link = fun->link->link;
+	}
+}
+
+
 /*
  * Prerequisite: valid computation (check by means of pfq_lang_validate_computation_descr)
  */
@@ -499,12 +841,15 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 		struct pfq_lang_functional_node *next;
 		const char *signature;
 		init_ptr_t init, fini;
+		migrate_ptr_t migrate;
+		uint32_t digest = 0;
 		void *addr;
                 size_t i;
+		int op;
 
                 fun = &descr->fun[n];
 
-		addr = resolve_user_symbol(&global->functions, fun->symbol, &signature, &init, &fini);
+		addr = resolve_user_symbol(&global->functions, fun->symbol, &signature, &init, &fini, &migrate, &op);
 		if (addr == NULL) {
 			printk(KERN_INFO "[PFQ] %zu: rtlink: bad descriptor!\n", n);
 			return -EPERM;
@@ -514,9 +859,16 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 		comp->node[n].init = init;
 		comp->node[n].fini = fini;
+		comp->node[n].migrate = migrate;
+		comp->node[n].origin = NULL;
 
 		comp->node[n].fun.run  = addr;
                 comp->node[n].fun.next = next ? &next->fun : NULL;
+                comp->node[n].fun.link = comp->node[n].fun.next;
+		comp->node[n].fun.profile = comp->profile ? comp->profile + n : NULL;
+		comp->node[n].fun.op   = op;
+
+		pr_devel("[PFQ] %zu: rtlink: %s function (op %d)\n", n, op == native_call ? "interpreted" : "native", op);
 
 		for(i = 0; i < sizeof(comp->node[n].fun.arg)/sizeof(comp->node[n].fun.arg[0]); i++)
 		{
@@ -536,6 +888,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 				comp->node[n].fun.arg[i].value = (ptrdiff_t)str;
 				comp->node[n].fun.arg[i].nelem = -1ULL;
+
+				comp->node[n].user_arg[i].addr = str;
+				comp->node[n].user_arg[i].size = strlen(str);
+
+				digest = jhash(str, strlen(str), digest);
 			}
 			else if (is_arg_vector_str(&fun->arg[i])) {
 
@@ -558,10 +915,15 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 						printk(KERN_INFO "[PFQ] %zu: pod_user(2): internal error!\n", n);
 						return -EPERM;
 					}
+
+					digest = jhash(base_ptr[j], strlen(base_ptr[j]), digest);
 				}
 
 				comp->node[n].fun.arg[i].value = (ptrdiff_t)base_ptr;
 				comp->node[n].fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
+
+				comp->node[n].user_arg[i].addr = base_ptr;
+				comp->node[n].user_arg[i].nelem = (size_t)fun->arg[i].nelem;
 			}
 			else if (is_arg_data(&fun->arg[i])) {
 
@@ -575,6 +937,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
 					comp->node[n].fun.arg[i].nelem = -1ULL;
+
+					comp->node[n].user_arg[i].addr = ptr;
+					comp->node[n].user_arg[i].size = fun->arg[i].size;
+
+					digest = jhash(ptr, fun->arg[i].size, digest);
 				}
 				else {
 					ptrdiff_t arg = 0;
@@ -586,6 +953,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 					comp->node[n].fun.arg[i].value = arg;
 					comp->node[n].fun.arg[i].nelem = -1ULL;
+
+					comp->node[n].user_arg[i].size = fun->arg[i].size;
+					comp->node[n].user_arg[i].value = arg;
+
+					digest = jhash(&arg, sizeof(arg), digest);
 				}
 
 			}
@@ -602,6 +974,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
 					comp->node[n].fun.arg[i].nelem = (size_t)fun->arg[i].nelem;
+
+					comp->node[n].user_arg[i].addr = ptr;
+					comp->node[n].user_arg[i].size = (size_t)fun->arg[i].size * (size_t)fun->arg[i].nelem;
+
+					digest = jhash(ptr, (size_t)fun->arg[i].size * (size_t)fun->arg[i].nelem, digest);
 				}
 				else {  /* empty vector */
 
@@ -613,6 +990,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 
 				comp->node[n].fun.arg[i].value = (ptrdiff_t)get_functional_node_by_index(descr, comp, (int)fun->arg[i].size);
 				comp->node[n].fun.arg[i].nelem = -1ULL;
+
+				comp->node[n].user_arg[i].addr = (void *)comp->node[n].fun.arg[i].value;
+				comp->node[n].user_arg[i].value = (ptrdiff_t)fun->arg[i].size;
+
+				digest = jhash_1word((u32)fun->arg[i].size, digest);
 			}
 			else if (!is_arg_null(&fun->arg[i])) {
 
@@ -621,8 +1003,11 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 				return -EPERM;
 			}
 		}
+
+		comp->node[n].digest = digest;
 	}
 
+	pfq_lang_computation_optimize(comp);
 	return 0;
 }
 
@@ -67,9 +67,13 @@ extern int pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *
 				  void *context);
 
 extern int pfq_lang_computation_init(struct pfq_lang_computation_tree *comp);
+extern int pfq_lang_computation_migrate(struct pfq_lang_computation_tree *comp, struct pfq_lang_computation_tree *old);
+extern void pfq_lang_computation_unmigrate(struct pfq_lang_computation_tree *comp);
 extern int pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp);
 
 extern struct pfq_lang_computation_tree * pfq_lang_computation_alloc(struct pfq_lang_computation_descr const *);
+extern void pfq_lang_computation_free(struct pfq_lang_computation_tree *comp);
+extern void pfq_lang_computation_profile(struct pfq_lang_computation_tree const *comp, size_t n, struct pfq_lang_node_profile *p);
 extern void * pfq_lang_context_alloc(struct pfq_lang_computation_descr const *);
 extern const char *pfq_lang_signature_by_user_symbol(const char __user *symb);
 extern size_t pfq_lang_number_of_arguments(struct pfq_lang_functional_descr const *fun);
@@ -78,5 +82,9 @@ extern char * strdup_user(const char __user *str);
 
 extern ActionQbuff pfq_lang_run(struct qbuff *, struct pfq_lang_computation_tree *prg);
 
+struct pfq_qbuff_queue;
+
+extern unsigned __int128 pfq_lang_run_batch(struct pfq_qbuff_queue *queue, unsigned __int128 mask, struct pfq_lang_computation_tree *prg);
+
 
 #endif /* PFQ_LANG_ENGINE_H */
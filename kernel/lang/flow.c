@@ -0,0 +1,212 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/flow.h>
+
+#include <pfq/global.h>
+#include <pfq/printk.h>
+
+
+/*
+ * the flow of a packet: IPv4 5-tuple (addresses only for fragments and
+ * protocols other than TCP/UDP) and group. Endpoints are sorted so that
+ * both directions of a connection share the same slot...
+ */
+
+static bool
+qbuff_flow_key(struct qbuff *buff, struct pfq_flow_key *key)
+{
+	struct iphdr _iph;
+	const struct iphdr *ip;
+	__be32 addr;
+	__be16 port;
+
+	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	if (ip == NULL)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+
+	key->saddr = ip->saddr;
+	key->daddr = ip->daddr;
+	key->proto = ip->protocol;
+	key->gid   = (uint8_t)(buff->monad->group - global->groups);
+
+	if ((ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) &&
+	    !(ip->frag_off & __constant_htons(IP_MF|IP_OFFSET))) {
+
+		struct udphdr _udp;
+		const struct udphdr *udp;
+
+		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+		if (udp == NULL)
+			return false;
+
+		key->source = udp->source;
+		key->dest   = udp->dest;
+	}
+
+	if (be32_to_cpu(key->saddr) > be32_to_cpu(key->daddr) ||
+	    (key->saddr == key->daddr && be16_to_cpu(key->source) > be16_to_cpu(key->dest))) {
+
+		addr = key->saddr; key->saddr = key->daddr; key->daddr = addr;
+		port = key->source; key->source = key->dest; key->dest = port;
+	}
+
+	return true;
+}
+
+
+struct pfq_flow *
+pfq_lang_flow_lookup(struct qbuff *buff)
+{
+	struct pfq_flow_key key;
+
+	if (!qbuff_flow_key(buff, &key))
+		return NULL;
+
+	return pfq_flow_lookup(&key, buff->counter, qbuff_len(buff));
+}
+
+
+static uint64_t
+flow_count(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+	if (f == NULL)
+		return NOTHING;
+
+	return (uint64_t)JUST(f->packets);
+}
+
+
+static uint64_t
+flow_bytes(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+	if (f == NULL)
+		return NOTHING;
+
+	return (uint64_t)JUST(f->bytes);
+}
+
+
+static uint64_t
+flow_state(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+	if (f == NULL)
+		return NOTHING;
+
+	return (uint64_t)JUST(f->state);
+}
+
+
+static ActionQbuff
+flow_put_state(arguments_t args, struct qbuff * buff)
+{
+	const uint32_t value = GET_ARG(uint32_t, args);
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+
+	if (f)
+		f->state = value;
+
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+flow_first(arguments_t args, struct qbuff * buff)
+{
+	const int n = GET_ARG(int, args);
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+
+	if (f && f->packets <= (uint64_t)max(n, 0))
+		return Pass(buff);
+
+	return Drop(buff);
+}
+
+
+/*
+ * mark the flow for export, accounting the TCP flags: a record is pushed
+ * to the flow ring of the sockets of the group when the flow ends...
+ */
+
+static ActionQbuff
+flow_export(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_flow *f = pfq_lang_flow_lookup(buff);
+
+	if (f == NULL)
+		return Pass(buff);
+
+	f->export = 1;
+
+	if (f->key.proto == IPPROTO_TCP) {
+
+		struct iphdr _iph;
+		const struct iphdr *ip;
+		uint8_t _flags;
+		const uint8_t *flags;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip && !(ip->frag_off & __constant_htons(IP_OFFSET))) {
+			flags = qbuff_ip_header_pointer(buff, (ip->ihl<<2) + 13, sizeof(_flags), &_flags);
+			if (flags)
+				f->tcp_flags |= *flags;
+		}
+	}
+
+	return Pass(buff);
+}
+
+
+int flow_init(arguments_t args)
+{
+	int ret = pfq_flow_table_get();
+	if (ret < 0)
+		printk(KERN_INFO "[PFQ|init] flow table: not available!\n");
+	return ret;
+}
+
+
+int flow_fini(arguments_t args)
+{
+	pfq_flow_table_put();
+	return 0;
+}
+
+
+struct pfq_lang_function_descr flow_functions[] = {
+
+	{ "flow_count",		"Qbuff -> Word64",			flow_count,	flow_init, flow_fini },
+	{ "flow_bytes",		"Qbuff -> Word64",			flow_bytes,	flow_init, flow_fini },
+	{ "flow_state",		"Qbuff -> Word64",			flow_state,	flow_init, flow_fini },
+	{ "flow_put_state",	"Word32 -> Qbuff -> Action Qbuff",	flow_put_state,	flow_init, flow_fini },
+	{ "flow_first",		"CInt -> Qbuff -> Action Qbuff",	flow_first,	flow_init, flow_fini },
+	{ "flow_export",	"Qbuff -> Action Qbuff",		flow_export,	flow_init, flow_fini },
+
+	{ NULL }};
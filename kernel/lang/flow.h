@@ -0,0 +1,38 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_LANG_FLOW_H
+#define PFQ_LANG_FLOW_H
+
+#include <lang/module.h>
+
+#include <pfq/flow.h>
+
+
+extern int  flow_init(arguments_t args);
+extern int  flow_fini(arguments_t args);
+
+extern struct pfq_flow * pfq_lang_flow_lookup(struct qbuff *buff);
+
+
+#endif /* PFQ_LANG_FLOW_H */
@@ -0,0 +1,222 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/histogram.h>
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/percpu.h>
+#include <linux/pf_q.h>
+
+
+/*
+ * histograms: the packets are counted in per-cpu buckets by the value of a
+ * property, the bucket edges are given in ascending order. Packets for
+ * which the property is Nothing are not counted. The buckets are merged
+ * when read (Q_SO_GET_GROUP_HISTOGRAM and /proc/net/pfq/histograms)...
+ */
+
+#define HISTOGRAM_COUNT(args)	GET_ARG_7(uint64_t __percpu *, args)
+
+
+static inline size_t
+histogram_bucket(uint64_t const *edges, size_t n, uint64_t value)
+{
+	size_t lo = 0, hi = n;
+
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (value < edges[mid])
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+
+static ActionQbuff
+histogram(arguments_t args, struct qbuff * buff)
+{
+	uint64_t const *edges = GET_ARRAY_1(uint64_t, args);
+	size_t n = LEN_ARRAY_1(args);
+	property_t p = GET_ARG_2(property_t, args);
+	uint64_t value;
+
+	value = EVAL_PROPERTY(p, buff);
+	if (!IS_NOTHING(value))
+		this_cpu_inc(HISTOGRAM_COUNT(args)[histogram_bucket(edges, n, FROM_JUST(uint64_t, value))]);
+
+	return Pass(buff);
+}
+
+
+static int histogram_init(arguments_t args)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t const *edges = GET_ARRAY_1(uint64_t, args);
+	size_t n = LEN_ARRAY_1(args), i;
+	uint64_t __percpu *count;
+
+	if (id < 0) {
+		printk(KERN_INFO "[PFQ|init] histogram: bad id %d!\n", id);
+		return -EINVAL;
+	}
+
+	if (n == 0 || n > Q_HISTOGRAM_MAX_EDGES) {
+		printk(KERN_INFO "[PFQ|init] histogram: bad number of edges %zu (max %d)!\n", n, Q_HISTOGRAM_MAX_EDGES);
+		return -EINVAL;
+	}
+
+	for(i = 1; i < n; i++)
+	{
+		if (edges[i] <= edges[i-1]) {
+			printk(KERN_INFO "[PFQ|init] histogram: edges not in ascending order!\n");
+			return -EINVAL;
+		}
+	}
+
+	count = __alloc_percpu(sizeof(uint64_t) * (n + 1), sizeof(uint64_t));
+	if (count == NULL) {
+		printk(KERN_INFO "[PFQ|init] histogram: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	SET_ARG_7(args, count);
+
+	pr_devel("[PFQ|init] histogram %d: %zu buckets\n", id, n + 1);
+	return 0;
+}
+
+
+static int histogram_fini(arguments_t args)
+{
+	free_percpu(HISTOGRAM_COUNT(args));
+	SET_ARG_7(args, (uint64_t __percpu *)NULL);
+	return 0;
+}
+
+
+static int histogram_migrate(arguments_t args, arguments_t old)
+{
+	/* same id and edges: keep counting in the buckets of the running computation */
+
+	if (HISTOGRAM_COUNT(old) == NULL)
+		return -EINVAL;
+
+	SET_ARG_7(args, HISTOGRAM_COUNT(old));
+	return 0;
+}
+
+
+/*
+ * read out: the buckets of a node are summed over the cpus, the counters
+ * are read while being updated by the other cpus...
+ */
+
+bool
+pfq_lang_histogram_node(struct pfq_lang_functional_node const *node, int *id, uint64_t const **edges, size_t *n)
+{
+	arguments_t args = (arguments_t)&node->fun;
+
+	if (node->fun.run != (void *)histogram || !node->initialized)
+		return false;
+
+	*id = GET_ARG_0(int, args);
+	*edges = GET_ARRAY_1(uint64_t, args);
+	*n = LEN_ARRAY_1(args);
+	return true;
+}
+
+
+void
+pfq_lang_histogram_sum(struct pfq_lang_functional_node const *node, uint64_t *count, size_t size)
+{
+	arguments_t args = (arguments_t)&node->fun;
+	size_t i;
+	int cpu;
+
+	size = min(size, LEN_ARRAY_1(args) + 1);
+
+	for_each_possible_cpu(cpu)
+	{
+		uint64_t const *c = per_cpu_ptr(HISTOGRAM_COUNT(args), cpu);
+
+		for(i = 0; i < size; i++)
+			count[i] += READ_ONCE(c[i]);
+	}
+}
+
+
+/* the histograms with the same id (and edges) of a computation add up */
+
+int
+pfq_lang_histogram_read(struct pfq_lang_computation_tree const *comp, int id,
+			uint64_t *edges, uint64_t *count, size_t *size)
+{
+	uint64_t const *first = NULL;
+	size_t n, nedges = 0;
+
+	memset(count, 0, sizeof(uint64_t) * *size);
+
+	for(n = 0; n < comp->size; n++)
+	{
+		uint64_t const *e;
+		size_t len;
+		int this_id;
+
+		if (!pfq_lang_histogram_node(&comp->node[n], &this_id, &e, &len) || this_id != id)
+			continue;
+
+		if (first == NULL) {
+			first = e;
+			nedges = len;
+		}
+		else if (len != nedges || memcmp(e, first, sizeof(uint64_t) * len)) {
+			pr_devel("[PFQ] histogram %d: node %zu with different edges ignored!\n", id, n);
+			continue;
+		}
+
+		pfq_lang_histogram_sum(&comp->node[n], count, *size);
+	}
+
+	if (first == NULL)
+		return -ENOENT;
+
+	if (*size)
+		memcpy(edges, first, sizeof(uint64_t) * min(*size - 1, nedges));
+
+	*size = nedges + 1;
+	return 0;
+}
+
+
+struct pfq_lang_function_descr histogram_functions[] = {
+
+	{ "histogram",	"CInt -> [Word64] -> (Qbuff -> Word64) -> Qbuff -> Action Qbuff",	histogram,	histogram_init,	histogram_fini,	histogram_migrate },
+
+	{ NULL }};
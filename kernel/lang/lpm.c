@@ -0,0 +1,507 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/inet.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+
+/*
+ * Longest prefix match over large sets of IPv4/IPv6 prefixes.
+ *
+ * At init the prefixes are flattened into the sorted list of the address
+ * ranges they split the space into, each one labeled with its longest
+ * matching prefix. A direct-indexed table on the 16 most significant bits
+ * of the address (as in DIR-24-8, but smaller) narrows the lookup to the
+ * few ranges of that block, then a binary search picks the range.
+ */
+
+#define LPM_JUMP_BITS	16
+#define LPM_JUMP_SIZE	(1 << LPM_JUMP_BITS)
+#define LPM_MISS	-1
+
+#define LPM_TABLE(args)	GET_ARG_7(struct lpm_table *, args)
+
+
+typedef unsigned __int128 lpm_key_t;
+
+
+struct lpm_prefix
+{
+	lpm_key_t	start;
+	lpm_key_t	end;
+	int		len;
+	int		index;
+};
+
+
+struct lpm_ranges
+{
+	size_t		size;
+	lpm_key_t	*start;
+	int		*index;
+	uint32_t	*jump;		/* LPM_JUMP_SIZE + 1 */
+};
+
+
+struct lpm_table
+{
+	struct lpm_ranges ip4;
+	struct lpm_ranges ip6;
+};
+
+
+static inline lpm_key_t
+lpm_key6(struct in6_addr const *addr)
+{
+	lpm_key_t key = 0;
+	int n;
+
+	for(n = 0; n < 16; n++)
+		key = (key << 8) | addr->s6_addr[n];
+	return key;
+}
+
+
+static inline int
+lpm_ranges_lookup(struct lpm_ranges const *r, lpm_key_t key, int bits)
+{
+	unsigned int h = (unsigned int)(key >> (bits - LPM_JUMP_BITS));
+	size_t lo, hi;
+
+	if (r->size == 0)
+		return LPM_MISS;
+
+	/* the range of the key is the last one starting at or before it */
+
+	lo = r->jump[h] ? r->jump[h] - 1 : 0;
+	hi = r->jump[h+1];
+
+	while (hi - lo > 1)
+	{
+		size_t mid = lo + ((hi - lo) >> 1);
+		if (r->start[mid] <= key)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return r->index[lo];
+}
+
+
+/*
+ * the source (or destination) address of the packet: index of the longest
+ * matching prefix, LPM_MISS if none...
+ */
+
+static int
+lpm_lookup(struct lpm_table const *t, struct qbuff * buff, bool dst)
+{
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return LPM_MISS;
+
+		return lpm_ranges_lookup(&t->ip4, be32_to_cpu(dst ? ip->daddr : ip->saddr), 32);
+	}
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return LPM_MISS;
+
+		return lpm_ranges_lookup(&t->ip6, lpm_key6(dst ? &ip6->daddr : &ip6->saddr), 128);
+	}
+	}
+
+	return LPM_MISS;
+}
+
+
+static inline uint64_t
+lpm_class(arguments_t args, int index)
+{
+	const uint32_t *class = GET_ARRAY_1(uint32_t, args);
+
+	if (LEN_ARRAY_1(args) == 0)
+		return (uint64_t)index;
+	return class[index];
+}
+
+
+static bool
+lpm_src(arguments_t args, struct qbuff * buff)
+{
+	return lpm_lookup(LPM_TABLE(args), buff, false) != LPM_MISS;
+}
+
+
+static bool
+lpm_dst(arguments_t args, struct qbuff * buff)
+{
+	return lpm_lookup(LPM_TABLE(args), buff, true) != LPM_MISS;
+}
+
+
+static bool
+lpm(arguments_t args, struct qbuff * buff)
+{
+	struct lpm_table *t = LPM_TABLE(args);
+
+	if ((buff->monad->ep_ctx & EPOINT_DST) && lpm_lookup(t, buff, true) != LPM_MISS)
+		return true;
+
+	if ((buff->monad->ep_ctx & EPOINT_SRC) && lpm_lookup(t, buff, false) != LPM_MISS)
+		return true;
+
+	return false;
+}
+
+
+static ActionQbuff
+lpm_src_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm_src(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+lpm_dst_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm_dst(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+lpm_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static uint64_t
+lpm_src_class(arguments_t args, struct qbuff * buff)
+{
+	int index = lpm_lookup(LPM_TABLE(args), buff, false);
+	if (index == LPM_MISS)
+		return NOTHING;
+
+	return (uint64_t)JUST(lpm_class(args, index));
+}
+
+
+static uint64_t
+lpm_dst_class(arguments_t args, struct qbuff * buff)
+{
+	int index = lpm_lookup(LPM_TABLE(args), buff, true);
+	if (index == LPM_MISS)
+		return NOTHING;
+
+	return (uint64_t)JUST(lpm_class(args, index));
+}
+
+
+static ActionQbuff
+steer_lpm(arguments_t args, struct qbuff * buff)
+{
+	struct lpm_table *t = LPM_TABLE(args);
+	int index;
+
+	index = lpm_lookup(t, buff, false);
+	if (index == LPM_MISS)
+		index = lpm_lookup(t, buff, true);
+
+	if (index == LPM_MISS)
+		return Drop(buff);
+
+	return Steering(buff, (uint32_t)lpm_class(args, index));
+}
+
+
+/*
+ * init: parse the prefixes and build the ranges...
+ */
+
+static int
+lpm_parse(const char *str, struct lpm_prefix *p, bool *ip6)
+{
+	const char *end;
+	u8 addr[16];
+	int len, bits;
+	lpm_key_t key, mask, max;
+
+	if (in4_pton(str, -1, addr, '/', &end)) {
+		key = ((lpm_key_t)addr[0] << 24) | ((lpm_key_t)addr[1] << 16) | ((lpm_key_t)addr[2] << 8) | addr[3];
+		bits = 32;
+		max = 0xffffffff;
+		*ip6 = false;
+	}
+	else if (in6_pton(str, -1, addr, '/', &end)) {
+		key = lpm_key6((struct in6_addr *)addr);
+		bits = 128;
+		max = ~(lpm_key_t)0;
+		*ip6 = true;
+	}
+	else
+		return -EINVAL;
+
+	len = bits;
+	if (*end == '/' && (kstrtoint(end + 1, 10, &len) < 0 || len < 0 || len > bits))
+		return -EINVAL;
+
+	mask = len == 0 ? 0 : (max << (bits - len)) & max;
+
+	p->start = key & mask;
+	p->end   = (key & mask) | (~mask & max);
+	p->len   = len;
+	return 0;
+}
+
+
+static int
+lpm_prefix_cmp(const void *a, const void *b)
+{
+	const struct lpm_prefix *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	if (x->len != y->len)
+		return x->len - y->len;
+	return x->index - y->index;
+}
+
+
+static int
+lpm_ranges_build(struct lpm_ranges *r, struct lpm_prefix *p, size_t n, lpm_key_t max, int bits)
+{
+	struct lpm_prefix *stack[129];
+	lpm_key_t cur = 0;
+	bool done = false;
+	size_t i, m = 0;
+	int top = -1;
+
+	if (n == 0)
+		return 0;
+
+	sort(p, n, sizeof(*p), lpm_prefix_cmp, NULL);
+
+	r->start = vmalloc(sizeof(lpm_key_t) * (2*n + 1));
+	r->index = vmalloc(sizeof(int) * (2*n + 1));
+	r->jump  = vzalloc(sizeof(uint32_t) * (LPM_JUMP_SIZE + 1));
+
+	if (!r->start || !r->index || !r->jump)
+		return -ENOMEM;
+
+#define LPM_EMIT(s, v)	do { if (m == 0 || r->index[m-1] != (v)) { r->start[m] = (s); r->index[m] = (v); m++; } } while(0)
+
+	for(i = 0; i < n; i++)
+	{
+		/* duplicate prefixes: the last one wins */
+
+		if (i + 1 < n && p[i].start == p[i+1].start && p[i].len == p[i+1].len)
+			continue;
+
+		while (top >= 0 && stack[top]->end < p[i].start) {
+			if (cur <= stack[top]->end) {
+				LPM_EMIT(cur, stack[top]->index);
+				cur = stack[top]->end + 1;
+			}
+			top--;
+		}
+
+		if (cur < p[i].start) {
+			LPM_EMIT(cur, top >= 0 ? stack[top]->index : LPM_MISS);
+			cur = p[i].start;
+		}
+
+		stack[++top] = &p[i];
+	}
+
+	for(; top >= 0 && !done; top--)
+	{
+		if (cur <= stack[top]->end) {
+			LPM_EMIT(cur, stack[top]->index);
+			if (stack[top]->end == max)
+				done = true;
+			else
+				cur = stack[top]->end + 1;
+		}
+	}
+
+	if (!done)
+		LPM_EMIT(cur, LPM_MISS);
+
+#undef LPM_EMIT
+
+	r->size = m;
+
+	/* jump[h]: first range starting in the block h (or after it) */
+
+	for(i = 0; i < m; i++)
+	{
+		unsigned int h = (unsigned int)(r->start[i] >> (bits - LPM_JUMP_BITS));
+		r->jump[h+1] = (uint32_t)(i + 1);
+	}
+
+	for(i = 1; i <= LPM_JUMP_SIZE; i++)
+	{
+		if (r->jump[i] < r->jump[i-1])
+			r->jump[i] = r->jump[i-1];
+	}
+
+	return 0;
+}
+
+
+static void
+lpm_free(struct lpm_table *t)
+{
+	if (t == NULL)
+		return;
+
+	vfree(t->ip4.start);
+	vfree(t->ip4.index);
+	vfree(t->ip4.jump);
+	vfree(t->ip6.start);
+	vfree(t->ip6.index);
+	vfree(t->ip6.jump);
+	kfree(t);
+}
+
+
+static int lpm_init(arguments_t args)
+{
+	const char **str = GET_ARRAY_0(const char *, args);
+	size_t i, n = LEN_ARRAY_0(args), n4 = 0, n6 = 0;
+	struct lpm_prefix *p4, *p6;
+	struct lpm_table *t;
+	int err = 0;
+
+	if (n == 0) {
+		printk(KERN_INFO "[PFQ|init] lpm: empty prefix list!\n");
+		return -EINVAL;
+	}
+
+	p4 = vmalloc(sizeof(struct lpm_prefix) * n);
+	p6 = vmalloc(sizeof(struct lpm_prefix) * n);
+	t  = kzalloc(sizeof(struct lpm_table), GFP_KERNEL);
+
+	if (!p4 || !p6 || !t) {
+		printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		struct lpm_prefix p;
+		bool ip6;
+
+		if (lpm_parse(str[i], &p, &ip6) < 0) {
+			printk(KERN_INFO "[PFQ|init] lpm: bad prefix '%s'!\n", str[i]);
+			err = -EINVAL;
+			goto out;
+		}
+
+		p.index = (int)i;
+
+		if (ip6)
+			p6[n6++] = p;
+		else
+			p4[n4++] = p;
+	}
+
+	err = lpm_ranges_build(&t->ip4, p4, n4, 0xffffffff, 32);
+	if (err == 0)
+		err = lpm_ranges_build(&t->ip6, p6, n6, ~(lpm_key_t)0, 128);
+	if (err)
+		printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+out:
+	vfree(p4);
+	vfree(p6);
+
+	if (err) {
+		lpm_free(t);
+		return err;
+	}
+
+	SET_ARG_7(args, t);
+
+	pr_devel("[PFQ|init] lpm@%p: %zu IPv4 prefixes (%zu ranges), %zu IPv6 prefixes (%zu ranges).\n",
+		 t, n4, t->ip4.size, n6, t->ip6.size);
+	return 0;
+}
+
+
+static int lpm_class_init(arguments_t args)
+{
+	if (LEN_ARRAY_1(args) != 0 && LEN_ARRAY_1(args) != LEN_ARRAY_0(args)) {
+		printk(KERN_INFO "[PFQ|init] lpm: %zu classes given for %zu prefixes!\n", LEN_ARRAY_1(args), LEN_ARRAY_0(args));
+		return -EINVAL;
+	}
+
+	return lpm_init(args);
+}
+
+
+static int lpm_fini(arguments_t args)
+{
+	lpm_free(LPM_TABLE(args));
+	SET_ARG_7(args, (struct lpm_table *)NULL);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr lpm_functions[] = {
+
+	{ "lpm",		"[String] -> Qbuff -> Bool",				lpm,		lpm_init,	lpm_fini },
+	{ "lpm_src",		"[String] -> Qbuff -> Bool",				lpm_src,	lpm_init,	lpm_fini },
+	{ "lpm_dst",		"[String] -> Qbuff -> Bool",				lpm_dst,	lpm_init,	lpm_fini },
+	{ "lpm_filter",		"[String] -> Qbuff -> Action Qbuff",			lpm_filter,	lpm_init,	lpm_fini },
+	{ "lpm_src_filter",	"[String] -> Qbuff -> Action Qbuff",			lpm_src_filter,	lpm_init,	lpm_fini },
+	{ "lpm_dst_filter",	"[String] -> Qbuff -> Action Qbuff",			lpm_dst_filter,	lpm_init,	lpm_fini },
+	{ "lpm_src_class",	"[String] -> [Word32] -> Qbuff -> Word64",		lpm_src_class,	lpm_class_init,	lpm_fini },
+	{ "lpm_dst_class",	"[String] -> [Word32] -> Qbuff -> Word64",		lpm_dst_class,	lpm_class_init,	lpm_fini },
+	{ "steer_lpm",		"[String] -> [Word32] -> Qbuff -> Action Qbuff",	steer_lpm,	lpm_class_init,	lpm_fini },
+
+	{ NULL }};
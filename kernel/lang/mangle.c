@@ -0,0 +1,549 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <net/checksum.h>
+#include <net/dsfield.h>
+#include <net/inet_ecn.h>
+#include <net/ip.h>
+
+#include <linux/etherdevice.h>
+#include <linux/if_vlan.h>
+#include <linux/inet.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+
+
+/*
+ * header mangling: MAC and IP addresses, TCP/UDP ports, TTL/hop limit, DSCP
+ * and VLAN id. IP and TCP/UDP checksums are updated incrementally (RFC 1624),
+ * and headers are copied on write, when the skb is cloned or shared.
+ * Changes are seen by the groups and the sockets that receive the packet
+ * afterwards...
+ */
+
+struct mangle_addr
+{
+	int		version;	/* 4 or 6 */
+	__be32		addr[4];
+};
+
+
+#define MANGLE_ADDR(args)	GET_ARG_7(struct mangle_addr *, args)
+
+
+/* IP and TCP/UDP headers of the packet */
+
+struct mangle_hdr
+{
+	int		version;
+	int		ipoff;
+	int		l4off;		/* -1 = no TCP/UDP header */
+	int		l4proto;
+};
+
+
+static bool
+mangle_locate(struct qbuff * buff, struct mangle_hdr *h)
+{
+	h->version = qbuff_ip_version(buff);
+	h->ipoff   = buff->monad->ipoff;
+	h->l4off   = -1;
+	h->l4proto = IPPROTO_NONE;
+
+	switch(h->version)
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		h->l4proto = ip->protocol;
+		if (!(ip->frag_off & __constant_htons(IP_OFFSET)))
+			h->l4off = h->ipoff + (ip->ihl<<2);
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		h->l4proto = ip6->nexthdr;
+		h->l4off = h->ipoff + sizeof(struct ipv6hdr);
+	} break;
+	default:
+		return false;
+	}
+
+	if (h->l4proto != IPPROTO_TCP && h->l4proto != IPPROTO_UDP)
+		h->l4off = -1;
+
+	return true;
+}
+
+
+/* writable headers, up to the L4 checksum when l4 is set */
+
+static void *
+mangle_writable(struct qbuff * buff, struct mangle_hdr const *h, bool l4)
+{
+	int len;
+
+	if (l4 && h->l4off >= 0)
+		len = h->l4off + (h->l4proto == IPPROTO_TCP ? sizeof(struct tcphdr) : sizeof(struct udphdr));
+	else
+		len = h->ipoff + (h->version == 4 ? sizeof(struct iphdr) : sizeof(struct ipv6hdr));
+
+	return qbuff_make_writable(buff, len);
+}
+
+
+static __sum16 *
+mangle_l4_check(void *data, struct mangle_hdr const *h)
+{
+	struct udphdr *udp;
+
+	if (h->l4off < 0)
+		return NULL;
+
+	if (h->l4proto == IPPROTO_TCP)
+		return &((struct tcphdr *)(data + h->l4off))->check;
+
+	/* UDP over IPv4 may have no checksum */
+
+	udp = data + h->l4off;
+	if (h->version == 4 && udp->check == 0)
+		return NULL;
+
+	return &udp->check;
+}
+
+
+/*
+ * RFC 1624 update of the L4 checksum. With CHECKSUM_PARTIAL the field holds
+ * the pseudo-header sum only, which does not cover the ports...
+ */
+
+static void
+mangle_l4_csum(struct qbuff * buff, struct mangle_hdr const *h, __sum16 *sum, __be32 from, __be32 to, bool pseudohdr)
+{
+	if (sum == NULL)
+		return;
+
+	if (!qbuff_is_xdp(buff) && QBUFF_SKB(buff)->ip_summed == CHECKSUM_PARTIAL) {
+		if (pseudohdr)
+			*sum = ~csum_fold(csum_add(csum_sub(csum_unfold(*sum), (__force __wsum)from), (__force __wsum)to));
+		return;
+	}
+
+	csum_replace4(sum, from, to);
+
+	if (h->l4proto == IPPROTO_UDP && *sum == 0)
+		*sum = CSUM_MANGLED_0;
+}
+
+
+/* the parse cache and the checksum of the whole packet are stale */
+
+static inline void
+mangle_done(struct qbuff * buff)
+{
+	buff->parse.flags &= ~QBUFF_PARSED_HASH;
+
+	if (!qbuff_is_xdp(buff) && QBUFF_SKB(buff)->ip_summed == CHECKSUM_COMPLETE)
+		QBUFF_SKB(buff)->ip_summed = CHECKSUM_NONE;
+}
+
+
+/* MAC addresses */
+
+static ActionQbuff
+mangle_eth(struct qbuff * buff, const uint8_t *src, const uint8_t *dst)
+{
+	struct ethhdr *eth = qbuff_make_writable(buff, ETH_HLEN);
+
+	if (eth == NULL)
+		return Drop(buff);
+
+	if (src)
+		memcpy(eth->h_source, src, ETH_ALEN);
+	if (dst)
+		memcpy(eth->h_dest, dst, ETH_ALEN);
+
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+set_eth_src(arguments_t args, struct qbuff * buff)
+{
+	return mangle_eth(buff, GET_ARG(uint8_t *, args), NULL);
+}
+
+
+static ActionQbuff
+set_eth_dst(arguments_t args, struct qbuff * buff)
+{
+	return mangle_eth(buff, NULL, GET_ARG(uint8_t *, args));
+}
+
+
+static ActionQbuff
+swap_eth(arguments_t args, struct qbuff * buff)
+{
+	struct ethhdr *eth = qbuff_make_writable(buff, ETH_HLEN);
+	uint8_t tmp[ETH_ALEN];
+
+	if (eth == NULL)
+		return Drop(buff);
+
+	memcpy(tmp, eth->h_source, ETH_ALEN);
+	memcpy(eth->h_source, eth->h_dest, ETH_ALEN);
+	memcpy(eth->h_dest, tmp, ETH_ALEN);
+
+	return Pass(buff);
+}
+
+
+/* IP addresses: packets of the other IP version are left unchanged */
+
+static ActionQbuff
+mangle_addr(struct qbuff * buff, struct mangle_addr const *a, bool dst)
+{
+	struct mangle_hdr h;
+	__sum16 *l4sum;
+	__be32 *addr;
+	void *data;
+	int n;
+
+	if (!mangle_locate(buff, &h) || h.version != a->version)
+		return Pass(buff);
+
+	data = mangle_writable(buff, &h, true);
+	if (data == NULL)
+		return Drop(buff);
+
+	l4sum = mangle_l4_check(data, &h);
+
+	if (h.version == 4) {
+		struct iphdr *ip = data + h.ipoff;
+
+		addr = dst ? &ip->daddr : &ip->saddr;
+
+		csum_replace4(&ip->check, *addr, a->addr[0]);
+		mangle_l4_csum(buff, &h, l4sum, *addr, a->addr[0], true);
+		*addr = a->addr[0];
+	}
+	else {
+		struct ipv6hdr *ip6 = data + h.ipoff;
+
+		addr = dst ? ip6->daddr.s6_addr32 : ip6->saddr.s6_addr32;
+
+		for(n = 0; n < 4; n++) {
+			mangle_l4_csum(buff, &h, l4sum, addr[n], a->addr[n], true);
+			addr[n] = a->addr[n];
+		}
+	}
+
+	mangle_done(buff);
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+set_ip_src(arguments_t args, struct qbuff * buff)
+{
+	return mangle_addr(buff, MANGLE_ADDR(args), false);
+}
+
+
+static ActionQbuff
+set_ip_dst(arguments_t args, struct qbuff * buff)
+{
+	return mangle_addr(buff, MANGLE_ADDR(args), true);
+}
+
+
+/* TCP/UDP ports */
+
+static ActionQbuff
+mangle_port(struct qbuff * buff, __be16 port, bool dst)
+{
+	struct mangle_hdr h;
+	struct udphdr *udp;
+	__be16 *p;
+	void *data;
+
+	if (!mangle_locate(buff, &h) || h.l4off < 0)
+		return Pass(buff);
+
+	data = mangle_writable(buff, &h, true);
+	if (data == NULL)
+		return Drop(buff);
+
+	udp = data + h.l4off;
+	p = dst ? &udp->dest : &udp->source;
+
+	mangle_l4_csum(buff, &h, mangle_l4_check(data, &h), (__force __be32)(__force u32)*p, (__force __be32)(__force u32)port, false);
+	*p = port;
+
+	mangle_done(buff);
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+set_src_port(arguments_t args, struct qbuff * buff)
+{
+	return mangle_port(buff, htons((uint16_t)GET_ARG(int, args)), false);
+}
+
+
+static ActionQbuff
+set_dst_port(arguments_t args, struct qbuff * buff)
+{
+	return mangle_port(buff, htons((uint16_t)GET_ARG(int, args)), true);
+}
+
+
+/* TTL (IPv4) and hop limit (IPv6) */
+
+static ActionQbuff
+mangle_ttl(struct qbuff * buff, int ttl)
+{
+	struct mangle_hdr h;
+	void *data;
+
+	if (!mangle_locate(buff, &h))
+		return Pass(buff);
+
+	data = mangle_writable(buff, &h, false);
+	if (data == NULL)
+		return Drop(buff);
+
+	if (h.version == 4) {
+		struct iphdr *ip = data + h.ipoff;
+
+		if (ttl < 0) {
+			if (ip->ttl <= 1)
+				return Drop(buff);
+			ip_decrease_ttl(ip);
+		}
+		else {
+			__be16 *word = (__be16 *)&ip->ttl, old = *word;
+
+			ip->ttl = (uint8_t)ttl;
+			csum_replace2(&ip->check, old, *word);
+		}
+	}
+	else {
+		struct ipv6hdr *ip6 = data + h.ipoff;
+
+		if (ttl < 0) {
+			if (ip6->hop_limit <= 1)
+				return Drop(buff);
+			ip6->hop_limit--;
+		}
+		else
+			ip6->hop_limit = (uint8_t)ttl;
+	}
+
+	mangle_done(buff);
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+set_ttl(arguments_t args, struct qbuff * buff)
+{
+	return mangle_ttl(buff, GET_ARG(int, args));
+}
+
+
+static ActionQbuff
+dec_ttl(arguments_t args, struct qbuff * buff)
+{
+	return mangle_ttl(buff, -1);
+}
+
+
+/* DSCP: the ECN bits are preserved */
+
+static ActionQbuff
+set_dscp(arguments_t args, struct qbuff * buff)
+{
+	const uint8_t dsfield = (uint8_t)(GET_ARG(int, args) << 2);
+	struct mangle_hdr h;
+	void *data;
+
+	if (!mangle_locate(buff, &h))
+		return Pass(buff);
+
+	data = mangle_writable(buff, &h, false);
+	if (data == NULL)
+		return Drop(buff);
+
+	if (h.version == 4)
+		ipv4_change_dsfield(data + h.ipoff, INET_ECN_MASK, dsfield);
+	else
+		ipv6_change_dsfield(data + h.ipoff, INET_ECN_MASK, dsfield);
+
+	mangle_done(buff);
+	return Pass(buff);
+}
+
+
+/*
+ * VLAN id: the accelerated tag (in the metadata) or, if none, the in-band
+ * 802.1Q header is rewritten. Skb-less buffs carry both, and both are
+ * rewritten. Untagged skbs are tagged through the accelerated tag, inserted
+ * on transmission; untagged skb-less buffs have no room for a tag and are
+ * left untouched. Tags are never removed...
+ */
+
+static ActionQbuff
+set_vlan_id(arguments_t args, struct qbuff * buff)
+{
+	const uint16_t vid = (uint16_t)GET_ARG(int, args);
+	const uint16_t tci = qbuff_vlan_tci(buff);
+	const bool inband = qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_8021Q);
+
+	if ((!tci || qbuff_is_xdp(buff)) && inband) {
+		struct vlan_ethhdr *veth = qbuff_make_writable(buff, VLAN_ETH_HLEN);
+
+		if (veth == NULL)
+			return Drop(buff);
+
+		veth->h_vlan_TCI = htons((ntohs(veth->h_vlan_TCI) & ~Q_VLAN_VID_MASK) | vid);
+	}
+
+	if (tci)
+		qbuff_set_vlan_tci(buff, (tci & ~Q_VLAN_VID_MASK) | vid);
+	else if (!inband && !qbuff_is_xdp(buff)) {
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,10,0))
+		__vlan_hwaccel_put_tag(QBUFF_SKB(buff), vid);
+#else
+		__vlan_hwaccel_put_tag(QBUFF_SKB(buff), __constant_htons(ETH_P_8021Q), vid);
+#endif
+	}
+
+	return Pass(buff);
+}
+
+
+static int
+set_eth_init(arguments_t args)
+{
+	char *mac = GET_ARG(char *, args);
+	uint8_t mac_addr[ETH_ALEN];
+
+	if (!mac_pton(mac, mac_addr)) {
+		printk(KERN_INFO "[PFQ|init] set_eth: bad mac address format!\n");
+		return -EINVAL;
+	}
+
+	memcpy(mac, mac_addr, ETH_ALEN);
+	pr_devel("[PFQ|init] set_eth: mac -> %*phC\n", ETH_ALEN, mac);
+	return 0;
+}
+
+
+static int
+set_ip_init(arguments_t args)
+{
+	const char *str = GET_ARG(const char *, args);
+	struct mangle_addr *a;
+
+	a = kzalloc(sizeof(*a), GFP_KERNEL);
+	if (a == NULL) {
+		printk(KERN_INFO "[PFQ|init] set_ip: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	if (in4_pton(str, -1, (u8 *)a->addr, -1, NULL))
+		a->version = 4;
+	else if (in6_pton(str, -1, (u8 *)a->addr, -1, NULL))
+		a->version = 6;
+	else {
+		printk(KERN_INFO "[PFQ|init] set_ip: bad address %s!\n", str);
+		kfree(a);
+		return -EINVAL;
+	}
+
+	SET_ARG_7(args, a);
+	return 0;
+}
+
+
+static int
+set_ip_fini(arguments_t args)
+{
+	kfree(MANGLE_ADDR(args));
+	SET_ARG_7(args, (struct mangle_addr *)NULL);
+	return 0;
+}
+
+
+static int
+mangle_range_init(arguments_t args, const char *name, int min, int max)
+{
+	const int value = GET_ARG(int, args);
+
+	if (value < min || value > max) {
+		printk(KERN_INFO "[PFQ|init] %s: bad value %d!\n", name, value);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static int set_port_init(arguments_t args) { return mangle_range_init(args, "set_port", 0, 65535); }
+static int set_ttl_init (arguments_t args) { return mangle_range_init(args, "set_ttl", 1, 255); }
+static int set_dscp_init(arguments_t args) { return mangle_range_init(args, "set_dscp", 0, 63); }
+static int set_vlan_init(arguments_t args) { return mangle_range_init(args, "set_vlan_id", 0, Q_VLAN_VID_MASK); }
+
+
+struct pfq_lang_function_descr mangle_functions[] = {
+
+	{ "set_eth_src",	"String -> Qbuff -> Action Qbuff",	set_eth_src,	set_eth_init,	NULL },
+	{ "set_eth_dst",	"String -> Qbuff -> Action Qbuff",	set_eth_dst,	set_eth_init,	NULL },
+	{ "swap_eth",		"Qbuff -> Action Qbuff",		swap_eth,	NULL,		NULL },
+	{ "set_ip_src",		"String -> Qbuff -> Action Qbuff",	set_ip_src,	set_ip_init,	set_ip_fini },
+	{ "set_ip_dst",		"String -> Qbuff -> Action Qbuff",	set_ip_dst,	set_ip_init,	set_ip_fini },
+	{ "set_src_port",	"CInt -> Qbuff -> Action Qbuff",	set_src_port,	set_port_init,	NULL },
+	{ "set_dst_port",	"CInt -> Qbuff -> Action Qbuff",	set_dst_port,	set_port_init,	NULL },
+	{ "set_ttl",		"CInt -> Qbuff -> Action Qbuff",	set_ttl,	set_ttl_init,	NULL },
+	{ "dec_ttl",		"Qbuff -> Action Qbuff",		dec_ttl,	NULL,		NULL },
+	{ "set_dscp",		"CInt -> Qbuff -> Action Qbuff",	set_dscp,	set_dscp_init,	NULL },
+	{ "set_vlan_id",	"CInt -> Qbuff -> Action Qbuff",	set_vlan_id,	set_vlan_init,	NULL },
+
+	{ NULL }};
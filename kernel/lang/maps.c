@@ -0,0 +1,373 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/maps.h>
+#include <pfq/printk.h>
+
+
+/*
+ * functions over the lookup maps (see Q_SO_MAP_CREATE/Q_SO_MAP_UPDATE):
+ * maps are referenced by id and can be updated while the computation runs.
+ * Maps of IPv4 and IPv6 addresses are told apart by the key size...
+ */
+
+static bool
+map_lookup_addr(int id, struct qbuff * buff, bool dst, uint64_t *value)
+{
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		return pfq_map_lookup(id, dst ? &ip->daddr : &ip->saddr, sizeof(__be32), value);
+	}
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		return pfq_map_lookup(id, dst ? &ip6->daddr : &ip6->saddr, sizeof(struct in6_addr), value);
+	}
+	}
+
+	return false;
+}
+
+
+/*
+ * the 5-tuple key of the packet: addresses, ports (zero for fragments and
+ * protocols other than TCP/UDP) and protocol, in network order...
+ */
+
+static int
+map_tuple_key(struct qbuff * buff, uint8_t *key)
+{
+	struct udphdr _udp;
+	const struct udphdr *udp = NULL;
+	int alen;
+	uint8_t proto;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return 0;
+
+		alen = sizeof(__be32);
+		memcpy(key, &ip->saddr, alen);
+		memcpy(key + alen, &ip->daddr, alen);
+		proto = ip->protocol;
+
+		if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+		    !(ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)))
+			udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return 0;
+
+		alen = sizeof(struct in6_addr);
+		memcpy(key, &ip6->saddr, alen);
+		memcpy(key + alen, &ip6->daddr, alen);
+		proto = ip6->nexthdr;
+
+		if (proto == IPPROTO_TCP || proto == IPPROTO_UDP)
+			udp = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, sizeof(struct ipv6hdr), sizeof(_udp), &_udp);
+	} break;
+	default:
+		return 0;
+	}
+
+	if (udp) {
+		memcpy(key + 2 * alen, &udp->source, sizeof(__be16));
+		memcpy(key + 2 * alen + 2, &udp->dest, sizeof(__be16));
+	}
+	else
+		memset(key + 2 * alen, 0, 2 * sizeof(__be16));
+
+	key[2 * alen + 4] = proto;
+	return 2 * alen + 5;
+}
+
+
+static void
+map_tuple_reverse(uint8_t *key, int len)
+{
+	int alen = (len - 5) / 2, n;
+
+	for(n = 0; n < alen; n++)
+		swap(key[n], key[alen + n]);
+
+	swap(key[2 * alen], key[2 * alen + 2]);
+	swap(key[2 * alen + 1], key[2 * alen + 3]);
+}
+
+
+/* the 5-tuple of the packet, in either direction */
+
+static bool
+map_lookup_tuple(int id, struct qbuff * buff, uint64_t *value)
+{
+	uint8_t key[Q_MAP_KEY_LEN];
+	int len;
+
+	len = map_tuple_key(buff, key);
+	if (len == 0)
+		return false;
+
+	if (pfq_map_lookup(id, key, len, value))
+		return true;
+
+	map_tuple_reverse(key, len);
+	return pfq_map_lookup(id, key, len, value);
+}
+
+
+static bool
+map_src(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	return map_lookup_addr(id, buff, false, &value);
+}
+
+
+static bool
+map_dst(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	return map_lookup_addr(id, buff, true, &value);
+}
+
+
+static bool
+map_addr(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	if ((buff->monad->ep_ctx & EPOINT_DST) && map_lookup_addr(id, buff, true, &value))
+		return true;
+
+	if ((buff->monad->ep_ctx & EPOINT_SRC) && map_lookup_addr(id, buff, false, &value))
+		return true;
+
+	return false;
+}
+
+
+static bool
+map_tuple(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	return map_lookup_tuple(id, buff, &value);
+}
+
+
+static ActionQbuff
+map_src_filter(arguments_t args, struct qbuff * buff)
+{
+	if (map_src(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+map_dst_filter(arguments_t args, struct qbuff * buff)
+{
+	if (map_dst(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+map_addr_filter(arguments_t args, struct qbuff * buff)
+{
+	if (map_addr(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+map_tuple_filter(arguments_t args, struct qbuff * buff)
+{
+	if (map_tuple(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static uint64_t
+map_src_value(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	if (!map_lookup_addr(id, buff, false, &value))
+		return NOTHING;
+
+	return (uint64_t)JUST(value);
+}
+
+
+static uint64_t
+map_dst_value(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	if (!map_lookup_addr(id, buff, true, &value))
+		return NOTHING;
+
+	return (uint64_t)JUST(value);
+}
+
+
+static uint64_t
+map_tuple_value(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	uint64_t value;
+
+	if (!map_lookup_tuple(id, buff, &value))
+		return NOTHING;
+
+	return (uint64_t)JUST(value);
+}
+
+
+static uint64_t
+map_value(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	property_t p = GET_ARG_1(property_t, args);
+	uint64_t key, value;
+
+	key = EVAL_PROPERTY(p, buff);
+	if (IS_NOTHING(key))
+		return NOTHING;
+
+	if (!pfq_map_lookup_value(id, FROM_JUST(uint64_t, key), &value))
+		return NOTHING;
+
+	return (uint64_t)JUST(value);
+}
+
+
+static int map_init(arguments_t args)
+{
+	const int id = GET_ARG_0(int, args);
+	struct pfq_map_info info;
+
+	if (pfq_map_info(id, &info) < 0) {
+		printk(KERN_INFO "[PFQ|init] map: id=%d not found!\n", id);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+static int map_addr_init(arguments_t args)
+{
+	const int id = GET_ARG_0(int, args);
+	struct pfq_map_info info;
+
+	if (pfq_map_info(id, &info) < 0) {
+		printk(KERN_INFO "[PFQ|init] map: id=%d not found!\n", id);
+		return -EINVAL;
+	}
+
+	if (info.type == Q_MAP_ARRAY ||
+	    (info.key_size != sizeof(__be32) && info.key_size != sizeof(struct in6_addr))) {
+		printk(KERN_INFO "[PFQ|init] map: id=%d is not a map of IP addresses!\n", id);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+static int map_tuple_init(arguments_t args)
+{
+	const int id = GET_ARG_0(int, args);
+	struct pfq_map_info info;
+
+	if (pfq_map_info(id, &info) < 0) {
+		printk(KERN_INFO "[PFQ|init] map: id=%d not found!\n", id);
+		return -EINVAL;
+	}
+
+	if (info.type == Q_MAP_ARRAY ||
+	    (info.key_size != Q_MAP_TUPLE4_LEN && info.key_size != Q_MAP_TUPLE6_LEN)) {
+		printk(KERN_INFO "[PFQ|init] map: id=%d is not a map of 5-tuples!\n", id);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+struct pfq_lang_function_descr map_functions[] = {
+
+	{ "map_src",		"CInt -> Qbuff -> Bool",			map_src,	 map_addr_init, NULL },
+	{ "map_dst",		"CInt -> Qbuff -> Bool",			map_dst,	 map_addr_init, NULL },
+	{ "map_addr",		"CInt -> Qbuff -> Bool",			map_addr,	 map_addr_init, NULL },
+	{ "map_src_filter",	"CInt -> Qbuff -> Action Qbuff",		map_src_filter,	 map_addr_init, NULL },
+	{ "map_dst_filter",	"CInt -> Qbuff -> Action Qbuff",		map_dst_filter,	 map_addr_init, NULL },
+	{ "map_addr_filter",	"CInt -> Qbuff -> Action Qbuff",		map_addr_filter, map_addr_init, NULL },
+	{ "map_src_value",	"CInt -> Qbuff -> Word64",			map_src_value,	 map_addr_init, NULL },
+	{ "map_dst_value",	"CInt -> Qbuff -> Word64",			map_dst_value,	 map_addr_init, NULL },
+	{ "map_tuple",		"CInt -> Qbuff -> Bool",			map_tuple,	 map_tuple_init, NULL },
+	{ "map_tuple_filter",	"CInt -> Qbuff -> Action Qbuff",		map_tuple_filter, map_tuple_init, NULL },
+	{ "map_tuple_value",	"CInt -> Qbuff -> Word64",			map_tuple_value, map_tuple_init, NULL },
+	{ "map_value",		"CInt -> (Qbuff -> Word64) -> Qbuff -> Word64",	map_value,	 map_init,	NULL },
+
+	{ NULL }};
@@ -106,11 +106,32 @@ struct pfq_lang_functional_arg
 };
 
 
+struct pfq_lang_user_arg
+{
+	const void    *addr;	/* kernel copy of the argument, or the node of a function */
+	size_t	       size;	/* bytes of the copy */
+	size_t	       nelem;	/* strings, for vectors of strings */
+	ptrdiff_t      value;	/* small pod */
+};
+
+
+struct pfq_lang_profile
+{
+	local_t run;
+	local_t pass;
+	local_t drop;
+	local_t cycles;
+};
+
+
 struct pfq_lang_functional
 {
 	void * run;					/* pointer to function */
 	struct pfq_lang_functional_arg arg[8];		/* arguments */
 	struct pfq_lang_functional *next;		/* kleisli composition */
+	int op;						/* native opcode (native_call = interpreted) */
+	struct pfq_lang_functional *link;		/* kleisli composition, after link-time optimization */
+	struct pfq_lang_profile __percpu *profile;	/* per-node counters (lang_profile) */
 };
 
 
@@ -125,6 +146,7 @@ typedef uint64_t      (*property_ptr_t) (arguments_t, struct qbuff *);
 typedef bool	      (*predicate_ptr_t)(arguments_t, struct qbuff *);
 typedef int	      (*init_ptr_t)	(arguments_t);
 typedef int	      (*fini_ptr_t)	(arguments_t);
+typedef int	      (*migrate_ptr_t)	(arguments_t, arguments_t);
 
 typedef struct
 {
@@ -154,6 +176,11 @@ struct pfq_lang_functional_node
 
 	init_ptr_t	      init;
 	fini_ptr_t	      fini;
+	migrate_ptr_t	      migrate;
+
+	uint32_t	      digest;	/* of the arguments, as passed by the user */
+	struct pfq_lang_user_arg user_arg[8];
+	struct pfq_lang_functional_node *origin;	/* state migrated from */
 
 	bool		      initialized;
 };
@@ -163,6 +190,7 @@ struct pfq_lang_computation_tree
 {
 	size_t size;
 	struct pfq_lang_functional_node *entry_point;
+	struct pfq_lang_profile __percpu *profile;
 	struct pfq_lang_functional_node node[];
 };
 
@@ -176,6 +204,7 @@ struct pfq_lang_function_descr
 	void *		ptr;
 	init_ptr_t	init;
 	fini_ptr_t	fini;
+	migrate_ptr_t	migrate;	/* share the state of a running instance, in place of init */
 };
 
 /* class predicates */
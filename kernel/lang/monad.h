@@ -190,5 +190,11 @@ struct pfq_group_counters * get_group_counters(struct qbuff * buff)
 	return this_cpu_ptr(buff->monad->group->counters);
 }
 
+static inline
+struct pfq_group_shed_stats * get_group_shed_stats(struct qbuff * buff)
+{
+	return this_cpu_ptr(buff->monad->group->shed);
+}
+
 
 #endif /* PFQ_LANG_MONAD_H */
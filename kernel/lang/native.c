@@ -0,0 +1,116 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <lang/native.h>
+#include <lang/symtable.h>
+
+#include <pfq/global.h>
+
+#include <linux/kernel.h>
+
+
+/*
+ * native opcodes of the built-in functions: the run pointers are resolved
+ * once, when the built-ins are the only functions of the symtable, so that
+ * a function registered by a module is never taken for one of them...
+ */
+
+static struct
+{
+	const char *symbol;
+	int	    op;
+	void	   *run;
+
+} native_table[] =
+{
+	{ "unit",		native_unit		},
+	{ "ip",			native_ip		},
+	{ "udp",		native_udp		},
+	{ "tcp",		native_tcp		},
+	{ "icmp",		native_icmp		},
+	{ "flow",		native_flow		},
+	{ "vlan",		native_vlan		},
+	{ "drop",		native_drop		},
+	{ "broadcast",		native_broadcast	},
+	{ "kernel",		native_kernel		},
+	{ "detour",		native_detour		},
+	{ "classify",		native_classify		},
+	{ "mark",		native_mark		},
+	{ "put_state",		native_put_state	},
+	{ "conditional",	native_conditional	},
+	{ "when",		native_when		},
+	{ "unless",		native_unless		},
+	{ "filter",		native_filter		},
+	{ "port",		native_port		},
+	{ "steer_flow",		native_steer_flow	},
+
+	{ "is_ip",		native_is_ip		},
+	{ "is_udp",		native_is_udp		},
+	{ "is_tcp",		native_is_tcp		},
+	{ "is_icmp",		native_is_icmp		},
+	{ "is_flow",		native_is_flow		},
+	{ "has_vlan",		native_has_vlan		},
+	{ "has_vid",		native_has_vid		},
+	{ "has_port",		native_has_port		},
+	{ "has_src_port",	native_has_src_port	},
+	{ "has_dst_port",	native_has_dst_port	},
+	{ "less",		native_less		},
+	{ "any_bit",		native_any_bit		},
+	{ "not",		native_not		},
+	{ "and",		native_and		},
+	{ "or",			native_or		},
+	{ "xor",		native_xor		},
+};
+
+
+void
+pfq_lang_native_init(void)
+{
+	struct symtable_entry *entry;
+	size_t n;
+
+	for(n = 0; n < ARRAY_SIZE(native_table); n++)
+	{
+		entry = pfq_lang_symtable_search(&global->functions, native_table[n].symbol);
+		native_table[n].run = entry ? entry->function : NULL;
+
+		if (entry == NULL)
+			printk(KERN_INFO "[PFQ] native: '%s' no such function!\n", native_table[n].symbol);
+	}
+}
+
+
+int
+pfq_lang_native_op(const void *run)
+{
+	size_t n;
+
+	for(n = 0; n < ARRAY_SIZE(native_table); n++)
+	{
+		if (native_table[n].run == run)
+			return native_table[n].op;
+	}
+
+	return native_call;
+}
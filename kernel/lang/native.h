@@ -0,0 +1,280 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PFQ_LANG_NATIVE_H
+#define PFQ_LANG_NATIVE_H
+
+#include <lang/module.h>
+#include <lang/predicate.h>
+#include <lang/filter.h>
+#include <lang/forward.h>
+#include <lang/misc.h>
+
+#include <linux/timex.h>
+
+
+/* native opcodes: monadic functions and predicates called directly (and
+ * inlined) by the engine. Any other function is interpreted through its
+ * pointer. Fused opcodes are only produced by the link-time optimizer. */
+
+enum native_op
+{
+	native_call = 0,
+	native_unit,
+	native_ip,
+	native_udp,
+	native_tcp,
+	native_icmp,
+	native_flow,
+	native_vlan,
+	native_drop,
+	native_broadcast,
+	native_kernel,
+	native_detour,
+	native_classify,
+	native_mark,
+	native_put_state,
+	native_conditional,
+	native_when,
+	native_unless,
+	native_filter,
+	native_port,
+	native_steer_flow,
+
+	/* fused functions */
+
+	native_then,
+	native_else,
+	native_ip_udp,
+	native_ip_tcp,
+	native_udp_steer_flow,
+	native_tcp_steer_flow,
+	native_ip_udp_steer_flow,
+	native_ip_tcp_steer_flow,
+
+	/* predicates */
+
+	native_is_ip,
+	native_is_udp,
+	native_is_tcp,
+	native_is_icmp,
+	native_is_flow,
+	native_has_vlan,
+	native_has_vid,
+	native_has_port,
+	native_has_src_port,
+	native_has_dst_port,
+	native_less,
+	native_any_bit,
+	native_not,
+	native_and,
+	native_or,
+	native_xor,
+
+	/* constant predicates */
+
+	native_false,
+	native_true
+};
+
+
+extern void pfq_lang_native_init(void);
+extern int  pfq_lang_native_op(const void *run);
+
+
+static inline bool
+native_eval_predicate(struct pfq_lang_functional *pred, struct qbuff *b);
+
+
+static inline bool
+__native_eval_predicate(struct pfq_lang_functional *pred, struct qbuff *b)
+{
+	switch(pred->op)
+	{
+	case native_is_ip:		return is_ip(b);
+	case native_is_udp:		return is_udp(b);
+	case native_is_tcp:		return is_tcp(b);
+	case native_is_icmp:		return is_icmp(b);
+	case native_is_flow:		return is_flow(b);
+	case native_has_vlan:		return has_vlan(b);
+	case native_has_vid:		return has_vid(b, GET_ARG(int, pred));
+	case native_has_port:		return has_port(b, GET_ARG(uint16_t, pred));
+	case native_has_src_port:	return has_src_port(b, GET_ARG(uint16_t, pred));
+	case native_has_dst_port:	return has_dst_port(b, GET_ARG(uint16_t, pred));
+	case native_less:		return less(pred, b);
+	case native_any_bit:		return any_bit(pred, b);
+	case native_not:		return !native_eval_predicate(GET_ARG(predicate_t, pred).fun, b);
+	case native_and:		return  native_eval_predicate(GET_ARG_0(predicate_t, pred).fun, b) &&
+						native_eval_predicate(GET_ARG_1(predicate_t, pred).fun, b);
+	case native_or:			return  native_eval_predicate(GET_ARG_0(predicate_t, pred).fun, b) ||
+						native_eval_predicate(GET_ARG_1(predicate_t, pred).fun, b);
+	case native_xor:		return  native_eval_predicate(GET_ARG_0(predicate_t, pred).fun, b) !=
+						native_eval_predicate(GET_ARG_1(predicate_t, pred).fun, b);
+	case native_false:		return false;
+	case native_true:		return true;
+	default:			break;
+	}
+
+	/* fallback: interpreted predicate */
+
+	return ((predicate_ptr_t)pred->run)(pred, b);
+}
+
+
+static inline bool
+native_eval_predicate(struct pfq_lang_functional *pred, struct qbuff *b)
+{
+	if (unlikely(pred->profile)) {
+
+		struct pfq_lang_profile *p = this_cpu_ptr(pred->profile);
+		cycles_t start = get_cycles();
+		bool ret = __native_eval_predicate(pred, b);
+
+		local_add((long)(get_cycles() - start), &p->cycles);
+		local_inc(&p->run);
+		local_inc(ret ? &p->pass : &p->drop);
+		return ret;
+	}
+
+	return __native_eval_predicate(pred, b);
+}
+
+
+static inline ActionQbuff
+native_eval_function(function_t f, struct qbuff * buff);
+
+
+static inline ActionQbuff
+native_steer_flow(struct pfq_lang_functional *fun, struct qbuff *b)
+{
+	uint32_t hash;
+
+	/* outer headers only: the inner ones are hashed by steer_flow itself */
+
+	if (b->monad->shift == 0)
+		return qbuff_flow_hash(b, &hash) ? Steering(b, hash) : Drop(b);
+
+	return ((function_ptr_t)fun->run)(fun, b);
+}
+
+
+static inline ActionQbuff
+native_eval(struct pfq_lang_functional *fun, struct qbuff *b)
+{
+	switch(fun->op)
+	{
+	case native_unit:		return unit(fun, b);
+	case native_ip:			return filter_ip(fun, b);
+	case native_udp:		return filter_udp(fun, b);
+	case native_tcp:		return filter_tcp(fun, b);
+	case native_icmp:		return filter_icmp(fun, b);
+	case native_flow:		return filter_flow(fun, b);
+	case native_vlan:		return filter_vlan(fun, b);
+	case native_drop:		return forward_drop(fun, b);
+	case native_broadcast:		return forward_broadcast(fun, b);
+	case native_kernel:		return forward_kernel(fun, b);
+	case native_detour:		return detour_kernel(fun, b);
+	case native_classify:		return forward_class(fun, b);
+	case native_mark:		return mark(fun, b);
+	case native_put_state:		return put_state(fun, b);
+
+	case native_conditional:	return native_eval_predicate(GET_ARG_0(predicate_t, fun).fun, b) ?
+						native_eval_function(GET_ARG_1(function_t, fun), b) :
+						native_eval_function(GET_ARG_2(function_t, fun), b);
+
+	case native_when:		return native_eval_predicate(GET_ARG_0(predicate_t, fun).fun, b) ?
+						native_eval_function(GET_ARG_1(function_t, fun), b) : Pass(b);
+
+	case native_unless:		return native_eval_predicate(GET_ARG_0(predicate_t, fun).fun, b) ?
+						Pass(b) : native_eval_function(GET_ARG_1(function_t, fun), b);
+
+	case native_filter:		return native_eval_predicate(GET_ARG(predicate_t, fun).fun, b) ? Pass(b) : Drop(b);
+	case native_port:		return has_port(b, GET_ARG(uint16_t, fun)) ? Pass(b) : Drop(b);
+	case native_steer_flow:		return native_steer_flow(fun, b);
+
+	/* the predicate of these is known at link time */
+
+	case native_then:		return native_eval_function(GET_ARG_1(function_t, fun), b);
+	case native_else:		return native_eval_function(GET_ARG_2(function_t, fun), b);
+
+	/* superinstructions: the fused nodes follow in the kleisli composition */
+
+	case native_ip_udp:		return is_ip(b) && is_udp(b) ? Pass(b) : Drop(b);
+	case native_ip_tcp:		return is_ip(b) && is_tcp(b) ? Pass(b) : Drop(b);
+	case native_udp_steer_flow:	return is_udp(b) ? native_steer_flow(fun->next, b) : Drop(b);
+	case native_tcp_steer_flow:	return is_tcp(b) ? native_steer_flow(fun->next, b) : Drop(b);
+	case native_ip_udp_steer_flow:	return is_ip(b) && is_udp(b) ? native_steer_flow(fun->next->next, b) : Drop(b);
+	case native_ip_tcp_steer_flow:	return is_ip(b) && is_tcp(b) ? native_steer_flow(fun->next->next, b) : Drop(b);
+
+	default:			break;
+	}
+
+	/* fallback: interpreted function */
+
+	return ((function_ptr_t)fun->run)(fun, b);
+}
+
+
+static inline ActionQbuff
+native_eval_profile(struct pfq_lang_functional *fun, struct qbuff *b)
+{
+	struct pfq_lang_profile *p = this_cpu_ptr(fun->profile);
+	cycles_t start = get_cycles();
+	ActionQbuff ret = native_eval(fun, b);
+
+	local_add((long)(get_cycles() - start), &p->cycles);
+	local_inc(&p->run);
+
+	if (ret.qbuff == NULL || is_drop(ret.qbuff->monad->fanout))
+		local_inc(&p->drop);
+	else
+		local_inc(&p->pass);
+
+	return ret;
+}
+
+
+static inline ActionQbuff
+native_eval_function(function_t f, struct qbuff * buff)
+{
+	struct pfq_lang_functional *fun = f.fun;
+	while (fun) {
+
+                fanout_t *a;
+		buff = unlikely(fun->profile) ? native_eval_profile(fun, buff).qbuff
+					      : native_eval(fun, buff).qbuff;
+		if (buff == NULL)
+			return Pass(buff);
+
+                a = &buff->monad->fanout;
+                if (is_drop(*a))
+                        return Pass(buff);
+                fun = fun->link;
+	}
+
+	return Pass(buff);
+}
+
+
+#endif /* PFQ_LANG_NATIVE_H */
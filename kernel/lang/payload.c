@@ -0,0 +1,431 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+
+/*
+ * Multi-pattern matching over the payload of packets (Aho-Corasick).
+ *
+ * At init the patterns are compiled into a DFA whose alphabet is reduced
+ * to the classes of bytes that appear in them (all the others share the
+ * class 0), so that each state takes a row of a few bytes. The scan is a
+ * single table lookup per byte, with no backtracking.
+ *
+ * Patterns are strings where \xHH stands for any byte (and \\ for '\').
+ */
+
+#define PAYLOAD_MAX_STATES	65535
+#define PAYLOAD_CHUNK		64
+#define PAYLOAD_MISS		-1
+
+#define PAYLOAD_DFA(args)	GET_ARG_7(struct payload_dfa *, args)
+
+
+struct payload_dfa
+{
+	uint8_t		class[256];
+	unsigned int	nclass;
+	unsigned int	nstate;
+	int		*match;		/* per state: smallest pattern ending here, or PAYLOAD_MISS */
+	uint16_t	*next;		/* nstate * nclass */
+};
+
+
+/*
+ * offset of the payload in the packet (after the TCP/UDP/ICMP header, if any),
+ * -1 if not IP...
+ */
+
+static int
+payload_offset(struct qbuff * buff)
+{
+	int l4off, proto;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return -1;
+
+		l4off = ip->ihl<<2;
+		proto = ip->frag_off & __constant_htons(IP_OFFSET) ? IPPROTO_NONE : ip->protocol;
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return -1;
+
+		l4off = sizeof(struct ipv6hdr);
+		proto = ip6->nexthdr;
+	} break;
+	default:
+		return -1;
+	}
+
+	switch(proto)
+	{
+	case IPPROTO_TCP: {
+		struct tcphdr _tcph;
+		const struct tcphdr *tcp;
+
+		tcp = qbuff_generic_ip_header_pointer(buff, buff->monad->ipproto, l4off, sizeof(_tcph), &_tcph);
+		if (tcp == NULL)
+			return -1;
+
+		l4off += tcp->doff<<2;
+	} break;
+	case IPPROTO_UDP:
+		l4off += sizeof(struct udphdr);
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		l4off += sizeof(struct icmphdr);
+		break;
+	}
+
+	return buff->monad->ipoff + l4off;
+}
+
+
+/*
+ * scan the first depth bytes of payload (all of it, if depth <= 0): the
+ * pattern of the first match, PAYLOAD_MISS if none. Non-linear buffers
+ * are scanned in chunks...
+ */
+
+static int
+payload_scan(struct payload_dfa const *dfa, struct qbuff * buff, int depth)
+{
+	uint8_t chunk[PAYLOAD_CHUNK];
+	unsigned int state = 0;
+	int off, len;
+
+	off = payload_offset(buff);
+	if (off < 0)
+		return PAYLOAD_MISS;
+
+	len = (int)qbuff_len(buff) - off;
+	if (depth > 0 && len > depth)
+		len = depth;
+
+	while (len > 0)
+	{
+		int n = min(len, PAYLOAD_CHUNK), i;
+		const uint8_t *p = qbuff_header_pointer(buff, off, n, chunk);
+
+		if (p == NULL)
+			break;
+
+		for(i = 0; i < n; i++)
+		{
+			state = dfa->next[state * dfa->nclass + dfa->class[p[i]]];
+			if (dfa->match[state] != PAYLOAD_MISS)
+				return dfa->match[state];
+		}
+
+		off += n;
+		len -= n;
+	}
+
+	return PAYLOAD_MISS;
+}
+
+
+static bool
+payload_match(arguments_t args, struct qbuff * buff)
+{
+	const int depth = GET_ARG_1(int, args);
+
+	return payload_scan(PAYLOAD_DFA(args), buff, depth) != PAYLOAD_MISS;
+}
+
+
+static ActionQbuff
+payload_filter(arguments_t args, struct qbuff * buff)
+{
+	if (payload_match(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static uint64_t
+payload_pattern(arguments_t args, struct qbuff * buff)
+{
+	const int depth = GET_ARG_1(int, args);
+	int id;
+
+	id = payload_scan(PAYLOAD_DFA(args), buff, depth);
+	if (id == PAYLOAD_MISS)
+		return NOTHING;
+
+	return (uint64_t)JUST(id);
+}
+
+
+/* mark (or state) of matching packets: pattern index + 1 */
+
+static ActionQbuff
+payload_mark(arguments_t args, struct qbuff * buff)
+{
+	const int depth = GET_ARG_1(int, args);
+	int id;
+
+	id = payload_scan(PAYLOAD_DFA(args), buff, depth);
+	if (id != PAYLOAD_MISS)
+		set_mark(buff, (uint32_t)id + 1);
+
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+payload_put_state(arguments_t args, struct qbuff * buff)
+{
+	const int depth = GET_ARG_1(int, args);
+	int id;
+
+	id = payload_scan(PAYLOAD_DFA(args), buff, depth);
+	if (id != PAYLOAD_MISS)
+		set_state(buff, (uint32_t)id + 1);
+
+	return Pass(buff);
+}
+
+
+/*
+ * init: unescape the patterns and compile the automaton...
+ */
+
+static int
+payload_unescape(const char *str, uint8_t *out)
+{
+	int len = 0;
+
+	while (*str)
+	{
+		if (str[0] == '\\' && str[1] == '\\') {
+			out[len++] = '\\';
+			str += 2;
+		}
+		else if (str[0] == '\\' && str[1] == 'x') {
+			int hi = hex_to_bin(str[2]), lo = hi < 0 ? -1 : hex_to_bin(str[3]);
+			if (lo < 0)
+				return -EINVAL;
+			out[len++] = (uint8_t)(hi << 4 | lo);
+			str += 4;
+		}
+		else
+			out[len++] = (uint8_t)*str++;
+	}
+
+	return len;
+}
+
+
+static void
+payload_free(struct payload_dfa *dfa)
+{
+	if (dfa == NULL)
+		return;
+
+	vfree(dfa->match);
+	vfree(dfa->next);
+	kfree(dfa);
+}
+
+
+static int
+payload_compile(struct payload_dfa *dfa, const char **str, size_t n)
+{
+	unsigned int max_state = 1, s, c, head = 0, tail = 0;
+	unsigned int *fail = NULL, *queue = NULL;
+	uint8_t *pat = NULL;
+	size_t i;
+	int err = 0, len, j;
+
+	for(i = 0; i < n; i++)
+		max_state += strlen(str[i]);
+
+	if (max_state > PAYLOAD_MAX_STATES) {
+		printk(KERN_INFO "[PFQ|init] payload: patterns too long (%u states)!\n", max_state);
+		return -EINVAL;
+	}
+
+	pat = kmalloc(max_state, GFP_KERNEL);
+	if (pat == NULL)
+		return -ENOMEM;
+
+	/* byte classes */
+
+	memset(dfa->class, 0, sizeof(dfa->class));
+	dfa->nclass = 1;
+
+	for(i = 0; i < n; i++)
+	{
+		len = payload_unescape(str[i], pat);
+		if (len <= 0) {
+			printk(KERN_INFO "[PFQ|init] payload: bad pattern '%s'!\n", str[i]);
+			err = -EINVAL;
+			goto out;
+		}
+
+		for(j = 0; j < len; j++)
+			if (dfa->class[pat[j]] == 0)
+				dfa->class[pat[j]] = (uint8_t)dfa->nclass++;
+	}
+
+	dfa->next  = vzalloc(sizeof(uint16_t) * max_state * dfa->nclass);
+	dfa->match = vmalloc(sizeof(int) * max_state);
+	fail	   = vzalloc(sizeof(unsigned int) * max_state);
+	queue	   = vmalloc(sizeof(unsigned int) * max_state);
+
+	if (!dfa->next || !dfa->match || !fail || !queue) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for(s = 0; s < max_state; s++)
+		dfa->match[s] = PAYLOAD_MISS;
+
+	/* trie of the patterns */
+
+	dfa->nstate = 1;
+
+	for(i = 0; i < n; i++)
+	{
+		len = payload_unescape(str[i], pat);
+		s = 0;
+
+		for(j = 0; j < len; j++)
+		{
+			uint16_t *t = &dfa->next[s * dfa->nclass + dfa->class[pat[j]]];
+			if (*t == 0)
+				*t = (uint16_t)dfa->nstate++;
+			s = *t;
+		}
+
+		if (dfa->match[s] == PAYLOAD_MISS)
+			dfa->match[s] = (int)i;
+	}
+
+	/* failure links, in breadth-first order, folded into the transitions */
+
+	queue[tail++] = 0;
+
+	while (head < tail)
+	{
+		s = queue[head++];
+
+		for(c = 0; c < dfa->nclass; c++)
+		{
+			uint16_t *t = &dfa->next[s * dfa->nclass + c];
+
+			if (*t != 0) {
+				unsigned int f = s == 0 ? 0 : dfa->next[fail[s] * dfa->nclass + c];
+
+				fail[*t] = f;
+				if (dfa->match[*t] == PAYLOAD_MISS ||
+				    (dfa->match[f] != PAYLOAD_MISS && dfa->match[f] < dfa->match[*t]))
+					dfa->match[*t] = dfa->match[f];
+
+				queue[tail++] = *t;
+			}
+			else
+				*t = s == 0 ? 0 : dfa->next[fail[s] * dfa->nclass + c];
+		}
+	}
+out:
+	kfree(pat);
+	vfree(fail);
+	vfree(queue);
+	return err;
+}
+
+
+static int payload_init(arguments_t args)
+{
+	const char **str = GET_ARRAY_0(const char *, args);
+	size_t n = LEN_ARRAY_0(args);
+	struct payload_dfa *dfa;
+	int err;
+
+	if (n == 0) {
+		printk(KERN_INFO "[PFQ|init] payload: empty pattern list!\n");
+		return -EINVAL;
+	}
+
+	dfa = kzalloc(sizeof(struct payload_dfa), GFP_KERNEL);
+	if (dfa == NULL) {
+		printk(KERN_INFO "[PFQ|init] payload: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	err = payload_compile(dfa, str, n);
+	if (err) {
+		if (err == -ENOMEM)
+			printk(KERN_INFO "[PFQ|init] payload: out of memory!\n");
+		payload_free(dfa);
+		return err;
+	}
+
+	SET_ARG_7(args, dfa);
+
+	pr_devel("[PFQ|init] payload@%p: %zu patterns, %u states, %u byte classes.\n",
+		 dfa, n, dfa->nstate, dfa->nclass);
+	return 0;
+}
+
+
+static int payload_fini(arguments_t args)
+{
+	payload_free(PAYLOAD_DFA(args));
+	SET_ARG_7(args, (struct payload_dfa *)NULL);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr payload_functions[] = {
+
+	{ "payload_match",	"[String] -> CInt -> Qbuff -> Bool",		payload_match,		payload_init,	payload_fini },
+	{ "payload_filter",	"[String] -> CInt -> Qbuff -> Action Qbuff",	payload_filter,		payload_init,	payload_fini },
+	{ "payload_pattern",	"[String] -> CInt -> Qbuff -> Word64",		payload_pattern,	payload_init,	payload_fini },
+	{ "payload_mark",	"[String] -> CInt -> Qbuff -> Action Qbuff",	payload_mark,		payload_init,	payload_fini },
+	{ "payload_put_state",	"[String] -> CInt -> Qbuff -> Action Qbuff",	payload_put_state,	payload_init,	payload_fini },
+
+	{ NULL }};
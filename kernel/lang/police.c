@@ -0,0 +1,262 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/jhash.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <linux/sched/clock.h>
+#else
+#include <linux/sched.h>
+#endif
+
+
+/*
+ * policers: per-cpu token buckets, in the form of GCRA (a single
+ * theoretical arrival time per bucket, in ns of the cpu clock). The rate
+ * (packets per second) and the burst are enforced on each cpu; flow
+ * policers hash the symmetric flow of the current IP header (shift and
+ * tunnels honoured, ports of fragments ignored) into
+ * Q_POLICE_FLOW_BUCKETS buckets per cpu. Exceeding packets are dropped, or
+ * reclassified by the *_class variants, and counted in the group stats...
+ */
+
+struct police
+{
+	uint64_t	interval;	/* ns between two conforming packets */
+	uint64_t	tolerance;	/* (burst - 1) * interval */
+	uint32_t	seed;
+	uint64_t __percpu *tat;		/* 1 or Q_POLICE_FLOW_BUCKETS per cpu */
+};
+
+
+#define POLICE(args)	GET_ARG_7(struct police *, args)
+
+
+static inline bool
+police_account(struct qbuff * buff, bool conform)
+{
+	struct pfq_group_shed_stats *stats = get_group_shed_stats(buff);
+
+	if (conform)
+		local_inc(&stats->police_in);
+	else
+		local_inc(&stats->police_out);
+	return conform;
+}
+
+
+static inline bool
+police_bucket(struct police const *p, uint64_t *tat)
+{
+	uint64_t now = local_clock();
+	uint64_t t = max(*tat, now);
+
+	if (t - now > p->tolerance)
+		return false;
+
+	*tat = t + p->interval;
+	return true;
+}
+
+
+static bool
+conform(arguments_t args, struct qbuff * buff)
+{
+	struct police *p = POLICE(args);
+
+	return police_account(buff, police_bucket(p, this_cpu_ptr(p->tat)));
+}
+
+
+static bool
+flow_conform(arguments_t args, struct qbuff * buff)
+{
+	struct police *p = POLICE(args);
+	uint64_t *tat = this_cpu_ptr(p->tat);
+	uint32_t hash;
+
+	/* packets without a flow are not policed */
+
+	if (!qbuff_symmetric_hash(buff, &hash))
+		return police_account(buff, true);
+
+	tat += jhash_1word(hash, p->seed) & (Q_POLICE_FLOW_BUCKETS-1);
+
+	return police_account(buff, police_bucket(p, tat));
+}
+
+
+static ActionQbuff
+police(arguments_t args, struct qbuff * buff)
+{
+	if (conform(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+police_flow(arguments_t args, struct qbuff * buff)
+{
+	if (flow_conform(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+police_class(arguments_t args, struct qbuff * buff)
+{
+	const int c = GET_ARG_2(int, args);
+
+	if (conform(args, buff))
+		return Pass(buff);
+	return Pass(class(buff, (1ULL << c)));
+}
+
+
+static ActionQbuff
+police_flow_class(arguments_t args, struct qbuff * buff)
+{
+	const int c = GET_ARG_2(int, args);
+
+	if (flow_conform(args, buff))
+		return Pass(buff);
+	return Pass(class(buff, (1ULL << c)));
+}
+
+
+static int
+police_alloc(arguments_t args, const char *name, size_t buckets)
+{
+	const uint64_t rate  = GET_ARG_0(uint64_t, args);
+	const uint64_t burst = GET_ARG_1(uint64_t, args);
+	struct police *p;
+
+	if (rate == 0 || rate > NSEC_PER_SEC) {
+		printk(KERN_INFO "[PFQ|init] %s: bad rate %llu pps!\n", name, rate);
+		return -EINVAL;
+	}
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (p == NULL) {
+		printk(KERN_INFO "[PFQ|init] %s: out of memory!\n", name);
+		return -ENOMEM;
+	}
+
+	p->interval = div64_u64(NSEC_PER_SEC, rate);
+
+	if (burst == 0 || burst > div64_u64(1ULL << 62, p->interval)) {
+		printk(KERN_INFO "[PFQ|init] %s: bad burst %llu!\n", name, burst);
+		kfree(p);
+		return -EINVAL;
+	}
+
+	p->tolerance = (burst - 1) * p->interval;
+	p->seed = get_random_int();
+	p->tat = __alloc_percpu(sizeof(uint64_t) * buckets, sizeof(uint64_t));
+	if (p->tat == NULL) {
+		printk(KERN_INFO "[PFQ|init] %s: out of memory!\n", name);
+		kfree(p);
+		return -ENOMEM;
+	}
+
+	SET_ARG_7(args, p);
+
+	pr_devel("[PFQ|init] %s: rate=%llu pps burst=%llu interval=%llu ns\n", name, rate, burst, p->interval);
+	return 0;
+}
+
+
+static int
+police_class_check(arguments_t args, const char *name)
+{
+	const int c = GET_ARG_2(int, args);
+
+	if (c <= 0 || c >= (int)Q_CLASS_MAX-1) {
+		printk(KERN_INFO "[PFQ|init] %s: bad class %d!\n", name, c);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static int police_init(arguments_t args)
+{
+	return police_alloc(args, "police", 1);
+}
+
+
+static int police_flow_init(arguments_t args)
+{
+	return police_alloc(args, "police_flow", Q_POLICE_FLOW_BUCKETS);
+}
+
+
+static int police_class_init(arguments_t args)
+{
+	int ret = police_class_check(args, "police_class");
+	return ret < 0 ? ret : police_alloc(args, "police_class", 1);
+}
+
+
+static int police_flow_class_init(arguments_t args)
+{
+	int ret = police_class_check(args, "police_flow_class");
+	return ret < 0 ? ret : police_alloc(args, "police_flow_class", Q_POLICE_FLOW_BUCKETS);
+}
+
+
+static int police_fini(arguments_t args)
+{
+	struct police *p = POLICE(args);
+
+	if (p) {
+		free_percpu(p->tat);
+		kfree(p);
+	}
+
+	SET_ARG_7(args, (struct police *)NULL);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr police_functions[] = {
+
+	{ "conform",		"Word64 -> Word64 -> Qbuff -> Bool",			conform,		police_init,		police_fini },
+	{ "flow_conform",	"Word64 -> Word64 -> Qbuff -> Bool",			flow_conform,		police_flow_init,	police_fini },
+	{ "police",		"Word64 -> Word64 -> Qbuff -> Action Qbuff",		police,			police_init,		police_fini },
+	{ "police_flow",	"Word64 -> Word64 -> Qbuff -> Action Qbuff",		police_flow,		police_flow_init,	police_fini },
+	{ "police_class",	"Word64 -> Word64 -> CInt -> Qbuff -> Action Qbuff",	police_class,		police_class_init,	police_fini },
+	{ "police_flow_class",	"Word64 -> Word64 -> CInt -> Qbuff -> Action Qbuff",	police_flow_class,	police_flow_class_init,	police_fini },
+
+	{ NULL }};
@@ -282,7 +282,7 @@ is_flow(struct qbuff * buff)
 static inline bool
 is_l3_proto(struct qbuff * buff, uint16_t type)
 {
-	return qbuff_eth_hdr(buff)->h_proto == __constant_htons(type);
+	return qbuff_eth_proto(buff) == __constant_htons(type);
 }
 
 
@@ -58,13 +58,13 @@ qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
 	{
 	case IPPROTO_NONE: {
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IP))
+		if (qbuff_eth_proto(buff) == __constant_htons(ETH_P_IP))
 		{
 			*proto = IPPROTO_IP;
 			return (int)qbuff_maclen(buff);
 		}
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IPV6))
+		if (qbuff_eth_proto(buff) == __constant_htons(ETH_P_IPV6))
 		{
 			*proto = IPPROTO_IPV6;
 			return (int)qbuff_maclen(buff);
@@ -91,6 +91,104 @@ qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
 }
 
 
+/*
+ * parse the outer headers of the packet, once for all the groups...
+ */
+
+static inline struct qbuff_parse const *
+qbuff_parse_headers(struct qbuff *buff)
+{
+	struct qbuff_parse *p = &buff->parse;
+	int proto = IPPROTO_NONE;
+
+	if (likely(p->flags & QBUFF_PARSED_L3))
+		return p;
+
+	p->ipoff = qbuff_next_ip_offset(buff, 0, &proto);
+	p->ipproto = p->ipoff < 0 ? IPPROTO_NONE : proto;
+	p->l4off = -1;
+	p->l4proto = IPPROTO_NONE;
+
+	switch(p->ipproto)
+	{
+	case IPPROTO_IP: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_header_pointer(buff, p->ipoff, sizeof(_iph), &_iph);
+		if (ip) {
+			p->l4off = p->ipoff + (ip->ihl<<2);
+			p->l4proto = ip->protocol;
+		}
+	} break;
+	case IPPROTO_IPV6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_header_pointer(buff, p->ipoff, sizeof(_ip6h), &_ip6h);
+		if (ip6) {
+			p->l4off = p->ipoff + (int)sizeof(struct ipv6hdr);
+			p->l4proto = ip6->nexthdr;
+		}
+	} break;
+	}
+
+	p->flags |= QBUFF_PARSED_L3;
+	return p;
+}
+
+
+/*
+ * flow hash of the outer IPv4 header (addresses, and ports for TCP/UDP),
+ * computed once for all the groups...
+ */
+
+static inline bool
+qbuff_flow_hash(struct qbuff *buff, uint32_t *hash)
+{
+	struct qbuff_parse *p = &buff->parse;
+
+	if (!(p->flags & QBUFF_PARSED_HASH))
+	{
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		qbuff_parse_headers(buff);
+
+		p->hash_ok = false;
+		p->flags |= QBUFF_PARSED_HASH;
+
+		if (p->ipproto != IPPROTO_IP)
+			return false;
+
+		ip = qbuff_header_pointer(buff, p->ipoff, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		if (p->l4proto == IPPROTO_UDP ||
+		    p->l4proto == IPPROTO_TCP) {
+
+			struct udphdr _udp;
+			const struct udphdr *udp;
+
+			udp = qbuff_header_pointer(buff, p->l4off, sizeof(_udp), &_udp);
+			if (udp == NULL)
+				return false;  /* broken */
+
+			p->hash = (__force uint32_t)(ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest);
+		}
+		else {
+			p->hash = (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr;
+		}
+
+		p->hash_ok = true;
+	}
+
+	*hash = p->hash;
+	return p->hash_ok;
+}
+
+
 static inline const void *
 qbuff_generic_ip_header_pointer(struct qbuff * buff, int ip_proto, int offset, int len, void *buffer)
 {
@@ -99,6 +197,21 @@ qbuff_generic_ip_header_pointer(struct qbuff * buff, int ip_proto, int offset, i
 	if (unlikely(ipoff < 0))
 		return NULL;
 
+	if (buff->monad->ipproto == IPPROTO_NONE && buff->monad->shift == 0)
+	{
+		/* outer header: use the parse cache of the packet */
+
+		struct qbuff_parse const *p = qbuff_parse_headers(buff);
+
+		if (p->ipoff < 0) {
+			buff->monad->ipoff = -1;
+			return NULL;
+		}
+
+		buff->monad->ipproto = p->ipproto;
+		buff->monad->ipoff = p->ipoff;
+	}
+
 	if (buff->monad->ipproto == IPPROTO_NONE)
 	{
 		int n = 0;
@@ -159,4 +272,89 @@ qbuff_ip_protocol(struct qbuff * buff)
 }
 
 
+/*
+ * symmetric hash of the flow (addresses, and ports for TCP/UDP) for both
+ * IPv4 and IPv6, the same on every cpu and direction. The IP header is the
+ * one of the monad (shift). The ports of fragments (the first included) are
+ * not hashed, so that all the fragments of a datagram hash the same...
+ */
+
+static inline bool
+qbuff_symmetric_hash(struct qbuff * buff, uint32_t *hash)
+{
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
+	uint32_t h = 0;
+	int n, offset;
+	u8 nexthdr;
+
+	if (qbuff_ip_version(buff) == 4) {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		h = (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr;
+
+		if ((ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) &&
+		    !(ip->frag_off & __constant_htons(IP_MF|IP_OFFSET))) {
+			struct udphdr _udp;
+			const struct udphdr *udp;
+
+			udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+			if (udp == NULL)
+				return false;  /* broken */
+
+			h ^= (__force uint32_t)udp->source ^ (__force uint32_t)udp->dest;
+		}
+
+		*hash = h;
+		return true;
+	}
+
+	ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6 == NULL)
+		return false;
+
+	for(n = 0; n < 4; n++)
+		h ^= (__force uint32_t)ip6->saddr.s6_addr32[n] ^ (__force uint32_t)ip6->daddr.s6_addr32[n];
+
+	/* skip the option headers: a fragment header stops the walk, as the
+	 * fragmentation bits do for IPv4 */
+
+	nexthdr = ip6->nexthdr;
+	offset  = sizeof(struct ipv6hdr);
+
+	for(n = 0; n < 8 && (nexthdr == IPPROTO_HOPOPTS ||
+			     nexthdr == IPPROTO_ROUTING ||
+			     nexthdr == IPPROTO_DSTOPTS); n++) {
+		struct ipv6_opt_hdr _opt;
+		const struct ipv6_opt_hdr *opt;
+
+		opt = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, offset, sizeof(_opt), &_opt);
+		if (opt == NULL) {
+			nexthdr = IPPROTO_NONE;
+			break;
+		}
+
+		nexthdr = opt->nexthdr;
+		offset += (opt->hdrlen + 1) << 3;
+	}
+
+	if (nexthdr == IPPROTO_TCP || nexthdr == IPPROTO_UDP) {
+		struct udphdr _udp;
+		const struct udphdr *udp;
+
+		udp = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, offset, sizeof(_udp), &_udp);
+		if (udp)
+			h ^= (__force uint32_t)udp->source ^ (__force uint32_t)udp->dest;
+	}
+
+	*hash = h;
+	return true;
+}
+
+
 #endif /* PFQ_LANG_QBUFF_H */
@@ -0,0 +1,183 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+
+
+/*
+ * sampling functions: deterministic (1 packet out of n), probabilistic and
+ * flow-consistent (all the packets of a flow, or none). Probabilities are
+ * fixed point, p * 2^32. Decisions are counted in the group stats...
+ */
+
+#define SAMPLE_COUNTER(args)	GET_ARG_7(unsigned long __percpu *, args)
+
+
+static DEFINE_PER_CPU(u64, sample_rnd);
+
+
+/* xorshift64*, per cpu */
+
+static inline uint32_t
+sample_random(void)
+{
+	u64 *state = this_cpu_ptr(&sample_rnd);
+	u64 x = *state;
+
+	if (unlikely(x == 0))
+		x = ((u64)get_random_int() << 32) | get_random_int() | 1;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+
+	return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+static inline bool
+sample_below(uint32_t value, uint32_t p)
+{
+	return p == UINT_MAX || value < p;
+}
+
+
+static inline bool
+sample_account(struct qbuff * buff, bool keep)
+{
+	struct pfq_group_shed_stats *stats = get_group_shed_stats(buff);
+
+	if (keep)
+		local_inc(&stats->sample_in);
+	else
+		local_inc(&stats->sample_out);
+	return keep;
+}
+
+
+static bool
+sample_every(arguments_t args, struct qbuff * buff)
+{
+	const unsigned long n = (unsigned long)GET_ARG_0(int, args);
+	unsigned long *counter = this_cpu_ptr(SAMPLE_COUNTER(args));
+
+	return sample_account(buff, (*counter)++ % n == 0);
+}
+
+
+static bool
+sample_prob(arguments_t args, struct qbuff * buff)
+{
+	const uint32_t p = GET_ARG_0(uint32_t, args);
+
+	return sample_account(buff, sample_below(sample_random(), p));
+}
+
+
+static bool
+sample_flow(arguments_t args, struct qbuff * buff)
+{
+	const uint32_t p = GET_ARG_0(uint32_t, args);
+	uint32_t hash;
+
+	if (!qbuff_symmetric_hash(buff, &hash))
+		return sample_account(buff, false);
+
+	return sample_account(buff, sample_below(jhash_1word(hash, 0), p));
+}
+
+
+static ActionQbuff
+sample_every_filter(arguments_t args, struct qbuff * buff)
+{
+	if (sample_every(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+sample_prob_filter(arguments_t args, struct qbuff * buff)
+{
+	if (sample_prob(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+sample_flow_filter(arguments_t args, struct qbuff * buff)
+{
+	if (sample_flow(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static int sample_every_init(arguments_t args)
+{
+	const int n = GET_ARG_0(int, args);
+	unsigned long __percpu *counter;
+
+	if (n <= 0) {
+		printk(KERN_INFO "[PFQ|init] sample_every: bad rate %d!\n", n);
+		return -EINVAL;
+	}
+
+	counter = alloc_percpu(unsigned long);
+	if (counter == NULL) {
+		printk(KERN_INFO "[PFQ|init] sample_every: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	SET_ARG_7(args, counter);
+	return 0;
+}
+
+
+static int sample_every_fini(arguments_t args)
+{
+	free_percpu(SAMPLE_COUNTER(args));
+	SET_ARG_7(args, (unsigned long __percpu *)NULL);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr sample_functions[] = {
+
+	{ "sample_every",		"CInt -> Qbuff -> Bool",		sample_every,		sample_every_init, sample_every_fini },
+	{ "sample_prob",		"Word32 -> Qbuff -> Bool",		sample_prob,		NULL,		   NULL },
+	{ "sample_flow",		"Word32 -> Qbuff -> Bool",		sample_flow,		NULL,		   NULL },
+	{ "sample_every_filter",	"CInt -> Qbuff -> Action Qbuff",	sample_every_filter,	sample_every_init, sample_every_fini },
+	{ "sample_prob_filter",		"Word32 -> Qbuff -> Action Qbuff",	sample_prob_filter,	NULL,		   NULL },
+	{ "sample_flow_filter",		"Word32 -> Qbuff -> Action Qbuff",	sample_flow_filter,	NULL,		   NULL },
+
+	{ NULL }};
@@ -0,0 +1,230 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+#include <pfq/sketch.h>
+
+
+/*
+ * functions over the heavy-hitter sketches (see Q_SO_SKETCH_CREATE): the
+ * flow key of the packet is made of the Q_KEY_* fields of the sketch...
+ */
+
+#define Q_KEY_ETH	(Q_KEY_ETH_TYPE|Q_KEY_ETH_SRC|Q_KEY_ETH_DST)
+#define Q_KEY_L4	(Q_KEY_SRC_PORT|Q_KEY_DST_PORT|Q_KEY_ICMP_TYPE|Q_KEY_ICMP_CODE)
+
+#define IP_ECN_MASK	0x3
+#define IP_DSCP_MASK	0xfc
+
+
+static void
+sketch_key(struct qbuff * buff, uint64_t keys, struct pfq_sketch_key *key)
+{
+	int l4off, proto;
+
+	memset(key, 0, sizeof(*key));
+
+	if (keys & Q_KEY_ETH) {
+		struct ethhdr *eth = qbuff_eth_hdr(buff);
+
+		if (keys & Q_KEY_ETH_SRC)
+			memcpy(key->eth_src, eth->h_source, ETH_ALEN);
+		if (keys & Q_KEY_ETH_DST)
+			memcpy(key->eth_dst, eth->h_dest, ETH_ALEN);
+		if (keys & Q_KEY_ETH_TYPE)
+			key->eth_type = (__force uint16_t)qbuff_eth_proto(buff);
+	}
+
+	if (!(keys & ~Q_KEY_ETH))
+		return;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return;
+
+		if (keys & Q_KEY_IP_SRC)
+			memcpy(key->ip_src, &ip->saddr, sizeof(ip->saddr));
+		if (keys & Q_KEY_IP_DST)
+			memcpy(key->ip_dst, &ip->daddr, sizeof(ip->daddr));
+
+		key->ip_tos = ((keys & Q_KEY_IP_ECN)  ? ip->tos & IP_ECN_MASK  : 0) |
+			      ((keys & Q_KEY_IP_DSCP) ? ip->tos & IP_DSCP_MASK : 0);
+
+		key->ip_version = 4;
+		l4off = ip->ihl<<2;
+		proto = ip->protocol;
+
+		if (ip->frag_off & __constant_htons(IP_OFFSET))
+			l4off = -1;
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		uint8_t tos;
+
+		ip6 = qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return;
+
+		if (keys & Q_KEY_IP_SRC)
+			memcpy(key->ip_src, &ip6->saddr, sizeof(ip6->saddr));
+		if (keys & Q_KEY_IP_DST)
+			memcpy(key->ip_dst, &ip6->daddr, sizeof(ip6->daddr));
+
+		tos = (uint8_t)((ip6->priority << 4) | (ip6->flow_lbl[0] >> 4));
+		key->ip_tos = ((keys & Q_KEY_IP_ECN)  ? tos & IP_ECN_MASK  : 0) |
+			      ((keys & Q_KEY_IP_DSCP) ? tos & IP_DSCP_MASK : 0);
+
+		key->ip_version = 6;
+		l4off = sizeof(struct ipv6hdr);
+		proto = ip6->nexthdr;
+	} break;
+	default:
+		return;
+	}
+
+	if (keys & Q_KEY_IP_PROTO)
+		key->ip_proto = (uint8_t)proto;
+
+	if (!(keys & Q_KEY_L4) || l4off < 0)
+		return;
+
+	switch(proto)
+	{
+	case IPPROTO_TCP:
+	case IPPROTO_UDP: {
+		struct udphdr _udp;
+		const struct udphdr *udp;
+
+		udp = qbuff_generic_ip_header_pointer(buff, buff->monad->ipproto, l4off, sizeof(_udp), &_udp);
+		if (udp == NULL)
+			return;
+
+		if (keys & Q_KEY_SRC_PORT)
+			key->src_port = (__force uint16_t)udp->source;
+		if (keys & Q_KEY_DST_PORT)
+			key->dst_port = (__force uint16_t)udp->dest;
+	} break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6: {
+		struct icmphdr _icmp;
+		const struct icmphdr *icmp;
+
+		icmp = qbuff_generic_ip_header_pointer(buff, buff->monad->ipproto, l4off, sizeof(_icmp), &_icmp);
+		if (icmp == NULL)
+			return;
+
+		if (keys & Q_KEY_ICMP_TYPE)
+			key->icmp_type = icmp->type;
+		if (keys & Q_KEY_ICMP_CODE)
+			key->icmp_code = icmp->code;
+	} break;
+	}
+}
+
+
+static ActionQbuff
+sketch_update(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	struct pfq_sketch_key key;
+	struct pfq_sketch *s;
+
+	rcu_read_lock();
+
+	s = pfq_sketch_get(id);
+	if (likely(s != NULL)) {
+		sketch_key(buff, s->conf.keys, &key);
+		pfq_sketch_update(s, &key, (s->conf.flags & Q_SKETCH_BYTES) ? qbuff_len(buff) : 1);
+	}
+
+	rcu_read_unlock();
+	return Pass(buff);
+}
+
+
+static uint64_t
+sketch_estimate(arguments_t args, struct qbuff * buff)
+{
+	const int id = GET_ARG_0(int, args);
+	struct pfq_sketch_key key;
+	struct pfq_sketch *s;
+	uint64_t ret = NOTHING;
+
+	rcu_read_lock();
+
+	s = pfq_sketch_get(id);
+	if (likely(s != NULL)) {
+		sketch_key(buff, s->conf.keys, &key);
+		ret = (uint64_t)JUST(pfq_sketch_estimate(s, &key));
+	}
+
+	rcu_read_unlock();
+	return ret;
+}
+
+
+static bool
+sketch_heavy(arguments_t args, struct qbuff * buff)
+{
+	const uint64_t threshold = GET_ARG_1(uint64_t, args);
+	uint64_t est = sketch_estimate(args, buff);
+
+	return !IS_NOTHING(est) && FROM_JUST(uint64_t, est) >= threshold;
+}
+
+
+static int sketch_init(arguments_t args)
+{
+	const int id = GET_ARG_0(int, args);
+	bool found;
+
+	rcu_read_lock();
+	found = pfq_sketch_get(id) != NULL;
+	rcu_read_unlock();
+
+	if (!found) {
+		printk(KERN_INFO "[PFQ|init] sketch: id=%d not found!\n", id);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+struct pfq_lang_function_descr sketch_functions[] = {
+
+	{ "sketch_update",	"CInt -> Qbuff -> Action Qbuff",		sketch_update,	 sketch_init, NULL },
+	{ "sketch_estimate",	"CInt -> Qbuff -> Word64",			sketch_estimate, sketch_init, NULL },
+	{ "sketch_heavy",	"CInt -> Word64 -> Qbuff -> Bool",		sketch_heavy,	 sketch_init, NULL },
+
+	{ NULL }};
@@ -512,6 +512,13 @@ steering_flow(arguments_t args, struct qbuff * buff)
 	const struct udphdr *udp;
 	__be32 hash;
 
+	/* outer headers: the flow hash is shared by all the groups */
+
+	if (buff->monad->shift == 0) {
+		uint32_t fhash;
+		return qbuff_flow_hash(buff, &fhash) ? Steering(buff, fhash) : Drop(buff);
+	}
+
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
 		return Drop(buff);
@@ -41,6 +41,16 @@ extern struct pfq_lang_function_descr  combinator_functions[];
 extern struct pfq_lang_function_descr  property_functions[];
 extern struct pfq_lang_function_descr  control_functions[];
 extern struct pfq_lang_function_descr  misc_functions[];
+extern struct pfq_lang_function_descr  flow_functions[];
+extern struct pfq_lang_function_descr  map_functions[];
+extern struct pfq_lang_function_descr  lpm_functions[];
+extern struct pfq_lang_function_descr  payload_functions[];
+extern struct pfq_lang_function_descr  sketch_functions[];
+extern struct pfq_lang_function_descr  sample_functions[];
+extern struct pfq_lang_function_descr  police_functions[];
+extern struct pfq_lang_function_descr  mangle_functions[];
+extern struct pfq_lang_function_descr  histogram_functions[];
+extern struct pfq_lang_function_descr  dedup_functions[];
 extern struct pfq_lang_function_descr  dummy_functions[];
 
 
@@ -53,6 +63,7 @@ __pfq_lang_symtable_free(struct symtable *table)
 		table->entry[n].function = NULL;
 		table->entry[n].init = NULL;
 		table->entry[n].fini = NULL;
+		table->entry[n].migrate = NULL;
 	}
 	table->size = 0;
 }
@@ -95,7 +106,7 @@ __pfq_lang_get_free_entry(struct symtable *table)
 
 static int
 __pfq_lang_symtable_register_function(struct symtable *table, const char *symbol, void *fun,
-				 init_ptr_t init, fini_ptr_t fini, const char *signature)
+				 init_ptr_t init, fini_ptr_t fini, migrate_ptr_t migrate, const char *signature)
 {
 	struct symtable_entry * elem;
 
@@ -123,6 +134,7 @@ __pfq_lang_symtable_register_function(struct symtable *table, const char *symbol
 	elem->function = fun;
         elem->init     = init;
         elem->fini     = fini;
+        elem->migrate  = migrate;
 	return 0;
 }
 
@@ -138,6 +150,7 @@ __pfq_lang_symtable_unregister_function(struct symtable *table, const char *symb
 			table->entry[n].function = NULL;
 			table->entry[n].init = NULL;
 			table->entry[n].fini = NULL;
+			table->entry[n].migrate = NULL;
 			return 0;
 		}
 	}
@@ -170,6 +183,7 @@ pfq_lang_symtable_register_functions(const char *module, struct symtable *table,
 						       , fun[i].ptr
 						       , fun[i].init
 						       , fun[i].fini
+						       , fun[i].migrate
 						       , fun[i].signature) < 0)
 		{
                         int j = 0;
@@ -224,6 +238,16 @@ pfq_lang_symtable_init(void)
         pfq_lang_symtable_register_functions(NULL, &global->functions, control_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, vlan_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, misc_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, flow_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, map_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, lpm_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, payload_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, sketch_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, sample_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, police_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, mangle_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, histogram_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, dedup_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, dummy_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, predicate_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, combinator_functions);
@@ -262,12 +286,12 @@ pfq_lang_symtable_search(struct symtable *table, const char *symbol)
 
 int
 pfq_lang_symtable_register_function(const char *module, struct symtable *table, const char *symbol, void *fun,
-				    init_ptr_t init, fini_ptr_t fini, const char *signature)
+				    init_ptr_t init, fini_ptr_t fini, migrate_ptr_t migrate, const char *signature)
 {
 	int rc;
 
         down_write(&global->symtable_sem);
-	rc = __pfq_lang_symtable_register_function(table, symbol, fun, init, fini, signature);
+	rc = __pfq_lang_symtable_register_function(table, symbol, fun, init, fini, migrate, signature);
 	up_write(&global->symtable_sem);
 
 	if (rc == 0 && module)
@@ -35,6 +35,7 @@ struct symtable_entry
 	void *                  function;
 	void *			init;
 	void *			fini;
+	void *			migrate;
 };
 
 
@@ -54,13 +55,14 @@ struct pfq_lang_function_descr;
 typedef struct pfq_lang_functional * arguments_t;
 typedef int (*init_ptr_t)	(arguments_t);
 typedef int (*fini_ptr_t)	(arguments_t);
+typedef int (*migrate_ptr_t)	(arguments_t, arguments_t);
 
 /* symtable */
 
 extern void pfq_lang_symtable_init(void);
 extern void pfq_lang_symtable_free(void);
 
-extern int  pfq_lang_symtable_register_function(const char *module, struct symtable *table, const char *symbol, void * fun, init_ptr_t init, fini_ptr_t fini, const char *signature);
+extern int  pfq_lang_symtable_register_function(const char *module, struct symtable *table, const char *symbol, void * fun, init_ptr_t init, fini_ptr_t fini, migrate_ptr_t migrate, const char *signature);
 extern int  pfq_lang_symtable_register_functions(const char *module, struct symtable *table, struct pfq_lang_function_descr *fun);
 extern int  pfq_lang_symtable_unregister_function(const char *module, struct symtable *table, const char *symbol);
 extern void pfq_lang_symtable_unregister_functions(const char *module, struct symtable *table, struct pfq_lang_function_descr *fun);
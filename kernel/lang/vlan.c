@@ -90,10 +90,22 @@ static int vlan_fini(arguments_t args)
 }
 
 
+static int vlan_migrate(arguments_t args, arguments_t old)
+{
+	if (GET_ARG_1(char *, old) == NULL)
+		return -EINVAL;
+
+	SET_ARG_1(args, GET_ARG_1(char *, old));
+
+	pr_devel("[PFQ|init] vlan_id filter: memory migrated@%p!\n", GET_ARG_1(char *, args));
+	return 0;
+}
+
+
 struct pfq_lang_function_descr vlan_functions[] = {
 
-	{ "vlan_id",		"[CInt] -> Qbuff -> Bool",		vlan_id,	vlan_init,	vlan_fini },
-	{ "vlan_id_filter",	"[CInt] -> Qbuff -> Action Qbuff",	vlan_id_filter, vlan_init,	vlan_fini },
+	{ "vlan_id",		"[CInt] -> Qbuff -> Bool",		vlan_id,	vlan_init,	vlan_fini,	vlan_migrate },
+	{ "vlan_id_filter",	"[CInt] -> Qbuff -> Action Qbuff",	vlan_id_filter, vlan_init,	vlan_fini,	vlan_migrate },
 
 	{ NULL }};
 
@@ -31,6 +31,11 @@ extern  int pfq_netif_rx(struct sk_buff *);
 extern  int pfq_netif_receive_skb(struct sk_buff *);
 extern  gro_result_t pfq_gro_receive(struct napi_struct *, struct sk_buff *);
 
+/* skb-less receive (e.g. XDP buffers): pfq_xdp_flush must be called at the end of the NAPI poll */
+
+extern  int pfq_xdp_receive(struct net_device *, void *data, void *data_end, uint16_t rx_queue, uint32_t hash);
+extern  int pfq_xdp_flush(void);
+
 extern struct sk_buff * __pfq_alloc_skb(unsigned int len, gfp_t priority, int fclone, int node);
 extern struct sk_buff * pfq_dev_alloc_skb(unsigned int length);
 extern struct sk_buff * __pfq_netdev_alloc_skb(struct net_device *dev, unsigned int length, gfp_t gfp);
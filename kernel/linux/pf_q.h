@@ -131,11 +131,71 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_GET_GROUP_STATS		31
 #define Q_SO_GET_GROUP_COUNTERS		32
 #define Q_SO_GET_WEIGHT			33
+#define Q_SO_GET_GROUP_SHED		34	/* per-group overload shedding counters */
+#define Q_SO_GET_GROUP_PROFILE		35	/* per-node profile of the group computation */
+#define Q_SO_GET_MAP_INFO		36	/* lookup map info and counters */
+#define Q_SO_GET_SKETCH_TOPK		37	/* heavy hitters of a sketch */
+#define Q_SO_GET_GROUP_HISTOGRAM	38	/* histogram of the group computation */
+#define Q_SO_GET_GROUP_BUDGET		39	/* processing budget of the group */
 
 #define Q_SO_TX_BIND			40
 #define Q_SO_TX_UNBIND			41
 #define Q_SO_TX_QUEUE_XMIT	        42
 
+#define Q_SO_GROUP_BIND_TX		43	/* bind group to the egress (Tx side) of a device */
+#define Q_SO_GROUP_UNBIND_TX		44
+#define Q_SO_RX_FANOUT			45	/* enable/disable software RSS fan-out on a device */
+#define Q_SO_GROUP_BUDGET		46	/* per-group processing budget */
+#define Q_SO_GROUP_EBPF			47	/* eBPF (socket filter) program, by fd */
+#define Q_SO_MAP_CREATE			48	/* create a lookup map */
+#define Q_SO_MAP_DESTROY		49
+#define Q_SO_MAP_UPDATE			50	/* insert/replace or delete a batch of map entries */
+#define Q_SO_SKETCH_CREATE		51	/* create a heavy-hitter sketch */
+#define Q_SO_SKETCH_DESTROY		52
+#define Q_SO_SKETCH_RESET		53
+#define Q_SO_SET_FLOW_SLOTS		54	/* length of the flow record ring, in records (0 = none) */
+
+/* overload shedding modes (lower priority groups) */
+
+#define Q_SHED_SKIP			0	/* skip the group */
+#define Q_SHED_SAMPLE			1	/* process one packet out of 'sample' */
+
+/* eBPF group filter verdicts: a verdict with the Q_EBPF_STEER bit set
+ * passes the packet and steers it among the sockets of the group with
+ * the hash in the lower 31 bits (Q_EBPF_PASS excepted). Any other
+ * non-zero value passes the packet, as for socket filters */
+
+#define Q_EBPF_DROP			0
+#define Q_EBPF_PASS			0xffffffffU
+#define Q_EBPF_STEER			0x80000000U
+#define Q_EBPF_STEER_HASH(h)		(Q_EBPF_STEER | ((h) & 0x7fffffffU))
+
+/* lookup maps, updatable at runtime and referenced by id in pfq-lang */
+
+#define Q_MAX_MAP			64
+#define Q_MAP_KEY_LEN			40	/* bytes: up to an IPv6 5-tuple */
+#define Q_MAP_TUPLE4_LEN		13	/* saddr, daddr, source, dest, protocol */
+#define Q_MAP_TUPLE6_LEN		37
+
+#define Q_MAP_HASH			1	/* exact match */
+#define Q_MAP_ARRAY			2	/* key: uint32_t index (host order) */
+#define Q_MAP_LPM			3	/* longest prefix match */
+#define Q_MAP_CUCKOO			4	/* membership only (cuckoo filter), values are ignored:
+						   updating a member is a no-op, a delete removes it
+						   (with no effect on the other members) */
+
+#define Q_MAP_UPDATE			0	/* insert or replace */
+#define Q_MAP_DELETE			1
+
+/* heavy-hitter sketches, updated by pfq-lang functions and read by id */
+
+#define Q_MAX_SKETCH			16
+#define Q_SKETCH_BYTES			1	/* count bytes rather than packets */
+
+/* histograms of pfq-lang properties, read by group and id */
+
+#define Q_HISTOGRAM_MAX_EDGES		64	/* buckets are edges + 1 */
+
 /* general placeholders */
 
 #define Q_ANY_DEVICE			-1
@@ -144,6 +204,11 @@ typedef uint8_t  pfq_qver_t;
 #define Q_ANY_KTHREAD			0xbadbee
 #define Q_NO_KTHREAD			-1
 
+/* packet direction */
+
+#define Q_DIR_RX			0
+#define Q_DIR_TX			1
+
 /* timestamp */
 
 #define Q_TSTAMP_OFF			0	/*default*/
@@ -239,11 +304,34 @@ struct pfq_shared_tx_queue
 } ____pfq_cacheline_aligned;
 
 
+/* flow record ring (flow_export): many producers (kernel), one consumer */
+
+struct pfq_shared_flow_queue
+{
+        unsigned int                    len;        /* ring length in records (power of 2, 0 = none) */
+        unsigned long                   lost;       /* records lost with the ring full */
+
+	struct
+	{
+		unsigned int		index;	    /* records produced */
+
+	} prod  ____pfq_cacheline_aligned;
+
+	struct
+	{
+		unsigned int		index;	    /* records consumed */
+
+	} cons ____pfq_cacheline_aligned;
+
+} ____pfq_cacheline_aligned;
+
+
 struct pfq_shared_queue
 {
         struct pfq_shared_rx_queue rx;
         struct pfq_shared_tx_queue tx;
         struct pfq_shared_tx_queue tx_async[Q_MAX_TX_QUEUES];
+        struct pfq_shared_flow_queue flow;
 };
 
 
@@ -282,6 +370,8 @@ struct pfq_pkthdr_info
         } vlan;
 
         uint16_t      queue;			/* hardware queue */
+        uint8_t       dir;			/* direction: Q_DIR_RX, Q_DIR_TX */
+        uint8_t       reserved[7];
         uint32_t     commit;                    /* commit round */
 };
 
@@ -385,6 +475,22 @@ struct pfq_so_vlan_toggle
         int toggle;
 };
 
+struct pfq_so_rx_fanout
+{
+        int ifindex;
+        int toggle;
+};
+
+struct pfq_so_group_budget
+{
+        int gid;
+        int priority;                   /* lower value, higher priority */
+        unsigned int ns_batch;          /* processing time per batch, ns (0 = unlimited) */
+        unsigned int pkt_ms;            /* packets per millisecond (0 = unlimited) */
+        int shed;                       /* Q_SHED_SKIP, Q_SHED_SAMPLE */
+        unsigned int sample;
+};
+
 struct pfq_so_binding
 {
         union
@@ -428,6 +534,35 @@ struct pfq_so_fprog
         struct sock_fprog fcode;
 };
 
+struct pfq_so_ebpf
+{
+        int gid;
+        int fd;                         /* BPF_PROG_TYPE_SOCKET_FILTER program (-1 = reset) */
+};
+
+struct pfq_so_map
+{
+        int id;
+        int type;                       /* Q_MAP_HASH, Q_MAP_ARRAY, Q_MAP_LPM, Q_MAP_CUCKOO */
+        int key_size;                   /* bytes, up to Q_MAP_KEY_LEN (network order) */
+        unsigned int max_entries;
+};
+
+struct pfq_map_entry
+{
+        uint8_t  key[Q_MAP_KEY_LEN];
+        uint32_t prefix;                /* prefix length in bits (Q_MAP_LPM) */
+        uint64_t value;
+};
+
+struct pfq_so_map_update
+{
+        int id;
+        int op;                         /* Q_MAP_UPDATE, Q_MAP_DELETE */
+        size_t size;                    /* number of entries */
+        struct pfq_map_entry const __user *entry;
+};
+
 
 /* pfq statistics for socket and groups */
 
@@ -453,4 +588,128 @@ struct pfq_counters
         unsigned long int counter[Q_MAX_COUNTERS];
 };
 
+/* pfq overload shedding, sampling, policing and dedup counters for groups */
+
+struct pfq_group_shed
+{
+        unsigned long int gid;          /* group id (in) */
+        unsigned long int shed;         /* packets skipped or sampled out because of overload */
+        unsigned long int over;         /* times the group exceeded its budget */
+        unsigned long int sample_in;    /* packets kept by pfq-lang sampling functions */
+        unsigned long int sample_out;   /* packets sampled out */
+        unsigned long int police_in;    /* packets conforming to pfq-lang policers */
+        unsigned long int police_out;   /* packets exceeding policers (dropped or reclassified) */
+        unsigned long int dedup;        /* duplicates dropped by pfq-lang dedup */
+        unsigned long int dedup_coll;   /* dedup entries evicted within their window */
+};
+
+/* pfq-lang per-node profile (computations loaded with lang_profile=1) */
+
+struct pfq_lang_node_profile
+{
+        unsigned long int run;          /* invocations */
+        unsigned long int pass;         /* passed (true, for predicates) */
+        unsigned long int drop;         /* dropped (false, for predicates) */
+        unsigned long int cycles;       /* cycles spent, nested functions included */
+};
+
+struct pfq_so_group_profile
+{
+        int gid;
+        size_t size;                    /* in: capacity of node, out: number of nodes */
+        struct pfq_lang_node_profile __user *node;
+};
+
+/* histogram of a group computation: bucket i counts the values in
+ * [edges[i-1], edges[i]), the first and the last bucket are open */
+
+struct pfq_so_group_histogram
+{
+        int gid;
+        int id;                         /* as passed to the histogram function */
+        size_t size;                    /* in: capacity of count (edges: size - 1), out: number of buckets */
+        uint64_t __user *edges;
+        uint64_t __user *count;
+};
+
+/* pfq lookup map info */
+
+struct pfq_map_info
+{
+        int id;                         /* map id (in) */
+        int type;
+        int key_size;
+        unsigned int max_entries;
+        unsigned long int count;        /* entries in use */
+        unsigned long int lookup;       /* lookups from pfq-lang functions */
+        unsigned long int hit;
+        unsigned long int slots;        /* capacity (fingerprints, for Q_MAP_CUCKOO) */
+        unsigned int fpr;               /* estimated false positive rate, parts per billion (Q_MAP_CUCKOO) */
+};
+
+/* pfq heavy-hitter sketches */
+
+struct pfq_so_sketch
+{
+        int id;
+        int flags;                      /* Q_SKETCH_BYTES */
+        uint64_t keys;                  /* flow key: Q_KEY_* fields */
+        unsigned int width;             /* counters per row (power of 2) */
+        unsigned int depth;             /* rows */
+        unsigned int topk;              /* heavy hitters tracked per cpu (power of 2, at least 4) */
+};
+
+struct pfq_sketch_key
+{
+        uint8_t  eth_src[6];
+        uint8_t  eth_dst[6];
+        uint16_t eth_type;              /* network order */
+        uint8_t  ip_src[16];            /* IPv4: first 4 bytes */
+        uint8_t  ip_dst[16];
+        uint16_t src_port;              /* network order */
+        uint16_t dst_port;
+        uint8_t  ip_version;
+        uint8_t  ip_proto;
+        uint8_t  ip_tos;                /* ECN and/or DSCP bits */
+        uint8_t  icmp_type;
+        uint8_t  icmp_code;
+        uint8_t  reserved;
+};
+
+struct pfq_sketch_entry
+{
+        struct pfq_sketch_key key;      /* fields not in the flow key are zero */
+        uint64_t count;                 /* estimate (upper bound) */
+};
+
+struct pfq_so_sketch_topk
+{
+        int id;
+        size_t size;                    /* in: capacity of entry, out: number of entries */
+        struct pfq_sketch_entry __user *entry;
+        uint64_t total;                 /* out: packets (or bytes) counted */
+};
+
+/* flow records, exported by flow_export on idle timeout or eviction: the
+ * endpoints are sorted, a record accounts both directions of the flow */
+
+#define Q_FLOW_END_IDLE			1
+#define Q_FLOW_END_EVICTED		2
+
+struct pfq_flow_record
+{
+        uint32_t saddr;                 /* network byte order */
+        uint32_t daddr;
+        uint16_t source;
+        uint16_t dest;
+        uint8_t  proto;
+        uint8_t  gid;
+        uint8_t  tcp_flags;             /* OR of the TCP flags of the flow */
+        uint8_t  reason;                /* Q_FLOW_END_* */
+        uint64_t packets;
+        uint64_t bytes;
+        uint64_t first;                 /* ns since the epoch */
+        uint64_t last;
+};
+
 #endif /* PF_Q_LINUX_H */
@@ -23,7 +23,18 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/init.h>
+#include <linux/inet.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
 
 #include <linux/pf_q.h>
 
@@ -36,6 +47,12 @@
 MODULE_LICENSE("GPL");
 
 
+static int sessions = 16384;
+
+module_param(sessions, int, 0444);
+MODULE_PARM_DESC(sessions, " Media endpoints tracked per cpu (power of 2, default=16384)");
+
+
 /* Basic RTP header */
 struct rtphdr {
 	uint8_t  rh_flags;	/* T:2 P:1 X:1 CC:4 */
@@ -81,6 +98,36 @@ bool valid_codec(uint8_t c)
 }
 
 
+/* offset of the SIP message (over UDP or TCP), -1 if not available */
+
+static int
+sip_payload(struct qbuff * buff, const struct iphdr *ip)
+{
+	int off = (int)qbuff_maclen(buff) + (ip->ihl<<2);
+
+	if (ip->frag_off & __constant_htons(IP_OFFSET))
+		return -1;
+
+	switch(ip->protocol)
+	{
+	case IPPROTO_UDP:
+		return off + sizeof(struct udphdr);
+	case IPPROTO_TCP: {
+		struct tcphdr _tcph;
+		const struct tcphdr *tcp;
+
+		tcp = qbuff_header_pointer(buff, off, sizeof(_tcph), &_tcph);
+		if (tcp == NULL)
+			return -1;
+
+		return off + (tcp->doff<<2);
+	}
+	}
+
+	return -1;
+}
+
+
 enum htype
 {
 	type_unknown = 0,
@@ -94,15 +141,20 @@ struct hret
 {
 	uint32_t	hash;
 	enum htype	type;
+	__be32		saddr;
+	__be32		daddr;
+	__be16		source;
+	__be16		dest;
+	int		payload;	/* offset of the SIP message */
 };
 
 
 static struct hret
 heuristic_voip(struct qbuff * buff, bool steer)
 {
-	struct hret ret = { 0, type_unknown };
+	struct hret ret = { 0, type_unknown, 0, 0, 0, 0, -1 };
 
-	if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IP))
+	if (qbuff_eth_proto(buff) == __constant_htons(ETH_P_IP))
 	{
 		struct iphdr _iph;
 		const struct iphdr *ip;
@@ -112,21 +164,31 @@ heuristic_voip(struct qbuff * buff, bool steer)
 
                 uint16_t source,dest;
 
-		ip = qbuff_header_pointer(buff, QBUFF_SKB(buff)->mac_len, sizeof(_iph), &_iph);
+		ip = qbuff_header_pointer(buff, qbuff_maclen(buff), sizeof(_iph), &_iph);
 		if (ip == NULL)
 			return ret;
 
-		hdr = qbuff_header_pointer(buff, QBUFF_SKB(buff)->mac_len + (ip->ihl<<2), sizeof(_hdr), &_hdr);
+		hdr = qbuff_header_pointer(buff, qbuff_maclen(buff) + (ip->ihl<<2), sizeof(_hdr), &_hdr);
 		if (hdr == NULL)
 			return ret;
 
 		dest = be16_to_cpu(hdr->udp.dest);
 		source = be16_to_cpu(hdr->udp.source);
 
-		/* check for SIP packets */
+		ret.saddr  = ip->saddr;
+		ret.daddr  = ip->daddr;
+		ret.source = hdr->udp.source;
+		ret.dest   = hdr->udp.dest;
+
+		/* check for SIP packets (5061 is SIP over TLS: not parsed) */
+
+		if (dest == 5060 || source == 5060) {
+			ret.type = type_sip;
+			ret.payload = sip_payload(buff, ip);
+			return ret;
+		}
 
-		if (dest == 5060 || source == 5060 ||
-		    dest == 5061 || source == 5061) {
+		if (dest == 5061 || source == 5061) {
 			ret.type = type_sip;
 			return ret;
 		}
@@ -261,6 +323,466 @@ steering_voip(arguments_t arg, struct qbuff * buff)
 }
 
 
+/*
+ * session tracking: the media endpoints (address and port of RTP and RTCP)
+ * announced in the SDP bodies of SIP messages are bound to the hash of the
+ * Call-ID, so that signalling and media of a call are steered to the same
+ * socket, in both directions. SIP is rare compared to media: each cpu keeps
+ * its own copy of the session table, written by the cpu that parses the
+ * SIP message (under the table lock) and read without locks by the owner.
+ * The tables are bounded (set-associative, the least recently used entry
+ * is replaced) and the entries expire when idle. SDP over IPv4 only...
+ */
+
+#define VOIP_WAYS	4
+#define VOIP_TIMEOUT	(60 * HZ)
+#define VOIP_SIP_MAX	2048
+#define VOIP_MAX_MEDIA	8
+
+
+struct voip_session
+{
+	seqcount_t	seq;
+	__be32		addr;
+	__be16		port;
+	uint32_t	call;		/* 0: free */
+	unsigned long	last;		/* jiffies */
+};
+
+
+struct voip_table
+{
+	spinlock_t		lock;
+	struct voip_session	*entry;
+};
+
+
+struct voip_media
+{
+	__be32		addr;
+	uint16_t	port;
+	uint16_t	rtcp;		/* a=rtcp, 0 = port + 1 */
+};
+
+
+static struct voip_table __percpu *voip_tables;
+static char __percpu *voip_scratch;
+static uint32_t voip_seed;
+
+
+static inline struct voip_session *
+voip_set(struct voip_table *t, __be32 addr, __be16 port)
+{
+	uint32_t h = jhash_2words((__force uint32_t)addr, (__force uint32_t)port, voip_seed);
+	return &t->entry[(h & (sessions / VOIP_WAYS - 1)) * VOIP_WAYS];
+}
+
+
+static void
+voip_insert(__be32 addr, __be16 port, uint32_t call)
+{
+	unsigned long now = jiffies;
+	int cpu, i;
+
+	for_each_online_cpu(cpu)
+	{
+		struct voip_table *t = per_cpu_ptr(voip_tables, cpu);
+		struct voip_session *set, *e;
+
+		spin_lock_bh(&t->lock);
+
+		set = voip_set(t, addr, port);
+		e = set;
+
+		for(i = 0; i < VOIP_WAYS; i++)
+		{
+			if (set[i].call && set[i].addr == addr && set[i].port == port) {
+				e = &set[i];
+				break;
+			}
+
+			if (e->call && (!set[i].call || time_before(set[i].last, e->last)))
+				e = &set[i];
+		}
+
+		write_seqcount_begin(&e->seq);
+		e->addr = addr;
+		e->port = port;
+		e->call = call;
+		e->last = now;
+		write_seqcount_end(&e->seq);
+
+		spin_unlock_bh(&t->lock);
+	}
+}
+
+
+static uint32_t
+voip_lookup(__be32 addr, __be16 port, bool touch)
+{
+	struct voip_table *t = this_cpu_ptr(voip_tables);
+	struct voip_session *set = voip_set(t, addr, port);
+	unsigned long now = jiffies;
+	int i;
+
+	for(i = 0; i < VOIP_WAYS; i++)
+	{
+		struct voip_session *e = &set[i];
+		unsigned long last;
+		unsigned int seq;
+		uint32_t call;
+		bool match;
+
+		do {
+			seq   = read_seqcount_begin(&e->seq);
+			match = e->addr == addr && e->port == port;
+			call  = e->call;
+			last  = e->last;
+		}
+		while (read_seqcount_retry(&e->seq, seq));
+
+		if (!call || !match)
+			continue;
+
+		if (time_after(now, last + VOIP_TIMEOUT))
+			return 0;
+
+		if (touch && time_after(now, last + HZ))
+			WRITE_ONCE(e->last, now);
+
+		return call;
+	}
+
+	return 0;
+}
+
+
+/* SIP/SDP parsing: lines are bounded by end, not terminated */
+
+static const char *
+sip_line(const char *p, const char *end, size_t *len)
+{
+	const char *eol = memchr(p, '\n', end - p);
+
+	if (eol == NULL)
+		eol = end;
+
+	*len = eol - p;
+	if (*len && p[*len-1] == '\r')
+		(*len)--;
+
+	return eol < end ? eol + 1 : end;
+}
+
+
+static bool
+sip_header(const char *line, size_t len, const char *name, const char **value, size_t *vlen)
+{
+	size_t n = strlen(name);
+
+	if (len <= n || strncasecmp(line, name, n) != 0)
+		return false;
+
+	line += n;
+	len -= n;
+
+	while (len && (*line == ' ' || *line == '\t')) {
+		line++;
+		len--;
+	}
+
+	if (len == 0 || *line != ':')
+		return false;
+
+	do {
+		line++;
+		len--;
+	}
+	while (len && (*line == ' ' || *line == '\t'));
+
+	while (len && (line[len-1] == ' ' || line[len-1] == '\t'))
+		len--;
+
+	if (len == 0)
+		return false;
+
+	*value = line;
+	*vlen = len;
+	return true;
+}
+
+
+static const char *
+sdp_uint(const char *p, const char *end, unsigned long *v)
+{
+	const char *q = p;
+
+	for(*v = 0; q < end && *q >= '0' && *q <= '9' && *v <= 0xffff; q++)
+		*v = *v * 10 + (*q - '0');
+
+	return q == p ? NULL : q;
+}
+
+
+/* c=IN IP4 <addr> */
+
+static bool
+sdp_connection(const char *line, size_t len, __be32 *addr)
+{
+	const char *end = line + len, *a;
+
+	if (len < 9 || memcmp(line, "c=IN IP4 ", 9) != 0)
+		return false;
+
+	line += 9;
+	for(a = line; a < end && *a != '/' && *a != ' '; a++)
+		;
+
+	return in4_pton(line, a - line, (u8 *)addr, -1, NULL) == 1;
+}
+
+
+/* m=<media> <port>[/<n>] <proto> ... */
+
+static bool
+sdp_media(const char *line, size_t len, uint16_t *port)
+{
+	const char *end = line + len, *p;
+	unsigned long v;
+
+	if (len < 2 || memcmp(line, "m=", 2) != 0)
+		return false;
+
+	p = memchr(line, ' ', len);
+	if (p == NULL || (p = sdp_uint(p + 1, end, &v)) == NULL || v == 0 || v > 0xffff)
+		return false;
+
+	*port = (uint16_t)v;
+	return true;
+}
+
+
+/* a=rtcp:<port> */
+
+static bool
+sdp_rtcp(const char *line, size_t len, uint16_t *port)
+{
+	unsigned long v;
+
+	if (len < 7 || memcmp(line, "a=rtcp:", 7) != 0)
+		return false;
+
+	if (sdp_uint(line + 7, line + len, &v) == NULL || v == 0 || v > 0xffff)
+		return false;
+
+	*port = (uint16_t)v;
+	return true;
+}
+
+
+/*
+ * the hash of the Call-ID of a SIP message (0 if none), after binding the
+ * media endpoints of its SDP body (offers and answers alike) to it, if
+ * learn is set...
+ */
+
+static uint32_t
+voip_learn(struct qbuff * buff, struct hret const *h, bool learn)
+{
+	struct voip_media media[VOIP_MAX_MEDIA];
+	const char *p, *end, *line, *id = NULL;
+	size_t len, idlen = 0;
+	__be32 addr = 0;
+	uint32_t call;
+	int n = 0, i;
+
+	if (h->payload < 0 || h->payload >= (int)qbuff_len(buff))
+		return 0;
+
+	len = min_t(size_t, qbuff_len(buff) - h->payload, VOIP_SIP_MAX);
+
+	p = qbuff_header_pointer(buff, h->payload, len, this_cpu_ptr(voip_scratch));
+	if (p == NULL)
+		return 0;
+
+	end = p + len;
+
+	/* headers */
+
+	while (p < end)
+	{
+		line = p;
+		p = sip_line(p, end, &len);
+		if (len == 0)
+			break;
+
+		if (id == NULL && !sip_header(line, len, "Call-ID", &id, &idlen))
+			sip_header(line, len, "i", &id, &idlen);
+	}
+
+	if (id == NULL)
+		return 0;
+
+	call = jhash(id, idlen, voip_seed) | 1;
+
+	if (!learn)
+		return call;
+
+	/* SDP body */
+
+	while (p < end)
+	{
+		line = p;
+		p = sip_line(p, end, &len);
+
+		if (sdp_connection(line, len, n ? &media[n-1].addr : &addr))
+			continue;
+
+		if (n < VOIP_MAX_MEDIA && sdp_media(line, len, &media[n].port)) {
+			media[n].addr = addr;
+			media[n].rtcp = 0;
+			n++;
+			continue;
+		}
+
+		if (n)
+			sdp_rtcp(line, len, &media[n-1].rtcp);
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		if (!media[i].addr)
+			continue;
+
+		voip_insert(media[i].addr, htons(media[i].port), call);
+		voip_insert(media[i].addr, htons(media[i].rtcp ? media[i].rtcp : media[i].port + 1), call);
+	}
+
+	return call;
+}
+
+
+/*
+ * the call of the packet: SIP by Call-ID, RTP/RTCP by endpoint (0 if unknown).
+ * Only steering learns sessions (and keeps them alive), predicates and
+ * properties do not change the tables.
+ */
+
+static uint32_t
+voip_call(struct qbuff * buff, struct hret const *h, bool learn)
+{
+	uint32_t call;
+
+	switch(h->type)
+	{
+	case type_sip:
+		return voip_learn(buff, h, learn);
+	case type_rtp:
+	case type_rtcp:
+		call = voip_lookup(h->daddr, h->dest, learn);
+		return call ? call : voip_lookup(h->saddr, h->source, learn);
+	default:
+		return 0;
+	}
+}
+
+
+static bool
+is_call(arguments_t arg, struct qbuff * buff)
+{
+	struct hret ret = heuristic_voip(buff, false);
+	return voip_call(buff, &ret, false) != 0;
+}
+
+
+static uint64_t
+call_id(arguments_t arg, struct qbuff * buff)
+{
+	struct hret ret = heuristic_voip(buff, false);
+	uint32_t call = voip_call(buff, &ret, false);
+
+	if (call == 0)
+		return NOTHING;
+
+	return (uint64_t)JUST(call);
+}
+
+
+static ActionQbuff
+steering_call(arguments_t arg, struct qbuff * buff)
+{
+	struct hret ret = heuristic_voip(buff, true);
+	uint32_t call = voip_call(buff, &ret, true);
+
+	if (call)
+		return Steering(buff, call);
+
+	switch(ret.type)
+	{
+	case type_unknown: return Drop(buff);
+	case type_rtp:	   return Steering(buff, ret.hash);
+	case type_rtcp:    return Steering(buff, ret.hash);
+	case type_sip:     return Broadcast(buff);
+	}
+
+	return Drop(buff);
+}
+
+
+static void
+voip_destruct(void)
+{
+	int cpu;
+
+	if (voip_tables) {
+		for_each_possible_cpu(cpu)
+			vfree(per_cpu_ptr(voip_tables, cpu)->entry);
+		free_percpu(voip_tables);
+	}
+
+	free_percpu(voip_scratch);
+}
+
+
+static int
+voip_init(void)
+{
+	int cpu, i;
+
+	if (sessions < VOIP_WAYS || !is_power_of_2(sessions)) {
+		printk(KERN_INFO "[RTP] sessions=%d: must be a power of 2 (>= %d)!\n", sessions, VOIP_WAYS);
+		return -EINVAL;
+	}
+
+	voip_seed = get_random_int();
+
+	voip_tables = alloc_percpu(struct voip_table);
+	voip_scratch = __alloc_percpu(VOIP_SIP_MAX, sizeof(long));
+	if (voip_tables == NULL || voip_scratch == NULL)
+		goto err;
+
+	for_each_possible_cpu(cpu)
+	{
+		struct voip_table *t = per_cpu_ptr(voip_tables, cpu);
+
+		spin_lock_init(&t->lock);
+
+		t->entry = vzalloc_node(sizeof(struct voip_session) * sessions, cpu_to_node(cpu));
+		if (t->entry == NULL)
+			goto err;
+
+		for(i = 0; i < sessions; i++)
+			seqcount_init(&t->entry[i].seq);
+	}
+
+	return 0;
+err:
+	printk(KERN_INFO "[RTP] session tables: out of memory!\n");
+	voip_destruct();
+	return -ENOMEM;
+}
+
+
 static struct pfq_lang_function_descr rtp_hooks[] = {
 
 	{ "rtp"		, "Qbuff -> Action Qbuff", filter_rtp    , NULL, NULL},
@@ -269,18 +791,22 @@ static struct pfq_lang_function_descr rtp_hooks[] = {
 	{ "voip"	, "Qbuff -> Action Qbuff", filter_voip   , NULL, NULL},
 	{ "steer_rtp"	, "Qbuff -> Action Qbuff", steering_rtp  , NULL, NULL},
 	{ "steer_voip"	, "Qbuff -> Action Qbuff", steering_voip , NULL, NULL},
+	{ "steer_call"	, "Qbuff -> Action Qbuff", steering_call , NULL, NULL},
 
 	{ "is_rtp"	, "Qbuff -> Bool"	 , is_rtp	 , NULL, NULL},
 	{ "is_rtcp"	, "Qbuff -> Bool"	 , is_rtcp	 , NULL, NULL},
 	{ "is_sip"	, "Qbuff -> Bool"	 , is_sip	 , NULL, NULL},
 	{ "is_voip"	, "Qbuff -> Bool"	 , is_voip	 , NULL, NULL},
+	{ "is_call"	, "Qbuff -> Bool"	 , is_call	 , NULL, NULL},
+
+	{ "call_id"	, "Qbuff -> Word64"	 , call_id	 , NULL, NULL},
 
 	{ NULL }};
 
 
 static int __init usr_init_module(void)
 {
-	int i = 0;
+	int i = 0, err;
 	for(; rtp_hooks[i].symbol; i++)
 	{
 		printk(KERN_INFO "[RTp] registiering %s\n", rtp_hooks[i].symbol);
@@ -288,8 +814,13 @@ static int __init usr_init_module(void)
 
 	printk(KERN_INFO "[RTR] registeering@%p...\n", rtp_hooks);
 
+	err = voip_init();
+	if (err < 0)
+		return err;
+
 	if (pfq_lang_register_functions("[RTP]", rtp_hooks) < 0)
 	{
+		voip_destruct();
 		return -EPERM;
 	}
 
@@ -300,6 +831,7 @@ static int __init usr_init_module(void)
 static void __exit usr_exit_module(void)
 {
 	pfq_lang_unregister_functions("[RTP]", rtp_hooks);
+	voip_destruct();
 }
 
 
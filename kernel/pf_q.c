@@ -52,6 +52,7 @@
 #include <linux/pf_q.h>
 
 #include <lang/symtable.h>
+#include <lang/native.h>
 
 #include <pfq/global.h>
 #include <pfq/devmap.h>
@@ -69,6 +70,8 @@
 #include <pfq/sockopt.h>
 #include <pfq/bpf.h>
 #include <pfq/memory.h>
+#include <pfq/maps.h>
+#include <pfq/sketch.h>
 #include <pfq/thread.h>
 #include <pfq/vlan.h>
 #include <pfq/pool.h>
@@ -116,6 +119,11 @@ pfq_release(struct socket *sock)
 	pr_devel("[PFQ|%d] disabling socket...\n", so->id);
 	pfq_sock_disable(so);
 
+	/* destroy the maps and the sketches owned by this socket */
+
+	pfq_maps_release(so->id);
+	pfq_sketches_release(so->id);
+
 	/* release the socket id */
 
 	pr_devel("[PFQ|%d] releasing id...\n", so->id);
@@ -263,6 +271,12 @@ static int pfq_netdev_notifier( struct notifier_block *this
 		}
 
 		pr_devel("[PFQ] %s: device %s, ifindex %d\n", kind, dev->name, dev->ifindex);
+
+		/* release the egress hook (and the reference) of the device */
+
+		if (info == NETDEV_UNREGISTER)
+			pfq_devmap_tx_unregister(dev->ifindex);
+
 		return NOTIFY_OK;
 	}
 
@@ -478,6 +492,9 @@ static int __init pfq_init_module(void)
 	/* register pfq-lang default functions */
 	pfq_lang_symtable_init();
 
+	/* resolve the native opcodes of the default functions */
+	pfq_lang_native_init();
+
 	/* register netdev notifier */
         register_netdevice_notifier(&pfq_netdev_notifier_block);
 
@@ -492,6 +509,13 @@ static int __init pfq_init_module(void)
 			goto err7;
 	}
 
+	/* start Rx threads */
+	if (global->rx_cpu_nr)
+	{
+		if ((err = pfq_start_rx_threads()) < 0)
+			goto err7;
+	}
+
 	/* proc init */
 
 	err = pfq_proc_init();
@@ -511,6 +535,10 @@ static int __init pfq_init_module(void)
         printk(KERN_INFO "[PFQ] max_slot_size   : %d\n", global->max_slot_size);
         printk(KERN_INFO "[PFQ] capt_batch_len  : %d\n", global->capt_batch_len);
         printk(KERN_INFO "[PFQ] xmit_batch_len  : %d\n", global->xmit_batch_len);
+        printk(KERN_INFO "[PFQ] lang_batch      : %d\n", global->lang_batch);
+        printk(KERN_INFO "[PFQ] lang_profile    : %d\n", global->lang_profile);
+        printk(KERN_INFO "[PFQ] flow_table_size : %d\n", global->flow_table_size);
+        printk(KERN_INFO "[PFQ] flow_timeout    : %d\n", global->flow_timeout);
         printk(KERN_INFO "[PFQ] vlan_untag      : %d\n", global->vlan_untag);
         printk(KERN_INFO "[PFQ] skb_tx_pool_size: %d\n", global->skb_tx_pool_size);
         printk(KERN_INFO "[PFQ] skb_rx_pool_size: %d\n", global->skb_rx_pool_size);
@@ -521,6 +549,7 @@ static int __init pfq_init_module(void)
 err8:
 	pfq_proc_destruct();
 err7:
+	pfq_stop_rx_threads();
 	pfq_stop_tx_threads();
 err6:
 	unregister_netdevice_notifier(&pfq_netdev_notifier_block);
@@ -554,6 +583,9 @@ static void __exit pfq_exit_module(void)
 	/* stop Tx threads */
 	pfq_stop_tx_threads();
 
+	/* stop Rx threads */
+	pfq_stop_rx_threads();
+
 	/* unregister netdevice notifier */
         unregister_netdevice_notifier(&pfq_netdev_notifier_block);
 
@@ -570,6 +602,9 @@ static void __exit pfq_exit_module(void)
         /* disable direct capture */
         pfq_devmap_toggle_reset();
 
+        /* disable egress capture */
+        pfq_devmap_tx_reset();
+
         /* wait grace period */
         msleep(Q_GRACE_PERIOD);
 
@@ -590,6 +625,10 @@ static void __exit pfq_exit_module(void)
 
 	pfq_groups_destruct();
 
+	/* free lookup maps and sketches */
+	pfq_maps_destruct();
+	pfq_sketches_destruct();
+
         printk(KERN_INFO "[PFQ] unloaded.\n");
 }
 
@@ -701,6 +740,29 @@ pfq_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 }
 
 
+/* returns 1 if the frame is taken by PFQ (the driver must not pass it to
+ * the stack), 0 otherwise. The frame must stay valid until pfq_xdp_flush. */
+
+static int
+pfq_xdp_receive(struct net_device *dev, void *data, void *data_end, uint16_t rx_queue, uint32_t hash)
+{
+	if (likely(pfq_devmap_toggle_get(dev->ifindex))) {
+		pfq_receive_xdp(dev, data, data_end, rx_queue, hash);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static int
+pfq_xdp_flush(void)
+{
+	return pfq_receive_xdp_flush();
+}
+
+
+
 int
 pfq_lang_register_functions(const char *module, struct pfq_lang_function_descr *fun)
 {
@@ -718,6 +780,8 @@ pfq_lang_unregister_functions(const char *module, struct pfq_lang_function_descr
 EXPORT_SYMBOL_GPL(pfq_netif_rx);
 EXPORT_SYMBOL_GPL(pfq_netif_receive_skb);
 EXPORT_SYMBOL_GPL(pfq_gro_receive);
+EXPORT_SYMBOL_GPL(pfq_xdp_receive);
+EXPORT_SYMBOL_GPL(pfq_xdp_flush);
 
 EXPORT_SYMBOL(pfq_lang_register_functions);
 EXPORT_SYMBOL(pfq_lang_unregister_functions);
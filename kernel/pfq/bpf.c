@@ -82,3 +82,39 @@ pfq_free_sk_filter(struct sk_filter *filter)
 }
 
 
+struct bpf_prog *
+pfq_get_ebpf_prog(int fd)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	struct bpf_prog *prog;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,8,0))
+	prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_SOCKET_FILTER);
+#else
+	prog = bpf_prog_get(fd);
+	if (!IS_ERR(prog) && prog->type != BPF_PROG_TYPE_SOCKET_FILTER) {
+		bpf_prog_put(prog);
+		prog = ERR_PTR(-EINVAL);
+	}
+#endif
+	if (IS_ERR(prog)) {
+		pr_devel("[PFQ] eBPF: bpf_prog_get error: (%ld)!\n", PTR_ERR(prog));
+		return NULL;
+	}
+
+        pr_devel("[PFQ] eBPF: new prog (len %u, jited %d)\n", prog->len, prog->jited);
+	return prog;
+#else
+	return NULL;
+#endif
+}
+
+
+void
+pfq_put_ebpf_prog(struct bpf_prog *prog)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	bpf_prog_put(prog);
+#endif
+}
+
@@ -25,9 +25,20 @@
 #ifndef PFQ_BPF_H
 #define PFQ_BPF_H
 
+#include <linux/version.h>
 #include <linux/filter.h>
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+#include <linux/bpf.h>
+#define PFQ_EBPF_SUPPORT
+#endif
+
+struct bpf_prog;
+
 extern struct sk_filter * pfq_alloc_sk_filter(struct sock_fprog *fprog);
 extern void pfq_free_sk_filter(struct sk_filter *filter);
 
+extern struct bpf_prog * pfq_get_ebpf_prog(int fd);
+extern void pfq_put_ebpf_prog(struct bpf_prog *prog);
+
 #endif /* PFQ_BPF_H */
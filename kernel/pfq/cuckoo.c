@@ -0,0 +1,288 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/cuckoo.h>
+
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/bottom_half.h>
+#include <linux/vmalloc.h>
+
+
+#define CUCKOO_BUCKET(c, i)	(&(c)->slot[(i) * Q_CUCKOO_SLOTS])
+
+
+static inline void
+cuckoo_hash(struct pfq_cuckoo const *c, const void *key, int len, unsigned long *index, uint16_t *fp)
+{
+	uint32_t h = jhash(key, (u32)len, c->seed);
+	uint32_t f = jhash(key, (u32)len, ~c->seed) >> 16;
+
+	*index = h & c->mask;
+	*fp = f ? (uint16_t)f : 1;
+}
+
+
+/* the alternate bucket depends on the fingerprint only: alt(alt(i)) == i */
+
+static inline unsigned long
+cuckoo_alt(struct pfq_cuckoo const *c, unsigned long index, uint16_t fp)
+{
+	return (index ^ jhash_1word(fp, c->seed)) & c->mask;
+}
+
+
+static inline bool
+cuckoo_bucket_has(struct pfq_cuckoo const *c, unsigned long index, uint16_t fp)
+{
+	const uint16_t *b = CUCKOO_BUCKET(c, index);
+	int n;
+
+	for(n = 0; n < Q_CUCKOO_SLOTS; n++)
+	{
+		if (READ_ONCE(b[n]) == fp)
+			return true;
+	}
+
+	return false;
+}
+
+
+static inline bool
+cuckoo_bucket_put(struct pfq_cuckoo *c, unsigned long index, uint16_t fp)
+{
+	uint16_t *b = CUCKOO_BUCKET(c, index);
+	int n;
+
+	for(n = 0; n < Q_CUCKOO_SLOTS; n++)
+	{
+		if (b[n] == 0) {
+			WRITE_ONCE(b[n], fp);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static inline bool
+cuckoo_bucket_del(struct pfq_cuckoo *c, unsigned long index, uint16_t fp)
+{
+	uint16_t *b = CUCKOO_BUCKET(c, index);
+	int n;
+
+	for(n = 0; n < Q_CUCKOO_SLOTS; n++)
+	{
+		if (b[n] == fp) {
+			WRITE_ONCE(b[n], 0);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static inline bool
+__cuckoo_contains(struct pfq_cuckoo const *c, unsigned long index, uint16_t fp)
+{
+	unsigned long alt = cuckoo_alt(c, index, fp);
+
+	if (cuckoo_bucket_has(c, index, fp) || cuckoo_bucket_has(c, alt, fp))
+		return true;
+
+	return READ_ONCE(c->victim) == fp &&
+	       (READ_ONCE(c->victim_index) == index || READ_ONCE(c->victim_index) == alt);
+}
+
+
+int
+pfq_cuckoo_init(struct pfq_cuckoo *c, unsigned int max_entries)
+{
+	unsigned long buckets = roundup_pow_of_two(DIV_ROUND_UP(max_entries, Q_CUCKOO_SLOTS));
+
+	/* keep the load factor below 95% at max_entries */
+
+	if ((unsigned long)max_entries * 100 > buckets * Q_CUCKOO_SLOTS * 95)
+		buckets <<= 1;
+
+	c->slot = vzalloc(buckets * Q_CUCKOO_SLOTS * sizeof(uint16_t));
+	if (c->slot == NULL)
+		return -ENOMEM;
+
+	c->mask = buckets - 1;
+	c->count = 0;
+	c->seed = get_random_int();
+	c->victim = 0;
+	c->victim_index = 0;
+
+	seqcount_init(&c->seq);
+	return 0;
+}
+
+
+void
+pfq_cuckoo_free(struct pfq_cuckoo *c)
+{
+	vfree(c->slot);
+	c->slot = NULL;
+}
+
+
+/*
+ * insert the key: a fingerprint is added at each insertion, duplicates
+ * included, and each insertion takes a delete. Keys sharing a fingerprint
+ * and a bucket hold a fingerprint each, so that deleting one of them never
+ * makes a false negative of the other. When both buckets are full the
+ * fingerprints are relocated under the seqcount, and readers never miss
+ * a key in transit. Writers run with BH disabled, as readers on the packet
+ * path would spin on an interrupted relocation...
+ */
+
+int
+pfq_cuckoo_insert(struct pfq_cuckoo *c, const void *key, int len)
+{
+	unsigned long index;
+	uint16_t fp;
+	int n;
+
+	cuckoo_hash(c, key, len, &index, &fp);
+
+	if (c->victim)
+		return -ENOSPC;
+
+	if (cuckoo_bucket_put(c, index, fp) ||
+	    cuckoo_bucket_put(c, cuckoo_alt(c, index, fp), fp)) {
+		c->count++;
+		return 0;
+	}
+
+	if (get_random_int() & 1)
+		index = cuckoo_alt(c, index, fp);
+
+	local_bh_disable();
+	write_seqcount_begin(&c->seq);
+
+	for(n = 0; n < Q_CUCKOO_MAX_KICKS; n++)
+	{
+		uint16_t *b = CUCKOO_BUCKET(c, index);
+		int s = get_random_int() % Q_CUCKOO_SLOTS;
+		uint16_t kicked = b[s];
+
+		WRITE_ONCE(b[s], fp);
+
+		fp = kicked;
+		index = cuckoo_alt(c, index, fp);
+
+		if (cuckoo_bucket_put(c, index, fp))
+			break;
+	}
+
+	if (n == Q_CUCKOO_MAX_KICKS) {
+		WRITE_ONCE(c->victim_index, index);
+		WRITE_ONCE(c->victim, fp);
+	}
+
+	write_seqcount_end(&c->seq);
+	local_bh_enable();
+
+	c->count++;
+	return 0;
+}
+
+
+/*
+ * delete the key, once per insertion: it must have been inserted, or a key
+ * sharing its fingerprint and buckets could be removed instead...
+ */
+
+int
+pfq_cuckoo_delete(struct pfq_cuckoo *c, const void *key, int len)
+{
+	unsigned long index, alt;
+	uint16_t fp;
+
+	cuckoo_hash(c, key, len, &index, &fp);
+	alt = cuckoo_alt(c, index, fp);
+
+	if (c->victim == fp && (c->victim_index == index || c->victim_index == alt)) {
+		WRITE_ONCE(c->victim, 0);
+		c->count--;
+		return 0;
+	}
+
+	if (!cuckoo_bucket_del(c, index, fp) &&
+	    !cuckoo_bucket_del(c, alt, fp))
+		return 0;
+
+	c->count--;
+
+	/* room for the victim, possibly */
+
+	if (c->victim) {
+		uint16_t v = c->victim;
+		if (cuckoo_bucket_put(c, c->victim_index, v) ||
+		    cuckoo_bucket_put(c, cuckoo_alt(c, c->victim_index, v), v))
+			WRITE_ONCE(c->victim, 0);
+	}
+
+	return 0;
+}
+
+
+bool
+pfq_cuckoo_contains(struct pfq_cuckoo *c, const void *key, int len)
+{
+	unsigned long index;
+	unsigned int seq;
+	uint16_t fp;
+	bool ret;
+
+	cuckoo_hash(c, key, len, &index, &fp);
+
+	do {
+		seq = read_seqcount_begin(&c->seq);
+		ret = __cuckoo_contains(c, index, fp);
+	}
+	while (read_seqcount_retry(&c->seq, seq));
+
+	return ret;
+}
+
+
+/*
+ * estimated false positive rate, in parts per billion: a lookup compares
+ * 2 * Q_CUCKOO_SLOTS fingerprints of 16 bits, each in use with probability
+ * equal to the load factor...
+ */
+
+unsigned int
+pfq_cuckoo_fpr(struct pfq_cuckoo const *c)
+{
+	u64 num = (u64)c->count * 2 * Q_CUCKOO_SLOTS * 1000000000ULL;
+
+	return (unsigned int)div64_u64(num, (u64)pfq_cuckoo_slots(c) << 16);
+}
@@ -0,0 +1,74 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_CUCKOO_H
+#define PFQ_CUCKOO_H
+
+#include <pfq/define.h>
+
+#include <linux/seqlock.h>
+#include <linux/types.h>
+
+
+/*
+ * cuckoo filter: membership of keys with deletion, made of buckets of
+ * Q_CUCKOO_SLOTS 16-bit fingerprints (partial-key cuckoo hashing)...
+ */
+
+struct pfq_cuckoo
+{
+	uint16_t	*slot;		/* 0: empty */
+	unsigned long	 mask;		/* buckets - 1 */
+	unsigned long	 count;
+	uint32_t	 seed;
+	seqcount_t	 seq;		/* relocations in progress */
+
+	unsigned long	 victim_index;	/* last fingerprint that found no room */
+	uint16_t	 victim;
+};
+
+
+extern int  pfq_cuckoo_init(struct pfq_cuckoo *c, unsigned int max_entries);
+extern void pfq_cuckoo_free(struct pfq_cuckoo *c);
+
+/* serialized by the caller */
+
+extern int  pfq_cuckoo_insert(struct pfq_cuckoo *c, const void *key, int len);
+extern int  pfq_cuckoo_delete(struct pfq_cuckoo *c, const void *key, int len);
+
+/* packet path */
+
+extern bool pfq_cuckoo_contains(struct pfq_cuckoo *c, const void *key, int len);
+
+
+static inline unsigned long
+pfq_cuckoo_slots(struct pfq_cuckoo const *c)
+{
+	return (c->mask + 1) * Q_CUCKOO_SLOTS;
+}
+
+
+extern unsigned int pfq_cuckoo_fpr(struct pfq_cuckoo const *c);
+
+
+#endif /* PFQ_CUCKOO_H */
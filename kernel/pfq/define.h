@@ -42,6 +42,9 @@
 
 #define Q_MAX_TX_SKB_COPY		256
 
+#define Q_RX_FANOUT_QUEUE_LEN		1024
+#define Q_RX_FANOUT_RETURN_LEN		(Q_RX_FANOUT_QUEUE_LEN + Q_BUFF_BATCH_LEN)
+
 #define Q_GRACE_PERIOD			200 /* msec */
 
 #define Q_FUN_SYMB_LEN			256
@@ -56,6 +59,27 @@
 
 #define Q_MAX_SOCKQUEUE_LEN		262144
 
+#define Q_FLOW_WAYS			4	/* slots per bucket of the flow table */
+#define Q_FLOW_EXPIRE_SCAN		4096	/* flow slots checked per timer tick */
+
+#define Q_MAP_UPDATE_BATCH		256	/* map entries copied from user space at a time */
+
+#define Q_CUCKOO_SLOTS			4	/* fingerprints per bucket of cuckoo filters */
+#define Q_CUCKOO_MAX_KICKS		500	/* relocations before a cuckoo filter is full */
+
+#define Q_SKETCH_WAYS			4	/* heavy hitters per set of a sketch */
+#define Q_SKETCH_MAX_DEPTH		8
+#define Q_SKETCH_MAX_WIDTH		(1U << 20)
+#define Q_SKETCH_MAX_TOPK		4096
+#define Q_SKETCH_MAX_MEMORY		(256UL << 20)	/* bytes of all the sketches, over all the cpus */
+
+#define Q_POLICE_FLOW_BUCKETS		2048	/* per-cpu token buckets of flow policers */
+
+#define Q_DEDUP_SLOTS			65536	/* entries of a dedup table (shared by the cpus) */
+#define Q_DEDUP_WAYS			4	/* entries per set of a dedup table */
+#define Q_DEDUP_PAYLOAD			64	/* bytes hashed after the IP header */
+#define Q_DEDUP_MAX_WINDOW		60000000 /* usec */
+
 #define Q_INVALID_ID			(__force pfq_id_t)-1
 
 
@@ -24,10 +24,14 @@
 
 #include <pfq/devmap.h>
 #include <pfq/group.h>
+#include <pfq/io.h>
 #include <pfq/kcompat.h>
 #include <pfq/printk.h>
 #include <pfq/thread.h>
 
+#include <linux/netdevice.h>
+#include <linux/slab.h>
+
 
 void pfq_devmap_toggle_update(void)
 {
@@ -95,3 +99,120 @@ int pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid)
     return n;
 }
 
+
+
+/* egress hooks are registered per device, only while some group is bound
+ * to the Tx side of it. Called with devmap_lock held. */
+
+static void pfq_devmap_tx_hook_update(void)
+{
+    int i;
+
+    for(i=0; i < Q_MAX_DEVICE; ++i)
+    {
+        unsigned long val = (unsigned long)atomic_long_read(&global->devmap_tx[i]);
+        struct packet_type *pt = global->devmap_tx_hook[i];
+
+        if (val && !pt) {
+
+            struct net_device *dev = dev_get_by_index(&init_net, i);
+            if (!dev)
+                continue;
+
+            pt = kzalloc(sizeof(struct packet_type), GFP_KERNEL);
+            if (!pt) {
+                printk(KERN_INFO "[PFQ] egress hook: out of memory (ifindex=%d)!\n", i);
+                dev_put(dev);
+                continue;
+            }
+
+            pt->type = __constant_htons(ETH_P_ALL);
+            pt->func = pfq_egress_rcv;
+            pt->dev  = dev;
+
+            dev_add_pack(pt);
+            global->devmap_tx_hook[i] = pt;
+            pr_devel("[PFQ] egress hook registered on %s.\n", dev->name);
+        }
+        else if (!val && pt) {
+
+            dev_remove_pack(pt);
+            global->devmap_tx_hook[i] = NULL;
+            pr_devel("[PFQ] egress hook unregistered from %s.\n", pt->dev->name);
+
+            dev_put(pt->dev);
+            kfree(pt);
+        }
+    }
+}
+
+
+int pfq_devmap_tx_update(int action, int index, pfq_gid_t gid)
+{
+    int n = 0, i;
+
+    if (unlikely((__force int)gid >= Q_MAX_GID ||
+		 (__force int)gid < 0)) {
+        pr_devel("[PF_Q] devmap_tx_update: bad gid (%u)\n",gid);
+        return 0;
+    }
+
+    mutex_lock(&global->devmap_lock);
+
+    for(i=0; i < Q_MAX_DEVICE; ++i)
+    {
+        long tmp;
+
+        if (index != Q_ANY_DEVICE && index != i)
+            continue;
+
+        tmp = atomic_long_read(&global->devmap_tx[i]);
+
+        if (action == Q_DEVMAP_SET) {
+            tmp |= 1L << (__force int)gid;
+            atomic_long_set(&global->devmap_tx[i], tmp);
+            n++;
+            continue;
+        }
+
+        if (tmp & (1L << (__force int)gid)) {
+            tmp &= ~(1L << (__force int)gid);
+            atomic_long_set(&global->devmap_tx[i], tmp);
+            n++;
+        }
+    }
+
+    pfq_devmap_tx_hook_update();
+
+    mutex_unlock(&global->devmap_lock);
+    return n;
+}
+
+
+/* the device is going away: drop its egress bindings (and the hook) */
+
+void pfq_devmap_tx_unregister(int index)
+{
+    mutex_lock(&global->devmap_lock);
+
+    atomic_long_set(&global->devmap_tx[index & Q_MAX_DEVICE_MASK], 0);
+
+    pfq_devmap_tx_hook_update();
+
+    mutex_unlock(&global->devmap_lock);
+}
+
+
+void pfq_devmap_tx_reset(void)
+{
+    int i;
+
+    mutex_lock(&global->devmap_lock);
+
+    for(i=0; i < Q_MAX_DEVICE; ++i)
+        atomic_long_set(&global->devmap_tx[i], 0);
+
+    pfq_devmap_tx_hook_update();
+
+    mutex_unlock(&global->devmap_lock);
+}
@@ -64,6 +64,20 @@ unsigned long pfq_devmap_get_groups(int dev, int queue)
 
 extern void pfq_devmap_toggle_update(void);
 
+/* egress (Tx side) bindings, per device */
+
+extern int  pfq_devmap_tx_update(int action, int index, pfq_gid_t gid);
+extern void pfq_devmap_tx_unregister(int index);
+extern void pfq_devmap_tx_reset(void);
+
+
+static inline
+unsigned long pfq_devmap_tx_get_groups(int dev)
+{
+        return (long unsigned)atomic_long_read(&global->devmap_tx[dev & Q_MAX_DEVICE_MASK]);
+}
+
+
 static inline
 int pfq_devmap_toggle_get(int index)
 {
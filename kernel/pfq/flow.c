@@ -0,0 +1,357 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/bitops.h>
+#include <pfq/flow.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/printk.h>
+#include <pfq/sock.h>
+
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/pf_q.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/vmalloc.h>
+
+
+struct pfq_flow_table
+{
+	unsigned long	mask;		/* number of buckets - 1 */
+	unsigned long	timeout;	/* jiffies */
+	uint32_t	seed;
+
+	unsigned long	created;
+	unsigned long	evicted;
+	unsigned long	expired;
+	unsigned long	exported;
+
+	unsigned long	cursor;		/* next slot checked by the timer */
+	struct pfq_flow_table *next;	/* release list */
+
+	struct pfq_flow	slot[];
+};
+
+
+static DEFINE_PER_CPU(struct pfq_flow_table *, pfq_flow_tab);
+static DEFINE_MUTEX(pfq_flow_lock);
+static int pfq_flow_users;
+
+
+static void
+pfq_flow_table_free(void)
+{
+	struct pfq_flow_table *list = NULL, *tab;
+	int cpu;
+
+	/* unpublish the tables first: the timers may be expiring flows */
+
+	for_each_possible_cpu(cpu)
+	{
+		tab = per_cpu(pfq_flow_tab, cpu);
+		per_cpu(pfq_flow_tab, cpu) = NULL;
+
+		if (tab) {
+			tab->next = list;
+			list = tab;
+		}
+	}
+
+	synchronize_rcu();
+
+	while (list) {
+		tab = list;
+		list = tab->next;
+		vfree(tab);
+	}
+}
+
+
+static int
+pfq_flow_table_alloc(void)
+{
+	unsigned long buckets;
+	uint32_t seed;
+	int cpu;
+
+	if (global->flow_table_size <= 0) {
+		printk(KERN_INFO "[PFQ] flow table: disabled (flow_table_size=%d)!\n", global->flow_table_size);
+		return -EPERM;
+	}
+
+	buckets = roundup_pow_of_two(DIV_ROUND_UP(global->flow_table_size, Q_FLOW_WAYS));
+	seed = get_random_int();
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_flow_table *tab;
+
+		tab = vzalloc_node(sizeof(struct pfq_flow_table) + buckets * Q_FLOW_WAYS * sizeof(struct pfq_flow), cpu_to_node(cpu));
+		if (tab == NULL) {
+			printk(KERN_INFO "[PFQ] flow table: out of memory!\n");
+			pfq_flow_table_free();
+			return -ENOMEM;
+		}
+
+		tab->mask = buckets - 1;
+		tab->timeout = msecs_to_jiffies(global->flow_timeout * 1000);
+		tab->seed = seed;
+
+		per_cpu(pfq_flow_tab, cpu) = tab;
+	}
+
+	printk(KERN_INFO "[PFQ] flow table: %lu slots per CPU (%zu bytes), timeout %d sec.\n",
+	       buckets * Q_FLOW_WAYS, buckets * Q_FLOW_WAYS * sizeof(struct pfq_flow), global->flow_timeout);
+	return 0;
+}
+
+
+/*
+ * the flow table is shared by all the computations that make use of it:
+ * allocated by the first user, released by the last one...
+ */
+
+int
+pfq_flow_table_get(void)
+{
+	int ret = 0;
+
+	mutex_lock(&pfq_flow_lock);
+
+	if (pfq_flow_users == 0)
+		ret = pfq_flow_table_alloc();
+	if (ret == 0)
+		pfq_flow_users++;
+
+	mutex_unlock(&pfq_flow_lock);
+	return ret;
+}
+
+
+void
+pfq_flow_table_put(void)
+{
+	mutex_lock(&pfq_flow_lock);
+
+	if (pfq_flow_users > 0 && --pfq_flow_users == 0) {
+		pfq_flow_table_free();
+		printk(KERN_INFO "[PFQ] flow table: released.\n");
+	}
+
+	mutex_unlock(&pfq_flow_lock);
+}
+
+
+bool
+pfq_flow_table_stats(int cpu, struct pfq_flow_stats *stats)
+{
+	struct pfq_flow_table *tab;
+	bool ret = false;
+
+	mutex_lock(&pfq_flow_lock);
+
+	tab = per_cpu(pfq_flow_tab, cpu);
+	if (tab) {
+		unsigned long n, now = jiffies;
+
+		stats->size    = (tab->mask + 1) * Q_FLOW_WAYS;
+		stats->active  = 0;
+		stats->created = tab->created;
+		stats->evicted = tab->evicted;
+		stats->expired = tab->expired;
+		stats->exported = tab->exported;
+
+		for(n = 0; n < stats->size; n++)
+		{
+			struct pfq_flow const *f = &tab->slot[n];
+			if (f->packets && time_before_eq(now, f->last + tab->timeout))
+				stats->active++;
+		}
+
+		ret = true;
+	}
+
+	mutex_unlock(&pfq_flow_lock);
+	return ret;
+}
+
+
+/*
+ * push the record of a flow that ends to the sockets of its group. Times
+ * are converted from jiffies, at their resolution...
+ */
+
+static void
+pfq_flow_export(struct pfq_flow_table *tab, struct pfq_flow const *f, int reason, unsigned long now)
+{
+	struct pfq_flow_record rec;
+	unsigned long mask, bit;
+	uint64_t real = ktime_to_ns(ktime_get_real());
+	bool sent = false;
+
+	rec.saddr     = (__force uint32_t)f->key.saddr;
+	rec.daddr     = (__force uint32_t)f->key.daddr;
+	rec.source    = (__force uint16_t)f->key.source;
+	rec.dest      = (__force uint16_t)f->key.dest;
+	rec.proto     = f->key.proto;
+	rec.gid       = f->key.gid;
+	rec.tcp_flags = f->tcp_flags;
+	rec.reason    = (uint8_t)reason;
+	rec.packets   = f->packets;
+	rec.bytes     = f->bytes;
+	rec.first     = real - (uint64_t)jiffies_to_msecs(now - f->first) * NSEC_PER_MSEC;
+	rec.last      = real - (uint64_t)jiffies_to_msecs(now - f->last) * NSEC_PER_MSEC;
+
+	mask = pfq_group_get_all_sock_mask((__force pfq_gid_t)f->key.gid);
+
+	pfq_bitwise_foreach(mask, bit,
+	{
+		struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)pfq_ctz(bit));
+		if (so && pfq_sock_flow_record(so, &rec))
+			sent = true;
+	});
+
+	if (sent)
+		tab->exported++;
+}
+
+
+/*
+ * expire the idle flows marked for export, a chunk of the table at a time
+ * (per-CPU timer, softirq context)...
+ */
+
+void
+pfq_flow_table_expire(void)
+{
+	struct pfq_flow_table *tab;
+	unsigned long now = jiffies, size, n;
+
+	rcu_read_lock();
+
+	tab = this_cpu_read(pfq_flow_tab);
+	if (tab) {
+		size = (tab->mask + 1) * Q_FLOW_WAYS;
+
+		for(n = 0; n < min_t(unsigned long, size, Q_FLOW_EXPIRE_SCAN); n++)
+		{
+			struct pfq_flow *f = &tab->slot[tab->cursor];
+
+			tab->cursor = (tab->cursor + 1) & (size - 1);
+
+			if (f->packets && f->export && time_after(now, f->last + tab->timeout)) {
+				pfq_flow_export(tab, f, Q_FLOW_END_IDLE, now);
+				f->packets = 0;
+				tab->expired++;
+			}
+		}
+	}
+
+	rcu_read_unlock();
+}
+
+
+/*
+ * lookup the flow of the current CPU, creating it if missing. The packet
+ * (unique id) is accounted once, even when more functions of the computation
+ * look up the same flow...
+ */
+
+struct pfq_flow *
+pfq_flow_lookup(struct pfq_flow_key const *key, uint32_t id, size_t len)
+{
+	struct pfq_flow_table *tab = this_cpu_read(pfq_flow_tab);
+	struct pfq_flow *bucket, *victim, *f;
+	unsigned long now = jiffies;
+	uint32_t hash;
+	int n;
+
+	if (unlikely(tab == NULL))
+		return NULL;
+
+	hash = jhash2((const u32 *)key, sizeof(*key)/sizeof(u32), tab->seed);
+	bucket = &tab->slot[(hash & tab->mask) * Q_FLOW_WAYS];
+	victim = bucket;
+
+	for(n = 0; n < Q_FLOW_WAYS; n++)
+	{
+		f = &bucket[n];
+
+		if (f->packets && f->hash == hash && memcmp(&f->key, key, sizeof(*key)) == 0) {
+
+			if (likely(time_before_eq(now, f->last + tab->timeout)))
+				goto account;
+
+			if (f->export)
+				pfq_flow_export(tab, f, Q_FLOW_END_IDLE, now);
+
+			tab->expired++;
+			goto renew;
+		}
+
+		/* LRU: prefer free slots, then the least recently used */
+
+		if (victim->packets && (f->packets == 0 || time_before(f->last, victim->last)))
+			victim = f;
+	}
+
+	f = victim;
+
+	if (f->packets) {
+		bool idle = time_after(now, f->last + tab->timeout);
+
+		if (f->export)
+			pfq_flow_export(tab, f, idle ? Q_FLOW_END_IDLE : Q_FLOW_END_EVICTED, now);
+
+		if (idle)
+			tab->expired++;
+		else
+			tab->evicted++;
+	}
+
+	f->key  = *key;
+	f->hash = hash;
+renew:
+	f->state     = 0;
+	f->tcp_flags = 0;
+	f->export    = 0;
+	f->first     = now;
+	f->packets   = 0;
+	f->bytes     = 0;
+	tab->created++;
+
+account:
+	if (f->packets == 0 || f->seen != id) {
+		f->seen = id;
+		f->last = now;
+		f->packets++;
+		f->bytes += len;
+	}
+
+	return f;
+}
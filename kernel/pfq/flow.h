@@ -0,0 +1,88 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_FLOW_H
+#define PFQ_FLOW_H
+
+#include <pfq/define.h>
+
+#include <linux/types.h>
+
+
+/*
+ * per-CPU flow table: fixed memory, set-associative buckets of
+ * Q_FLOW_WAYS slots, LRU eviction within the bucket and lazy
+ * timeout (flow_timeout) checked at lookup. Flows marked for export
+ * are also expired by the per-CPU timer, and a record is pushed to the
+ * sockets of their group when they end...
+ */
+
+struct pfq_flow_key
+{
+	__be32		saddr;
+	__be32		daddr;
+	__be16		source;
+	__be16		dest;
+	uint8_t		proto;
+	uint8_t		gid;
+	uint16_t	reserved;
+};
+
+
+struct pfq_flow
+{
+	struct pfq_flow_key key;
+	uint32_t	hash;
+	uint32_t	state;		/* per-flow state (flow_put_state) */
+	uint32_t	seen;		/* unique id of the last accounted packet */
+	uint8_t		tcp_flags;	/* OR of the TCP flags (flow_export) */
+	uint8_t		export;		/* export a record when the flow ends */
+	uint16_t	reserved;
+	unsigned long	first;		/* jiffies */
+	unsigned long	last;		/* jiffies */
+	uint64_t	packets;	/* 0 = free slot */
+	uint64_t	bytes;
+};
+
+
+struct pfq_flow_stats
+{
+	unsigned long	size;
+	unsigned long	active;
+	unsigned long	created;
+	unsigned long	evicted;
+	unsigned long	expired;
+	unsigned long	exported;
+};
+
+
+extern int  pfq_flow_table_get(void);
+extern void pfq_flow_table_put(void);
+extern bool pfq_flow_table_stats(int cpu, struct pfq_flow_stats *stats);
+extern void pfq_flow_table_expire(void);
+
+extern struct pfq_flow *
+pfq_flow_lookup(struct pfq_flow_key const *key, uint32_t id, size_t len);
+
+
+#endif /* PFQ_FLOW_H */
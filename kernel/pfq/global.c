@@ -32,6 +32,10 @@ struct pfq_global_data default_global =
 
 	.xmit_batch_len		= 1,
 	.capt_batch_len		= 1,
+	.lang_batch		= 0,
+	.lang_profile		= 0,
+	.flow_table_size	= 16384,
+	.flow_timeout		= 30,
 
 	.vlan_untag		= 0,
 
@@ -42,14 +46,22 @@ struct pfq_global_data default_global =
 	.tx_cpu_nr		= 0,
 	.tx_retry		= 1,
 
+	.rx_cpu			= {0},
+	.rx_cpu_nr		= 0,
+
 	.socket_ptr		= {{0}},
 	.socket_count		= {0},
      // .socket_lock		= {{0}},
 
 	.devmap			= {{{0}}},
 	.devmap_toggle		= {{0}},
+	.devmap_tx		= {{0}},
+	.devmap_tx_hook		= { NULL },
      // .devmap_lock		= {{0}},
 
+	.rx_fanout		= {{0}},
+	.rx_fanout_nr		= {0},
+
 	.pool_enabled		= {0},
 	.groups			= {{}},
      // .groups_lock		= {{0}},
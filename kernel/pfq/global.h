@@ -35,6 +35,7 @@ struct pfq_kernel_stats __percpu;
 struct pfq_memory_stats __percpu;
 struct pfq_percpu_data  __percpu;
 struct pfq_percpu_pool  __percpu;
+struct packet_type;
 
 
 struct pfq_global_data
@@ -44,6 +45,11 @@ struct pfq_global_data
 
 	int xmit_batch_len;
 	int capt_batch_len;
+	int lang_batch;
+	int lang_profile;
+
+	int flow_table_size;
+	int flow_timeout;
 
 	int skb_tx_pool_size;
 	int skb_rx_pool_size;
@@ -54,14 +60,22 @@ struct pfq_global_data
 	int tx_cpu_nr;
 	int tx_retry;
 
+	int rx_cpu[Q_MAX_CPU];
+	int rx_cpu_nr;
+
 	atomic_long_t   socket_ptr[Q_MAX_ID];
 	atomic_t        socket_count;
 	struct mutex	socket_lock;
 
 	atomic_long_t   devmap [Q_MAX_DEVICE][Q_MAX_QUEUE];
 	atomic_t        devmap_toggle [Q_MAX_DEVICE];
+	atomic_long_t   devmap_tx [Q_MAX_DEVICE];
+	struct packet_type *devmap_tx_hook [Q_MAX_DEVICE];
 	struct mutex	devmap_lock;
 
+	atomic_t	rx_fanout [Q_MAX_DEVICE];
+	atomic_t	rx_fanout_nr;
+
 	atomic_t	pool_enabled;
 
 	struct pfq_group groups[Q_MAX_GID];
@@ -72,8 +72,14 @@ pfq_groups_init(void)
 			goto err;
 		}
 
+		group->shed = alloc_percpu(struct pfq_group_shed_stats);
+		if (group->shed == NULL) {
+			goto err;
+		}
+
 		pfq_group_stats_reset(group->stats);
 		pfq_group_counters_reset(group->counters);
+		pfq_group_shed_stats_reset(group->shed);
 	}
 
 	return 0;
@@ -94,8 +100,10 @@ pfq_groups_destruct(void)
 
 		free_percpu(group->stats);
 		free_percpu(group->counters);
+		free_percpu(group->shed);
 		group->stats = NULL;
 		group->counters = NULL;
+		group->shed = NULL;
 	}
 }
 
@@ -176,11 +184,15 @@ __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
         }
 
         atomic_long_set(&group->bp_filter,0L);
+        atomic_long_set(&group->ebpf_prog,0L);
         atomic_long_set(&group->comp,     0L);
         atomic_long_set(&group->comp_ctx, 0L);
 
 	pfq_group_stats_reset(group->stats);
 	pfq_group_counters_reset(group->counters);
+	pfq_group_shed_stats_reset(group->shed);
+
+	memset(&group->budget, 0, sizeof(group->budget));
 
 	group->vlan_filt = false;
 
@@ -197,6 +209,7 @@ static void
 __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 {
         struct sk_filter *filter;
+        struct bpf_prog *prog;
         struct pfq_lang_computation_tree *old_comp;
         void *old_ctx;
         size_t i;
@@ -204,6 +217,7 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
         /* remove this gid from devmap matrix */
 
         pfq_devmap_update(Q_DEVMAP_RESET, Q_ANY_DEVICE, Q_ANY_QUEUE, gid);
+        pfq_devmap_tx_update(Q_DEVMAP_RESET, Q_ANY_DEVICE, gid);
 
 	group->enabled = false;
 
@@ -212,6 +226,7 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
         group->policy = Q_POLICY_GROUP_UNDEFINED;
 
         filter   = (struct sk_filter *)atomic_long_xchg(&group->bp_filter, 0L);
+        prog     = (struct bpf_prog *)atomic_long_xchg(&group->ebpf_prog, 0L);
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, 0L);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, 0L);
 
@@ -223,17 +238,22 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 		pfq_lang_computation_destruct(old_comp);
 	}
 
-	kfree(old_comp);
+	pfq_lang_computation_free(old_comp);
 	kfree(old_ctx);
 
 	if (filter)
 		pfq_free_sk_filter(filter);
 
+	if (prog)
+		pfq_put_ebpf_prog(prog);
+
         group->vlan_filt = false;
 	for(i = 0; i < 4096; i++) {
 		group->vid_filters[i] = 0;
 	}
 
+	memset(&group->budget, 0, sizeof(group->budget));
+
         printk(KERN_INFO "[PFQ] Group (%d) disabled.\n", gid);
 }
 
@@ -355,6 +375,72 @@ pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter)
 }
 
 
+void
+pfq_group_set_ebpf(pfq_gid_t gid, struct bpf_prog *prog)
+{
+        struct pfq_group * group;
+        struct bpf_prog * old_prog;
+
+	group = pfq_group_get(gid);
+        if (group == NULL) {
+		if (prog)
+			pfq_put_ebpf_prog(prog);
+                return;
+        }
+
+        old_prog = (void *)atomic_long_xchg(&group->ebpf_prog, (long)prog);
+
+        msleep(Q_GRACE_PERIOD);
+
+	if (old_prog)
+		pfq_put_ebpf_prog(old_prog);
+}
+
+
+int
+pfq_group_set_budget(pfq_gid_t gid, struct pfq_group_budget const *budget)
+{
+        struct pfq_group * group;
+
+	group = pfq_group_get(gid);
+        if (group == NULL)
+                return -EINVAL;
+
+        /* budget fields are read locklessly by the receive path: a
+         * transient mix of old and new values is harmless */
+
+        mutex_lock(&global->groups_lock);
+
+        group->budget.shed     = budget->shed;
+        group->budget.sample   = budget->sample;
+        group->budget.priority = budget->priority;
+
+        smp_wmb();
+
+        group->budget.ns_batch = budget->ns_batch;
+        group->budget.pkt_ms   = budget->pkt_ms;
+
+        mutex_unlock(&global->groups_lock);
+        return 0;
+}
+
+
+int
+pfq_group_get_budget(pfq_gid_t gid, struct pfq_group_budget *budget)
+{
+        struct pfq_group * group;
+
+	group = pfq_group_get(gid);
+        if (group == NULL)
+                return -EINVAL;
+
+        mutex_lock(&global->groups_lock);
+        *budget = group->budget;
+        mutex_unlock(&global->groups_lock);
+        return 0;
+}
+
+
 int
 pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *ctx)
 {
@@ -368,6 +454,21 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
 
         mutex_lock(&global->groups_lock);
 
+        /* the running computation keeps going until the new one is published:
+         * carry its state across, then initialize the rest of the functions */
+
+        old_comp = (struct pfq_lang_computation_tree *)atomic_long_read(&group->comp);
+        if (old_comp && comp)
+                pfq_lang_computation_migrate(comp, old_comp);
+
+        if (comp && pfq_lang_computation_init(comp) < 0) {
+                printk(KERN_INFO "[PFQ] Group (%d) computation: initialization aborted!\n", gid);
+                pfq_lang_computation_unmigrate(comp);
+                pfq_lang_computation_destruct(comp);
+                mutex_unlock(&global->groups_lock);
+                return -EPERM;
+        }
+
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, (long)comp);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, (long)ctx);
 
@@ -380,7 +481,7 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
 
         /* free the old computation/context */
 
-        kfree(old_comp);
+        pfq_lang_computation_free(old_comp);
         kfree(old_ctx);
 
         mutex_unlock(&global->groups_lock);
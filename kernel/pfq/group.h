@@ -35,6 +35,18 @@
 
 typedef struct pfq_kernel_stats pfq_group_stats_t;
 struct pfq_group_counters;
+struct pfq_group_shed_stats;
+
+
+struct pfq_group_budget
+{
+	int priority;					/* lower value, higher priority */
+	unsigned int ns_batch;				/* processing time per batch, ns (0 = unlimited) */
+	unsigned int pkt_ms;				/* packets per millisecond (0 = unlimited) */
+	int shed;					/* Q_SHED_SKIP, Q_SHED_SAMPLE */
+	unsigned int sample;				/* Q_SHED_SAMPLE: process 1 packet out of sample */
+};
+
 
 struct pfq_group
 {
@@ -47,6 +59,7 @@ struct pfq_group
         						   Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
 
         atomic_long_t bp_filter;			/* struct sk_filter pointer */
+        atomic_long_t ebpf_prog;			/* struct bpf_prog pointer (eBPF socket filter) */
 
         atomic_long_t comp;                             /* struct pfq_lang_computation_tree *  (new functional program) */
         atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
@@ -54,6 +67,9 @@ struct pfq_group
 	pfq_group_stats_t __percpu *stats;
 	struct pfq_group_counters __percpu *counters;
 
+	struct pfq_group_budget budget;			/* processing budget and overload shedding */
+	struct pfq_group_shed_stats __percpu *shed;
+
         bool   enabled;
         bool   vlan_filt;                               /* enable/disable vlan filtering */
         char   vid_filters[4096];                       /* vlan filters */
@@ -74,6 +90,9 @@ extern unsigned long pfq_group_get_all_sock_mask(pfq_gid_t gid);
 
 extern int  pfq_group_get_context(pfq_gid_t gid, int level, int size, void __user *context);
 extern void pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter);
+extern void pfq_group_set_ebpf(pfq_gid_t gid, struct bpf_prog *prog);
+extern int  pfq_group_set_budget(pfq_gid_t gid, struct pfq_group_budget const *budget);
+extern int  pfq_group_get_budget(pfq_gid_t gid, struct pfq_group_budget *budget);
 
 extern struct pfq_group * pfq_group_get(pfq_gid_t gid);
 
@@ -108,6 +127,13 @@ bool pfq_group_is_free(pfq_gid_t gid)
 }
 
 
+static inline
+bool pfq_group_has_budget(struct pfq_group const *group)
+{
+	return group->budget.ns_batch || group->budget.pkt_ms;
+}
+
+
 static inline
 int pfq_get_tgid(void)
 {
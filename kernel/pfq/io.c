@@ -28,6 +28,13 @@
 #include <net/inet_common.h>
 #endif
 
+#include <linux/version.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+#include <linux/sched/clock.h>
+#else
+#include <linux/sched.h>
+#endif
+
 #include <lang/engine.h>
 #include <lang/symtable.h>
 
@@ -568,7 +575,7 @@ pfq_qbuff_lazy_xmit(struct qbuff * buff, struct net_device *dev, int queue)
 		return 0;
 	}
 
-	skb_set_queue_mapping(QBUFF_SKB(buff), queue);
+	qbuff_set_queue_mapping(buff, queue);
 
 	buff->fwd_dev[buff->fwd_dev_num++] = dev;
 	return 1;
@@ -702,12 +709,609 @@ unsigned int pfq_fold(unsigned int a, unsigned int b)
 }
 
 
+/*
+ * run the filters of a group for this buff, and setup the monad...
+ */
+
+static inline bool
+pfq_receive_group_filter(struct qbuff *buff, struct pfq_group *this_group, pfq_gid_t gid, struct pfq_percpu_pool *pool, int cpu)
+{
+	struct pfq_lang_monad *monad = buff->monad;
+
+	/* check if bp filter is enabled */
+
+	if (atomic_long_read(&this_group->bp_filter)) {
+
+		/* classic BPF runs on skb only */
+
+		if (qbuff_is_xdp(buff) && !qbuff_materialize_skb(buff, &pool->rx)) {
+			__sparse_inc(this_group->stats, lost, cpu);
+			return false;
+		}
+
+		if (!qbuff_run_bp_filter(buff, this_group)) {
+			__sparse_inc(this_group->stats, drop, cpu);
+			return false;
+		}
+	}
+
+	/* check vlan filter */
+
+	if (pfq_group_vlan_filters_enabled(gid)) {
+		if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
+			__sparse_inc(this_group->stats, drop, cpu);
+			return false;
+		}
+	}
+
+	/* setup monad for this group */
+
+	monad->fanout.class_mask = Q_CLASS_DEFAULT;
+	monad->fanout.type = fanout_copy;
+	monad->group = this_group;
+	monad->state = 0;
+	monad->shift = 0;
+	monad->ipoff = 0;
+	monad->ipproto = IPPROTO_NONE;
+	monad->ep_ctx = EPOINT_SRC | EPOINT_DST;
+
+	/* check if eBPF filter is enabled */
+
+	if (atomic_long_read(&this_group->ebpf_prog)) {
+
+		uint32_t verdict;
+
+		if (qbuff_is_xdp(buff) && !qbuff_materialize_skb(buff, &pool->rx)) {
+			__sparse_inc(this_group->stats, lost, cpu);
+			return false;
+		}
+
+		verdict = qbuff_run_ebpf_filter(buff, this_group);
+		if (verdict == Q_EBPF_DROP) {
+			__sparse_inc(this_group->stats, drop, cpu);
+			return false;
+		}
+
+		/* verdicts with the steering bit carry a hash */
+
+		if (verdict != Q_EBPF_PASS && (verdict & Q_EBPF_STEER))
+			Steering(buff, verdict & ~Q_EBPF_STEER);
+	}
+
+	return true;
+}
+
+
+/*
+ * compute the sockets of the group this buff is forwarded to...
+ */
+
+static inline void
+pfq_receive_group_fanout(struct qbuff *buff, struct pfq_group *this_group, bool computation)
+{
+	struct pfq_lang_monad *monad = buff->monad;
+	unsigned long cbit, elig_mask = 0;
+
+	if (!computation && !is_steering(monad->fanout)) {
+		buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
+		return;
+	}
+
+	/* compute the eligible mask of sockets enabled to receive this packet... */
+
+	pfq_bitwise_foreach(monad->fanout.class_mask, cbit,
+	{
+		int class = (int)pfq_ctz(cbit);
+		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
+	});
+
+
+	if (is_steering(monad->fanout)) { /* single or double */
+
+		unsigned long steer_mask[Q_MAX_STEERING_MASK];
+		unsigned int sbit, steer_mask_numb = 0;
+
+		/* compute the load balancing mask list */
+
+		pfq_bitwise_foreach(elig_mask, sbit,
+		{
+			pfq_id_t id = (__force pfq_id_t)pfq_ctz(sbit);
+			struct pfq_sock * so = pfq_sock_get_by_id(id);
+
+			int i, end = so ? so->weight : 1;
+			for(i = 0; i < end; ++i)
+				steer_mask[steer_mask_numb++] = sbit;
+		});
+
+		if (unlikely(!steer_mask_numb))
+			return;
+
+		buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad->fanout.hash), (unsigned int)steer_mask_numb)];
+
+		if (is_double_steering(monad->fanout))
+			buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad->fanout.hash2), (unsigned int)steer_mask_numb)];
+
+	}
+	else {  /* broadcast */
+
+		buff->fwd_mask |= elig_mask;
+	}
+}
+
+
+/*
+ * run a single group for this buff...
+ */
+
+static inline void
+pfq_receive_group(struct qbuff *buff, struct pfq_group *this_group, pfq_gid_t gid, struct pfq_percpu_pool *pool, int cpu)
+{
+	struct pfq_lang_computation_tree *prg;
+
+	if (!pfq_receive_group_filter(buff, this_group, gid, pool, cpu))
+		return;
+
+	/* process pfq-lang */
+
+	prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
+	if (prg) {
+		size_t to_kernel = buff->to_kernel;
+		size_t num_fwd = buff->fwd_dev_num;
+
+		/* run the functional program */
+
+		if (!pfq_lang_run(buff, prg).qbuff) {
+			__sparse_inc(this_group->stats, drop, cpu);
+			return;
+		}
+
+		/* update stats */
+
+		__sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
+		__sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
+
+		/* skip this packet? */
+
+		if (is_drop(buff->monad->fanout)) {
+			__sparse_inc(this_group->stats, drop, cpu);
+			return;
+		}
+	}
+
+	pfq_receive_group_fanout(buff, this_group, prg != NULL);
+}
+
+
+/*
+ * overload shedding: a group whose priority is lower than the one of a
+ * group over budget is skipped, or sampled (one packet out of sample).
+ */
+
+static inline bool
+pfq_receive_shed(struct pfq_percpu_data *data, struct pfq_group *group, struct pfq_group_load *load)
+{
+	if (likely(group->budget.priority <= data->overload_prio))
+		return false;
+
+	if (group->budget.shed == Q_SHED_SAMPLE && ++load->sample >= group->budget.sample) {
+		load->sample = 0;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * charge the group with the cost of this buff, and raise the overload
+ * level of this cpu when the budget is exceeded...
+ */
+
+static inline void
+pfq_receive_charge( struct pfq_percpu_data *data
+		  , struct pfq_group *group
+		  , struct pfq_group_load *load
+		  , u64 start
+		  , unsigned int npkts
+		  , int cpu)
+{
+	if (group->budget.ns_batch)
+		load->batch_ns += local_clock() - start;
+
+	load->window_pkts += npkts;
+
+	if (load->over)
+		return;
+
+	if ((group->budget.ns_batch && load->batch_ns > group->budget.ns_batch) ||
+	    (group->budget.pkt_ms && load->window_pkts > group->budget.pkt_ms)) {
+
+		load->over = true;
+		__sparse_inc(group->shed, over, cpu);
+
+		if (group->budget.priority < data->overload_prio)
+			data->overload_prio = group->budget.priority;
+	}
+}
+
+
+/*
+ * reset the per-batch load of groups, and the overload level every 1 ms...
+ */
+
+static inline void
+pfq_receive_load_reset(struct pfq_percpu_data *data)
+{
+	u64 now = local_clock();
+	int n;
+
+	if (now - data->load_window >= NSEC_PER_MSEC) {
+		for(n = 0; n < Q_MAX_GID; n++) {
+			data->group_load[n].batch_ns = 0;
+			data->group_load[n].window_pkts = 0;
+			data->group_load[n].over = false;
+		}
+		data->overload_prio = INT_MAX;
+		data->load_window = now;
+		return;
+	}
+
+	for(n = 0; n < Q_MAX_GID; n++)
+		data->group_load[n].batch_ns = 0;
+}
+
+
+/*
+ * run the eligible groups for this buff...
+ */
+
+static inline void
+pfq_receive_groups( struct pfq_percpu_data *data
+		  , struct pfq_percpu_pool *pool
+		  , struct qbuff *buff
+		  , unsigned long group_mask
+		  , int cpu)
+{
+	unsigned long bit;
+
+	/* batch-at-a-time evaluation: groups are run by pfq_receive_run */
+
+	if (global->lang_batch) {
+		buff->group_mask = group_mask;
+		return;
+	}
+
+	/* process all groups for this qbuff */
+
+	pfq_bitwise_foreach(group_mask, bit,
+	{
+		pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
+		struct pfq_group * this_group = pfq_group_get(gid);
+		struct pfq_group_load *load;
+		u64 start = 0;
+
+		if (unlikely(!this_group))
+			continue;
+
+		/* increment counter for this group */
+
+		__sparse_inc(this_group->stats, recv, cpu);
+
+		/* a higher priority group is over budget? */
+
+		load = &data->group_load[(__force int)gid];
+
+		if (unlikely(pfq_receive_shed(data, this_group, load))) {
+			__sparse_inc(this_group->shed, shed, cpu);
+			continue;
+		}
+
+		if (this_group->budget.ns_batch)
+			start = local_clock();
+
+		pfq_receive_group(buff, this_group, gid, pool, cpu);
+
+		if (pfq_group_has_budget(this_group))
+			pfq_receive_charge(data, this_group, load, start, 1, cpu);
+	}
+	);
+}
+
+
+/*
+ * run a group over the whole batch: filters are mask operations, and
+ * each node of the computation runs on all the selected buffs before
+ * the next one...
+ */
+
+static inline void
+pfq_receive_group_batch( struct pfq_percpu_data *data
+		       , struct pfq_percpu_pool *pool
+		       , struct pfq_group *this_group
+		       , pfq_gid_t gid
+		       , unsigned __int128 mask
+		       , int cpu)
+{
+	struct pfq_qbuff_queue *queue = PFQ_QBUFF_QUEUE(data->qbuff_queue);
+	struct pfq_group_load *load = &data->group_load[(__force int)gid];
+	struct pfq_lang_computation_tree *prg;
+	unsigned __int128 run = mask, live = 0;
+	size_t num_fwd = 0, to_kernel = 0;
+	unsigned int npkts = 0;
+	struct qbuff *buff;
+	u64 start = 0;
+	size_t n;
+
+	if (this_group->budget.ns_batch)
+		start = local_clock();
+
+	/* filters */
+
+	for_each_qbuff_with_mask(run, queue, buff, n)
+	{
+		__sparse_inc(this_group->stats, recv, cpu);
+
+		if (unlikely(pfq_receive_shed(data, this_group, load))) {
+			__sparse_inc(this_group->shed, shed, cpu);
+			continue;
+		}
+
+		npkts++;
+
+		if (pfq_receive_group_filter(buff, this_group, gid, pool, cpu)) {
+			live |= (unsigned __int128)1 << n;
+			num_fwd += buff->fwd_dev_num;
+			to_kernel += buff->to_kernel;
+		}
+	}
+
+	/* process pfq-lang, a node at a time */
+
+	prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
+	if (prg && live) {
+
+		unsigned __int128 pass = pfq_lang_run_batch(queue, live, prg);
+		size_t num_fwd_run = 0, to_kernel_run = 0;
+
+		/* update stats */
+
+		run = live;
+		for_each_qbuff_with_mask(run, queue, buff, n)
+		{
+			num_fwd_run += buff->fwd_dev_num;
+			to_kernel_run += buff->to_kernel;
+		}
+
+		__sparse_add(this_group->stats, frwd, num_fwd_run - num_fwd, cpu);
+		__sparse_add(this_group->stats, kern, to_kernel_run - to_kernel, cpu);
+		__sparse_add(this_group->stats, drop, pfq_popcount(live & ~pass), cpu);
+
+		live = pass;
+	}
+
+	/* compute the sockets this batch is forwarded to */
+
+	run = live;
+	for_each_qbuff_with_mask(run, queue, buff, n)
+	{
+		pfq_receive_group_fanout(buff, this_group, prg != NULL);
+	}
+
+	if (pfq_group_has_budget(this_group))
+		pfq_receive_charge(data, this_group, load, start, npkts, cpu);
+}
+
+
+/*
+ * batch-at-a-time evaluation of the groups deferred to the queue...
+ */
+
+static inline void
+pfq_receive_batch( struct pfq_percpu_data *data
+		 , struct pfq_percpu_pool *pool
+		 , int cpu)
+{
+	struct pfq_qbuff_queue *queue = PFQ_QBUFF_QUEUE(data->qbuff_queue);
+	unsigned long all_group_mask = 0, bit;
+	unsigned int discarded = 0;
+	struct qbuff *buff;
+	size_t n;
+
+	for_each_qbuff(queue, buff, n)
+	{
+		all_group_mask |= buff->group_mask;
+	}
+
+	if (!all_group_mask)
+		return;
+
+	/* run each group over the buffs it is eligible for */
+
+	pfq_bitwise_foreach(all_group_mask, bit,
+	{
+		pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
+		struct pfq_group * this_group = pfq_group_get(gid);
+		unsigned __int128 mask = 0;
+
+		if (unlikely(!this_group))
+			continue;
+
+		for_each_qbuff(queue, buff, n)
+		{
+			if (buff->group_mask & bit)
+				mask |= (unsigned __int128)1 << n;
+		}
+
+		pfq_receive_group_batch(data, pool, this_group, gid, mask, cpu);
+	});
+
+	for_each_qbuff(queue, buff, n)
+	{
+		if (!buff->group_mask)
+			continue;
+
+		buff->group_mask = 0;
+
+		/* outgoing packets are never passed back to the kernel */
+
+		if (qbuff_get_direction(buff) == Q_DIR_TX)
+			buff->to_kernel = false;
+
+		/* skb-less buffs forwarded or passed to kernel */
+
+		if (qbuff_is_xdp(buff) && (buff->fwd_dev_num || buff->to_kernel)) {
+			if (!qbuff_materialize_skb(buff, &pool->rx)) {
+				__sparse_inc(global->percpu_stats, lost, cpu);
+				buff->fwd_mask = 0;
+				buff->fwd_dev_num = 0;
+				buff->to_kernel = false;
+			}
+		}
+
+		if (!(buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel))
+			discarded++;
+	}
+
+	/* as in per-packet mode, buffs dropped by all the groups are not received */
+
+	__sparse_sub(global->percpu_stats, recv, discarded, cpu);
+}
+
+
+/*
+ * commit the buff to the per-cpu queue (or release it), and run the
+ * queue if the batch is full or the timeout expired...
+ */
+
+static inline int
+pfq_receive_commit( struct pfq_percpu_data *data
+		  , struct pfq_percpu_pool *pool
+		  , struct qbuff *buff
+		  , int cpu)
+{
+	/* get the current timestamp */
+
+	ktime_t current_rx = qbuff_get_ktime(buff);
+
+	/* this packet is ready to be enqueued for transmission or possibly dropped */
+
+	if (buff->group_mask || buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel) {
+		/* commit this buff to the queue */
+		data->qbuff_queue->len++;
+	}
+	else {  /* or drop and release it */
+		qbuff_free(buff, &pool->rx);
+	}
+
+	/* transmit the queue or wait for the next packet? */
+
+	if (data->qbuff_queue->len < (size_t)global->capt_batch_len &&
+	     ktime_to_ns(ktime_sub(current_rx, data->last_rx)) < 1000000) {
+		return 0;
+	}
+
+	data->last_rx = current_rx;
+
+	/* run IO now */
+
+	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
+
+	return pfq_receive_run( data
+			      , pool
+			      , cpu);
+}
+
+
+/*
+ * process an skb (mac header already pushed) on this cpu...
+ */
+
+static inline int
+__pfq_receive_skb( struct pfq_percpu_data *data
+		 , struct pfq_percpu_pool *pool
+		 , struct sk_buff *skb
+		 , int cpu)
+{
+	unsigned long group_mask;
+	struct qbuff *buff;
+
+	/* initialize the qbuff */
+
+	buff = &data->qbuff_queue->queue[data->qbuff_queue->len];
+
+	qbuff_init( buff
+		  , skb
+		  , &data->monad[data->qbuff_queue->len]
+		  , data->counter++);
+
+	/* get the eligible groups */
+
+	group_mask = pfq_devmap_get_groups( qbuff_get_ifindex(buff)
+					  , qbuff_get_rx_queue(buff));
+
+	/* process all the groups for this qbuff */
+
+	pfq_receive_groups(data, pool, buff, group_mask, cpu);
+
+	return pfq_receive_commit(data, pool, buff, cpu);
+}
+
+
+/*
+ * software RSS: the capturing cpu only computes the flow hash, and
+ * hands the packet over to an Rx thread.
+ */
+
+static inline int
+pfq_rx_fanout(struct sk_buff *skb, struct pfq_percpu_pool *pool, int cpu)
+{
+	uint32_t hash;
+	int tid;
+
+	/* the hardware hash is what does not work here: recompute it in software */
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,14,0))
+	skb->rxhash = 0;
+	hash = skb_get_rxhash(skb);
+#else
+	skb_clear_hash(skb);
+	hash = skb_get_hash(skb);
+#endif
+
+	tid = (int)pfq_fold(prefold(hash), (unsigned int)global->rx_cpu_nr);
+
+	/* take back the pool skbs already released by the Rx threads */
+
+	pfq_rx_thread_reclaim(&pool->rx, cpu);
+
+	if (unlikely(pfq_rx_thread_enqueue(tid, skb, cpu) < 0)) {
+		__sparse_inc(global->percpu_stats, lost, cpu);
+		sparse_inc(global->percpu_memory, os_free);
+		pfq_free_skb_pool(skb, &pool->rx);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int
+pfq_receive_fanout(struct sk_buff *skb)
+{
+	int cpu = smp_processor_id();
+
+	return __pfq_receive_skb( per_cpu_ptr(global->percpu_data, cpu)
+				, per_cpu_ptr(global->percpu_pool, cpu)
+				, skb
+				, cpu);
+}
+
+
 int
 pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 {
 	struct pfq_percpu_data * data;
 	struct pfq_percpu_pool * pool;
-	unsigned long bit;
 	int cpu;
 
 	/* if no socket is open drop the packet */
@@ -728,11 +1332,6 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 	if (likely(skb)) /* ensure this is not the timer heartbeat */
 	{
-		struct pfq_lang_monad monad;
-		unsigned long group_mask;
-		struct qbuff *buff;
-		ktime_t current_rx;
-
 		/* if required, timestamp the packet now */
 		if (ktime_to_ns(skb->tstamp) == 0)
 			__net_timestamp(skb);
@@ -752,173 +1351,239 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 		skb_push(skb, skb->mac_len);
 
-		/* initialize the qbuff */
+		/* redistribute the packet to the Rx threads? */
 
-		buff = &data->qbuff_queue->queue[data->qbuff_queue->len];
+		if (atomic_read(&global->rx_fanout[skb->dev->ifindex & Q_MAX_DEVICE_MASK]))
+			return pfq_rx_fanout(skb, pool, cpu);
 
-		qbuff_init( buff
-			  , skb
-			  , &monad
-			  , data->counter++);
+		return __pfq_receive_skb(data, pool, skb, cpu);
+	}
 
-		/* get the eligible groups */
+	/* timer heartbeat */
 
-		group_mask = pfq_devmap_get_groups( qbuff_get_ifindex(buff)
-						  , qbuff_get_rx_queue(buff));
+	if (global->rx_cpu_nr)
+		pfq_rx_thread_reclaim(&pool->rx, cpu);
 
+	if (data->qbuff_queue->len == 0)
+		return 0;
 
-		/* process all groups for this qbuff */
+	/* run IO now */
 
-		pfq_bitwise_foreach(group_mask, bit,
-		{
-			pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
-			struct pfq_group * this_group = pfq_group_get(gid);
-			struct pfq_lang_computation_tree *prg;
+	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
 
-			if (unlikely(!this_group))
-				continue;
+	return pfq_receive_run( data
+			      , pool
+			      , cpu);
+}
 
-			/* increment counter for this group */
 
-			__sparse_inc(this_group->stats, recv, cpu);
 
-			/* check if bp filter is enabled */
+/*
+ * skb-less receive: the frame (e.g. an XDP buffer) is owned by the driver,
+ * which must call pfq_receive_xdp_flush() at the end of the NAPI poll,
+ * before recycling its pages. An skb is allocated only if the packet is
+ * forwarded or passed to the kernel.
+ */
 
-			if (atomic_long_read(&this_group->bp_filter)) {
-				if (!qbuff_run_bp_filter(buff, this_group)) {
-					__sparse_inc(this_group->stats, drop, cpu);
-					continue;
-				}
-			}
+int
+pfq_receive_xdp(struct net_device *dev, void *pkt, void *pkt_end, uint16_t rx_queue, uint32_t hash)
+{
+	struct pfq_percpu_data * data;
+	struct pfq_percpu_pool * pool;
+	unsigned long group_mask;
+	struct qbuff *buff;
+	ktime_t current_rx;
+	int cpu;
 
-			/* check vlan filter */
+	if (unlikely(pfq_sock_counter() == 0))
+		return 0;
 
-			if (pfq_group_vlan_filters_enabled(gid)) {
-				if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
-					__sparse_inc(this_group->stats, drop, cpu);
-					continue;
-				}
-			}
+	if (unlikely((pkt_end - pkt) < ETH_HLEN))
+		return -1;
 
-			/* process pfq-lang */
+        cpu = smp_processor_id();
+	pool = per_cpu_ptr(global->percpu_pool, cpu);
+	data = per_cpu_ptr(global->percpu_data, cpu);
 
-			prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
-			if (prg) {
-				unsigned long cbit, elig_mask = 0;
-				size_t to_kernel = buff->to_kernel;
-				size_t num_fwd = buff->fwd_dev_num;
+	/* initialize the qbuff */
 
-			 	/* setup monad for this computation */
+	buff = &data->qbuff_queue->queue[data->qbuff_queue->len];
 
-			 	monad.fanout.class_mask = Q_CLASS_DEFAULT;
-			 	monad.fanout.type = fanout_copy;
-			 	monad.group = this_group;
-			 	monad.state = 0;
-			 	monad.shift = 0;
-			 	monad.ipoff = 0;
-			 	monad.ipproto = IPPROTO_NONE;
-			 	monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
+	qbuff_init_xdp( buff
+		      , dev
+		      , pkt
+		      , pkt_end
+		      , rx_queue
+		      , hash
+		      , &data->monad[data->qbuff_queue->len]
+		      , data->counter++);
 
-			 	/* run the functional program */
+	/* process all the groups for this qbuff */
 
-			 	if (!pfq_lang_run(buff, prg).qbuff) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+	group_mask = pfq_devmap_get_groups(dev->ifindex, rx_queue);
 
-			 	/* update stats */
+	pfq_receive_groups(data, pool, buff, group_mask, cpu);
 
-                                 __sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
-                                 __sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
+	/* not delivered: release the skb the group filters may have materialized */
 
-			 	/* skip this packet? */
+	if (!(buff->group_mask || buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel)) {
+		qbuff_free(buff, &pool->rx);
+		return 0;
+	}
 
-			 	if (is_drop(monad.fanout)) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+	/* forwarded or passed to kernel: materialize the skb now */
 
-			 	/* compute the eligible mask of sockets enabled to receive this packet... */
+	if (buff->fwd_dev_num || buff->to_kernel) {
+		if (!qbuff_materialize_skb(buff, &pool->rx)) {
+			__sparse_inc(global->percpu_stats, lost, cpu);
+			buff->fwd_dev_num = 0;
+			buff->to_kernel = false;
 
-			 	pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
-			 	{
-			 		int class = (int)pfq_ctz(cbit);
-			 		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
-			 	});
+			/* the sockets still get the packet */
 
+			if (!(buff->group_mask || buff->fwd_mask))
+				return -1;
+		}
+	}
 
-			 	if (is_steering(monad.fanout)) { /* single or double */
+	/* commit this buff to the queue */
 
-			 		unsigned long steer_mask[Q_MAX_STEERING_MASK];
-			 		unsigned int sbit, steer_mask_numb = 0;
+	data->qbuff_queue->len++;
 
-					/* compute the load balancing mask list */
+	/* run the queue if the batch is full or the timeout expired */
 
-			 		pfq_bitwise_foreach(elig_mask, sbit,
-			 		{
-			 			pfq_id_t id = (__force pfq_id_t)pfq_ctz(sbit);
-			 			struct pfq_sock * so = pfq_sock_get_by_id(id);
+	current_rx = qbuff_get_ktime(buff);
 
-						int i, end = so ? so->weight : 1;
-						for(i = 0; i < end; ++i)
-							steer_mask[steer_mask_numb++] = sbit;
-			 		});
+	if (data->qbuff_queue->len < (size_t)global->capt_batch_len &&
+	     ktime_to_ns(ktime_sub(current_rx, data->last_rx)) < 1000000) {
+		return 0;
+	}
 
-					buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad.fanout.hash), (unsigned int)steer_mask_numb)];
+	data->last_rx = current_rx;
 
-					if (is_double_steering(monad.fanout))
-						buff->fwd_mask |= steer_mask[pfq_fold(prefold(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
+	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
 
-			 	}
-			 	else {  /* broadcast */
+	return pfq_receive_run(data, pool, cpu);
+}
 
-			 		buff->fwd_mask |= elig_mask;
-			 	}
 
-			} else {
-				buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
-			}
-		}
-		);
+int
+pfq_receive_xdp_flush(void)
+{
+	struct pfq_percpu_data * data;
+	int cpu = smp_processor_id();
+
+	data = per_cpu_ptr(global->percpu_data, cpu);
+	if (data->qbuff_queue->len == 0)
+		return 0;
 
-		/* get the current timestamp */
+	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
 
-		current_rx = qbuff_get_ktime(buff);
+	return pfq_receive_run( data
+			      , per_cpu_ptr(global->percpu_pool, cpu)
+			      , cpu);
+}
 
-		/* this packet is ready to be enqueued for transmission or possibly dropped */
 
-		if (buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel) {
-			/* commit this buff to the queue */
-			data->qbuff_queue->len++;
-		}
-		else {  /* or drop and release it */
-			qbuff_free(buff, &pool->rx);
-		}
+/*
+ * egress (Tx side) capture: the packet is the clone made by dev_queue_xmit_nit
+ * (shared among all the taps of the device), batched into the same per-cpu
+ * queue of Rx.
+ */
 
-		/* transmit the queue or wait for the next packet? */
+int
+pfq_receive_tx(struct sk_buff *skb)
+{
+	struct pfq_percpu_data * data;
+	struct pfq_percpu_pool * pool;
+	unsigned long group_mask;
+	struct qbuff *buff;
+	int cpu;
 
-		if (data->qbuff_queue->len < (size_t)global->capt_batch_len &&
-		     ktime_to_ns(ktime_sub(current_rx, data->last_rx)) < 1000000) {
-			return 0;
-		}
+        cpu = smp_processor_id();
+	pool = per_cpu_ptr(global->percpu_pool, cpu);
+	data = per_cpu_ptr(global->percpu_data, cpu);
 
-		data->last_rx = current_rx;
+	group_mask = pfq_devmap_tx_get_groups(skb->dev->ifindex);
+
+	if (unlikely(pfq_sock_counter() == 0 || !group_mask)) {
+		sparse_inc(global->percpu_memory, os_free);
+		kfree_skb(skb);
+		return 0;
 	}
-	else {
-		if (data->qbuff_queue->len == 0)
-			return 0;
+
+	/* the clone is shared with the other taps: get a private one before
+	 * any write (data is made writable on demand, see qbuff_make_writable) */
+
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (unlikely(skb == NULL)) {
+		__sparse_inc(global->percpu_stats, lost, cpu);
+		return -1;
 	}
 
-	/* run IO now */
+	/* transmitted while the queue of this cpu is running (e.g. a reply to
+	 * a packet passed to the kernel): defer it */
 
-	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
+	if (unlikely(data->running)) {
+		if (skb_queue_len(&data->egress_backlog) >= Q_BUFF_QUEUE_LEN) {
+			__sparse_inc(global->percpu_stats, lost, cpu);
+			sparse_inc(global->percpu_memory, os_free);
+			kfree_skb(skb);
+			return -1;
+		}
 
-	return pfq_receive_run( data
-			      , pool
-			      , cpu);
+		__skb_queue_tail(&data->egress_backlog, skb);
+		return 0;
+	}
+
+	/* if required, timestamp the packet now */
+
+	if (ktime_to_ns(skb->tstamp) == 0)
+		__net_timestamp(skb);
+
+	/* skb->data already points to the mac header */
+
+	skb_reset_mac_len(skb);
+
+	/* initialize the qbuff */
+
+	buff = &data->qbuff_queue->queue[data->qbuff_queue->len];
+
+	qbuff_init( buff
+		  , skb
+		  , &data->monad[data->qbuff_queue->len]
+		  , data->counter++);
+
+	/* process all the groups bound to the egress of this device */
+
+	pfq_receive_groups(data, pool, buff, group_mask, cpu);
+
+	/* outgoing packets are never passed back to the kernel */
+
+	buff->to_kernel = false;
+
+	return pfq_receive_commit(data, pool, buff, cpu);
 }
 
 
+/*
+ * the egress hook is an ETH_P_ALL tap registered on each device bound to
+ * some group (see pfq_devmap_tx_hook_update). Taps are delivered the Rx
+ * packets of the device as well: those are released at once, with no work
+ * done (and are not accounted as drops)...
+ */
+
+int
+pfq_egress_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev)
+{
+	if (likely(skb->pkt_type != PACKET_OUTGOING)) {
+		consume_skb(skb);
+		return 0;
+	}
+
+	return pfq_receive_tx(skb);
+}
+
 
 int pfq_receive_run( struct pfq_percpu_data *data
 		   , struct pfq_percpu_pool *pool
@@ -928,6 +1593,7 @@ int pfq_receive_run( struct pfq_percpu_data *data
 	unsigned long long all_fwd_mask = 0;
 	struct pfq_endpoint_info endpoints;
         struct qbuff *buff;
+        struct sk_buff *skb;
         unsigned int bit;
 	size_t n;
 
@@ -942,6 +1608,12 @@ int pfq_receive_run( struct pfq_percpu_data *data
 	return 0;
 #endif
 
+	data->running = true;
+
+	/* run the groups deferred to this batch */
+
+	pfq_receive_batch(data, pool, cpu);
+
 	/* transpose the forward matrix */
 
 	for(n = 0; n < data->qbuff_queue->len; n++)
@@ -980,7 +1652,7 @@ int pfq_receive_run( struct pfq_percpu_data *data
 
  	for_each_qbuff(PFQ_QBUFF_QUEUE(data->qbuff_queue), buff, n)
  	{
- 		if (fwd_to_kernel(buff)) {
+ 		if (fwd_to_kernel(buff) && !qbuff_is_xdp(buff)) {
 
  			bool peeked = QBUFF_SKB(buff)->peeked;
 
@@ -999,16 +1671,33 @@ int pfq_receive_run( struct pfq_percpu_data *data
  	}
 
 	data->qbuff_queue->len = 0;
+	data->running = false;
+
+	/* a new batch begins: reset the load of groups */
+
+	pfq_receive_load_reset(data);
+
+	/* capture the egress packets deferred meanwhile */
+
+	while ((skb = __skb_dequeue(&data->egress_backlog)))
+		pfq_receive_tx(skb);
+
 	return 0;
 }
 
 
 
 static inline
-int pfq_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
+int pfq_copy_bits(const struct qbuff *buff, int offset, void *to, int len)
 {
-	int data = skb_headroom(skb);
-	int end = pfq_skb_end_offset(skb);
+	const struct sk_buff *skb = QBUFF_SKB(buff);
+	int data, end;
+
+	if (qbuff_is_xdp(buff))
+		return qbuff_copy_bits(buff, offset, to, len);
+
+	data = skb_headroom(skb);
+	end = pfq_skb_end_offset(skb);
 
 	if (likely(len <= (end - data - offset))) {
 		skb_copy_from_linear_data_offset(skb, offset, to, len);
@@ -1045,13 +1734,12 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 
 	for_each_qbuff_with_mask(mask, buffs, buff, n)
 	{
-		struct sk_buff *skb = QBUFF_SKB(buff);
 		size_t bytes, slot_index;
 		char *pkt;
 
 		/* compute the boundaries */
 
-		bytes = min_t(size_t, skb->len, so->tx_len);
+		bytes = min_t(size_t, qbuff_len(buff), so->tx_len);
 		pkt = (char *)(hdr+1);
 		slot_index = qlen + copied;
 
@@ -1070,36 +1758,36 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 
 		/* copy bytes of packet */
 #if 1
-		if (pfq_copy_bits(skb, 0, pkt, bytes) != 0) {
-			printk(KERN_WARNING "[PFQ] error: BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
-			       bytes, skb->len, skb->mac_len);
+		if (pfq_copy_bits(buff, 0, pkt, bytes) != 0) {
+			printk(KERN_WARNING "[PFQ] error: BUG! skb_copy_bits failed (bytes=%zu, skb_len=%u mac_len=%zu)!\n",
+			       bytes, qbuff_len(buff), qbuff_maclen(buff));
 			return copied;
 		}
 #else
-		skb_copy_from_linear_data_offset(skb, 0, pkt, bytes);
+		skb_copy_from_linear_data_offset(QBUFF_SKB(buff), 0, pkt, bytes);
 #endif
 
 		/* fill pkt header */
 
 		if (likely(so->tstamp != 0)) {
-			struct timespec ts;
-			skb_get_timestampns(skb, &ts);
+			struct timespec ts = ktime_to_timespec(qbuff_get_ktime(buff));
 			hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
 			hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
 		}
 
 		hdr->caplen = (uint16_t)bytes;
-		hdr->len = (uint16_t)skb->len;
+		hdr->len = (uint16_t)qbuff_len(buff);
 
 		/* copy state from pfq_cb annotation */
 
-		hdr->info.data.mark  = skb->mark;
+		hdr->info.data.mark  = qbuff_get_mark(buff);
 
 		/* setup the header */
 
-		hdr->info.ifindex = skb->dev->ifindex;
-		hdr->info.vlan.tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
-		hdr->info.queue	= skb_rx_queue_recorded(skb) ? (uint16_t)skb_get_rx_queue(skb) : 0;
+		hdr->info.ifindex = qbuff_get_ifindex(buff);
+		hdr->info.vlan.tci = qbuff_vlan_tci(buff) & ~VLAN_TAG_PRESENT;
+		hdr->info.queue	= qbuff_get_rx_queue(buff);
+		hdr->info.dir	= (uint8_t)qbuff_get_direction(buff);
 
 		/* commit the slot (release semantic) */
 
@@ -63,7 +63,7 @@ typedef union
 
 struct sk_buff;
 struct napi_struct;
-struct napi_struct;
+struct packet_type;
 
 
 extern size_t pfq_sk_queue_recv( struct pfq_sock *so
@@ -121,8 +121,14 @@ extern int pfq_qbuff_lazy_xmit_run(struct pfq_qbuff_queue *queue, struct pfq_end
 /* receive */
 
 extern int pfq_receive(struct napi_struct *napi, struct sk_buff * skb);
+extern int pfq_receive_xdp(struct net_device *dev, void *pkt, void *pkt_end, uint16_t rx_queue, uint32_t hash);
+extern int pfq_receive_xdp_flush(void);
+extern int pfq_receive_tx(struct sk_buff *skb);
+extern int pfq_receive_fanout(struct sk_buff *skb);
 extern int pfq_receive_run( struct pfq_percpu_data *data , struct pfq_percpu_pool *pool , int cpu);
 
+extern int pfq_egress_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev);
+
 #endif /* PFQ_IO_H */
 
 
@@ -0,0 +1,572 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/cuckoo.h>
+#include <pfq/maps.h>
+#include <pfq/printk.h>
+#include <pfq/sparse.h>
+
+#include <linux/bitops.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+
+#define Q_MAP_MAX_ENTRIES	(1U << 24)
+#define Q_MAP_MAX_PREFIX	(Q_MAP_KEY_LEN << 3)
+
+
+struct pfq_map_stats
+{
+	local_t		lookup;
+	local_t		hit;
+};
+
+
+struct pfq_map_node
+{
+	struct hlist_node	hlist;
+	struct rcu_head		rcu;
+	uint64_t		value;
+	uint32_t		prefix;
+	uint8_t			key[Q_MAP_KEY_LEN];
+};
+
+
+struct pfq_map
+{
+	pfq_id_t		owner;					/* creating socket */
+	int			type;
+	int			key_size;
+	unsigned int		max_entries;
+	unsigned long		count;
+	uint32_t		seed;
+
+	struct pfq_map_stats __percpu *stats;
+
+	DECLARE_BITMAP(prefix_mask, Q_MAP_MAX_PREFIX + 1);	/* prefix lengths in use (Q_MAP_LPM) */
+	unsigned int		prefix_count[Q_MAP_MAX_PREFIX + 1];
+
+	uint64_t		*array;					/* Q_MAP_ARRAY */
+	struct hlist_head	*bucket;				/* Q_MAP_HASH, Q_MAP_LPM (and exact keys of Q_MAP_CUCKOO) */
+	unsigned long		mask;
+
+	struct pfq_cuckoo	filter;					/* Q_MAP_CUCKOO */
+};
+
+
+/*
+ * maps are published with RCU: functions look them up by id from the
+ * packet path, while updates from user space are serialized by the mutex.
+ * A map is owned by the socket that created it: only the owner updates or
+ * destroys it, and it is destroyed when the owner is released...
+ */
+
+static struct pfq_map __rcu *pfq_maps[Q_MAX_MAP];
+static DEFINE_MUTEX(pfq_maps_lock);
+
+
+static inline void
+pfq_map_mask_key(uint8_t *out, const uint8_t *key, int key_size, uint32_t prefix)
+{
+	int n;
+
+	for(n = 0; n < key_size; n++)
+	{
+		int bits = (int)prefix - (n << 3);
+		out[n] = bits >= 8 ? key[n] :
+			 bits <= 0 ? 0    : key[n] & (uint8_t)(0xff << (8 - bits));
+	}
+}
+
+
+static inline struct pfq_map_node *
+__pfq_map_find(struct pfq_map *map, const uint8_t *key, uint32_t prefix)
+{
+	struct pfq_map_node *node;
+	uint32_t hash = jhash(key, map->key_size, map->seed ^ prefix);
+
+	hlist_for_each_entry_rcu(node, &map->bucket[hash & map->mask], hlist)
+	{
+		if (node->prefix == prefix && memcmp(node->key, key, map->key_size) == 0)
+			return node;
+	}
+
+	return NULL;
+}
+
+
+static void
+pfq_map_free(struct pfq_map *map)
+{
+	if (map->bucket) {
+		struct pfq_map_node *node;
+		struct hlist_node *tmp;
+		unsigned long n;
+
+		for(n = 0; n <= map->mask; n++)
+		{
+			hlist_for_each_entry_safe(node, tmp, &map->bucket[n], hlist)
+				kfree(node);
+		}
+	}
+
+	if (map->filter.slot)
+		pfq_cuckoo_free(&map->filter);
+
+	vfree(map->bucket);
+	vfree(map->array);
+	free_percpu(map->stats);
+	kfree(map);
+}
+
+
+int
+pfq_map_create(pfq_id_t owner, int id, int type, int key_size, unsigned int max_entries)
+{
+	struct pfq_map *map;
+	int err = 0;
+
+	if (id < 0 || id >= Q_MAX_MAP)
+		return -EINVAL;
+
+	if (type != Q_MAP_HASH && type != Q_MAP_ARRAY && type != Q_MAP_LPM && type != Q_MAP_CUCKOO)
+		return -EINVAL;
+
+	if (type == Q_MAP_ARRAY)
+		key_size = sizeof(uint32_t);
+
+	if (key_size <= 0 || key_size > Q_MAP_KEY_LEN ||
+	    max_entries == 0 || max_entries > Q_MAP_MAX_ENTRIES)
+		return -EINVAL;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (map == NULL)
+		return -ENOMEM;
+
+	map->owner = owner;
+	map->type = type;
+	map->key_size = key_size;
+	map->max_entries = max_entries;
+	map->seed = get_random_int();
+
+	map->stats = alloc_percpu(struct pfq_map_stats);
+	if (map->stats == NULL) {
+		err = -ENOMEM;
+		goto err;
+	}
+
+	if (type == Q_MAP_ARRAY) {
+		map->array = vzalloc(max_entries * sizeof(uint64_t));
+		if (map->array == NULL) {
+			err = -ENOMEM;
+			goto err;
+		}
+	}
+	else {
+		unsigned long buckets = roundup_pow_of_two(max_entries);
+
+		map->bucket = vzalloc(buckets * sizeof(struct hlist_head));
+		if (map->bucket == NULL) {
+			err = -ENOMEM;
+			goto err;
+		}
+		map->mask = buckets - 1;
+	}
+
+	if (type == Q_MAP_CUCKOO) {
+		err = pfq_cuckoo_init(&map->filter, max_entries);
+		if (err < 0)
+			goto err;
+	}
+
+	mutex_lock(&pfq_maps_lock);
+
+	if (rcu_access_pointer(pfq_maps[id]))
+		err = -EBUSY;
+	else
+		rcu_assign_pointer(pfq_maps[id], map);
+
+	mutex_unlock(&pfq_maps_lock);
+
+	if (err == 0) {
+		pr_devel("[PFQ] map %d: type=%d key_size=%d max_entries=%u created.\n", id, type, key_size, max_entries);
+		return 0;
+	}
+err:
+	pfq_map_free(map);
+	return err;
+}
+
+
+static int
+__pfq_map_destroy(int id, pfq_id_t owner, bool any)
+{
+	struct pfq_map *map;
+
+	if (id < 0 || id >= Q_MAX_MAP)
+		return -EINVAL;
+
+	mutex_lock(&pfq_maps_lock);
+
+	map = rcu_dereference_protected(pfq_maps[id], lockdep_is_held(&pfq_maps_lock));
+	if (map && !any && map->owner != owner) {
+		mutex_unlock(&pfq_maps_lock);
+		return -EACCES;
+	}
+
+	RCU_INIT_POINTER(pfq_maps[id], NULL);
+	mutex_unlock(&pfq_maps_lock);
+
+	if (map == NULL)
+		return -ENOENT;
+
+	synchronize_rcu();
+	pfq_map_free(map);
+
+	pr_devel("[PFQ] map %d: destroyed.\n", id);
+	return 0;
+}
+
+
+int
+pfq_map_destroy(pfq_id_t owner, int id)
+{
+	return __pfq_map_destroy(id, owner, false);
+}
+
+
+void
+pfq_maps_release(pfq_id_t owner)
+{
+	int id;
+
+	for(id = 0; id < Q_MAX_MAP; id++)
+	{
+		if (__pfq_map_destroy(id, owner, false) == 0)
+			pr_devel("[PFQ|%d] map %d: released.\n", owner, id);
+	}
+}
+
+
+void
+pfq_maps_destruct(void)
+{
+	int id;
+
+	for(id = 0; id < Q_MAX_MAP; id++)
+		__pfq_map_destroy(id, (__force pfq_id_t)0, true);
+}
+
+
+static int
+__pfq_map_update(struct pfq_map *map, struct pfq_map_entry const *entry)
+{
+	struct pfq_map_node *node;
+	uint8_t key[Q_MAP_KEY_LEN];
+	uint32_t prefix, hash;
+
+	if (map->type == Q_MAP_ARRAY) {
+		uint32_t idx;
+		memcpy(&idx, entry->key, sizeof(idx));
+		if (idx >= map->max_entries)
+			return -ERANGE;
+		WRITE_ONCE(map->array[idx], entry->value);
+		return 0;
+	}
+
+	prefix = map->type == Q_MAP_LPM ? entry->prefix : (uint32_t)map->key_size << 3;
+	if (prefix > ((uint32_t)map->key_size << 3))
+		return -EINVAL;
+
+	pfq_map_mask_key(key, entry->key, map->key_size, prefix);
+
+	node = __pfq_map_find(map, key, prefix);
+	if (node) {
+		WRITE_ONCE(node->value, entry->value);
+		return 0;
+	}
+
+	if (map->count >= map->max_entries)
+		return -ENOSPC;
+
+	node = kzalloc(sizeof(*node), GFP_KERNEL);
+	if (node == NULL)
+		return -ENOMEM;
+
+	/* cuckoo filters hold a fingerprint for each member, whose exact key
+	 * is kept here: a key is added (and deleted) once, and the deletion
+	 * of a key never takes the fingerprint of another one */
+
+	if (map->type == Q_MAP_CUCKOO) {
+		int err = pfq_cuckoo_insert(&map->filter, key, map->key_size);
+		if (err < 0) {
+			kfree(node);
+			return err;
+		}
+	}
+
+	memcpy(node->key, key, map->key_size);
+	node->prefix = prefix;
+	node->value = entry->value;
+
+	hash = jhash(key, map->key_size, map->seed ^ prefix);
+	hlist_add_head_rcu(&node->hlist, &map->bucket[hash & map->mask]);
+
+	if (map->prefix_count[prefix]++ == 0)
+		set_bit(prefix, map->prefix_mask);
+
+	map->count++;
+	return 0;
+}
+
+
+static int
+__pfq_map_delete(struct pfq_map *map, struct pfq_map_entry const *entry)
+{
+	struct pfq_map_node *node;
+	uint8_t key[Q_MAP_KEY_LEN];
+	uint32_t prefix;
+
+	if (map->type == Q_MAP_ARRAY) {
+		uint32_t idx;
+		memcpy(&idx, entry->key, sizeof(idx));
+		if (idx >= map->max_entries)
+			return -ERANGE;
+		WRITE_ONCE(map->array[idx], 0);
+		return 0;
+	}
+
+	prefix = map->type == Q_MAP_LPM ? entry->prefix : (uint32_t)map->key_size << 3;
+	if (prefix > ((uint32_t)map->key_size << 3))
+		return -EINVAL;
+
+	pfq_map_mask_key(key, entry->key, map->key_size, prefix);
+
+	node = __pfq_map_find(map, key, prefix);
+	if (node == NULL)
+		return 0;
+
+	if (map->type == Q_MAP_CUCKOO)
+		pfq_cuckoo_delete(&map->filter, key, map->key_size);
+
+	hlist_del_rcu(&node->hlist);
+
+	if (--map->prefix_count[prefix] == 0)
+		clear_bit(prefix, map->prefix_mask);
+
+	map->count--;
+	kfree_rcu(node, rcu);
+	return 0;
+}
+
+
+/*
+ * apply a batch of updates (or deletions) to the map: entries are applied
+ * in order, and the first error aborts the rest of the batch...
+ */
+
+int
+pfq_map_update(pfq_id_t owner, int id, int op, struct pfq_map_entry const *entry, size_t n)
+{
+	struct pfq_map *map;
+	size_t i;
+	int err = 0;
+
+	if (id < 0 || id >= Q_MAX_MAP)
+		return -EINVAL;
+
+	if (op != Q_MAP_UPDATE && op != Q_MAP_DELETE)
+		return -EINVAL;
+
+	mutex_lock(&pfq_maps_lock);
+
+	map = rcu_dereference_protected(pfq_maps[id], lockdep_is_held(&pfq_maps_lock));
+	if (map == NULL)
+		err = -ENOENT;
+	else if (map->owner != owner)
+		err = -EACCES;
+
+	for(i = 0; err == 0 && i < n; i++)
+		err = op == Q_MAP_UPDATE ? __pfq_map_update(map, &entry[i])
+					 : __pfq_map_delete(map, &entry[i]);
+
+	mutex_unlock(&pfq_maps_lock);
+	return err;
+}
+
+
+int
+pfq_map_info(int id, struct pfq_map_info *info)
+{
+	struct pfq_map *map;
+	int err = 0;
+
+	if (id < 0 || id >= Q_MAX_MAP)
+		return -EINVAL;
+
+	mutex_lock(&pfq_maps_lock);
+
+	map = rcu_dereference_protected(pfq_maps[id], lockdep_is_held(&pfq_maps_lock));
+	if (map) {
+		info->id	  = id;
+		info->type	  = map->type;
+		info->key_size	  = map->key_size;
+		info->max_entries = map->max_entries;
+		info->count	  = map->type == Q_MAP_ARRAY ? map->max_entries : map->count;
+		info->lookup	  = (unsigned long)sparse_read(map->stats, lookup);
+		info->hit	  = (unsigned long)sparse_read(map->stats, hit);
+		info->slots	  = map->max_entries;
+		info->fpr	  = 0;
+
+		if (map->type == Q_MAP_CUCKOO) {
+			info->count = map->filter.count;
+			info->slots = pfq_cuckoo_slots(&map->filter);
+			info->fpr   = pfq_cuckoo_fpr(&map->filter);
+		}
+	}
+	else
+		err = -ENOENT;
+
+	mutex_unlock(&pfq_maps_lock);
+	return err;
+}
+
+
+static inline bool
+__pfq_map_lookup(struct pfq_map *map, const uint8_t *key, uint64_t *value)
+{
+	struct pfq_map_node *node = NULL;
+
+	switch(map->type)
+	{
+	case Q_MAP_ARRAY: {
+		uint32_t idx;
+		memcpy(&idx, key, sizeof(idx));
+		if (idx < map->max_entries) {
+			*value = READ_ONCE(map->array[idx]);
+			return true;
+		}
+	} break;
+	case Q_MAP_HASH: {
+		node = __pfq_map_find(map, key, (uint32_t)map->key_size << 3);
+	} break;
+	case Q_MAP_CUCKOO: {
+		*value = 1;
+		return pfq_cuckoo_contains(&map->filter, key, map->key_size);
+	}
+	case Q_MAP_LPM: {
+		uint8_t masked[Q_MAP_KEY_LEN];
+		int prefix;
+
+		for(prefix = map->key_size << 3; prefix >= 0 && node == NULL; prefix--)
+		{
+			if (!test_bit(prefix, map->prefix_mask))
+				continue;
+
+			pfq_map_mask_key(masked, key, map->key_size, (uint32_t)prefix);
+			node = __pfq_map_find(map, masked, (uint32_t)prefix);
+		}
+	} break;
+	}
+
+	if (node) {
+		*value = READ_ONCE(node->value);
+		return true;
+	}
+
+	return false;
+}
+
+
+bool
+pfq_map_lookup(int id, const void *key, int key_size, uint64_t *value)
+{
+	struct pfq_map *map;
+	bool ret = false;
+
+	if (unlikely(id < 0 || id >= Q_MAX_MAP))
+		return false;
+
+	rcu_read_lock();
+
+	map = rcu_dereference(pfq_maps[id]);
+	if (likely(map && map->key_size == key_size)) {
+		sparse_inc(map->stats, lookup);
+		ret = __pfq_map_lookup(map, key, value);
+		if (ret)
+			sparse_inc(map->stats, hit);
+	}
+
+	rcu_read_unlock();
+	return ret;
+}
+
+
+/*
+ * lookup by a numeric key: array index, or the key_size least significant
+ * bytes of the value in network order (hash and LPM maps)...
+ */
+
+bool
+pfq_map_lookup_value(int id, uint64_t key, uint64_t *value)
+{
+	struct pfq_map *map;
+	uint8_t buf[Q_MAP_KEY_LEN];
+	bool ret = false;
+	__be64 be;
+
+	if (unlikely(id < 0 || id >= Q_MAX_MAP))
+		return false;
+
+	rcu_read_lock();
+
+	map = rcu_dereference(pfq_maps[id]);
+	if (likely(map != NULL)) {
+
+		if (map->type == Q_MAP_ARRAY) {
+			uint32_t idx = key > UINT_MAX ? UINT_MAX : (uint32_t)key;
+			memcpy(buf, &idx, sizeof(idx));
+		}
+		else {
+			be = cpu_to_be64(key);
+			memset(buf, 0, sizeof(buf));
+			if (map->key_size >= (int)sizeof(be))
+				memcpy(buf + map->key_size - sizeof(be), &be, sizeof(be));
+			else
+				memcpy(buf, (uint8_t *)&be + sizeof(be) - map->key_size, map->key_size);
+		}
+
+		sparse_inc(map->stats, lookup);
+		ret = __pfq_map_lookup(map, buf, value);
+		if (ret)
+			sparse_inc(map->stats, hit);
+	}
+
+	rcu_read_unlock();
+	return ret;
+}
@@ -0,0 +1,49 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_MAPS_H
+#define PFQ_MAPS_H
+
+#include <pfq/types.h>
+
+#include <linux/pf_q.h>
+#include <linux/types.h>
+
+
+/* control path: maps are owned by the creating socket */
+
+extern int  pfq_map_create(pfq_id_t owner, int id, int type, int key_size, unsigned int max_entries);
+extern int  pfq_map_destroy(pfq_id_t owner, int id);
+extern void pfq_maps_release(pfq_id_t owner);
+extern void pfq_maps_destruct(void);
+
+extern int  pfq_map_update(pfq_id_t owner, int id, int op, struct pfq_map_entry const *entry, size_t n);
+extern int  pfq_map_info(int id, struct pfq_map_info *info);
+
+/* packet path */
+
+extern bool pfq_map_lookup(int id, const void *key, int key_size, uint64_t *value);
+extern bool pfq_map_lookup_value(int id, uint64_t key, uint64_t *value);
+
+
+#endif /* PFQ_MAPS_H */
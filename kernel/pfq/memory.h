@@ -33,6 +33,7 @@
 #include <pfq/skbuff.h>
 #include <pfq/sparse.h>
 #include <pfq/stats.h>
+#include <pfq/thread.h>
 
 #include <linux/version.h>
 #include <linux/skbuff.h>
@@ -260,6 +261,14 @@ void pfq_free_skb_pool(struct sk_buff *skb, struct pfq_skb_pool *pool)
 #ifdef PFQ_USE_SKB_POOL
 	if (likely(skb->peeked)) {
 		const int idx = PFQ_CB(skb)->pool;
+
+		/* Rx skb fanned out by another cpu: give it back to its pool */
+
+		if (unlikely(idx == 0 && PFQ_CB(skb)->cpu != smp_processor_id())) {
+			pfq_rx_thread_release(skb);
+			return;
+		}
+
 		if (likely(pool->fifo)) {
 			if (unlikely(!pfq_spsc_push(pool->fifo, skb))) {
 
@@ -35,17 +35,26 @@ module_param_named(max_pool_size,	 default_global.max_pool_size,		int, 0644);
 
 module_param_named(capt_batch_len,	 default_global.capt_batch_len,		int, 0644);
 module_param_named(xmit_batch_len,	 default_global.xmit_batch_len,		int, 0644);
+module_param_named(lang_batch,		 default_global.lang_batch,		int, 0644);
+module_param_named(lang_profile,	 default_global.lang_profile,		int, 0644);
+module_param_named(flow_table_size,	 default_global.flow_table_size,	int, 0644);
+module_param_named(flow_timeout,	 default_global.flow_timeout,		int, 0644);
 module_param_named(skb_tx_pool_size,	 default_global.skb_tx_pool_size,	int, 0644);
 module_param_named(skb_rx_pool_size,	 default_global.skb_rx_pool_size,	int, 0644);
 module_param_named(vlan_untag,		 default_global.vlan_untag,		int, 0644);
 module_param_named(tx_retry,		 default_global.tx_retry,		int, 0644);
 
 module_param_array_named(tx_cpu,	 default_global.tx_cpu,	  int, &default_global.tx_cpu_nr, 0644);
+module_param_array_named(rx_cpu,	 default_global.rx_cpu,	  int, &default_global.rx_cpu_nr, 0644);
 
 MODULE_PARM_DESC(max_slot_size,		" Maximum socket slot size (default=2048 bytes)");
 MODULE_PARM_DESC(max_pool_size,		" Maximum socket buffer pool size (default=2048)");
 MODULE_PARM_DESC(capt_batch_len,	" Capture batch queue length");
 MODULE_PARM_DESC(xmit_batch_len,	" Transmit batch queue length");
+MODULE_PARM_DESC(lang_batch,		" Evaluate groups a batch at a time (default=0, see capt_batch_len)");
+MODULE_PARM_DESC(lang_profile,		" Per-node profiling of the computations loaded from now on (default=0)");
+MODULE_PARM_DESC(flow_table_size,	" Flow table slots per CPU, used by pfq-lang flow functions (default=16384)");
+MODULE_PARM_DESC(flow_timeout,		" Flow table idle timeout in seconds (default=30)");
 MODULE_PARM_DESC(vlan_untag,		" Enable vlan untagging (default=0)");
 
 #ifdef PFQ_USE_SKB_POOL
@@ -54,5 +63,6 @@ MODULE_PARM_DESC(skb_rx_pool_size,	" Socket buffer Rx pool size (default=1024)")
 #endif
 
 MODULE_PARM_DESC(tx_cpu,		" Tx k-threads cpu");
+MODULE_PARM_DESC(rx_cpu,		" Rx k-threads cpu (software RSS fan-out)");
 MODULE_PARM_DESC(tx_retry,		" Tx retry attempts (default 1)");
 
@@ -98,6 +98,13 @@ int pfq_percpu_init(void)
                 data = per_cpu_ptr(global->percpu_data, cpu);
 
 		data->counter = 0;
+		data->running = false;
+
+		data->load_window = 0;
+		data->overload_prio = INT_MAX;
+		memset(data->group_load, 0, sizeof(data->group_load));
+
+		skb_queue_head_init(&data->egress_backlog);
 
 		data->qbuff_queue = pfq_malloc_pages(sizeof(struct pfq_qbuff_long_queue), GFP_KERNEL);
 		if (!data->qbuff_queue)
@@ -135,12 +142,14 @@ int pfq_percpu_qbuff_queue_reset(void)
 		for(n = 0; n < data->qbuff_queue->len; n++)
 		{
 			buff = &data->qbuff_queue->queue[n];
-			pfq_free_skb_pool(QBUFF_SKB(buff), &pool->rx);
+			qbuff_free(buff, &pool->rx);
 		}
 
-                total += data->qbuff_queue->len;
+                total += data->qbuff_queue->len + skb_queue_len(&data->egress_backlog);
 		data->qbuff_queue->len = 0;
 
+		__skb_queue_purge(&data->egress_backlog);
+
 		preempt_enable();
         }
 
@@ -164,9 +173,11 @@ int pfq_percpu_destruct(void)
 
                 data = per_cpu_ptr(global->percpu_data, cpu);
 
-                total += data->qbuff_queue->len;
+                total += data->qbuff_queue->len + skb_queue_len(&data->egress_backlog);
 		data->qbuff_queue->len = 0;
 
+		__skb_queue_purge(&data->egress_backlog);
+
 		preempt_enable();
         }
 
@@ -34,6 +34,8 @@
 #include <pfq/timer.h>
 #include <pfq/qbuff.h>
 
+#include <lang/monad.h>
+
 #include <linux/spinlock.h>
 
 extern int  pfq_percpu_init(void);
@@ -55,14 +57,31 @@ int  pfq_percpu_alloc(void);
 void pfq_percpu_free(void);
 
 
+struct pfq_group_load
+{
+	u64			batch_ns;		/* processing time spent in the current batch */
+	unsigned int		window_pkts;		/* packets processed in the current 1 ms window */
+	unsigned int		sample;			/* sampling counter, while shedding */
+	bool			over;			/* over budget in the current window */
+};
+
+
 struct pfq_percpu_data
 {
 	struct pfq_qbuff_long_queue  *qbuff_queue;
+	struct pfq_lang_monad	monad[Q_BUFF_BATCH_LEN];	/* per-qbuff monads of the queue */
+
+	struct sk_buff_head	egress_backlog;		/* egress packets captured while running the queue */
+	bool			running;
 
 	ktime_t			last_rx;
 	struct timer_list	timer;
 	uint32_t		counter;
 
+	u64			load_window;		/* start of the current 1 ms window (ns) */
+	int			overload_prio;		/* highest priority of groups over budget */
+	struct pfq_group_load	group_load[Q_MAX_GID];
+
 } ____pfq_cacheline_aligned;
 
 
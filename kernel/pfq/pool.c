@@ -134,6 +134,7 @@ int pfq_skb_pool_init(struct pfq_skb_pool *pool, size_t pool_size, size_t skb_le
 
 		PFQ_CB(skb)->id = total;
 		PFQ_CB(skb)->pool = idx;
+		PFQ_CB(skb)->cpu = cpu;
 		PFQ_CB(skb)->head = skb->head;
 
 		memcpy(skb + global->max_pool_size, skb, sizeof(struct sk_buff));
@@ -22,10 +22,13 @@
  ****************************************************************/
 
 
+#include <lang/engine.h>
+#include <lang/histogram.h>
 #include <lang/module.h>
 
 #include <pfq/bitops.h>
 #include <pfq/define.h>
+#include <pfq/flow.h>
 #include <pfq/global.h>
 #include <pfq/group.h>
 #include <pfq/memory.h>
@@ -38,6 +41,7 @@
 #include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/pf_q.h>
 #include <net/net_namespace.h>
 
@@ -52,6 +56,8 @@ static const char proc_groups[]  = "groups";
 static const char proc_sockets[] = "sockets";
 static const char proc_global[]  = "global";
 static const char proc_memory[]  = "memory";
+static const char proc_flow[]    = "flow";
+static const char proc_histograms[] = "histograms";
 
 
 static void
@@ -77,6 +83,12 @@ seq_printf_computation_tree(struct seq_file *m, struct pfq_lang_computation_tree
 	for(n = 0; n < tree->size; n++)
 	{
 		seq_printf_functional_node(m, &tree->node[n], n);
+
+		if (tree->profile) {
+			struct pfq_lang_node_profile p;
+			pfq_lang_computation_profile(tree, n, &p);
+			seq_printf(m, "    run=%lu pass=%lu drop=%lu cycles=%lu\n", p.run, p.pass, p.drop, p.cycles);
+		}
 	}
 }
 
@@ -145,7 +157,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 {
 	size_t n;
 
-	seq_printf(m, " group: recv      lost      drop      sent      disc.     failed    forward   kernel    pol pid   def.    uplane   cplane    ctrl\n");
+	seq_printf(m, " group: recv      lost      drop      sent      disc.     failed    forward   kernel    shed      over      s.in      s.out     p.in      p.out     dup       d.coll    pol pid   def.    uplane   cplane    ctrl\n");
 
 	pfq_group_lock();
 
@@ -157,7 +169,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 		if (!this_group->enabled)
 			continue;
 
-		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n,
+		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n,
 			   sparse_read(this_group->stats, recv),
 			   sparse_read(this_group->stats, lost),
 			   sparse_read(this_group->stats, drop),
@@ -167,7 +179,16 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 			   sparse_read(this_group->stats, fail),
 
 			   sparse_read(this_group->stats, frwd),
-			   sparse_read(this_group->stats, kern));
+			   sparse_read(this_group->stats, kern),
+
+			   sparse_read(this_group->shed, shed),
+			   sparse_read(this_group->shed, over),
+			   sparse_read(this_group->shed, sample_in),
+			   sparse_read(this_group->shed, sample_out),
+			   sparse_read(this_group->shed, police_in),
+			   sparse_read(this_group->shed, police_out),
+			   sparse_read(this_group->shed, dedup),
+			   sparse_read(this_group->shed, dedup_coll));
 
 		seq_printf(m, "%3d %3d ", this_group->policy, this_group->pid);
 
@@ -200,6 +221,86 @@ static int pfq_proc_stats(struct seq_file *m, void *v)
 }
 
 
+static int pfq_proc_flow(struct seq_file *m, void *v)
+{
+	struct pfq_flow_stats stats;
+	int cpu;
+
+	seq_printf(m, "        %10s %10s %10s %10s %10s %10s\n", "size", "active", "created", "evicted", "expired", "exported");
+
+	for_each_present_cpu(cpu)
+	{
+		if (!pfq_flow_table_stats(cpu, &stats)) {
+			seq_printf(m, "flow table not in use.\n");
+			break;
+		}
+
+		seq_printf(m, "CPU-%-3d %10lu %10lu %10lu %10lu %10lu %10lu\n", cpu,
+			   stats.size, stats.active, stats.created, stats.evicted, stats.expired, stats.exported);
+	}
+
+	return 0;
+}
+
+
+static int pfq_proc_histograms(struct seq_file *m, void *v)
+{
+	struct pfq_lang_computation_tree *comp;
+	uint64_t *count;
+	size_t n, i, j;
+
+	count = kmalloc(sizeof(uint64_t) * (Q_HISTOGRAM_MAX_EDGES+1), GFP_KERNEL);
+	if (count == NULL)
+		return -ENOMEM;
+
+	pfq_group_lock();
+
+	for(n = 0; n < Q_MAX_GID; n++)
+	{
+		struct pfq_group *this_group = pfq_group_get((__force pfq_gid_t)n);
+
+		if (!this_group->policy)
+			continue;
+
+		comp = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
+		if (comp == NULL)
+			continue;
+
+		for(i = 0; i < comp->size; i++)
+		{
+			uint64_t const *edges;
+			size_t nedges;
+			int id;
+
+			if (!pfq_lang_histogram_node(&comp->node[i], &id, &edges, &nedges))
+				continue;
+
+			memset(count, 0, sizeof(uint64_t) * (nedges+1));
+			pfq_lang_histogram_sum(&comp->node[i], count, nedges+1);
+
+			seq_printf(m, "group=%zu histogram=%d node=%zu\n", n, id, i);
+
+			seq_printf(m, "  %20s %20s %20s\n", "from", "to", "count");
+
+			for(j = 0; j <= nedges; j++)
+			{
+				seq_printf(m, "  %20llu ", j ? edges[j-1] : 0ULL);
+				if (j < nedges)
+					seq_printf(m, "%20llu ", edges[j]);
+				else
+					seq_printf(m, "%20s ", "-");
+				seq_printf(m, "%20llu\n", count[j]);
+			}
+		}
+	}
+
+	pfq_group_unlock();
+
+	kfree(count);
+	return 0;
+}
+
+
 static int pfq_proc_memory(struct seq_file *m, void *v)
 {
 #ifdef PFQ_USE_SKB_POOL
@@ -308,6 +409,16 @@ static int pfq_proc_stats_open(struct inode *inode, struct file *file)
 	return single_open(file, pfq_proc_stats, PDE_DATA(inode));
 }
 
+static int pfq_proc_flow_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pfq_proc_flow, PDE_DATA(inode));
+}
+
+static int pfq_proc_histograms_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pfq_proc_histograms, PDE_DATA(inode));
+}
+
 static ssize_t
 pfq_proc_stats_reset(struct file *file, const char __user *buf, size_t length, loff_t *ppos)
 {
@@ -350,6 +461,22 @@ static const struct file_operations pfq_proc_lang_fops = {
 	.release = single_release,
 };
 
+static const struct file_operations pfq_proc_flow_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pfq_proc_flow_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations pfq_proc_histograms_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pfq_proc_histograms_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 int pfq_proc_init(void)
 {
 	pfq_proc_dir = proc_mkdir("pfq", init_net.proc_net);
@@ -363,6 +490,8 @@ int pfq_proc_init(void)
 	proc_create(proc_sockets, 0644, pfq_proc_dir, &pfq_proc_sockets_fops);
 	proc_create(proc_global,  0644, pfq_proc_dir, &pfq_proc_global_fops);
 	proc_create(proc_memory,  0644, pfq_proc_dir, &pfq_proc_memory_fops);
+	proc_create(proc_flow,	  0644, pfq_proc_dir, &pfq_proc_flow_fops);
+	proc_create(proc_histograms, 0644, pfq_proc_dir, &pfq_proc_histograms_fops);
 
 	return 0;
 }
@@ -375,6 +504,8 @@ int pfq_proc_destruct(void)
 	remove_proc_entry(proc_sockets, pfq_proc_dir);
 	remove_proc_entry(proc_global,	pfq_proc_dir);
 	remove_proc_entry(proc_memory,	pfq_proc_dir);
+	remove_proc_entry(proc_flow,	pfq_proc_dir);
+	remove_proc_entry(proc_histograms, pfq_proc_dir);
 	remove_proc_entry("pfq", init_net.proc_net);
 
 	return 0;
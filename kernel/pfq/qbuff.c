@@ -22,8 +22,12 @@
  ****************************************************************/
 
 #include <lang/monad.h>
+
+#include <pfq/memory.h>
 #include <pfq/qbuff.h>
 
+#include <linux/etherdevice.h>
+
 bool
 qbuff_ingress(struct qbuff const *buff, struct iphdr const *ip)
 {
@@ -32,7 +36,7 @@ qbuff_ingress(struct qbuff const *buff, struct iphdr const *ip)
         bool ctx = buff->monad->ep_ctx;
 
 	rcu_read_lock();
-	in_dev = __in_dev_get_rcu(QBUFF_SKB(buff)->dev);
+	in_dev = __in_dev_get_rcu(qbuff_device(buff));
 	if (in_dev != NULL) {
 		for_primary_ifa(in_dev) {
 			if (((ifa->ifa_address == ip->daddr) && (ctx & EPOINT_DST)) ||
@@ -48,3 +52,58 @@ qbuff_ingress(struct qbuff const *buff, struct iphdr const *ip)
 }
 
 
+
+
+/*
+ * build an skb out of a skb-less buff (copy of the raw frame).
+ * On success the qbuff is switched to the skb backend.
+ */
+
+struct sk_buff *
+qbuff_materialize_skb(struct qbuff *buff, struct pfq_skb_pool *pool)
+{
+	struct qbuff_xdp *xdp = &buff->xdp;
+	unsigned int len;
+	struct sk_buff *skb;
+
+	if (!qbuff_is_xdp(buff))
+		return QBUFF_SKB(buff);
+
+	len = qbuff_xdp_len(buff);
+
+	skb = pfq_alloc_skb_pool( len + NET_SKB_PAD + NET_IP_ALIGN
+				, GFP_ATOMIC
+				, NUMA_NO_NODE
+				, 0
+				, pool);
+
+	if (unlikely(skb == NULL)) {
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ] materialize: could not allocate an skb!\n");
+		return NULL;
+	}
+
+	skb_reserve(skb, NET_SKB_PAD + NET_IP_ALIGN);
+	memcpy(__skb_put(skb, len), xdp->data, len);
+
+	skb->dev = xdp->dev;
+	skb->tstamp = xdp->tstamp;
+	skb->mark = xdp->mark;
+	skb->protocol = eth_type_trans(skb, xdp->dev);
+
+	skb_set_queue_mapping(skb, xdp->queue_mapping);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0))
+	if (xdp->hash)
+		skb_set_hash(skb, xdp->hash, PKT_HASH_TYPE_L3);
+#endif
+	skb_reset_network_header(skb);
+	skb_reset_transport_header(skb);
+	skb_reset_mac_len(skb);
+
+	/* push the mac header: as for the skb backend, data points to the beginning of the packet */
+
+	skb_push(skb, skb->mac_len);
+
+	buff->addr = skb;
+	return skb;
+}
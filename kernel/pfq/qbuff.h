@@ -34,15 +34,56 @@
 #include <linux/ip.h>
 
 struct pfq_lang_monad;
+struct pfq_skb_pool;
+
+
+/* skb-less backend: raw frames (e.g. XDP buffers) owned by the driver
+ * until the end of the NAPI poll. An skb is materialized only when
+ * the packet is forwarded or passed to the kernel. */
+
+struct qbuff_xdp
+{
+	void		       *data;
+	void		       *data_end;
+	struct net_device      *dev;
+	ktime_t			tstamp;
+	uint32_t		mark;
+	uint32_t		hash;
+	uint16_t		rx_queue;
+	uint16_t		queue_mapping;
+	uint16_t		vlan_tci;
+	uint16_t		maclen;
+	__be16			proto;		/* encapsulated protocol (802.1Q) */
+};
+
+
+/* outer headers parsed once per packet, and shared by all the groups */
+
+#define QBUFF_PARSED_L3		(1<<0)
+#define QBUFF_PARSED_HASH	(1<<1)
+
+struct qbuff_parse
+{
+	int			ipoff;		/* L3 offset (-1 = not IP) */
+	int			ipproto;	/* IPPROTO_IP, IPPROTO_IPV6 or IPPROTO_NONE */
+	int			l4off;		/* L4 offset (-1 = unknown) */
+	int			l4proto;
+	uint32_t		hash;		/* flow hash (IPv4 only) */
+	bool			hash_ok;
+	uint8_t			flags;		/* QBUFF_PARSED_* */
+};
 
 
 struct qbuff
 {
-	void		       *addr;				/* struct sk_buff * */
+	void		       *addr;				/* struct sk_buff * (NULL if skb-less) */
+	struct qbuff_xdp	xdp;				/* skb-less backend */
 	struct pfq_lang_monad  *monad;
+	struct qbuff_parse	parse;				/* parse cache */
 	struct net_device      *fwd_dev[Q_BUFF_QUEUE_LEN];	/* fwd to devs */
 	size_t			fwd_dev_num;
         unsigned long		fwd_mask;			/* fwd to sockets */
+        unsigned long		group_mask;			/* groups deferred to the batch (lang_batch) */
         uint32_t		counter;			/* unique id */
         bool			to_kernel;			/* fwd to kernel */
 };
@@ -60,6 +101,53 @@ qbuff_init( struct qbuff *buff
 	buff->fwd_dev_num = 0;
 	buff->counter = id;
 	buff->fwd_mask = 0;
+	buff->group_mask = 0;
+	buff->parse.flags = 0;
+	buff->to_kernel = false;
+}
+
+
+static inline void
+qbuff_init_xdp( struct qbuff *buff
+	      , struct net_device *dev
+	      , void *data
+	      , void *data_end
+	      , uint16_t rx_queue
+	      , uint32_t hash
+	      , struct pfq_lang_monad *monad
+	      , size_t id)
+{
+	struct ethhdr const *eth = data;
+
+	buff->addr = NULL;
+	buff->xdp.data = data;
+	buff->xdp.data_end = data_end;
+	buff->xdp.dev = dev;
+	buff->xdp.tstamp = ktime_get_real();
+	buff->xdp.mark = 0;
+	buff->xdp.hash = hash;
+	buff->xdp.rx_queue = rx_queue;
+	buff->xdp.queue_mapping = rx_queue + 1;
+	buff->xdp.vlan_tci = 0;
+	buff->xdp.maclen = ETH_HLEN;
+	buff->xdp.proto = eth->h_proto;
+
+	/* in-band 802.1Q tag: the mac header includes it */
+
+	if (eth->h_proto == __constant_htons(ETH_P_8021Q) &&
+	    (data_end - data) >= VLAN_ETH_HLEN) {
+		struct vlan_ethhdr const *veth = data;
+		buff->xdp.vlan_tci = be16_to_cpu(veth->h_vlan_TCI) | VLAN_TAG_PRESENT;
+		buff->xdp.maclen = VLAN_ETH_HLEN;
+		buff->xdp.proto = veth->h_vlan_encapsulated_proto;
+	}
+
+	buff->monad = monad;
+	buff->fwd_dev_num = 0;
+	buff->counter = id;
+	buff->fwd_mask = 0;
+	buff->group_mask = 0;
+	buff->parse.flags = 0;
 	buff->to_kernel = false;
 }
 
@@ -122,15 +210,42 @@ PFQ_DEFINE_QUEUE(struct pfq_qbuff_long_queue,  Q_BUFF_QUEUE_LEN);
 #define QBUFF_CB(buff)  (PFQ_CB(buff->addr))
 
 
+#define qbuff_is_xdp(buff)	((buff)->addr == NULL)
+
+
+static inline
+unsigned int
+qbuff_xdp_len(struct qbuff const *buff)
+{
+	return (unsigned int)(buff->xdp.data_end - buff->xdp.data);
+}
+
+
 bool qbuff_ingress(struct qbuff const *buff, struct iphdr const *ip);
 
+struct sk_buff * qbuff_materialize_skb(struct qbuff *buff, struct pfq_skb_pool *pool);
 
-#define qbuff_free(buff, ...)	pfq_free_skb_pool(QBUFF_SKB(buff), __VA_ARGS__)
+
+#define qbuff_free(buff, ...)	do { \
+		if (!qbuff_is_xdp(buff)) \
+			pfq_free_skb_pool(QBUFF_SKB(buff), __VA_ARGS__); \
+	} while(0)
+
+
+static inline
+int qbuff_get_direction(struct qbuff const *buff)
+{
+	if (qbuff_is_xdp(buff))
+		return Q_DIR_RX;
+	return QBUFF_SKB(buff)->pkt_type == PACKET_OUTGOING ? Q_DIR_TX : Q_DIR_RX;
+}
 
 
 static inline
 int qbuff_get_ifindex(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.dev->ifindex;
 	return QBUFF_SKB(buff)->dev->ifindex;
 }
 
@@ -138,6 +253,8 @@ static inline
 unsigned int
 qbuff_headroom(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return 0;
 	return skb_headroom(QBUFF_SKB(buff));
 }
 
@@ -146,14 +263,18 @@ static inline
 unsigned int
 qbuff_tailroom(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return 0;
 	return skb_tailroom(QBUFF_SKB(buff));
 }
 
 
 static inline
 struct net_device *
-qbuff_device(struct qbuff *buff)
+qbuff_device(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.dev;
 	return QBUFF_SKB(buff)->dev;
 }
 
@@ -161,6 +282,8 @@ qbuff_device(struct qbuff *buff)
 static inline
 uint16_t qbuff_get_queue_mapping(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.queue_mapping;
 	return skb_get_queue_mapping(QBUFF_SKB(buff));
 }
 
@@ -168,7 +291,10 @@ uint16_t qbuff_get_queue_mapping(struct qbuff const *buff)
 static inline
 void qbuff_set_queue_mapping(struct qbuff *buff, uint16_t map)
 {
-	skb_set_queue_mapping(QBUFF_SKB(buff), map);
+	if (qbuff_is_xdp(buff))
+		buff->xdp.queue_mapping = map;
+	else
+		skb_set_queue_mapping(QBUFF_SKB(buff), map);
 }
 
 
@@ -183,6 +309,8 @@ qbuff_clone(struct qbuff *buff)
 static inline uint32_t
 qbuff_get_rss_hash(struct qbuff *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.hash;
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(3,14,0))
 	return 0;
 #else
@@ -193,22 +321,99 @@ qbuff_get_rss_hash(struct qbuff *buff)
 static inline uint16_t
 qbuff_vlan_tci(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.vlan_tci;
 	return QBUFF_SKB(buff)->vlan_tci;
 }
 
 
+static inline void
+qbuff_set_vlan_tci(struct qbuff *buff, uint16_t tci)
+{
+	if (qbuff_is_xdp(buff))
+		buff->xdp.vlan_tci = tci;
+	else
+		QBUFF_SKB(buff)->vlan_tci = tci;
+}
+
+
 static inline void *
 qbuff_header_pointer(struct qbuff const *buff, int offset, int len, void *buffer)
 {
 	struct sk_buff const *skb = QBUFF_SKB(buff);
+
+	if (qbuff_is_xdp(buff)) {
+		if (unlikely(offset < 0 || offset + len > (int)qbuff_xdp_len(buff)))
+			return NULL;
+		return buff->xdp.data + offset;
+	}
+
 	return skb_header_pointer(skb, offset, len, buffer);
 }
 
 
+/*
+ * make the first len bytes of the packet linear and private (copy-on-write):
+ * a shared skb is replaced by a private copy, the header of a cloned one is
+ * copied. Return the (possibly moved) start of the packet, or NULL if out
+ * of memory and for short packets...
+ */
+
+static inline void *
+qbuff_make_writable(struct qbuff *buff, int len)
+{
+	struct sk_buff *skb = QBUFF_SKB(buff);
+
+	if (qbuff_is_xdp(buff)) {
+		if (unlikely(len > (int)qbuff_xdp_len(buff)))
+			return NULL;
+		return buff->xdp.data;
+	}
+
+	if (unlikely(skb_shared(skb))) {
+		struct sk_buff *nskb = skb_copy(skb, GFP_ATOMIC);
+		if (nskb == NULL)
+			return NULL;
+
+		nskb->peeked = 0;
+
+		/* release this reference only: the skb is owned by others, too */
+
+		consume_skb(skb);
+		buff->addr = skb = nskb;
+	}
+
+	if (!pskb_may_pull(skb, len))
+		return NULL;
+
+	if (skb_cloned(skb) && !skb_clone_writable(skb, len) &&
+	    pskb_expand_head(skb, 0, 0, GFP_ATOMIC))
+		return NULL;
+
+	return skb->data;
+}
+
+
+static inline int
+qbuff_copy_bits(struct qbuff const *buff, int offset, void *to, int len)
+{
+	if (qbuff_is_xdp(buff)) {
+		if (unlikely(offset + len > (int)qbuff_xdp_len(buff)))
+			return -EFAULT;
+		memcpy(to, buff->xdp.data + offset, len);
+		return 0;
+	}
+
+	return skb_copy_bits(QBUFF_SKB(buff), offset, to, len);
+}
+
+
 static inline
 struct ethhdr *
 qbuff_eth_hdr(struct qbuff *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return (struct ethhdr *)buff->xdp.data;
 	return eth_hdr(QBUFF_SKB(buff));
 }
 
@@ -217,6 +422,8 @@ static inline
 unsigned int
 qbuff_len(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return qbuff_xdp_len(buff);
 	return QBUFF_SKB(buff)->len;
 }
 
@@ -224,15 +431,31 @@ qbuff_len(struct qbuff const *buff)
 static inline size_t
 qbuff_maclen(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.maclen;
 	return QBUFF_SKB(buff)->mac_len;
 }
 
 
+static inline __be16
+qbuff_eth_proto(struct qbuff const *buff)
+{
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.proto;
+	return eth_hdr(QBUFF_SKB(buff))->h_proto;
+}
+
+
 static inline void
 qbuff_move_or_copy_to_kernel(struct qbuff *buff, gfp_t pri)
 {
 	struct sk_buff *nskb, *skb = QBUFF_SKB(buff);
 
+	/* skb-less buffs are materialized before being passed to the kernel */
+
+	if (unlikely(qbuff_is_xdp(buff)))
+		return;
+
 	if (likely(skb->pkt_type != PACKET_OUTGOING))
 		skb_pull(skb, QBUFF_SKB(buff)->mac_len);
 
@@ -257,6 +480,8 @@ qbuff_move_or_copy_to_kernel(struct qbuff *buff, gfp_t pri)
 static inline ktime_t
 qbuff_get_ktime(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.tstamp;
 	return skb_get_ktime(QBUFF_SKB(buff));
 }
 
@@ -264,6 +489,8 @@ qbuff_get_ktime(struct qbuff const *buff)
 static inline uint16_t
 qbuff_get_mark(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.mark;
 	return QBUFF_SKB(buff)->mark;
 }
 
@@ -271,13 +498,18 @@ qbuff_get_mark(struct qbuff const *buff)
 static inline void
 qbuff_set_mark(struct qbuff *buff, uint32_t value)
 {
-	QBUFF_SKB(buff)->mark = value;
+	if (qbuff_is_xdp(buff))
+		buff->xdp.mark = value;
+	else
+		QBUFF_SKB(buff)->mark = value;
 }
 
 
 static inline uint16_t
 qbuff_get_rx_queue(struct qbuff const *buff)
 {
+	if (qbuff_is_xdp(buff))
+		return buff->xdp.rx_queue;
 	return skb_rx_queue_recorded(QBUFF_SKB(buff)) ? skb_get_rx_queue(QBUFF_SKB(buff)) : 0;
 }
 
@@ -289,6 +521,11 @@ qbuff_run_bp_filter(struct qbuff *buff, struct pfq_group *this_group)
 
 	if (!bpf) return true;
 
+	/* classic BPF requires an skb: the caller materializes skb-less buffs */
+
+	if (unlikely(qbuff_is_xdp(buff)))
+		return true;
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(3,15,0))
 	return sk_run_filter(QBUFF_SKB(buff), bpf->insns);
 #elif (LINUX_VERSION_CODE < KERNEL_VERSION(4,4,0))
@@ -299,10 +536,29 @@ qbuff_run_bp_filter(struct qbuff *buff, struct pfq_group *this_group)
 
 }
 
+static inline uint32_t
+qbuff_run_ebpf_filter(struct qbuff *buff, struct pfq_group *this_group)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	struct bpf_prog *prog = (struct bpf_prog *)atomic_long_read(&this_group->ebpf_prog);
+
+	if (!prog) return Q_EBPF_PASS;
+
+	/* socket filter programs run on skb only */
+
+	if (unlikely(qbuff_is_xdp(buff)))
+		return Q_EBPF_PASS;
+
+	return bpf_prog_run_save_cb(prog, QBUFF_SKB(buff));
+#else
+	return Q_EBPF_PASS;
+#endif
+}
+
 static inline bool
 qbuff_run_vlan_filter(struct qbuff const *buff, pfq_gid_t gid)
 {
-	return pfq_group_check_vlan_filter(gid, QBUFF_SKB(buff)->vlan_tci & ~VLAN_TAG_PRESENT);
+	return pfq_group_check_vlan_filter(gid, qbuff_vlan_tci(buff) & ~VLAN_TAG_PRESENT);
 }
 
 
@@ -90,6 +90,13 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 			mapped_queue->tx_async[n].cons.off   = 0;
 		}
 
+		/* initialize the flow record ring */
+
+		mapped_queue->flow.len        = (unsigned int)so->flow_queue_len;
+		mapped_queue->flow.lost       = 0;
+		mapped_queue->flow.prod.index = 0;
+		mapped_queue->flow.cons.index = 0;
+
 		/* commit queues */
 
 		smp_wmb();
@@ -116,6 +123,11 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 			 so->tx_slot_size,
 			 so->tx_len,
 			 pfq_spsc_queue_mem(so) * Q_MAX_TX_QUEUES, Q_MAX_TX_QUEUES);
+
+		pr_devel("[PFQ|%d] flow record ring: len=%zu, mem=%zu bytes\n",
+			 so->id,
+			 so->flow_queue_len,
+			 pfq_flow_queue_mem(so));
 	}
 
 	return 0;
@@ -46,6 +46,11 @@ static inline size_t pfq_spsc_queue_mem(struct pfq_sock *so)
         return so->tx_queue_len * so->tx_slot_size * 2;
 }
 
+static inline size_t pfq_flow_queue_mem(struct pfq_sock *so)
+{
+        return so->flow_queue_len * sizeof(struct pfq_flow_record);
+}
+
 
 static inline
 size_t pfq_mpsc_queue_len(struct pfq_sock *p)
@@ -96,6 +101,19 @@ void *pfq_sock_tx_queue_mem(struct pfq_sock *so, int index)
 }
 
 
+static inline
+struct pfq_flow_record *pfq_sock_flow_queue_mem(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL))
+		return NULL;
+
+	return (void *)sq + sizeof(struct pfq_shared_queue)
+			  + pfq_mpsc_queue_mem(so)
+			  + pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES);
+}
+
+
 static inline
 char *pfq_mpsc_slot_ptr(struct pfq_sock *so, size_t qindex, size_t slot)
 {
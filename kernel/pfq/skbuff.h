@@ -36,6 +36,7 @@ struct pfq_cb
 	void *	 head;
 	uint32_t id;
 	u8	 pool;
+	u8	 cpu;
 };
 
 
@@ -0,0 +1,500 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/printk.h>
+#include <pfq/sketch.h>
+#include <pfq/sparse.h>
+
+#include <linux/cpumask.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/topology.h>
+#include <linux/vmalloc.h>
+
+
+/*
+ * sketches are published with RCU, as the lookup maps: functions update
+ * them from the packet path, each cpu its own counters. The memory of all
+ * the sketches is bounded by Q_SKETCH_MAX_MEMORY...
+ */
+
+static struct pfq_sketch __rcu *pfq_sketches[Q_MAX_SKETCH];
+static DEFINE_MUTEX(pfq_sketches_lock);
+static unsigned long pfq_sketches_memory;
+
+
+static inline unsigned long
+pfq_sketch_memory(struct pfq_so_sketch const *conf)
+{
+	return (sizeof(struct pfq_sketch_cpu) +
+		sizeof(uint64_t) * conf->depth * conf->width +
+		sizeof(struct pfq_sketch_slot) * conf->topk) * num_possible_cpus();
+}
+
+
+static void
+pfq_sketch_free(struct pfq_sketch *s)
+{
+	int cpu;
+
+	if (s->cpu) {
+		for_each_possible_cpu(cpu)
+		{
+			struct pfq_sketch_cpu *c = s->cpu[cpu];
+			if (c) {
+				vfree(c->row);
+				vfree(c->slot);
+				kfree(c);
+			}
+		}
+	}
+
+	kfree(s->cpu);
+	kfree(s);
+}
+
+
+static struct pfq_sketch *
+pfq_sketch_alloc(pfq_id_t owner, struct pfq_so_sketch const *conf)
+{
+	struct pfq_sketch *s;
+	int cpu;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (s == NULL)
+		return NULL;
+
+	s->conf  = *conf;
+	s->owner = owner;
+	s->seed = get_random_int();
+	s->cpu  = kcalloc(nr_cpu_ids, sizeof(struct pfq_sketch_cpu *), GFP_KERNEL);
+	if (s->cpu == NULL)
+		goto err;
+
+	for_each_possible_cpu(cpu)
+	{
+		int node = cpu_to_node(cpu);
+		struct pfq_sketch_cpu *c;
+
+		c = kzalloc_node(sizeof(*c), GFP_KERNEL, node);
+		if (c == NULL)
+			goto err;
+
+		s->cpu[cpu] = c;
+
+		c->row  = vzalloc_node(sizeof(uint64_t) * conf->depth * conf->width, node);
+		c->slot = vzalloc_node(sizeof(struct pfq_sketch_slot) * conf->topk, node);
+		if (c->row == NULL || c->slot == NULL)
+			goto err;
+	}
+
+	return s;
+err:
+	pfq_sketch_free(s);
+	return NULL;
+}
+
+
+int
+pfq_sketch_create(pfq_id_t owner, struct pfq_so_sketch const *conf)
+{
+	struct pfq_sketch *s;
+	unsigned long size;
+	int err = 0;
+
+	if (conf->id < 0 || conf->id >= Q_MAX_SKETCH)
+		return -EINVAL;
+
+	if (conf->keys == 0 ||
+	    conf->depth == 0 || conf->depth > Q_SKETCH_MAX_DEPTH ||
+	    !is_power_of_2(conf->width) || conf->width > Q_SKETCH_MAX_WIDTH ||
+	    !is_power_of_2(conf->topk) || conf->topk < Q_SKETCH_WAYS || conf->topk > Q_SKETCH_MAX_TOPK)
+		return -EINVAL;
+
+	/* reserve the memory first */
+
+	size = pfq_sketch_memory(conf);
+
+	mutex_lock(&pfq_sketches_lock);
+
+	if (rcu_access_pointer(pfq_sketches[conf->id]))
+		err = -EBUSY;
+	else if (size > Q_SKETCH_MAX_MEMORY - pfq_sketches_memory)
+		err = -ENOMEM;
+	else
+		pfq_sketches_memory += size;
+
+	mutex_unlock(&pfq_sketches_lock);
+
+	if (err)
+		return err;
+
+	s = pfq_sketch_alloc(owner, conf);
+
+	mutex_lock(&pfq_sketches_lock);
+
+	if (s == NULL)
+		err = -ENOMEM;
+	else if (rcu_access_pointer(pfq_sketches[conf->id]))
+		err = -EBUSY;
+	else
+		rcu_assign_pointer(pfq_sketches[conf->id], s);
+
+	if (err)
+		pfq_sketches_memory -= size;
+
+	mutex_unlock(&pfq_sketches_lock);
+
+	if (err) {
+		if (s)
+			pfq_sketch_free(s);
+		return err;
+	}
+
+	pr_devel("[PFQ] sketch %d: keys=%llx width=%u depth=%u topk=%u created.\n", conf->id,
+		 (unsigned long long)conf->keys, conf->width, conf->depth, conf->topk);
+	return 0;
+}
+
+
+static int
+__pfq_sketch_destroy(int id, pfq_id_t owner, bool any)
+{
+	struct pfq_sketch *s;
+
+	if (id < 0 || id >= Q_MAX_SKETCH)
+		return -EINVAL;
+
+	mutex_lock(&pfq_sketches_lock);
+
+	s = rcu_dereference_protected(pfq_sketches[id], lockdep_is_held(&pfq_sketches_lock));
+	if (s && !any && s->owner != owner) {
+		mutex_unlock(&pfq_sketches_lock);
+		return -EACCES;
+	}
+
+	RCU_INIT_POINTER(pfq_sketches[id], NULL);
+	if (s)
+		pfq_sketches_memory -= pfq_sketch_memory(&s->conf);
+	mutex_unlock(&pfq_sketches_lock);
+
+	if (s == NULL)
+		return -ENOENT;
+
+	synchronize_rcu();
+	pfq_sketch_free(s);
+
+	pr_devel("[PFQ] sketch %d: destroyed.\n", id);
+	return 0;
+}
+
+
+int
+pfq_sketch_destroy(pfq_id_t owner, int id)
+{
+	return __pfq_sketch_destroy(id, owner, false);
+}
+
+
+/* reset: replace the sketch with an empty one. The replacement is allocated
+ * before the old sketch is released, hence it is charged to the memory budget
+ * until then... */
+
+int
+pfq_sketch_reset(pfq_id_t owner, int id)
+{
+	struct pfq_sketch *old, *s;
+	unsigned long size = 0;
+	int err = 0;
+
+	if (id < 0 || id >= Q_MAX_SKETCH)
+		return -EINVAL;
+
+	mutex_lock(&pfq_sketches_lock);
+
+	old = rcu_dereference_protected(pfq_sketches[id], lockdep_is_held(&pfq_sketches_lock));
+	if (old == NULL) {
+		err = -ENOENT;
+		goto out;
+	}
+
+	if (old->owner != owner) {
+		err = -EACCES;
+		goto out;
+	}
+
+	size = pfq_sketch_memory(&old->conf);
+	if (size > Q_SKETCH_MAX_MEMORY - pfq_sketches_memory) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	s = pfq_sketch_alloc(owner, &old->conf);
+	if (s == NULL) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	pfq_sketches_memory += size;
+	rcu_assign_pointer(pfq_sketches[id], s);
+out:
+	mutex_unlock(&pfq_sketches_lock);
+
+	if (err)
+		return err;
+
+	synchronize_rcu();
+	pfq_sketch_free(old);
+
+	mutex_lock(&pfq_sketches_lock);
+	pfq_sketches_memory -= size;
+	mutex_unlock(&pfq_sketches_lock);
+	return 0;
+}
+
+
+void
+pfq_sketches_release(pfq_id_t owner)
+{
+	int id;
+
+	for(id = 0; id < Q_MAX_SKETCH; id++)
+	{
+		if (__pfq_sketch_destroy(id, owner, false) == 0)
+			pr_devel("[PFQ|%d] sketch %d: released.\n", owner, id);
+	}
+}
+
+
+void
+pfq_sketches_destruct(void)
+{
+	int id;
+
+	for(id = 0; id < Q_MAX_SKETCH; id++)
+		__pfq_sketch_destroy(id, (__force pfq_id_t)0, true);
+}
+
+
+struct pfq_sketch *
+pfq_sketch_get(int id)
+{
+	if (unlikely(id < 0 || id >= Q_MAX_SKETCH))
+		return NULL;
+
+	return rcu_dereference(pfq_sketches[id]);
+}
+
+
+/*
+ * the counters of the key are picked by double hashing, one per row: the
+ * estimate is the smallest of them...
+ */
+
+static inline uint64_t
+__pfq_sketch_min(struct pfq_sketch const *s, struct pfq_sketch_cpu const *c, uint32_t h1, uint32_t h2)
+{
+	uint64_t est = ~0ULL;
+	unsigned int i;
+
+	for(i = 0; i < s->conf.depth; i++)
+	{
+		uint64_t v = c->row[i * s->conf.width + ((h1 + i * h2) & (s->conf.width - 1))];
+		if (v < est)
+			est = v;
+	}
+
+	return est;
+}
+
+
+static inline void
+pfq_sketch_hash(struct pfq_sketch const *s, struct pfq_sketch_key const *key, uint32_t *h1, uint32_t *h2)
+{
+	*h1 = jhash(key, sizeof(*key), s->seed);
+	*h2 = jhash_1word(*h1, ~s->seed) | 1;
+}
+
+
+/*
+ * update the sketch of the current cpu: with the conservative update only
+ * the counters below the new estimate are raised. The flow then takes a
+ * slot of its set if its estimate beats the smallest there...
+ */
+
+uint64_t
+pfq_sketch_update(struct pfq_sketch *s, struct pfq_sketch_key const *key, uint64_t inc)
+{
+	struct pfq_sketch_cpu *c = s->cpu[smp_processor_id()];
+	struct pfq_sketch_slot *set, *min;
+	uint32_t h1, h2;
+	uint64_t est;
+	unsigned int i;
+
+	pfq_sketch_hash(s, key, &h1, &h2);
+
+	est = __pfq_sketch_min(s, c, h1, h2) + inc;
+
+	for(i = 0; i < s->conf.depth; i++)
+	{
+		uint64_t *v = &c->row[i * s->conf.width + ((h1 + i * h2) & (s->conf.width - 1))];
+		if (*v < est)
+			*v = est;
+	}
+
+	c->total += inc;
+
+	set = &c->slot[(h1 & (s->conf.topk / Q_SKETCH_WAYS - 1)) * Q_SKETCH_WAYS];
+	min = set;
+
+	for(i = 0; i < Q_SKETCH_WAYS; i++)
+	{
+		if (set[i].count && set[i].hash == h1 && memcmp(&set[i].key, key, sizeof(*key)) == 0) {
+			set[i].count = est;
+			return est;
+		}
+
+		if (set[i].count < min->count)
+			min = &set[i];
+	}
+
+	if (est > min->count) {
+		min->hash  = h1;
+		min->key   = *key;
+		min->count = est;
+	}
+
+	return est;
+}
+
+
+uint64_t
+pfq_sketch_estimate(struct pfq_sketch *s, struct pfq_sketch_key const *key)
+{
+	struct pfq_sketch_cpu *c = s->cpu[smp_processor_id()];
+	uint32_t h1, h2;
+
+	pfq_sketch_hash(s, key, &h1, &h2);
+	return __pfq_sketch_min(s, c, h1, h2);
+}
+
+
+/*
+ * read out: the heavy hitters of all the cpus, merged by key (the sketches
+ * of the cpus add up) and sorted by count. The tables are read while being
+ * updated, the result is an approximation anyway...
+ */
+
+static int
+pfq_sketch_slot_key_cmp(const void *a, const void *b)
+{
+	struct pfq_sketch_slot const *x = a, *y = b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return memcmp(&x->key, &y->key, sizeof(x->key));
+}
+
+
+static int
+pfq_sketch_slot_count_cmp(const void *a, const void *b)
+{
+	struct pfq_sketch_slot const *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count > y->count ? -1 : 1;
+	return 0;
+}
+
+
+int
+pfq_sketch_topk(int id, struct pfq_sketch_entry *entry, size_t *size, uint64_t *total)
+{
+	struct pfq_sketch_slot *all = NULL;
+	struct pfq_sketch *s;
+	size_t n = 0, m, i;
+	int cpu, err = 0;
+
+	if (id < 0 || id >= Q_MAX_SKETCH)
+		return -EINVAL;
+
+	mutex_lock(&pfq_sketches_lock);
+
+	s = rcu_dereference_protected(pfq_sketches[id], lockdep_is_held(&pfq_sketches_lock));
+	if (s == NULL) {
+		err = -ENOENT;
+		goto out;
+	}
+
+	all = vmalloc(sizeof(struct pfq_sketch_slot) * s->conf.topk * num_possible_cpus());
+	if (all == NULL) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	*total = 0;
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_sketch_cpu *c = s->cpu[cpu];
+
+		*total += READ_ONCE(c->total);
+
+		for(i = 0; i < s->conf.topk; i++)
+		{
+			if (READ_ONCE(c->slot[i].count))
+				all[n++] = c->slot[i];
+		}
+	}
+
+	/* merge the same flows seen by different cpus */
+
+	sort(all, n, sizeof(*all), pfq_sketch_slot_key_cmp, NULL);
+
+	for(i = 0, m = 0; i < n; i++)
+	{
+		if (m && pfq_sketch_slot_key_cmp(&all[m-1], &all[i]) == 0)
+			all[m-1].count += all[i].count;
+		else
+			all[m++] = all[i];
+	}
+
+	sort(all, m, sizeof(*all), pfq_sketch_slot_count_cmp, NULL);
+
+	if (*size > m)
+		*size = m;
+
+	for(i = 0; i < *size; i++)
+	{
+		entry[i].key   = all[i].key;
+		entry[i].count = all[i].count;
+	}
+out:
+	mutex_unlock(&pfq_sketches_lock);
+	vfree(all);
+	return err;
+}
@@ -0,0 +1,83 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_SKETCH_H
+#define PFQ_SKETCH_H
+
+#include <pfq/define.h>
+#include <pfq/types.h>
+
+#include <linux/pf_q.h>
+#include <linux/rcupdate.h>
+#include <linux/types.h>
+
+
+/*
+ * heavy-hitter sketch: a count-min sketch (conservative update) per cpu,
+ * plus a set-associative table of the flows with the largest estimates...
+ */
+
+struct pfq_sketch_slot
+{
+	uint32_t		hash;
+	uint64_t		count;
+	struct pfq_sketch_key	key;
+};
+
+
+struct pfq_sketch_cpu
+{
+	uint64_t		total;
+	uint64_t		*row;		/* depth * width */
+	struct pfq_sketch_slot	*slot;		/* topk */
+};
+
+
+struct pfq_sketch
+{
+	struct pfq_so_sketch	 conf;
+	pfq_id_t		 owner;		/* creating socket */
+	uint32_t		 seed;
+	struct pfq_sketch_cpu	**cpu;		/* nr_cpu_ids */
+};
+
+
+/* control path: sketches are owned by the creating socket */
+
+extern int  pfq_sketch_create(pfq_id_t owner, struct pfq_so_sketch const *conf);
+extern int  pfq_sketch_destroy(pfq_id_t owner, int id);
+extern int  pfq_sketch_reset(pfq_id_t owner, int id);
+extern void pfq_sketches_release(pfq_id_t owner);
+extern void pfq_sketches_destruct(void);
+
+extern int  pfq_sketch_topk(int id, struct pfq_sketch_entry *entry, size_t *size, uint64_t *total);
+
+/* packet path (under rcu_read_lock) */
+
+extern struct pfq_sketch * pfq_sketch_get(int id);
+
+extern uint64_t pfq_sketch_update(struct pfq_sketch *s, struct pfq_sketch_key const *key, uint64_t inc);
+extern uint64_t pfq_sketch_estimate(struct pfq_sketch *s, struct pfq_sketch_key const *key);
+
+
+#endif /* PFQ_SKETCH_H */
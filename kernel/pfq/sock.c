@@ -197,6 +197,11 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
         so->tx_slot_size  = PFQ_SHARED_QUEUE_SLOT_SIZE(xmitlen);
 	so->txq_num_async = 0;
 
+	/* flow record ring setup */
+
+	so->flow_queue_len = 0;
+	spin_lock_init(&so->flow_lock);
+
 	/* Tx async queues setup */
 
 	for(i = 0; i < Q_MAX_TX_QUEUES; ++i)
@@ -259,6 +264,44 @@ pfq_sock_tx_unbind(struct pfq_sock *so)
 }
 
 
+/*
+ * push a record into the flow ring of the socket: records are produced by
+ * the flow tables of all the cpus, and consumed by user space...
+ */
+
+bool
+pfq_sock_flow_record(struct pfq_sock *so, struct pfq_flow_record const *rec)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	const unsigned int len = (unsigned int)so->flow_queue_len;
+	struct pfq_flow_record *ring;
+	unsigned int prod;
+	bool ret = false;
+
+	/* the length is the one of the socket: the shared header is writable by user space */
+
+	if (sq == NULL || len == 0)
+		return false;
+
+	ring = pfq_sock_flow_queue_mem(so);
+
+	spin_lock_bh(&so->flow_lock);
+
+	prod = sq->flow.prod.index;
+
+	if (prod - __atomic_load_n(&sq->flow.cons.index, __ATOMIC_ACQUIRE) < len) {
+		ring[prod & (len - 1)] = *rec;
+		__atomic_store_n(&sq->flow.prod.index, prod + 1, __ATOMIC_RELEASE);
+		ret = true;
+	}
+	else
+		sq->flow.lost++;
+
+	spin_unlock_bh(&so->flow_lock);
+	return ret;
+}
+
+
 int
 pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem)
 {
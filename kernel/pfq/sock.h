@@ -42,6 +42,9 @@
 #endif
 
 
+struct pfq_flow_record;
+
+
 static inline struct pfq_sock *
 pfq_sk(struct sock *sk)
 {
@@ -84,6 +87,9 @@ struct pfq_sock
 	size_t			tx_queue_len;
 	size_t			tx_slot_size;
 
+	size_t			flow_queue_len;
+	spinlock_t		flow_lock;	/* flow record producers */
+
 	wait_queue_head_t	waitqueue;
 
         size_t			txq_num_async;
@@ -167,6 +173,8 @@ extern void	pfq_sock_release_id(pfq_id_t id);
 extern int	pfq_sock_tx_bind(struct pfq_sock *so, int tid, int if_index, int queue);
 extern int	pfq_sock_tx_unbind(struct pfq_sock *so);
 
+extern bool	pfq_sock_flow_record(struct pfq_sock *so, struct pfq_flow_record const *rec);
+
 extern int	pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem);
 extern int	pfq_sock_disable(struct pfq_sock *so);
 
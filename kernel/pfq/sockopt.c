@@ -22,6 +22,7 @@
  ****************************************************************/
 
 #include <lang/engine.h>
+#include <lang/histogram.h>
 #include <lang/symtable.h>
 
 #include <pfq/bpf.h>
@@ -30,16 +31,22 @@
 #include <pfq/global.h>
 #include <pfq/group.h>
 #include <pfq/io.h>
+#include <pfq/maps.h>
 #include <pfq/memory.h>
 #include <pfq/netdev.h>
 #include <pfq/percpu.h>
 #include <pfq/printk.h>
 #include <pfq/queue.h>
+#include <pfq/sketch.h>
 #include <pfq/sock.h>
 #include <pfq/sockopt.h>
 #include <pfq/stats.h>
 #include <pfq/thread.h>
 
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
 
 int pfq_getsockopt(struct socket *sock,
                     int level, int optname,
@@ -293,6 +300,268 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_GROUP_SHED:
+        {
+                struct pfq_group *group;
+                struct pfq_group_shed shed;
+                pfq_gid_t gid;
+
+                if (len != sizeof(shed))
+                        return -EINVAL;
+
+                if (copy_from_user(&shed, optval, sizeof(shed)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)shed.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+		if (pfq_group_is_free(gid)) {
+                        printk(KERN_INFO "[PFQ|%d] group shed error: gid=%d is a free group!\n",
+                               so->id, gid);
+                        return -EACCES;
+		}
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group shed error: gid=%d permission denied!\n",
+                               so->id, gid);
+                        return -EACCES;
+                }
+
+		shed.shed = (long unsigned)sparse_read(group->shed, shed);
+		shed.over = (long unsigned)sparse_read(group->shed, over);
+		shed.sample_in  = (long unsigned)sparse_read(group->shed, sample_in);
+		shed.sample_out = (long unsigned)sparse_read(group->shed, sample_out);
+		shed.police_in  = (long unsigned)sparse_read(group->shed, police_in);
+		shed.police_out = (long unsigned)sparse_read(group->shed, police_out);
+		shed.dedup      = (long unsigned)sparse_read(group->shed, dedup);
+		shed.dedup_coll = (long unsigned)sparse_read(group->shed, dedup_coll);
+
+                if (copy_to_user(optval, &shed, sizeof(shed)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_BUDGET:
+        {
+                struct pfq_so_group_budget value;
+                struct pfq_group_budget budget;
+                pfq_gid_t gid;
+
+                if (len != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, sizeof(value)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)value.gid;
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group budget error: gid=%d permission denied!\n",
+                               so->id, value.gid);
+                        return -EACCES;
+                }
+
+                if (pfq_group_get_budget(gid, &budget) < 0)
+                        return -EINVAL;
+
+                value.priority = budget.priority;
+                value.ns_batch = budget.ns_batch;
+                value.pkt_ms   = budget.pkt_ms;
+                value.shed     = budget.shed;
+                value.sample   = budget.sample;
+
+                if (copy_to_user(optval, &value, sizeof(value)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_PROFILE:
+        {
+                struct pfq_lang_computation_tree *comp;
+                struct pfq_so_group_profile prof;
+                struct pfq_group *group;
+                pfq_gid_t gid;
+                size_t n;
+                int err = 0;
+
+                if (len != sizeof(prof))
+                        return -EINVAL;
+
+                if (copy_from_user(&prof, optval, sizeof(prof)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)prof.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group profile error: gid=%d permission denied!\n",
+                               so->id, gid);
+                        return -EACCES;
+                }
+
+                /* the computation is not replaced while the groups are locked */
+
+                pfq_group_lock();
+
+                comp = (struct pfq_lang_computation_tree *)atomic_long_read(&group->comp);
+                if (comp == NULL || comp->profile == NULL) {
+                        pfq_group_unlock();
+                        return -ENODATA;
+                }
+
+                for(n = 0; n < min(prof.size, comp->size); n++)
+                {
+                        struct pfq_lang_node_profile p;
+                        pfq_lang_computation_profile(comp, n, &p);
+                        if (copy_to_user(&prof.node[n], &p, sizeof(p))) {
+                                err = -EFAULT;
+                                break;
+                        }
+                }
+
+                prof.size = comp->size;
+
+                pfq_group_unlock();
+
+                if (err)
+                        return err;
+
+                if (copy_to_user(optval, &prof, sizeof(prof)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_HISTOGRAM:
+        {
+                struct pfq_lang_computation_tree *comp;
+                struct pfq_so_group_histogram hist;
+                uint64_t *edges, *count;
+                struct pfq_group *group;
+                pfq_gid_t gid;
+                size_t size;
+                int err;
+
+                if (len != sizeof(hist))
+                        return -EINVAL;
+
+                if (copy_from_user(&hist, optval, sizeof(hist)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)hist.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group histogram error: gid=%d permission denied!\n",
+                               so->id, gid);
+                        return -EACCES;
+                }
+
+                size = min_t(size_t, hist.size, Q_HISTOGRAM_MAX_EDGES+1);
+
+                count = kcalloc(2 * Q_HISTOGRAM_MAX_EDGES + 1, sizeof(uint64_t), GFP_KERNEL);
+                if (count == NULL)
+                        return -ENOMEM;
+
+                edges = count + Q_HISTOGRAM_MAX_EDGES + 1;
+
+                /* the computation is not replaced while the groups are locked */
+
+                pfq_group_lock();
+
+                comp = (struct pfq_lang_computation_tree *)atomic_long_read(&group->comp);
+
+                err = comp ? pfq_lang_histogram_read(comp, hist.id, edges, count, &size) : -ENOENT;
+
+                pfq_group_unlock();
+
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] group histogram error: gid=%d id=%d (%d)!\n", so->id, gid, hist.id, err);
+                        kfree(count);
+                        return err;
+                }
+
+                if (hist.size &&
+                    (copy_to_user(hist.count, count, sizeof(uint64_t) * min(hist.size, size)) ||
+                     copy_to_user(hist.edges, edges, sizeof(uint64_t) * (min(hist.size, size) - 1)))) {
+                        kfree(count);
+                        return -EFAULT;
+                }
+
+                kfree(count);
+
+                hist.size = size;
+
+                if (copy_to_user(optval, &hist, sizeof(hist)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_MAP_INFO:
+        {
+                struct pfq_map_info info;
+                int err;
+
+                if (len != sizeof(info))
+                        return -EINVAL;
+
+                if (copy_from_user(&info, optval, sizeof(info)))
+                        return -EFAULT;
+
+                err = pfq_map_info(info.id, &info);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] map info error: id=%d not found!\n", so->id, info.id);
+                        return err;
+                }
+
+                if (copy_to_user(optval, &info, sizeof(info)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_SKETCH_TOPK:
+        {
+                struct pfq_so_sketch_topk value;
+                struct pfq_sketch_entry *entry;
+                int err;
+
+                if (len != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, sizeof(value)))
+                        return -EFAULT;
+
+                value.size = min_t(size_t, value.size, Q_SKETCH_MAX_TOPK);
+
+                entry = vmalloc(sizeof(*entry) * (value.size ? value.size : 1));
+                if (entry == NULL)
+                        return -ENOMEM;
+
+                err = pfq_sketch_topk(value.id, entry, &value.size, &value.total);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] sketch topk error: id=%d (%d)!\n", so->id, value.id, err);
+                        vfree(entry);
+                        return err;
+                }
+
+                if (copy_to_user(value.entry, entry, sizeof(*entry) * value.size) ||
+                    copy_to_user(optval, &value, sizeof(value))) {
+                        vfree(entry);
+                        return -EFAULT;
+                }
+
+                vfree(entry);
+        } break;
+
         case Q_SO_GET_WEIGHT:
         {
                 if (len != sizeof(so->weight))
@@ -424,6 +693,61 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_BIND_TX:
+        {
+                struct pfq_so_binding bind;
+		pfq_gid_t gid;
+
+                if (optlen != sizeof(bind))
+                        return -EINVAL;
+
+                if (copy_from_user(&bind, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)bind.gid;
+
+                if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] add bind Tx: gid=%d not joined!\n", so->id, bind.gid);
+			return -EACCES;
+		}
+
+                if (!pfq_dev_check_by_index(bind.ifindex)) {
+                        printk(KERN_INFO "[PFQ|%d] bind Tx: invalid ifindex=%d!\n", so->id, bind.ifindex);
+                        return -EACCES;
+                }
+
+                pfq_devmap_tx_update(Q_DEVMAP_SET, bind.ifindex, gid);
+
+                pr_devel("[PFQ|%d] group id=%d bind Tx: device ifindex=%d\n",
+					so->id, bind.gid, bind.ifindex);
+
+        } break;
+
+        case Q_SO_GROUP_UNBIND_TX:
+        {
+                struct pfq_so_binding bind;
+		pfq_gid_t gid;
+
+                if (optlen != sizeof(bind))
+                        return -EINVAL;
+
+                if (copy_from_user(&bind, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)bind.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group id=%d unbind Tx: gid=%d not joined!\n", so->id, gid, bind.gid);
+			return -EACCES;
+		}
+
+                pfq_devmap_tx_update(Q_DEVMAP_RESET, bind.ifindex, gid);
+
+                pr_devel("[PFQ|%d] group id=%d unbind Tx: device ifindex=%d\n",
+					so->id, gid, bind.ifindex);
+
+        } break;
+
         case Q_SO_EGRESS_BIND:
         {
                 struct pfq_so_binding bind;
@@ -541,6 +865,31 @@ int pfq_setsockopt(struct socket *sock,
                 pr_devel("[PFQ|%d] tx_queue: slots=%zu\n", so->id, so->tx_queue_len);
         } break;
 
+        case Q_SO_SET_FLOW_SLOTS:
+        {
+                typeof (so->flow_queue_len) slots;
+
+                if (optlen != sizeof(slots))
+                        return -EINVAL;
+                if (copy_from_user(&slots, optval, optlen))
+                        return -EFAULT;
+
+                if (pfq_sock_shared_queue(so)) {
+                        printk(KERN_INFO "[PFQ|%d] flow slots: socket enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                if (slots > Q_MAX_SOCKQUEUE_LEN) {
+                        printk(KERN_INFO "[PFQ|%d] invalid flow slots=%zu (max %d)\n",
+                               so->id, slots, Q_MAX_SOCKQUEUE_LEN);
+                        return -EPERM;
+                }
+
+                so->flow_queue_len = slots ? roundup_pow_of_two(slots) : 0;
+
+                pr_devel("[PFQ|%d] flow record ring: slots=%zu\n", so->id, so->flow_queue_len);
+        } break;
+
         case Q_SO_SET_TX_LEN:
         {
                 typeof(so->tx_len) xmitlen;
@@ -665,6 +1014,80 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_EBPF:
+        {
+                struct pfq_so_ebpf ebpf;
+		pfq_gid_t gid;
+
+                if (optlen != sizeof(ebpf))
+                        return -EINVAL;
+
+                if (copy_from_user(&ebpf, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)ebpf.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] ebpf: gid=%d not joined!\n", so->id, ebpf.gid);
+			return -EACCES;
+		}
+
+                if (ebpf.fd >= 0) {  /* set the program */
+
+                        struct bpf_prog *prog;
+#ifndef PFQ_EBPF_SUPPORT
+                        printk(KERN_INFO "[PFQ|%d] ebpf error: not supported by this kernel!\n", so->id);
+                        return -EOPNOTSUPP;
+#endif
+                        prog = pfq_get_ebpf_prog(ebpf.fd);
+                        if (prog == NULL) {
+                                printk(KERN_INFO "[PFQ|%d] ebpf error: invalid socket filter program (fd=%d) for gid=%d\n",
+                                       so->id, ebpf.fd, ebpf.gid);
+                                return -EINVAL;
+                        }
+
+                        pfq_group_set_ebpf(gid, prog);
+
+                        pr_devel("[PFQ|%d] ebpf: gid=%d (fd %d)\n", so->id, ebpf.gid, ebpf.fd);
+                }
+                else {
+			/* reset the program */
+                        pfq_group_set_ebpf(gid, NULL);
+                        pr_devel("[PFQ|%d] ebpf: gid=%d (resetting program)\n", so->id, ebpf.gid);
+                }
+
+        } break;
+
+        case Q_SO_RX_FANOUT:
+        {
+                struct pfq_so_rx_fanout fanout;
+                int old;
+
+                if (optlen != sizeof(fanout))
+                        return -EINVAL;
+
+                if (copy_from_user(&fanout, optval, optlen))
+                        return -EFAULT;
+
+                if (!pfq_dev_check_by_index(fanout.ifindex)) {
+                        printk(KERN_INFO "[PFQ|%d] rx fanout: invalid ifindex=%d!\n", so->id, fanout.ifindex);
+                        return -EINVAL;
+                }
+
+                if (fanout.toggle && global->rx_cpu_nr == 0) {
+                        printk(KERN_INFO "[PFQ|%d] rx fanout: no Rx threads running (see rx_cpu)!\n", so->id);
+                        return -EPERM;
+                }
+
+                old = atomic_xchg(&global->rx_fanout[fanout.ifindex & Q_MAX_DEVICE_MASK], fanout.toggle ? 1 : 0);
+                if (old != !!fanout.toggle)
+                        atomic_add(fanout.toggle ? 1 : -1, &global->rx_fanout_nr);
+
+                pr_devel("[PFQ|%d] rx fanout %s for ifindex=%d\n",
+			 so->id, (fanout.toggle ? "enabled" : "disabled"), fanout.ifindex);
+
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT_TOGGLE:
         {
                 struct pfq_so_vlan_toggle vlan;
@@ -689,6 +1112,170 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_BUDGET:
+        {
+                struct pfq_so_group_budget value;
+                struct pfq_group_budget budget;
+                pfq_gid_t gid;
+
+                if (optlen != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)value.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group budget: gid=%d not joined!\n", so->id, value.gid);
+			return -EACCES;
+		}
+
+                if (value.shed != Q_SHED_SKIP && value.shed != Q_SHED_SAMPLE) {
+                        printk(KERN_INFO "[PFQ|%d] group budget error: unknown shed mode %d!\n", so->id, value.shed);
+                        return -EINVAL;
+                }
+
+                if (value.shed == Q_SHED_SAMPLE && value.sample == 0) {
+                        printk(KERN_INFO "[PFQ|%d] group budget error: sample must be > 0!\n", so->id);
+                        return -EINVAL;
+                }
+
+                budget.priority = value.priority;
+                budget.ns_batch = value.ns_batch;
+                budget.pkt_ms   = value.pkt_ms;
+                budget.shed     = value.shed;
+                budget.sample   = value.sample;
+
+                if (pfq_group_set_budget(gid, &budget) < 0)
+                        return -EINVAL;
+
+                pr_devel("[PFQ|%d] group budget: gid=%d priority=%d ns_batch=%u pkt_ms=%u shed=%d sample=%u\n",
+                         so->id, value.gid, value.priority, value.ns_batch, value.pkt_ms, value.shed, value.sample);
+
+        } break;
+
+        case Q_SO_MAP_CREATE:
+        {
+                struct pfq_so_map value;
+                int err;
+
+                if (optlen != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_map_create(so->id, value.id, value.type, value.key_size, value.max_entries);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] map create error: id=%d type=%d key_size=%d max_entries=%u (%d)!\n",
+                               so->id, value.id, value.type, value.key_size, value.max_entries, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] map create: id=%d type=%d key_size=%d max_entries=%u\n",
+                         so->id, value.id, value.type, value.key_size, value.max_entries);
+        } break;
+
+        case Q_SO_MAP_DESTROY:
+        {
+                int id, err;
+
+                if (optlen != sizeof(id))
+                        return -EINVAL;
+
+                if (copy_from_user(&id, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_map_destroy(so->id, id);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] map destroy error: id=%d (%d)!\n", so->id, id, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] map destroy: id=%d\n", so->id, id);
+        } break;
+
+        case Q_SO_MAP_UPDATE:
+        {
+                struct pfq_so_map_update value;
+                struct pfq_map_entry *entry;
+                size_t n, chunk;
+                int err = 0;
+
+                if (optlen != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, optlen))
+                        return -EFAULT;
+
+                entry = kmalloc(sizeof(*entry) * Q_MAP_UPDATE_BATCH, GFP_KERNEL);
+                if (entry == NULL)
+                        return -ENOMEM;
+
+                /* copy and apply the entries a chunk at a time */
+
+                for(n = 0; err == 0 && n < value.size; n += chunk)
+                {
+                        chunk = min_t(size_t, value.size - n, Q_MAP_UPDATE_BATCH);
+
+                        if (copy_from_user(entry, value.entry + n, sizeof(*entry) * chunk)) {
+                                err = -EFAULT;
+                                break;
+                        }
+
+                        err = pfq_map_update(so->id, value.id, value.op, entry, chunk);
+                }
+
+                kfree(entry);
+
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] map update error: id=%d op=%d (%d)!\n", so->id, value.id, value.op, err);
+                        return err;
+                }
+        } break;
+
+        case Q_SO_SKETCH_CREATE:
+        {
+                struct pfq_so_sketch value;
+                int err;
+
+                if (optlen != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_sketch_create(so->id, &value);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] sketch create error: id=%d keys=%llx width=%u depth=%u topk=%u (%d)!\n",
+                               so->id, value.id, (unsigned long long)value.keys, value.width, value.depth, value.topk, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] sketch create: id=%d keys=%llx width=%u depth=%u topk=%u\n",
+                         so->id, value.id, (unsigned long long)value.keys, value.width, value.depth, value.topk);
+        } break;
+
+        case Q_SO_SKETCH_DESTROY:
+        case Q_SO_SKETCH_RESET:
+        {
+                int id, err;
+
+                if (optlen != sizeof(id))
+                        return -EINVAL;
+
+                if (copy_from_user(&id, optval, optlen))
+                        return -EFAULT;
+
+                err = optname == Q_SO_SKETCH_DESTROY ? pfq_sketch_destroy(so->id, id) : pfq_sketch_reset(so->id, id);
+                if (err) {
+                        printk(KERN_INFO "[PFQ|%d] sketch %s error: id=%d (%d)!\n", so->id,
+                               optname == Q_SO_SKETCH_DESTROY ? "destroy" : "reset", id, err);
+                        return err;
+                }
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT:
         {
                 struct pfq_so_vlan_toggle filt;
@@ -911,16 +1498,8 @@ int pfq_setsockopt(struct socket *sock,
 
 		pr_devel_computation_tree(comp);
 
-		/* run init functions */
-
-		if (pfq_lang_computation_init(comp) < 0) {
-                        printk(KERN_INFO "[PFQ|%d] computation: initialization aborted!", so->id);
-                        pfq_lang_computation_destruct(comp);
-                        err = -EPERM;
-                        goto error;
-		}
-
-                /* enable functional program */
+                /* run init functions (or migrate the state of the running
+                 * computation) and enable functional program */
 
                 if (pfq_group_set_prog(gid, comp, context) < 0) {
                         printk(KERN_INFO "[PFQ|%d] computation: set program error!\n", so->id);
@@ -931,7 +1510,7 @@ int pfq_setsockopt(struct socket *sock,
 		kfree(descr);
                 return 0;
 
-	error:  kfree(comp);
+	error:  pfq_lang_computation_free(comp);
 		kfree(context);
 		kfree(descr);
 		return err;
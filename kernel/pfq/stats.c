@@ -69,6 +69,24 @@ void pfq_group_counters_reset(struct pfq_group_counters __percpu *counters)
 	}
 }
 
+void pfq_group_shed_stats_reset(struct pfq_group_shed_stats __percpu *stats)
+{
+	int i;
+	for_each_present_cpu(i)
+	{
+		struct pfq_group_shed_stats * stat = per_cpu_ptr(stats, i);
+
+		local_set(&stat->shed, 0);
+		local_set(&stat->over, 0);
+		local_set(&stat->sample_in, 0);
+		local_set(&stat->sample_out, 0);
+		local_set(&stat->police_in, 0);
+		local_set(&stat->police_out, 0);
+		local_set(&stat->dedup, 0);
+		local_set(&stat->dedup_coll, 0);
+	}
+}
+
 
 void pfq_memory_stats_reset(struct pfq_memory_stats __percpu *stats)
 {
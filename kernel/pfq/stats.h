@@ -56,6 +56,19 @@ struct pfq_group_counters
 };
 
 
+struct pfq_group_shed_stats
+{
+	local_t shed;		/* packets skipped or sampled out because of overload */
+	local_t over;		/* times the group exceeded its budget */
+	local_t sample_in;	/* packets kept by sampling functions */
+	local_t sample_out;	/* packets sampled out */
+	local_t police_in;	/* packets conforming to policers */
+	local_t police_out;	/* packets exceeding policers */
+	local_t dedup;		/* duplicates dropped by dedup */
+	local_t dedup_coll;	/* live dedup entries evicted (table too small) */
+};
+
+
 struct pfq_memory_stats
 {
 	local_t os_alloc;
@@ -113,6 +126,7 @@ struct pfq_pool_stats
 extern void pfq_kernel_stats_read(struct pfq_kernel_stats __percpu *kstats, struct pfq_stats *stats);
 extern void pfq_kernel_stats_reset(struct pfq_kernel_stats __percpu *stats);
 extern void pfq_group_counters_reset(struct pfq_group_counters __percpu *counters);
+extern void pfq_group_shed_stats_reset(struct pfq_group_shed_stats __percpu *stats);
 extern void pfq_memory_stats_reset(struct pfq_memory_stats __percpu *stats);
 
 static inline void pfq_global_stats_reset(struct pfq_kernel_stats __percpu *stats)
@@ -24,7 +24,9 @@
 #include <pfq/define.h>
 #include <pfq/io.h>
 #include <pfq/memory.h>
+#include <pfq/percpu.h>
 #include <pfq/sock.h>
+#include <pfq/spsc_fifo.h>
 #include <pfq/thread.h>
 
 #include <linux/kernel.h>
@@ -50,6 +52,18 @@ static struct pfq_thread_tx_data pfq_thread_tx_pool[Q_MAX_CPU] =
 };
 
 
+static struct pfq_thread_rx_data pfq_thread_rx_pool[Q_MAX_CPU] =
+{
+	[0 ... Q_MAX_CPU-1] = {
+		.id	= -1,
+		.cpu    = -1,
+		.task	= NULL,
+		.fifo	= { NULL },
+		.ret	= { NULL }
+	}
+};
+
+
 #ifdef PFQ_DEBUG
 static void
 pfq_thread_ping(const char *type, struct pfq_thread_data const *data)
@@ -133,6 +147,140 @@ pfq_tx_thread(void *_data)
 }
 
 
+static int
+pfq_rx_thread(void *_data)
+{
+	struct pfq_thread_rx_data *data = (struct pfq_thread_rx_data *)_data;
+
+#ifdef PFQ_DEBUG
+        int now = 0;
+#endif
+
+	if (data == NULL) {
+		printk(KERN_INFO "[PFQ] Rx thread data error!\n");
+		return -EPERM;
+	}
+
+	printk(KERN_INFO "[PFQ] Rx[%d] thread started on cpu %d.\n", data->id, data->cpu);
+
+	__set_current_state(TASK_RUNNING);
+
+        for(;;)
+	{
+		/* drain the queues of the capturing cpus */
+
+		int total_recv = 0, cpu;
+
+		local_bh_disable();
+
+		for(cpu = 0; cpu < Q_MAX_CPU; cpu++)
+		{
+			struct pfq_spsc_fifo *fifo = data->fifo[cpu];
+			struct sk_buff *skb;
+			int budget = Q_BUFF_BATCH_LEN;
+
+			if (fifo == NULL)
+				continue;
+
+			while (budget-- > 0 && (skb = pfq_spsc_pop(fifo))) {
+				pfq_receive_fanout(skb);
+				total_recv++;
+			}
+		}
+
+		/* nothing to do: flush the pending batch */
+
+		if (total_recv == 0)
+			pfq_receive(NULL, NULL);
+
+		local_bh_enable();
+
+                if (kthread_should_stop())
+                        break;
+
+#ifdef PFQ_DEBUG
+		if (now != jiffies/(HZ*10)) {
+			now = jiffies/(HZ*10);
+			pfq_thread_ping("Rx", (struct pfq_thread_data *)data);
+		}
+#endif
+
+		if (total_recv == 0)
+			pfq_relax();
+
+		if (!atomic_read(&global->rx_fanout_nr))
+			msleep(1);
+	}
+
+        printk(KERN_INFO "[PFQ] Rx[%d] thread stopped on cpu %d.\n", data->id, data->cpu);
+	data->task = NULL;
+        return 0;
+}
+
+
+int
+pfq_rx_thread_enqueue(int tid, struct sk_buff *skb, int cpu)
+{
+	struct pfq_spsc_fifo *fifo = pfq_thread_rx_pool[tid].fifo[cpu & Q_MAX_CPU_MASK];
+
+	if (unlikely(fifo == NULL))
+		return -1;
+
+	return pfq_spsc_push(fifo, skb) ? 0 : -1;
+}
+
+
+/*
+ * pool skbs are released by the Rx thread that processed them, on its own cpu:
+ * the skb is queued back to the capturing cpu, which owns the pool...
+ */
+
+void
+pfq_rx_thread_release(struct sk_buff *skb)
+{
+	int cpu = smp_processor_id(), tid;
+
+	for(tid = 0; tid < global->rx_cpu_nr; tid++)
+	{
+		struct pfq_spsc_fifo *ret;
+
+		if (global->rx_cpu[tid] != cpu)
+			continue;
+
+		ret = pfq_thread_rx_pool[tid].ret[PFQ_CB(skb)->cpu];
+		if (likely(ret && pfq_spsc_push(ret, skb)))
+			return;
+		break;
+	}
+
+	pfq_printk_skb("[PFQ] internal error (pool skb not released)", skb);
+	sparse_inc(global->percpu_memory, os_free);
+}
+
+
+/*
+ * ...and put back into the pool as the capturing cpu drains the queue.
+ */
+
+void
+pfq_rx_thread_reclaim(struct pfq_skb_pool *pool, int cpu)
+{
+	int tid;
+
+	for(tid = 0; tid < global->rx_cpu_nr; tid++)
+	{
+		struct pfq_spsc_fifo *ret = pfq_thread_rx_pool[tid].ret[cpu & Q_MAX_CPU_MASK];
+		struct sk_buff *skb;
+
+		if (ret == NULL)
+			continue;
+
+		while ((skb = pfq_spsc_pop(ret)))
+			pfq_free_skb_pool(skb, pool);
+	}
+}
+
+
 int
 pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 {
@@ -274,6 +422,111 @@ pfq_stop_tx_threads(void)
 }
 
 
+static void
+pfq_rx_fifo_free_skb(void *skb)
+{
+	/* pool skbs are released along with the pool */
+
+	if (((struct sk_buff *)skb)->peeked)
+		return;
+
+	sparse_inc(global->percpu_memory, os_free);
+	kfree_skb((struct sk_buff *)skb);
+}
+
+
+int
+pfq_start_rx_threads(void)
+{
+	int err = 0;
+
+	if (global->rx_cpu_nr)
+	{
+		int n, cpu, node;
+		printk(KERN_INFO "[PFQ] starting %d Rx thread(s)...\n", global->rx_cpu_nr);
+
+		for(n = 0; n < global->rx_cpu_nr; n++)
+		{
+			struct pfq_thread_rx_data *data = &pfq_thread_rx_pool[n];
+
+			node = cpu_to_node(global->rx_cpu[n]);
+
+			/* one single-producer queue for each capturing cpu */
+
+			for_each_present_cpu(cpu)
+			{
+				data->fifo[cpu] = pfq_spsc_init(Q_RX_FANOUT_QUEUE_LEN, cpu);
+				data->ret[cpu]  = pfq_spsc_init(Q_RX_FANOUT_RETURN_LEN, global->rx_cpu[n]);
+				if (data->fifo[cpu] == NULL || data->ret[cpu] == NULL) {
+					printk(KERN_INFO "[PFQ] Rx[%d] thread: could not allocate queue!\n", n);
+					return -ENOMEM;
+				}
+			}
+
+			data->id = n;
+			data->cpu = global->rx_cpu[n];
+			data->task = kthread_create_on_node(pfq_rx_thread,
+							    data, node,
+							    "kpfq-Rx/%d", data->cpu);
+			if (IS_ERR(data->task)) {
+				printk(KERN_INFO "[PFQ] kernel_thread: create failed on cpu %d!\n",
+				       data->cpu);
+				err = PTR_ERR(data->task);
+				data->task = NULL;
+				return err;
+			}
+
+			kthread_bind(data->task, data->cpu);
+
+			pr_devel("[PFQ] created Rx[%d] kthread on cpu %d...\n", data->id, data->cpu);
+
+			wake_up_process(data->task);
+		}
+	}
+
+	return err;
+}
+
+
+void
+pfq_stop_rx_threads(void)
+{
+	if (global->rx_cpu_nr)
+	{
+		int n, cpu;
+
+		printk(KERN_INFO "[PFQ] stopping %d Rx thread(s)...\n", global->rx_cpu_nr);
+
+		for(n = 0; n < global->rx_cpu_nr; n++)
+		{
+			struct pfq_thread_rx_data *data = &pfq_thread_rx_pool[n];
+
+			if (data->task)
+			{
+				pr_devel("[PFQ stopping Rx[%d] thread@%p\n", data->id, data->task);
+
+				kthread_stop(data->task);
+				data->id   = -1;
+				data->cpu  = -1;
+				data->task = NULL;
+			}
+
+			for(cpu = 0; cpu < Q_MAX_CPU; cpu++)
+			{
+				if (data->fifo[cpu]) {
+					pfq_spsc_free(Q_RX_FANOUT_QUEUE_LEN, data->fifo[cpu], pfq_rx_fifo_free_skb);
+					data->fifo[cpu] = NULL;
+				}
+				if (data->ret[cpu]) {
+					pfq_spsc_free(Q_RX_FANOUT_RETURN_LEN, data->ret[cpu], NULL);
+					data->ret[cpu] = NULL;
+				}
+			}
+		}
+	}
+}
+
+
 int
 pfq_check_threads_affinity(void)
 {
@@ -297,6 +550,22 @@ pfq_check_threads_affinity(void)
 		inuse[cpu] = true;
 	}
 
+	/* check Rx thread affinity */
+
+	for(i=0; i < global->rx_cpu_nr; ++i)
+	{
+		cpu = global->rx_cpu[i];
+		if (cpu < 0 || cpu >= num_online_cpus()) {
+			printk(KERN_INFO "[PFQ] error: Rx[%d] thread bad affinity on cpu:%d!\n", i, cpu);
+			return -EFAULT;
+		}
+		if (inuse[cpu]) {
+			printk(KERN_INFO "[PFQ] error: Rx[%d] thread cpu:%d already in use!\n", i, cpu);
+			return -EFAULT;
+		}
+		inuse[cpu] = true;
+	}
+
 	return 0;
 }
 
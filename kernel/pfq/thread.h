@@ -32,6 +32,9 @@
 
 
 struct pfq_sock;
+struct pfq_spsc_fifo;
+struct pfq_skb_pool;
+struct sk_buff;
 
 extern struct task_struct *kthread_tx_pool [Q_MAX_CPU];
 
@@ -40,6 +43,12 @@ extern void pfq_stop_tx_threads(void);
 extern int  pfq_bind_tx_thread(int tx_index, struct pfq_sock *sock, int sock_queue);
 extern int  pfq_unbind_tx_thread(struct pfq_sock *sock);
 
+extern int  pfq_start_rx_threads(void);
+extern void pfq_stop_rx_threads(void);
+extern int  pfq_rx_thread_enqueue(int rx_index, struct sk_buff *skb, int cpu);
+extern void pfq_rx_thread_release(struct sk_buff *skb);
+extern void pfq_rx_thread_reclaim(struct pfq_skb_pool *pool, int cpu);
+
 extern int pfq_check_threads_affinity(void);
 extern int pfq_check_napi_contexts(void);
 
@@ -65,6 +74,23 @@ struct pfq_thread_tx_data
 } ____pfq_cacheline_aligned;
 
 
+struct pfq_thread_rx_data
+{
+	int			id;
+	int			cpu;
+	struct task_struct *	task;
+
+	/* specific for Rx data: a queue for each capturing cpu */
+
+	struct pfq_spsc_fifo *	fifo[Q_MAX_CPU];
+
+	/* ...and one to give the pool skbs back to it */
+
+	struct pfq_spsc_fifo *	ret[Q_MAX_CPU];
+
+} ____pfq_cacheline_aligned;
+
+
 
 static inline
 void pfq_relax(void)
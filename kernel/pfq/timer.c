@@ -21,6 +21,7 @@
  *
  ****************************************************************/
 
+#include <pfq/flow.h>
 #include <pfq/percpu.h>
 #include <pfq/timer.h>
 #include <pfq/io.h>
@@ -31,6 +32,7 @@ static void pfq_timer(unsigned long cpu)
 	struct pfq_percpu_data *data;
 
 	pfq_receive(NULL, NULL);
+	pfq_flow_table_expire();
 	data = per_cpu_ptr(global->percpu_data, cpu);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 31) || LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
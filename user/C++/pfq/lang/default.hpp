@@ -379,6 +379,10 @@ namespace pfq { namespace lang {
 
         auto is_voip         = predicate ("is_voip");
 
+        //! Evaluate to \c true if the Qbuff belongs to a call (SIP with Call-ID, or RTP/RTCP of an SDP endpoint).
+
+        auto is_call         = predicate ("is_call");
+
         //
         // default properties:
         //
@@ -398,6 +402,32 @@ namespace pfq { namespace lang {
 
         auto get_mark   = property("get_mark");
 
+        //! Evaluate to the hash of the Call-ID of the call of the packet.
+        /*!
+         * \see is_call
+         */
+
+        auto call_id    = property("call_id");
+
+        //! Evaluate to the number of packets of the flow, the current one included.
+        /*! Flows are IPv4 5-tuples (both directions) kept in a per-CPU table.
+         *
+         * when (flow_count > 1000, drop)
+         */
+
+        auto flow_count = property("flow_count");
+
+        //! Evaluate to the number of bytes of the flow, the current packet included.
+
+        auto flow_bytes = property("flow_bytes");
+
+        //! Evaluate to the state of the flow, possibly set by \c flow_put_state function.
+        /*
+         * \see flow_put_state
+         */
+
+        auto flow_state = property("flow_state");
+
         //! Evaluate to the \c tos field of the IP header.
 
         auto ip_tos     = property("ip_tos");
@@ -580,6 +610,17 @@ namespace pfq { namespace lang {
 
         auto steer_voip  = function("steer_voip");
 
+        //! Dispatch the packet across the sockets
+        /*!
+         * Dispatch by call: the media endpoints announced in the SDP of SIP
+         * messages are tracked, so that signalling and RTP/RTCP of a call are
+         * steered to the same socket. Example:
+         *
+         * steer_call
+         */
+
+        auto steer_call  = function("steer_call");
+
         //! Dispatch the packet across the sockets
         /*!
          * Dispatch with a randomized algorithm that guarantees
@@ -886,6 +927,33 @@ namespace pfq { namespace lang {
 
         auto dec            = [] (int value) { return function("dec", value); };
 
+        //! Set the state of the flow to the given value.
+        /*
+         * Example:
+         *
+         * when (has_dst_port(80), flow_put_state (1))
+         */
+
+        auto flow_put_state = [] (uint32_t value) { return function("flow_put_state", value); };
+
+        //! Pass the first n packets of every flow, drop the others.
+        /*
+         * Example:
+         *
+         * flow_first (10) >> steer_flow
+         */
+
+        auto flow_first     = [] (int n) { return function("flow_first", n); };
+
+        //! Export the flow of the packet: a record is pushed to the flow ring of the sockets of the group when the flow ends.
+        /*
+         * Example:
+         *
+         * flow_export >> drop
+         */
+
+        auto flow_export    = function("flow_export");
+
         //! Monadic version of \c is_l3_proto predicate.
         /*!
          * Predicates are used in conditional expressions, while monadic functions
@@ -1232,6 +1300,354 @@ namespace pfq { namespace lang {
             return std::pow(1 - std::pow(1 - 1.0/m, n * bloomK), bloomK);
         }
 
+        //
+        // lookup maps (created and updated at runtime, see pfq::map_create):
+        //
+
+        //! Evaluate to \c true if the source IP address is found in the given map of IPv4 (or IPv6) addresses.
+        /*!
+         * Example:
+         *
+         * when (map_src (1), drop)
+         */
+
+        auto map_src         = [] (int id) { return predicate("map_src", id); };
+
+        //! Evaluate to \c true if the destination IP address is found in the given map.
+
+        auto map_dst         = [] (int id) { return predicate("map_dst", id); };
+
+        //! Evaluate to \c true if the source or the destination IP address is found in the given map.
+
+        auto map_addr        = [] (int id) { return predicate("map_addr", id); };
+
+        //! Monadic counterpart of \c map_src function. \see map_src
+
+        auto map_src_filter  = [] (int id) { return function("map_src_filter", id); };
+
+        //! Monadic counterpart of \c map_dst function. \see map_dst
+
+        auto map_dst_filter  = [] (int id) { return function("map_dst_filter", id); };
+
+        //! Monadic counterpart of \c map_addr function. \see map_addr
+
+        auto map_addr_filter = [] (int id) { return function("map_addr_filter", id); };
+
+        //! Evaluate to the value associated with the source IP address in the given map.
+
+        auto map_src_value   = [] (int id) { return property("map_src_value", id); };
+
+        //! Evaluate to the value associated with the destination IP address in the given map.
+
+        auto map_dst_value   = [] (int id) { return property("map_dst_value", id); };
+
+        //! Evaluate to \c true if the 5-tuple of the packet (in either direction) is found in the given map.
+        /*!
+         * Keys are made of addresses, ports and protocol in network order (13 bytes for IPv4, 37 for IPv6).
+         */
+
+        auto map_tuple       = [] (int id) { return predicate("map_tuple", id); };
+
+        //! Monadic counterpart of \c map_tuple function. \see map_tuple
+
+        auto map_tuple_filter = [] (int id) { return function("map_tuple_filter", id); };
+
+        //! Evaluate to the value associated with the 5-tuple of the packet in the given map.
+
+        auto map_tuple_value = [] (int id) { return property("map_tuple_value", id); };
+
+        //! Evaluate to the value associated with the given property in the given map.
+        /*!
+         * The property is the index of array maps, or the key (in network byte order) of the others.
+         *
+         * Example:
+         *
+         * when (map_value (2, tcp_dest) == 1, drop)
+         */
+
+        template <typename P, typename std::enable_if<is_property<P>::value>::type * = nullptr>
+        auto inline
+        map_value(int id, P const &prop)
+        -> decltype(property(nullptr, id, prop))
+        {
+            return property("map_value", id, prop);
+        }
+
+        //
+        // longest prefix match:
+        //
+
+        //! Predicate that evaluates to \c true when the source or the destination address
+        //! of the packet matches one of the given IPv4/IPv6 networks (in CIDR notation).
+        /*!
+         * Example:
+         *
+         * when (lpm ({"10.0.0.0/8", "192.168.0.0/16", "2001:db8::/32"}), drop)
+         */
+
+        auto lpm            = [] (std::vector<std::string> const &nets) { return predicate("lpm", nets); };
+
+        //! Similarly to \c lpm, evaluates to \c true when the source address matches.  \see lpm
+
+        auto lpm_src        = [] (std::vector<std::string> const &nets) { return predicate("lpm_src", nets); };
+
+        //! Similarly to \c lpm, evaluates to \c true when the destination address matches.  \see lpm
+
+        auto lpm_dst        = [] (std::vector<std::string> const &nets) { return predicate("lpm_dst", nets); };
+
+        //! Monadic counterpart of \c lpm function.  \see lpm
+
+        auto lpm_filter     = [] (std::vector<std::string> const &nets) { return function("lpm_filter", nets); };
+
+        //! Monadic counterpart of \c lpm_src function.  \see lpm_src
+
+        auto lpm_src_filter = [] (std::vector<std::string> const &nets) { return function("lpm_src_filter", nets); };
+
+        //! Monadic counterpart of \c lpm_dst function.  \see lpm_dst
+
+        auto lpm_dst_filter = [] (std::vector<std::string> const &nets) { return function("lpm_dst_filter", nets); };
+
+        //! Evaluates to the class of the longest network matching the source address.
+        /*!
+         * Classes are given one per network; if empty, the index of the network is returned.
+         */
+
+        auto lpm_src_class  = [] (std::vector<std::string> const &nets, std::vector<uint32_t> const &classes) {
+                                    return property("lpm_src_class", nets, classes);
+                              };
+
+        //! Evaluates to the class of the longest network matching the destination address.  \see lpm_src_class
+
+        auto lpm_dst_class  = [] (std::vector<std::string> const &nets, std::vector<uint32_t> const &classes) {
+                                    return property("lpm_dst_class", nets, classes);
+                              };
+
+        //! Steers the packet by the class of the longest network matching the source
+        //! (or the destination) address. Unmatched packets are dropped.
+
+        auto steer_lpm      = [] (std::vector<std::string> const &nets, std::vector<uint32_t> const &classes) {
+                                    return function("steer_lpm", nets, classes);
+                              };
+
+        //
+        // payload matching:
+        //
+
+        //! Predicate that evaluates to \c true when any of the patterns is found in the payload.
+        /*!
+         * The second argument is the depth of the scan in bytes (0 for the whole payload).
+         * In patterns, \\xHH stands for any byte. Example:
+         *
+         * payload_filter ({"GET ", "POST ", "HTTP/1."}, 16) >> kernel
+         */
+
+        auto payload_match     = [] (std::vector<std::string> const &pats, int depth) { return predicate("payload_match", pats, depth); };
+
+        //! Monadic counterpart of \c payload_match function.  \see payload_match
+
+        auto payload_filter    = [] (std::vector<std::string> const &pats, int depth) { return function("payload_filter", pats, depth); };
+
+        //! Evaluates to the index of the first pattern found in the payload.  \see payload_match
+
+        auto payload_pattern   = [] (std::vector<std::string> const &pats, int depth) { return property("payload_pattern", pats, depth); };
+
+        //! Marks the packet with the index of the pattern found in the payload, plus one.
+
+        auto payload_mark      = [] (std::vector<std::string> const &pats, int depth) { return function("payload_mark", pats, depth); };
+
+        //! Sets the state of the packet to the index of the pattern found in the payload, plus one.
+
+        auto payload_put_state = [] (std::vector<std::string> const &pats, int depth) { return function("payload_put_state", pats, depth); };
+
+        //
+        // heavy hitters (sketches created at runtime, see pfq::sketch_create):
+        //
+
+        //! Counts the packet (or its bytes) in the given sketch.
+        /*!
+         * Example:
+         *
+         * sketch_update (0) >> when (sketch_heavy (0, 100000), log_msg ("heavy hitter"))
+         */
+
+        auto sketch_update   = [] (int id) { return function("sketch_update", id); };
+
+        //! Evaluates to the estimate of the flow of the packet in the given sketch (on the current cpu).
+
+        auto sketch_estimate = [] (int id) { return property("sketch_estimate", id); };
+
+        //! Evaluates to \c true if the estimate of the flow of the packet reaches the given threshold.
+
+        auto sketch_heavy    = [] (int id, uint64_t threshold) { return predicate("sketch_heavy", id, threshold); };
+
+        //
+        // sampling (decisions are counted in the group stats):
+        //
+
+        //! Evaluates to \c true for one packet out of n (per cpu).
+        /*!
+         * Example:
+         *
+         * sample_every_filter (1000) >> kernel
+         */
+
+        auto sample_every        = [] (int n) { return predicate("sample_every", n); };
+
+        //! Evaluates to \c true with the given probability.
+
+        auto sample_prob         = [] (double p) { return predicate("sample_prob", details::probability(p)); };
+
+        //! Evaluates to \c true for the packets of a fraction p of the flows (in both directions).
+        /*!
+         * Fragments are sampled on their addresses, so that all the fragments of
+         * a datagram are kept or discarded together.
+         */
+
+        auto sample_flow         = [] (double p) { return predicate("sample_flow", details::probability(p)); };
+
+        //! Monadic counterpart of \c sample_every function.  \see sample_every
+
+        auto sample_every_filter = [] (int n) { return function("sample_every_filter", n); };
+
+        //! Monadic counterpart of \c sample_prob function.  \see sample_prob
+
+        auto sample_prob_filter  = [] (double p) { return function("sample_prob_filter", details::probability(p)); };
+
+        //! Monadic counterpart of \c sample_flow function.  \see sample_flow
+
+        auto sample_flow_filter  = [] (double p) { return function("sample_flow_filter", details::probability(p)); };
+
+        //
+        // policing: per-cpu token buckets, rates in packets per second enforced on each cpu
+        // (decisions are counted in the group stats):
+        //
+
+        //! Evaluates to \c true if the packet conforms to the given rate and burst.
+        /*!
+         * Example:
+         *
+         * conditional (conform(100000, 1000), classify(1), classify(2))
+         */
+
+        auto conform           = [] (uint64_t rate, uint64_t burst) { return predicate("conform", rate, burst); };
+
+        //! Evaluates to \c true if the packet conforms to the given rate and burst of its flow.
+
+        auto flow_conform      = [] (uint64_t rate, uint64_t burst) { return predicate("flow_conform", rate, burst); };
+
+        //! Drops the packets exceeding the given rate and burst.
+
+        auto police            = [] (uint64_t rate, uint64_t burst) { return function("police", rate, burst); };
+
+        //! Drops the packets exceeding the given rate and burst of their flow.
+
+        auto police_flow       = [] (uint64_t rate, uint64_t burst) { return function("police_flow", rate, burst); };
+
+        //! Classifies the packets exceeding the given rate and burst with the given class.
+
+        auto police_class      = [] (uint64_t rate, uint64_t burst, int c) { return function("police_class", rate, burst, c); };
+
+        //! Classifies the packets exceeding the given rate and burst of their flow with the given class.
+
+        auto police_flow_class = [] (uint64_t rate, uint64_t burst, int c) { return function("police_flow_class", rate, burst, c); };
+
+        //
+        // header mangling (IP and TCP/UDP checksums are updated incrementally):
+        //
+
+        //! Sets the source MAC address of the packet.
+        /*!
+         * Example:
+         *
+         * set_eth_src ("4c:60:de:86:55:46")
+         */
+
+        auto set_eth_src  = [] (std::string mac) { return function("set_eth_src", std::move(mac)); };
+
+        //! Sets the destination MAC address of the packet.
+
+        auto set_eth_dst  = [] (std::string mac) { return function("set_eth_dst", std::move(mac)); };
+
+        //! Swaps the source and destination MAC addresses.
+
+        auto swap_eth     = function("swap_eth");
+
+        //! Sets the source IP address (IPv4 or IPv6) of the packets of the same IP version.
+
+        auto set_ip_src   = [] (std::string addr) { return function("set_ip_src", std::move(addr)); };
+
+        //! Sets the destination IP address (IPv4 or IPv6) of the packets of the same IP version.
+
+        auto set_ip_dst   = [] (std::string addr) { return function("set_ip_dst", std::move(addr)); };
+
+        //! Sets the source port of TCP and UDP packets.
+
+        auto set_src_port = [] (int port) { return function("set_src_port", port); };
+
+        //! Sets the destination port of TCP and UDP packets.
+
+        auto set_dst_port = [] (int port) { return function("set_dst_port", port); };
+
+        //! Sets the TTL (IPv4) or the hop limit (IPv6) of the packet.
+
+        auto set_ttl      = [] (int ttl) { return function("set_ttl", ttl); };
+
+        //! Decrements the TTL (IPv4) or the hop limit (IPv6) of the packet, dropping it when expired.
+
+        auto dec_ttl      = function("dec_ttl");
+
+        //! Sets the DSCP of the packet (the ECN bits are preserved).
+
+        auto set_dscp     = [] (int dscp) { return function("set_dscp", dscp); };
+
+        //! Sets the VLAN id of the packet.
+        /*!
+         * Untagged packets are tagged through the accelerated tag, except for
+         * skb-less (XDP) ones, which are left untouched. Tags are never removed.
+         */
+
+        auto set_vlan_id  = [] (int vid) { return function("set_vlan_id", vid); };
+
+        //
+        // histograms (per-cpu buckets, see pfq::group_histogram and /proc/net/pfq/histograms):
+        //
+
+        //! Counts the packet in the bucket of the value of the given property.
+        /*!
+         * The edges of the buckets are in ascending order (at most Q_HISTOGRAM_MAX_EDGES),
+         * the bucket i counts the values in [edges[i-1], edges[i]). Packets for which the
+         * property is nothing are not counted. Histograms are read by group and id.
+         *
+         * Example:
+         *
+         * histogram (0, {64, 128, 256, 512, 1024}, ip_tot_len) >> kernel
+         */
+
+        template <typename P, typename std::enable_if<is_property<P>::value>::type * = nullptr>
+        auto inline
+        histogram(int id, std::vector<uint64_t> const &edges, P const &prop)
+        -> decltype(function(nullptr, id, edges, prop))
+        {
+            return function("histogram", id, edges, prop);
+        }
+
+        //
+        // duplicate suppression (span/tap aggregation):
+        //
+
+        //! Drops the copies of a packet seen within the given window (usec).
+        /*!
+         * The packets are identified by the invariant fields of the IP header (TTL and
+         * checksum are skipped) and the first bytes after it. Non-IP packets are passed.
+         * Duplicates and live entries evicted from the table are counted in the group stats.
+         *
+         * Example:
+         *
+         * dedup (1000) >> kernel
+         */
+
+        auto dedup = [] (uint64_t usec) { return function("dedup", usec); };
+
     }
 
 } // namespace lang
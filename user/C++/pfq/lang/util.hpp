@@ -126,6 +126,15 @@ namespace pfq { namespace lang
                 throw std::runtime_error("pfq::lang::inet_pton");
             return ret;
         }
+
+        //! Probability as fixed point (p * 2^32), as taken by the sampling functions.
+
+        inline uint32_t
+        probability(double p)
+        {
+            return p >= 1.0 ? 0xffffffffU :
+                   p <= 0.0 ? 0U : static_cast<uint32_t>(p * 4294967296.0);
+        }
     }
 
 
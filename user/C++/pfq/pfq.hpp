@@ -564,6 +564,24 @@ namespace pfq {
            return data()->tx_slots;
         }
 
+        //! Specify the length of the flow record ring, in number of records (0 = no ring).
+
+        void
+        flow_slots(size_t value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_flow_slots(q, value));
+        }
+
+        //! Return the length of the flow record ring, as requested.
+
+        size_t
+        flow_slots() const
+        {
+            auto q = this->data();
+            return as<size_t>(q, pfq_get_flow_slots(q));
+        }
+
 
         //! Bind the main group of the socket to the given device/queue.
         /*!
@@ -610,6 +628,40 @@ namespace pfq {
             throw_if(q, pfq_unbind_group(q, gid, dev, queue));
         }
 
+        //! Bind the group to the egress (Tx side) of the given device.
+        /*!
+         * Outgoing packets are captured as well; the direction is
+         * reported in the packet header (info.dir).
+         */
+
+        void
+        bind_group_tx(int gid, const char *dev)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_bind_group_tx(q, gid, dev));
+        }
+
+        //! Unbind the group from the egress (Tx side) of the given device.
+
+        void
+        unbind_group_tx(int gid, const char *dev)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_unbind_group_tx(q, gid, dev));
+        }
+
+        //! Enable/disable the software RSS fan-out on the given device.
+        /*!
+         * Packets are redistributed by flow hash to the Rx kernel threads.
+         */
+
+        void
+        rx_fanout(const char *dev, bool toggle)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_rx_fanout(q, dev, toggle));
+        }
+
         //! Set the socket as egress and bind it to the given device/queue.
         /*!
          * The egress socket is be used by groups as network forwarder.
@@ -818,6 +870,24 @@ namespace pfq {
             throw_if(q, pfq_group_fprog_reset(q, gid));
         }
 
+        //! Specify an eBPF program (socket filter fd) for the given group.
+
+        void
+        set_group_ebpf(int gid, int fd)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ebpf(q, gid, fd));
+        }
+
+        //! Reset the eBPF program for the given group.
+
+        void
+        reset_group_ebpf(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ebpf_reset(q, gid));
+        }
+
 
         //! Wait for packets.
         /*!
@@ -1008,6 +1078,144 @@ namespace pfq {
             });
         }
 
+        //! Set the processing budget of the given group.
+        /*!
+         * The budget is given in nanoseconds per batch and/or packets per millisecond (0 = unlimited).
+         * Groups with a lower priority (higher value) are skipped or sampled when this group is over budget.
+         */
+
+        void
+        group_budget(int gid, int priority, unsigned int ns_batch, unsigned int pkt_ms, int shed = Q_SHED_SKIP, unsigned int sample = 1)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_group_budget(q, gid, priority, ns_batch, pkt_ms, shed, sample));
+        }
+
+        //! Return the processing budget of the given group.
+
+        pfq_so_group_budget
+        group_budget(int gid) const
+        {
+            pfq_so_group_budget budget;
+            auto q = this->data();
+            throw_if(q, pfq_get_group_budget(q, gid, &budget));
+            return budget;
+        }
+
+        //! Create a lookup map, referenced by id in pfq-lang functions.
+        /*!
+         * Keys are in network byte order, except for Q_MAP_ARRAY maps whose key is a uint32_t index.
+         * The map is owned by this socket: it is the only one that can update or destroy it,
+         * and the map is destroyed when the socket is closed.
+         */
+
+        void
+        map_create(int id, int type, int key_size, unsigned int max_entries)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_create(q, id, type, key_size, max_entries));
+        }
+
+        //! Destroy the given lookup map.
+
+        void
+        map_destroy(int id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_destroy(q, id));
+        }
+
+        //! Insert or replace the given entries of a lookup map.
+
+        void
+        map_update(int id, std::vector<pfq_map_entry> const &entries)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_update(q, id, entries.data(), entries.size()));
+        }
+
+        //! Delete the given entries of a lookup map.
+
+        void
+        map_delete(int id, std::vector<pfq_map_entry> const &entries)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_delete(q, id, entries.data(), entries.size()));
+        }
+
+        //! Return the info and counters of the given lookup map.
+
+        pfq_map_info
+        map_info(int id) const
+        {
+            pfq_map_info info;
+            auto q = this->data();
+            throw_if(q, pfq_get_map_info(q, id, &info));
+            return info;
+        }
+
+        //! Create a heavy-hitter sketch, keyed by the given Q_KEY_* fields.
+        /*!
+         * The sketch is owned by this socket: it is the only one that can reset or destroy it,
+         * and the sketch is destroyed when the socket is closed.
+         */
+
+        void
+        sketch_create(int id, uint64_t keys, unsigned int width, unsigned int depth, unsigned int topk, int flags = 0)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_sketch_create(q, id, keys, width, depth, topk, flags));
+        }
+
+        //! Destroy the given sketch.
+
+        void
+        sketch_destroy(int id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_sketch_destroy(q, id));
+        }
+
+        //! Reset the counters of the given sketch.
+
+        void
+        sketch_reset(int id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_sketch_reset(q, id));
+        }
+
+        //! Return (at most n of) the heavy hitters of the given sketch, sorted by count.
+
+        std::vector<pfq_sketch_entry>
+        sketch_topk(int id, size_t n, uint64_t *total = nullptr) const
+        {
+            auto q = this->data();
+            std::vector<pfq_sketch_entry> ret(n);
+            throw_if(q, pfq_get_sketch_topk(q, id, ret.data(), &n, total));
+            ret.resize(n);
+            return ret;
+        }
+
+        //! Read (at most n) flow records from the flow ring of the socket.
+
+        std::vector<pfq_flow_record>
+        read_flows(size_t n)
+        {
+            auto q = this->data();
+            std::vector<pfq_flow_record> ret(n);
+            ret.resize(as<size_t>(q, pfq_read_flows(q, ret.data(), n)));
+            return ret;
+        }
+
+        //! Return the number of flow records lost because the flow ring was full.
+
+        unsigned long
+        flow_lost() const
+        {
+            return pfq_get_flow_lost(this->data());
+        }
+
         //! Return the socket statistics.
 
         pfq_stats
@@ -1041,6 +1249,52 @@ namespace pfq {
             return std::vector<unsigned long>(std::begin(cs.counter), std::end(cs.counter));
         }
 
+        //! Return the overload shedding, sampling, policing and dedup counters of the given group.
+
+        pfq_group_shed
+        group_shed(int gid) const
+        {
+            pfq_group_shed shed;
+            auto q = this->data();
+            throw_if(q, pfq_get_group_shed(q, gid, &shed));
+            return shed;
+        }
+
+        //! Return the per-node profile of the computation of the given group.
+
+        std::vector<pfq_lang_node_profile>
+        group_profile(int gid) const
+        {
+            auto q = this->data();
+            size_t size = 0;
+            throw_if(q, pfq_get_group_profile(q, gid, nullptr, &size));
+
+            std::vector<pfq_lang_node_profile> ret(size);
+            throw_if(q, pfq_get_group_profile(q, gid, ret.data(), &size));
+            ret.resize(std::min(size, ret.size()));
+            return ret;
+        }
+
+        //! Return the histogram with the given id of the computation of the given group.
+        /*!
+         * The first vector holds the edges of the buckets, the second the counters:
+         * the bucket i counts the values in [edges[i-1], edges[i]).
+         */
+
+        std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
+        group_histogram(int gid, int id) const
+        {
+            auto q = this->data();
+            size_t size = Q_HISTOGRAM_MAX_EDGES + 1;
+
+            std::vector<uint64_t> edges(Q_HISTOGRAM_MAX_EDGES), count(size);
+            throw_if(q, pfq_get_group_histogram(q, gid, id, edges.data(), count.data(), &size));
+
+            count.resize(size);
+            edges.resize(size - 1);
+            return std::make_pair(std::move(edges), std::move(count));
+        }
+
         //! Return the memory size of the Rx queue.
 
         size_t
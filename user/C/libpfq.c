@@ -412,6 +412,8 @@ pfq_enable(pfq_t *q)
 	q->tx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue) + q->rx_queue_size * 2;
 	q->tx_queue_size = q->tx_slots * q->tx_slot_size;
 
+	q->flow_queue_addr = (char *)(q->tx_queue_addr) + q->tx_queue_size * 2 * (1 + Q_MAX_TX_QUEUES);
+
 	return Q_OK(q);
 }
 
@@ -652,6 +654,29 @@ pfq_get_tx_slots(pfq_t const *q)
 }
 
 
+int
+pfq_set_flow_slots(pfq_t *q, size_t value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (flow slots could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_FLOW_SLOTS, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set flow slots error");
+	}
+
+	q->flow_slots = value;
+	return Q_OK(q);
+}
+
+
+size_t
+pfq_get_flow_slots(pfq_t const *q)
+{
+	return q->flow_slots;
+}
+
+
 size_t
 pfq_get_rx_slot_size(pfq_t const *q)
 {
@@ -777,6 +802,79 @@ pfq_unbind(pfq_t *q, const char *dev, int queue)
 }
 
 
+int
+pfq_bind_group_tx(pfq_t *q, int gid, const char *dev)
+{
+	struct pfq_so_binding b;
+	int index;
+
+	if (strcmp(dev, "any")==0) {
+		index = Q_ANY_DEVICE;
+	}
+	else {
+		index = pfq_ifindex(q, dev);
+		if (index == -1) {
+			return Q_ERROR(q, "PFQ: bind_group_tx: device not found");
+		}
+	}
+
+	b.gid     = gid;
+	b.ifindex = index;
+	b.qindex  = Q_ANY_QUEUE;
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_BIND_TX, &b, sizeof(b)) == -1) {
+		return Q_ERROR(q, "PFQ: bind Tx error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_unbind_group_tx(pfq_t *q, int gid, const char *dev)
+{
+	struct pfq_so_binding b;
+	int index;
+
+	if (strcmp(dev, "any")==0) {
+		index = Q_ANY_DEVICE;
+	}
+	else {
+		index = pfq_ifindex(q, dev);
+		if (index == -1) {
+			return Q_ERROR(q, "PFQ: unbind_group_tx: device not found");
+		}
+	}
+
+	b.gid     = gid;
+	b.ifindex = index;
+	b.qindex  = Q_ANY_QUEUE;
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_UNBIND_TX, &b, sizeof(b)) == -1) {
+		return Q_ERROR(q, "PFQ: unbind Tx error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_rx_fanout(pfq_t *q, const char *dev, int toggle)
+{
+	struct pfq_so_rx_fanout f;
+
+	f.ifindex = pfq_ifindex(q, dev);
+	if (f.ifindex == -1) {
+		return Q_ERROR(q, "PFQ: rx_fanout: device not found");
+	}
+
+	f.toggle = toggle;
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_RX_FANOUT, &f, sizeof(f)) == -1) {
+		return Q_ERROR(q, "PFQ: rx fanout error");
+	}
+	return Q_OK(q);
+}
+
+
 int
 pfq_groups_mask(pfq_t const *q, unsigned long *_mask)
 {
@@ -1401,6 +1499,28 @@ pfq_group_fprog_reset(pfq_t *q, int gid)
 }
 
 
+int
+pfq_group_ebpf(pfq_t *q, int gid, int fd)
+{
+	struct pfq_so_ebpf ebpf = { gid, fd };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_EBPF, &ebpf, sizeof(ebpf)) == -1) {
+		return Q_ERROR(q, "PFQ: set group ebpf error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_ebpf_reset(pfq_t *q, int gid)
+{
+	if (pfq_group_ebpf(q, gid, -1) < 0)
+		return Q_ERROR(q, "PFQ: reset group ebpf error");
+	return Q_OK(q);
+}
+
+
 int
 pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group_policy)
 {
@@ -1491,6 +1611,49 @@ pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs)
 }
 
 
+int
+pfq_get_group_shed(pfq_t const *q, int gid, struct pfq_group_shed *shed)
+{
+	socklen_t size = sizeof(struct pfq_group_shed);
+	shed->gid = (unsigned int)gid;
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_SHED, shed, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get group shed error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_group_profile(pfq_t const *q, int gid, struct pfq_lang_node_profile *node, size_t *size)
+{
+	struct pfq_so_group_profile prof = { gid, *size, node };
+	socklen_t len = sizeof(prof);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_PROFILE, &prof, &len) == -1) {
+		return Q_ERROR(q, "PFQ: get group profile error");
+	}
+
+	*size = prof.size;
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_group_histogram(pfq_t const *q, int gid, int id, uint64_t *edges, uint64_t *count, size_t *size)
+{
+	struct pfq_so_group_histogram hist = { gid, id, *size, edges, count };
+	socklen_t len = sizeof(hist);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_HISTOGRAM, &hist, &len) == -1) {
+		return Q_ERROR(q, "PFQ: get group histogram error");
+	}
+
+	*size = hist.size;
+	return Q_OK(q);
+}
+
+
 int
 pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle)
 {
@@ -1527,6 +1690,147 @@ int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid)
 }
 
 
+int
+pfq_set_group_budget(pfq_t *q, int gid, int priority, unsigned int ns_batch, unsigned int pkt_ms, int shed, unsigned int sample)
+{
+        struct pfq_so_group_budget value = { gid, priority, ns_batch, pkt_ms, shed, sample };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_BUDGET, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: set group budget error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_get_group_budget(pfq_t const *q, int gid, struct pfq_so_group_budget *budget)
+{
+	socklen_t size = sizeof(struct pfq_so_group_budget);
+	budget->gid = gid;
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_BUDGET, budget, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get group budget error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_map_create(pfq_t *q, int id, int type, int key_size, unsigned int max_entries)
+{
+        struct pfq_so_map value = { id, type, key_size, max_entries };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_MAP_CREATE, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: map create error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_map_destroy(pfq_t *q, int id)
+{
+        if (setsockopt(q->fd, PF_Q, Q_SO_MAP_DESTROY, &id, sizeof(id)) == -1) {
+	        return Q_ERROR(q, "PFQ: map destroy error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_map_update(pfq_t *q, int id, struct pfq_map_entry const *entry, size_t size)
+{
+        struct pfq_so_map_update value = { id, Q_MAP_UPDATE, size, entry };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_MAP_UPDATE, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: map update error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_map_delete(pfq_t *q, int id, struct pfq_map_entry const *entry, size_t size)
+{
+        struct pfq_so_map_update value = { id, Q_MAP_DELETE, size, entry };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_MAP_UPDATE, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: map delete error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_get_map_info(pfq_t const *q, int id, struct pfq_map_info *info)
+{
+	socklen_t size = sizeof(struct pfq_map_info);
+	info->id = id;
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_MAP_INFO, info, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get map info error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_sketch_create(pfq_t *q, int id, uint64_t keys, unsigned int width, unsigned int depth, unsigned int topk, int flags)
+{
+        struct pfq_so_sketch value = { id, flags, keys, width, depth, topk };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_SKETCH_CREATE, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: sketch create error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_sketch_destroy(pfq_t *q, int id)
+{
+        if (setsockopt(q->fd, PF_Q, Q_SO_SKETCH_DESTROY, &id, sizeof(id)) == -1) {
+	        return Q_ERROR(q, "PFQ: sketch destroy error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_sketch_reset(pfq_t *q, int id)
+{
+        if (setsockopt(q->fd, PF_Q, Q_SO_SKETCH_RESET, &id, sizeof(id)) == -1) {
+	        return Q_ERROR(q, "PFQ: sketch reset error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_get_sketch_topk(pfq_t const *q, int id, struct pfq_sketch_entry *entry, size_t *size, uint64_t *total)
+{
+	struct pfq_so_sketch_topk value = { id, *size, entry, 0 };
+	socklen_t len = sizeof(value);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_SKETCH_TOPK, &value, &len) == -1) {
+		return Q_ERROR(q, "PFQ: get sketch topk error");
+	}
+
+	*size = value.size;
+	if (total)
+		*total = value.total;
+	return Q_OK(q);
+}
+
+
 int
 pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 {
@@ -1593,6 +1897,45 @@ pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int
 }
 
 
+int
+pfq_read_flows(pfq_t *q, struct pfq_flow_record *rec, size_t max)
+{
+	struct pfq_shared_queue *sq = (struct pfq_shared_queue *)q->shm_addr;
+	struct pfq_flow_record const *ring = (struct pfq_flow_record const *)q->flow_queue_addr;
+	unsigned int prod, cons, len;
+	size_t n;
+
+	if (q->shm_addr == MAP_FAILED || q->shm_addr == NULL)
+		return Q_ERROR(q, "PFQ: socket not enabled");
+
+	len = sq->flow.len;
+	if (len == 0)
+		return Q_ERROR(q, "PFQ: flow record ring not enabled");
+
+	cons = __atomic_load_n(&sq->flow.cons.index, __ATOMIC_RELAXED);
+	prod = __atomic_load_n(&sq->flow.prod.index, __ATOMIC_ACQUIRE);
+
+	for(n = 0; n < max && cons != prod; n++, cons++)
+		rec[n] = ring[cons & (len - 1)];
+
+	__atomic_store_n(&sq->flow.cons.index, cons, __ATOMIC_RELEASE);
+
+	return Q_VALUE(q, (int)n);
+}
+
+
+unsigned long
+pfq_get_flow_lost(pfq_t const *q)
+{
+	struct pfq_shared_queue const *sq = (struct pfq_shared_queue const *)q->shm_addr;
+
+	if (q->shm_addr == MAP_FAILED || q->shm_addr == NULL)
+		return 0;
+
+	return __atomic_load_n(&sq->flow.lost, __ATOMIC_RELAXED);
+}
+
+
 int
 pfq_dispatch(pfq_t *q, pfq_handler_t cb, long int microseconds, char *user)
 {
@@ -62,6 +62,9 @@ struct pfq_data_int
 	void * rx_queue_addr;
 	size_t rx_queue_size;
 
+	void * flow_queue_addr;
+	size_t flow_slots;
+
 	size_t rx_slots;
 	size_t rx_slot_size;
 
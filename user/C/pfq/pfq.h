@@ -391,6 +391,21 @@ extern int pfq_set_tx_slots(pfq_t *q, size_t value);
 extern size_t pfq_get_tx_slots(pfq_t const *q);
 
 
+/*! Specify the length of the flow record ring, in number of records. */
+/*!
+ * The ring receives the records of the flows exported by the flow_export function
+ * of the groups the socket joined. The length is rounded up to a power of 2; the
+ * default is 0 (no ring). It must be set before the socket is enabled.
+ */
+
+extern int pfq_set_flow_slots(pfq_t *q, size_t value);
+
+
+/*! Return the length of the flow record ring, as requested. */
+
+extern size_t pfq_get_flow_slots(pfq_t const *q);
+
+
 /*! Return the size of a Tx slot, in bytes. */
 
 extern size_t pfq_get_tx_slots(pfq_t const *q);
@@ -426,6 +441,29 @@ extern int pfq_bind_group(pfq_t *q, int gid, const char *dev, int queue);
 extern int pfq_unbind_group(pfq_t *q, int gid, const char *dev, int queue);
 
 
+/*! Bind the given group to the egress (Tx side) of the given device. */
+/*!
+ * Outgoing packets are captured and delivered along with the incoming ones;
+ * the direction is reported in the packet header (info.dir).
+ */
+
+extern int pfq_bind_group_tx(pfq_t *q, int gid, const char *dev);
+
+
+/*! Unbind the group from the egress (Tx side) of the given device. */
+
+extern int pfq_unbind_group_tx(pfq_t *q, int gid, const char *dev);
+
+
+/*! Enable/disable the software RSS fan-out on the given device. */
+/*!
+ * Packets captured on the device are redistributed by flow hash
+ * to the Rx kernel threads (rx_cpu module parameter).
+ */
+
+extern int pfq_rx_fanout(pfq_t *q, const char *dev, int toggle);
+
+
 /*! Set the socket as egress and bind it to the given device/queue. */
 /*!
  * The egress socket is used by groups as network forwarder.
@@ -516,6 +554,23 @@ extern int pfq_group_fprog(pfq_t *q, int gid, struct sock_fprog const *);
 extern int pfq_group_fprog_reset(pfq_t *q, int gid);
 
 
+/*! Specify an eBPF program for the given group. */
+/*!
+ * The program (BPF_PROG_TYPE_SOCKET_FILTER) is passed by file descriptor, as
+ * returned by the bpf(2) syscall. It returns Q_EBPF_DROP to drop the packet,
+ * Q_EBPF_PASS to pass it, or Q_EBPF_STEER_HASH(hash) to pass it and steer it
+ * among the sockets of the group with the given (31 bit) hash. Any other
+ * non-zero value passes the packet.
+ */
+
+extern int pfq_group_ebpf(pfq_t *q, int gid, int fd);
+
+
+/*! Reset the eBPF program for the given group. */
+
+extern int pfq_group_ebpf_reset(pfq_t *q, int gid);
+
+
 /*! Enable/disable vlan filtering for the given group. */
 
 extern int pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle);
@@ -534,6 +589,58 @@ extern int pfq_vlan_set_filter(pfq_t *q, int gid, int vid);
 extern int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid);
 
 
+/*! Set the processing budget of the given group. */
+/*!
+ * The budget is given in nanoseconds per batch and/or packets per millisecond (0 = unlimited).
+ * When a group exceeds its budget, the groups with a lower priority (higher value) are
+ * skipped (Q_SHED_SKIP) or sampled (Q_SHED_SAMPLE, one packet out of sample) on that cpu.
+ */
+
+extern int pfq_set_group_budget(pfq_t *q, int gid, int priority, unsigned int ns_batch, unsigned int pkt_ms, int shed, unsigned int sample);
+
+
+/*! Return the processing budget of the given group. */
+
+extern int pfq_get_group_budget(pfq_t const *q, int gid, struct pfq_so_group_budget *budget);
+
+
+/*! Create a lookup map with the given id. */
+/*!
+ * Maps (Q_MAP_HASH, Q_MAP_ARRAY, Q_MAP_LPM or Q_MAP_CUCKOO) are shared by all the
+ * groups and are referenced by id in pfq-lang functions. Keys are in network byte
+ * order, except for Q_MAP_ARRAY, whose key is a uint32_t index.
+ *
+ * A map is owned by the socket that creates it: only the owner can update or
+ * destroy it (EACCES otherwise), and the map is destroyed when the owner is closed.
+ *
+ * Q_MAP_CUCKOO maps are membership filters: values are ignored, updating a key that
+ * is already a member is a no-op and a single delete removes it. Deleting a key that
+ * is not a member has no effect, and never removes another member sharing its
+ * fingerprint. Their occupancy and estimated false positive rate are reported by
+ * pfq_get_map_info.
+ */
+
+extern int pfq_map_create(pfq_t *q, int id, int type, int key_size, unsigned int max_entries);
+
+
+/*! Destroy the lookup map with the given id. */
+
+extern int pfq_map_destroy(pfq_t *q, int id);
+
+
+/*! Insert or replace a batch of entries of the given map. */
+/*!
+ * Entries are applied in order; the first error aborts the rest of the batch.
+ */
+
+extern int pfq_map_update(pfq_t *q, int id, struct pfq_map_entry const *entry, size_t size);
+
+
+/*! Delete a batch of entries of the given map. */
+
+extern int pfq_map_delete(pfq_t *q, int id, struct pfq_map_entry const *entry, size_t size);
+
+
 /*! Wait for packets. */
 /*!
  * Wait for packets available for reading. A timeout in microseconds can be specified.
@@ -564,6 +671,20 @@ extern int pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
 extern int pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int microseconds);
 
 
+/*! Read the flow records available in the flow ring. */
+/*!
+ * At most max records are copied into rec; the number of records is returned.
+ * The call does not block.
+ */
+
+extern int pfq_read_flows(pfq_t *q, struct pfq_flow_record *rec, size_t max);
+
+
+/*! Return the number of flow records lost because the flow ring was full. */
+
+extern unsigned long pfq_get_flow_lost(pfq_t const *q);
+
+
 /*! Collect and process packets. */
 /*! The function takes a function pointer as callback.
  *  The callback must have the following signature:
@@ -604,6 +725,73 @@ extern int pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 extern int pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs);
 
 
+/*! Return the overload shedding, sampling, policing and dedup counters of the given group. */
+
+extern int pfq_get_group_shed(pfq_t const *q, int gid, struct pfq_group_shed *shed);
+
+
+/*! Return the per-node profile of the computation of the given group. */
+/*!
+ * The computation must be loaded with the lang_profile module parameter set.
+ * At most *size nodes are stored in node; on return *size is the number of
+ * nodes of the computation.
+ */
+
+extern int pfq_get_group_profile(pfq_t const *q, int gid, struct pfq_lang_node_profile *node, size_t *size);
+
+
+/*! Return the histogram with the given id of the computation of the given group. */
+/*!
+ * The histogram is collected by the pfq-lang function histogram: at most
+ * *size buckets are stored in count, and *size - 1 edges in edges (bucket i
+ * counts the values in [edges[i-1], edges[i])). On return *size is the
+ * number of buckets of the histogram.
+ */
+
+extern int pfq_get_group_histogram(pfq_t const *q, int gid, int id, uint64_t *edges, uint64_t *count, size_t *size);
+
+
+/*! Return the info and counters of the given lookup map. */
+
+extern int pfq_get_map_info(pfq_t const *q, int id, struct pfq_map_info *info);
+
+
+/*! Create a heavy-hitter sketch with the given id. */
+/*!
+ * Sketches are updated by pfq-lang functions (sketch_update) with the flow key made
+ * of the given Q_KEY_* fields. Each cpu keeps a count-min sketch of depth rows of
+ * width counters, and the topk flows with the largest estimates. With Q_SKETCH_BYTES
+ * bytes are counted rather than packets. The memory of all the sketches (over all the
+ * cpus) is limited to 256MB: beyond that, ENOMEM is returned.
+ *
+ * A sketch is owned by the socket that creates it: only the owner can reset or
+ * destroy it (EACCES otherwise), and the sketch is destroyed when the owner is closed.
+ * A reset allocates the empty sketch before releasing the old one, and fails with
+ * ENOMEM if both do not fit the memory limit.
+ */
+
+extern int pfq_sketch_create(pfq_t *q, int id, uint64_t keys, unsigned int width, unsigned int depth, unsigned int topk, int flags);
+
+
+/*! Destroy the given sketch. */
+
+extern int pfq_sketch_destroy(pfq_t *q, int id);
+
+
+/*! Reset the counters of the given sketch. */
+
+extern int pfq_sketch_reset(pfq_t *q, int id);
+
+
+/*! Return the heavy hitters of the given sketch, merged across cpus and sorted by count. */
+/*!
+ * At most *size entries are stored; on return *size is the number of entries. If
+ * not NULL, total is set to the packets (or bytes) counted by the sketch.
+ */
+
+extern int pfq_get_sketch_topk(pfq_t const *q, int id, struct pfq_sketch_entry *entry, size_t *size, uint64_t *total);
+
+
 /*! Transmit the packets in the queue. */
 
 extern int pfq_sync_queue(pfq_t *q, int queue);
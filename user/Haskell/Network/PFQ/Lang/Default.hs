@@ -51,6 +51,7 @@ module Network.PFQ.Lang.Default
     , is_rtcp
     , is_sip
     , is_voip
+    , is_call
 
     , has_port
     , has_src_port
@@ -75,6 +76,7 @@ module Network.PFQ.Lang.Default
     , ip_ttl
     , get_mark
     , get_state
+    , call_id
     , tcp_source
     , tcp_dest
     , tcp_hdrlen
@@ -170,6 +172,7 @@ module Network.PFQ.Lang.Default
     , steer_field_symmetric
     , steer_rtp
     , steer_voip
+    , steer_call
 
         -- * Forwarders
     , kernel
@@ -201,6 +204,110 @@ module Network.PFQ.Lang.Default
     , bloomCalcM
     , bloomCalcP
 
+        -- * Flow table
+        -- | Per-CPU table of IPv4 flows (5-tuple, both directions), with LRU and timeout eviction.
+
+    , flow_count
+    , flow_bytes
+    , flow_state
+    , flow_put_state
+    , flow_first
+    , flow_export
+
+        -- * Lookup maps
+        -- | Maps created and updated at runtime through the socket, referenced by id.
+
+    , map_src
+    , map_dst
+    , map_addr
+    , map_src_filter
+    , map_dst_filter
+    , map_addr_filter
+    , map_src_value
+    , map_dst_value
+    , map_tuple
+    , map_tuple_filter
+    , map_tuple_value
+    , map_value
+
+        -- * Longest prefix match
+        -- | Large sets of IPv4/IPv6 networks, matched by their longest prefix.
+
+    , lpm
+    , lpm_src
+    , lpm_dst
+    , lpm_filter
+    , lpm_src_filter
+    , lpm_dst_filter
+    , lpm_src_class
+    , lpm_dst_class
+    , steer_lpm
+
+        -- * Payload matching
+        -- | Sets of byte patterns matched against the payload (Aho-Corasick).
+
+    , payload_match
+    , payload_filter
+    , payload_pattern
+    , payload_mark
+    , payload_put_state
+
+        -- * Heavy hitters
+        -- | Sketches created at runtime through the socket, referenced by id.
+
+    , sketch_update
+    , sketch_estimate
+    , sketch_heavy
+
+        -- * Sampling
+        -- | Decisions are counted in the group stats (sample_in, sample_out).
+
+    , sample_every
+    , sample_prob
+    , sample_flow
+    , sample_every_filter
+    , sample_prob_filter
+    , sample_flow_filter
+
+        -- * Policing
+        -- | Per-cpu token buckets: rates are in packets per second and are enforced on each cpu.
+        -- Decisions are counted in the group stats (police_in, police_out).
+
+    , conform
+    , flow_conform
+    , police
+    , police_flow
+    , police_class
+    , police_flow_class
+
+        -- * Header mangling
+        -- | IP and TCP/UDP checksums are updated incrementally; the changes are seen
+        -- by the groups and the sockets that receive the packet afterwards.
+
+    , set_eth_src
+    , set_eth_dst
+    , swap_eth
+    , set_ip_src
+    , set_ip_dst
+    , set_src_port
+    , set_dst_port
+    , set_ttl
+    , dec_ttl
+    , set_dscp
+    , set_vlan_id
+
+        -- * Histograms
+        -- | Per-cpu buckets over a property, read by group and id (see pfq_get_group_histogram
+        -- and /proc/net/pfq/histograms).
+
+    , histogram
+
+        -- * Duplicate suppression
+        -- | Duplicates and live entries evicted from the table are counted in the
+        -- group stats (dedup, dedup_coll).
+
+    , dedup
+
         -- * Miscellaneous
 
     , unit
@@ -376,6 +483,11 @@ is_sip = Predicate "is_sip" () () () () () () () ()
 -- | Evaluate to /True/ if the Qbuff is a VoIP packet (RTP|RTCP|SIP).
 is_voip = Predicate "is_voip" () () () () () () () ()
 
+-- | Evaluate to /True/ if the Qbuff belongs to a call: a SIP message with a Call-ID,
+-- or RTP/RTCP to or from an endpoint announced in the SDP of a call.
+is_call :: NetPredicate
+is_call = Predicate "is_call" () () () () () () () ()
+
 
 has_port, has_src_port, has_dst_port :: Word16 -> NetPredicate
 
@@ -419,6 +531,10 @@ get_mark = Property "get_mark" () () () () () () () ()
 -- | Evaluate to the state of the computation (possibly set by 'state' function).
 get_state = Property "get_state" () () () () () () () ()
 
+-- | Evaluate to the hash of the Call-ID of the call of the packet (see 'is_call').
+call_id :: NetProperty
+call_id = Property "call_id" () () () () () () () ()
+
 
 -- | Evaluate to the /tos/ field of the IP header.
 ip_tos = Property "ip_tos" () () () () () () () ()
@@ -554,6 +670,15 @@ steer_rtp = Function "steer_rtp" () () () () () () () () :: NetFunction
 -- > steer_voip
 steer_voip = Function "steer_voip" () () () () () () () () :: NetFunction
 
+-- | Dispatch the packet across the sockets
+-- by call: the media endpoints announced in the SDP of SIP messages are
+-- tracked, so that signalling and RTP/RTCP of a call (both directions)
+-- are steered to the same socket. Other RTP/RTCP packets are steered as
+-- by 'steer_rtp', SIP messages without Call-ID are broadcasted.
+--
+-- > steer_call
+steer_call = Function "steer_call" () () () () () () () () :: NetFunction
+
 -- | Dispatch the packet across the sockets
 -- with a randomized algorithm that guarantees
 -- sub networks consistency.
@@ -946,3 +1071,321 @@ bloomCalcN m p = ceiling $ fromIntegral (-m) * log(1 - p ** (1 / fromIntegral bl
 bloomCalcP :: Int -> Int -> Double
 bloomCalcP n m = (1 - (1 - 1 / fromIntegral m) ** fromIntegral (n * bloomK))^bloomK
 
+
+
+-- flow table:
+
+-- | Evaluate to the number of packets of the flow, the current one included.
+--
+-- > when (flow_count .> 1000) drop
+flow_count = Property "flow_count" () () () () () () () ()
+
+-- | Evaluate to the number of bytes of the flow, the current packet included.
+flow_bytes = Property "flow_bytes" () () () () () () () ()
+
+-- | Evaluate to the state of the flow, possibly set by 'flow_put_state' function.
+-- New flows start with state 0.
+flow_state = Property "flow_state" () () () () () () () ()
+
+-- | Set the state of the flow to the given value.
+--
+-- > when (has_dst_port 80) (flow_put_state 1)
+flow_put_state :: Word32 -> NetFunction
+flow_put_state n = Function "flow_put_state" n () () () () () () ()
+
+-- | Pass the first /n/ packets of every flow, drop the others (and non-IPv4 packets).
+--
+-- > flow_first 10 >-> steer_flow
+flow_first :: Int -> NetFunction
+flow_first n = Function "flow_first" n () () () () () () ()
+
+-- | Export the flow of the packet: a record (packets, bytes, first/last time and TCP flags)
+-- is pushed to the flow ring of the sockets of the group on idle timeout or eviction.
+-- The computation evaluates to /Pass/.
+--
+-- > flow_export >-> drop
+flow_export :: NetFunction
+flow_export = Function "flow_export" () () () () () () () ()
+
+
+-- lookup maps:
+
+-- | Evaluate to /True/ if the source IP address is found in the given map (of IPv4
+-- or IPv6 addresses, after the key size).
+--
+-- > when (map_src 1) drop
+map_src :: Int -> NetPredicate
+map_src n = Predicate "map_src" n () () () () () () ()
+
+-- | Evaluate to /True/ if the destination IP address is found in the given map.
+map_dst :: Int -> NetPredicate
+map_dst n = Predicate "map_dst" n () () () () () () ()
+
+-- | Evaluate to /True/ if the source or the destination IP address is found in the given map.
+map_addr :: Int -> NetPredicate
+map_addr n = Predicate "map_addr" n () () () () () () ()
+
+-- | Monadic counterpart of 'map_src' function.
+map_src_filter :: Int -> NetFunction
+map_src_filter n = Function "map_src_filter" n () () () () () () ()
+
+-- | Monadic counterpart of 'map_dst' function.
+map_dst_filter :: Int -> NetFunction
+map_dst_filter n = Function "map_dst_filter" n () () () () () () ()
+
+-- | Monadic counterpart of 'map_addr' function.
+map_addr_filter :: Int -> NetFunction
+map_addr_filter n = Function "map_addr_filter" n () () () () () () ()
+
+-- | Evaluate to the value associated with the source IP address in the given map.
+map_src_value :: Int -> NetProperty
+map_src_value n = Property "map_src_value" n () () () () () () ()
+
+-- | Evaluate to the value associated with the destination IP address in the given map.
+map_dst_value :: Int -> NetProperty
+map_dst_value n = Property "map_dst_value" n () () () () () () ()
+
+-- | Evaluate to /True/ if the 5-tuple of the packet (in either direction) is found in
+-- the given map, whose keys are made of addresses, ports and protocol in network order
+-- (13 bytes for IPv4, 37 for IPv6). Cuckoo filter maps make large watchlists cheap:
+--
+-- > when (map_tuple 3) log_packet
+map_tuple :: Int -> NetPredicate
+map_tuple n = Predicate "map_tuple" n () () () () () () ()
+
+-- | Monadic counterpart of 'map_tuple' function.
+map_tuple_filter :: Int -> NetFunction
+map_tuple_filter n = Function "map_tuple_filter" n () () () () () () ()
+
+-- | Evaluate to the value associated with the 5-tuple of the packet in the given map.
+map_tuple_value :: Int -> NetProperty
+map_tuple_value n = Property "map_tuple_value" n () () () () () () ()
+
+-- | Evaluate to the value associated with the given property in the given map:
+-- the index of array maps, or the key (in network byte order) of the others.
+--
+-- > when (map_value 2 tcp_dest .== 1) drop
+map_value :: Int -> NetProperty -> NetProperty
+map_value n p = Property "map_value" n p () () () () () ()
+
+-- | Evaluate to /True/ if the source or the destination IP address matches
+-- one of the given networks (IPv4 or IPv6, in CIDR notation).
+--
+-- > when (lpm ["10.0.0.0/8", "192.168.0.0/16", "2001:db8::/32"]) drop
+lpm :: [String] -> NetPredicate
+lpm ns = Predicate "lpm" ns () () () () () () ()
+
+-- | Evaluate to /True/ if the source IP address matches one of the given networks.
+lpm_src :: [String] -> NetPredicate
+lpm_src ns = Predicate "lpm_src" ns () () () () () () ()
+
+-- | Evaluate to /True/ if the destination IP address matches one of the given networks.
+lpm_dst :: [String] -> NetPredicate
+lpm_dst ns = Predicate "lpm_dst" ns () () () () () () ()
+
+-- | Monadic counterpart of 'lpm' function.
+lpm_filter :: [String] -> NetFunction
+lpm_filter ns = Function "lpm_filter" ns () () () () () () ()
+
+-- | Monadic counterpart of 'lpm_src' function.
+lpm_src_filter :: [String] -> NetFunction
+lpm_src_filter ns = Function "lpm_src_filter" ns () () () () () () ()
+
+-- | Monadic counterpart of 'lpm_dst' function.
+lpm_dst_filter :: [String] -> NetFunction
+lpm_dst_filter ns = Function "lpm_dst_filter" ns () () () () () () ()
+
+-- | Evaluate to the class of the longest network matching the source IP address.
+-- Classes are given one per network; if the list is empty the index of the network
+-- is returned instead.
+--
+-- > when (lpm_src_class ["10.0.0.0/8", "10.1.0.0/16"] [1, 2] .== 2) log_packet
+lpm_src_class :: [String] -> [Word32] -> NetProperty
+lpm_src_class ns cs = Property "lpm_src_class" ns cs () () () () () ()
+
+-- | Evaluate to the class of the longest network matching the destination IP address.
+lpm_dst_class :: [String] -> [Word32] -> NetProperty
+lpm_dst_class ns cs = Property "lpm_dst_class" ns cs () () () () () ()
+
+-- | Steer the packet by the class of the longest network matching the source
+-- IP address, or the destination one. Packets that match no network are dropped.
+--
+-- > steer_lpm ["10.0.0.0/8", "172.16.0.0/12"] [0, 1]
+steer_lpm :: [String] -> [Word32] -> NetFunction
+steer_lpm ns cs = Function "steer_lpm" ns cs () () () () () ()
+
+-- | Evaluate to /True/ if any of the patterns is found in the first bytes of the payload
+-- (after the TCP/UDP/ICMP header). The second argument is the depth of the scan in bytes,
+-- 0 for the whole payload. In patterns, \\xHH stands for any byte.
+--
+-- > payload_filter ["GET ", "POST ", "HTTP/1."] 16 >-> kernel
+payload_match :: [String] -> Int -> NetPredicate
+payload_match ps n = Predicate "payload_match" ps n () () () () () ()
+
+-- | Monadic counterpart of 'payload_match' function.
+payload_filter :: [String] -> Int -> NetFunction
+payload_filter ps n = Function "payload_filter" ps n () () () () () ()
+
+-- | Evaluate to the index of the first pattern found in the payload.
+payload_pattern :: [String] -> Int -> NetProperty
+payload_pattern ps n = Property "payload_pattern" ps n () () () () () ()
+
+-- | Mark the packet with the index of the pattern found in the payload, plus one.
+-- Packets are never dropped.
+payload_mark :: [String] -> Int -> NetFunction
+payload_mark ps n = Function "payload_mark" ps n () () () () () ()
+
+-- | Set the state of the packet to the index of the pattern found in the payload, plus one.
+payload_put_state :: [String] -> Int -> NetFunction
+payload_put_state ps n = Function "payload_put_state" ps n () () () () () ()
+
+-- | Count the packet (or its bytes) in the given sketch, under the flow key of the sketch.
+--
+-- > sketch_update 0 >-> when (sketch_heavy 0 100000) (log_msg "heavy hitter")
+sketch_update :: Int -> NetFunction
+sketch_update n = Function "sketch_update" n () () () () () () ()
+
+-- | Evaluate to the estimate of the flow of the packet in the given sketch (on the current cpu).
+sketch_estimate :: Int -> NetProperty
+sketch_estimate n = Property "sketch_estimate" n () () () () () () ()
+
+-- | Evaluate to /True/ if the estimate of the flow of the packet reaches the given threshold.
+sketch_heavy :: Int -> Word64 -> NetPredicate
+sketch_heavy n t = Predicate "sketch_heavy" n t () () () () () ()
+
+-- | Evaluate to /True/ for one packet out of n (per cpu).
+--
+-- > sample_every_filter 1000 >-> kernel
+sample_every :: Int -> NetPredicate
+sample_every n = Predicate "sample_every" n () () () () () () ()
+
+-- | Evaluate to /True/ with the given probability.
+sample_prob :: Double -> NetPredicate
+sample_prob p = Predicate "sample_prob" (probability p) () () () () () () ()
+
+-- | Evaluate to /True/ for the packets of a fraction p of the flows: all the packets of a flow
+-- (in both directions) are kept or discarded together. Fragments are sampled on their
+-- addresses, so that all the fragments of a datagram are kept or discarded together.
+sample_flow :: Double -> NetPredicate
+sample_flow p = Predicate "sample_flow" (probability p) () () () () () () ()
+
+-- | Monadic counterpart of 'sample_every' function.
+sample_every_filter :: Int -> NetFunction
+sample_every_filter n = Function "sample_every_filter" n () () () () () () ()
+
+-- | Monadic counterpart of 'sample_prob' function.
+sample_prob_filter :: Double -> NetFunction
+sample_prob_filter p = Function "sample_prob_filter" (probability p) () () () () () () ()
+
+-- | Monadic counterpart of 'sample_flow' function.
+sample_flow_filter :: Double -> NetFunction
+sample_flow_filter p = Function "sample_flow_filter" (probability p) () () () () () () ()
+
+-- | Evaluate to /True/ if the packet conforms to the given rate (packets per second) and burst.
+--
+-- > conditional (conform 100000 1000) (classify 1) (classify 2)
+conform :: Word64 -> Word64 -> NetPredicate
+conform r b = Predicate "conform" r b () () () () () ()
+
+-- | Evaluate to /True/ if the packet conforms to the given rate and burst of its flow.
+-- The flow is that of the current IP header (see shift), and the ports of fragments
+-- are not part of it, so that all the fragments of a datagram share the same bucket.
+flow_conform :: Word64 -> Word64 -> NetPredicate
+flow_conform r b = Predicate "flow_conform" r b () () () () () ()
+
+-- | Drop the packets exceeding the given rate (packets per second) and burst.
+--
+-- > police 100000 1000 >-> steer_flow
+police :: Word64 -> Word64 -> NetFunction
+police r b = Function "police" r b () () () () () ()
+
+-- | Drop the packets exceeding the given rate and burst of their flow.
+police_flow :: Word64 -> Word64 -> NetFunction
+police_flow r b = Function "police_flow" r b () () () () () ()
+
+-- | Classify the packets exceeding the given rate and burst with the given class.
+--
+-- > police_class 100000 1000 2
+police_class :: Word64 -> Word64 -> Int -> NetFunction
+police_class r b c = Function "police_class" r b c () () () () ()
+
+-- | Classify the packets exceeding the given rate and burst of their flow with the given class.
+police_flow_class :: Word64 -> Word64 -> Int -> NetFunction
+police_flow_class r b c = Function "police_flow_class" r b c () () () () ()
+
+-- | Set the source MAC address of the packet.
+--
+-- > set_eth_src "4c:60:de:86:55:46"
+set_eth_src :: String -> NetFunction
+set_eth_src mac = Function "set_eth_src" mac () () () () () () ()
+
+-- | Set the destination MAC address of the packet.
+set_eth_dst :: String -> NetFunction
+set_eth_dst mac = Function "set_eth_dst" mac () () () () () () ()
+
+-- | Swap the source and destination MAC addresses (e.g. for reflectors).
+--
+-- > swap_eth >-> forward "eth0"
+swap_eth :: NetFunction
+swap_eth = Function "swap_eth" () () () () () () () ()
+
+-- | Set the source IP address (IPv4 or IPv6) of the packets of the same IP version.
+--
+-- > when (has_dst_port 53) (set_ip_src "192.168.0.1")
+set_ip_src :: String -> NetFunction
+set_ip_src addr = Function "set_ip_src" addr () () () () () () ()
+
+-- | Set the destination IP address (IPv4 or IPv6) of the packets of the same IP version.
+set_ip_dst :: String -> NetFunction
+set_ip_dst addr = Function "set_ip_dst" addr () () () () () () ()
+
+-- | Set the source port of TCP and UDP packets.
+set_src_port :: Int -> NetFunction
+set_src_port p = Function "set_src_port" p () () () () () () ()
+
+-- | Set the destination port of TCP and UDP packets.
+set_dst_port :: Int -> NetFunction
+set_dst_port p = Function "set_dst_port" p () () () () () () ()
+
+-- | Set the TTL (IPv4) or the hop limit (IPv6) of the packet.
+set_ttl :: Int -> NetFunction
+set_ttl n = Function "set_ttl" n () () () () () () ()
+
+-- | Decrement the TTL (IPv4) or the hop limit (IPv6) of the packet, dropping it when expired.
+dec_ttl :: NetFunction
+dec_ttl = Function "dec_ttl" () () () () () () () ()
+
+-- | Set the DSCP of the packet (the ECN bits are preserved).
+set_dscp :: Int -> NetFunction
+set_dscp n = Function "set_dscp" n () () () () () () ()
+
+-- | Set the VLAN id of the packet (accelerated or in-band 802.1Q tag). Untagged
+-- packets are tagged through the accelerated tag, except for skb-less (XDP) ones,
+-- which are left untouched. Tags are never removed.
+set_vlan_id :: Int -> NetFunction
+set_vlan_id vid = Function "set_vlan_id" vid () () () () () () ()
+
+-- | Count the packet in the bucket of the value of the given property. The
+-- edges of the buckets are in ascending order (at most 64); the bucket i counts
+-- the values in [edges[i-1], edges[i]). Packets for which the property is
+-- nothing are not counted.
+--
+-- > histogram 0 [64, 128, 256, 512, 1024] ip_tot_len >-> kernel
+histogram :: Int -> [Word64] -> NetProperty -> NetFunction
+histogram n edges p = Function "histogram" n edges p () () () () ()
+
+-- | Drop the copies of a packet seen within the given window (in usec), as
+-- received from multiple span ports or taps. The packets are identified by the
+-- invariant fields of the IP header (TTL and checksum are skipped) and the first
+-- bytes after it. Non-IP packets are passed.
+--
+-- > dedup 1000 >-> kernel
+dedup :: Word64 -> NetFunction
+dedup usec = Function "dedup" usec () () () () () () ()
+
+-- probability as fixed point (p * 2^32)
+probability :: Double -> Word32
+probability p
+    | p >= 1    = maxBound
+    | p <= 0    = 0
+    | otherwise = truncate (p * 4294967296)
@@ -16,6 +16,7 @@ predicates =
     is_rtcp                             .||.
     is_sip                              .||.
     is_voip                             .||.
+    is_call                             .||.
     has_port 1024                       .||.
     has_src_port 21                     .||.
     has_dst_port 80                     .||.
@@ -291,6 +292,7 @@ steerings = do
     steer_field_symmetric 14 18 4
     steer_rtp
     steer_voip
+    steer_call
 
 
 forwarders = do
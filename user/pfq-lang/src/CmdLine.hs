@@ -31,6 +31,7 @@ options = cmdArgsMode $ Options
           ,     json = False     &= groupname "IR" &=help "Format output as json object" &= explicit &= name "json"
           ,     fdescr = False   &= help "Format output as list of function descriptors" &= explicit &= name "fdescr"
           ,     gid = Nothing    &= help "Specify the PFQ gid to set the computation for" &= explicit &= name "gid"
+          ,     noopt = False    &= help "Disable the optimizing passes" &= explicit &= name "no-opt"
           ,     verb = 0         &= groupname "Other" &= help "Control verbosity level (0..3)" &= explicit &= name "verbosity"
           ,     file = Nothing   &= args
           } &= summary ("pfq-lang " ++ showVersion version)  &= program "pfq-lang"
@@ -34,6 +34,7 @@ import Control.Monad.Reader
 import Options
 
 import Lang.Parser
+import Lang.Optimizer
 
 #if __GLASGOW_HASKELL__ < 710
 import Control.Applicative
@@ -49,7 +50,7 @@ modToFilePath base n = base </> fixPath n <.> "hs"
     where fixPath = map (\c -> if c == '.' then '/' else c)
 
 
-compile :: String -> OptionT IO (Function (Qbuff -> Action Qbuff))
+compile :: String -> OptionT IO [FunctionDescr]
 compile raw = do
     let (code, localImports) = parseCode raw
 
@@ -92,5 +93,13 @@ compile raw = do
 
         interpret (mkMainFunction code) (as :: (Function (Qbuff -> Action Qbuff)))
 
-    either throw return res
+    comp <- either throw return res
+
+    -- serialize and optimize the computation:
+
+    let descr  = fst (serialize comp 0)
+        descr' = if noopt opt then descr else optimize descr
+
+    whenLevel 1 $ lift (hPutStrLn stderr $ "Functions: " ++ show (length descr) ++ " (" ++ show (length descr') ++ " optimized)")
+    return descr'
 
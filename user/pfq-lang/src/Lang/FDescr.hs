@@ -25,5 +25,5 @@ import Network.PFQ.Lang as Q
 import Options
 
 
-compile :: (Monad m) => Q.Function (Qbuff -> Action Qbuff) -> OptionT m String
-compile comp = return $ show (fst $ Q.serialize comp 0)
+compile :: (Monad m) => [Q.FunctionDescr] -> OptionT m String
+compile descr = return $ show descr
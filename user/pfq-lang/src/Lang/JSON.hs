@@ -27,8 +27,7 @@ import qualified Data.ByteString.Lazy.Char8 as C
 import Options
 
 
-compile :: (Monad m) => Q.Function (Qbuff -> Action Qbuff) -> OptionT m String
--- compile comp = return (C.unpack $ A.encode comp)
-compile comp = return (C.unpack $ A.encode $ fst (Q.serialize comp 0))
+compile :: (Monad m) => [Q.FunctionDescr] -> OptionT m String
+compile descr = return (C.unpack $ A.encode descr)
 
 
@@ -31,13 +31,13 @@ import Options
 import Data.Maybe
 
 
-load :: Q.Function (Qbuff -> Action Qbuff) -> OptionT IO String
-load comp = do
+load :: [Q.FunctionDescr] -> OptionT IO String
+load descr = do
     gid' <- fmap (fromJust . gid) ask
     lift $ Q.openNoGroup 64 4096 64 4096 >>= \handle ->
         withPfq handle $ \handlePtr -> do
             Q.joinGroup handlePtr gid' class_control policy_shared
-            Q.setGroupComputation handlePtr gid' comp
+            Q.setGroupComputationFromDescr handlePtr gid' descr
             return $ "PFQ: computation loaded for gid " ++ show gid' ++ "."
 
 
@@ -0,0 +1,296 @@
+-- Copyright (c) 2015-16 Nicola Bonelli <nicola@pfq.io>
+--
+-- This program is free software; you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation; either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- This program is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with this program; if not, write to the Free Software
+-- Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+--
+
+
+module Lang.Optimizer
+(
+  optimize
+) where
+
+import Network.PFQ.Lang
+
+import Data.List (sortBy)
+import Data.Ord (comparing)
+import Data.Maybe (fromMaybe)
+import Control.Monad.State
+
+
+-- | Intermediate representation: a computation is a kleisli composition of
+-- nodes, whose arguments are either plain data or references to other
+-- compositions (a single node for predicates and properties).
+
+data Node = Node String [Arg]
+    deriving Show
+
+data Arg = Plain Argument | Ref [Node]
+    deriving Show
+
+type Chain = [Node]
+
+
+symbol :: Node -> String
+symbol (Node s _) = s
+
+
+unitNode :: Node
+unitNode = Node "unit" (replicate 8 (Plain ArgNull))
+
+dropNode :: Node
+dropNode = Node "drop" (replicate 8 (Plain ArgNull))
+
+combine :: String -> Node -> Node -> Node
+combine op p q = Node op (Ref [p] : Ref [q] : replicate 6 (Plain ArgNull))
+
+
+-- | Optimize a serialized computation: dead-branch elimination, filter
+-- merging, predicate reordering and common subexpression elimination.
+
+optimize :: [FunctionDescr] -> [FunctionDescr]
+optimize = toDescr . optChain . fromDescr
+
+
+fromDescr :: [FunctionDescr] -> Chain
+fromDescr xs = chainAt 0
+    where table = [ (funIndex x, x) | x <- xs ]
+          chainAt n = case lookup n table of
+                        Just (FunctionDescr s as _ l) -> Node s (map arg as) : chainAt l
+                        Nothing -> []
+          arg (ArgFunPtr n) = Ref (chainAt n)
+          arg a = Plain a
+
+
+-- | Serialize the computation back. The entry point is the first function;
+-- identical pure predicates and properties are emitted once.
+
+data Emit = Emit
+    { emitted :: [FunctionDescr]
+    , counter :: Int
+    , shared  :: [(String, Int)]
+    }
+
+
+toDescr :: Chain -> [FunctionDescr]
+toDescr c = sortBy (comparing funIndex) . emitted $ execState (emitChain c') (Emit [] 0 [])
+    where c' = if null c then [unitNode] else c
+
+
+emitChain :: Chain -> State Emit Int
+emitChain [] = return (-1)
+emitChain c@[n] | isPure n = do
+    tab <- gets shared
+    case lookup (show c) tab of
+        Just i  -> return i
+        Nothing -> do
+            i <- emitNode n []
+            modify $ \st -> st { shared = (show c, i) : shared st }
+            return i
+emitChain (n:ns) = emitNode n ns
+
+
+emitNode :: Node -> Chain -> State Emit Int
+emitNode (Node s as) ns = do
+    i <- gets counter
+    modify $ \st -> st { counter = i + 1 }
+    as' <- mapM emitArg as
+    l <- emitChain ns
+    modify $ \st -> st { emitted = FunctionDescr s as' i l : emitted st }
+    return i
+
+
+emitArg :: Arg -> State Emit Argument
+emitArg (Plain a) = return a
+emitArg (Ref []) = fmap ArgFunPtr (emitChain [unitNode])
+emitArg (Ref c)  = fmap ArgFunPtr (emitChain c)
+
+
+-- | Kernel predicates and properties with no side effects, with their
+-- estimated cost (in header accesses) and probability of being true.
+
+predicates :: [(String, (Double, Double))]
+predicates =
+    [ ("is_ip",            (1, 0.9 ))
+    , ("has_vlan",         (1, 0.1 ))
+    , ("has_vid",          (1, 0.05))
+    , ("has_mark",         (1, 0.1 ))
+    , ("has_state",        (1, 0.1 ))
+    , ("is_l3_proto",      (1, 0.5 ))
+    , ("is_broadcast",     (1, 0.05))
+    , ("is_multicast",     (1, 0.1 ))
+    , ("vlan_id",          (1, 0.1 ))
+    , ("is_tcp",           (2, 0.6 ))
+    , ("is_udp",           (2, 0.3 ))
+    , ("is_icmp",          (2, 0.05))
+    , ("is_flow",          (2, 0.9 ))
+    , ("is_l4_proto",      (2, 0.3 ))
+    , ("is_frag",          (2, 0.01))
+    , ("is_first_frag",    (2, 0.01))
+    , ("is_more_frag",     (2, 0.01))
+    , ("has_port",         (3, 0.05))
+    , ("has_src_port",     (3, 0.05))
+    , ("has_dst_port",     (3, 0.05))
+    , ("has_addr",         (3, 0.1 ))
+    , ("has_src_addr",     (3, 0.1 ))
+    , ("has_dst_addr",     (3, 0.1 ))
+    , ("is_incoming_host", (3, 0.5 ))
+    , ("is_ip_host",       (3, 0.5 ))
+    , ("is_ip_broadcast",  (3, 0.05))
+    , ("is_ip_multicast",  (3, 0.05))
+    , ("bloom_src",        (5, 0.1 ))
+    , ("bloom_dst",        (5, 0.1 ))
+    , ("bloom",            (6, 0.1 ))
+    , ("lpm_src",          (6, 0.1 ))
+    , ("lpm_dst",          (6, 0.1 ))
+    , ("lpm",              (8, 0.1 ))
+    , ("payload_match",    (20, 0.05))
+    ]
+
+comparisons :: [String]
+comparisons = [ "less", "less_eq", "greater", "greater_eq", "equal", "not_equal", "any_bit", "all_bit" ]
+
+properties :: [String]
+properties = [ "ip_tos", "ip_tot_len", "ip_id", "ip_frag", "ip_ttl", "tcp_source", "tcp_dest", "tcp_hdrlen"
+             , "udp_source", "udp_dest", "udp_len", "icmp_type", "icmp_code", "get_mark", "get_state" ]
+
+combinators :: [String]
+combinators = [ "not", "and", "or", "xor" ]
+
+
+isPure :: Node -> Bool
+isPure (Node s as) = s `elem` (map fst predicates ++ comparisons ++ properties ++ combinators) && all pureArg as
+    where pureArg (Ref c) = all isPure c
+          pureArg _ = True
+
+
+estimate :: Node -> (Double, Double)
+estimate (Node "not" (Ref [p] : _)) = let (c, t) = estimate p in (c, 1 - t)
+estimate (Node "and" (Ref [p] : Ref [q] : _)) = let (c1, t1) = estimate p
+                                                    (c2, t2) = estimate q
+                                                in (c1 + t1 * c2, t1 * t2)
+estimate (Node "or"  (Ref [p] : Ref [q] : _)) = let (c1, t1) = estimate p
+                                                    (c2, t2) = estimate q
+                                                in (c1 + (1 - t1) * c2, 1 - (1 - t1) * (1 - t2))
+estimate (Node "xor" (Ref [p] : Ref [q] : _)) = let (c1, t1) = estimate p
+                                                    (c2, t2) = estimate q
+                                                in (c1 + c2, t1 + t2 - 2 * t1 * t2)
+estimate (Node s _) = fromMaybe (4, 0.5) (lookup s predicates)
+
+
+-- | The value of a predicate, when known at compile time.
+
+staticValue :: Node -> Maybe Bool
+staticValue (Node s (_ : Plain a : _))
+    | s `elem` ["less", "any_bit"] && show a == "0" = Just False
+staticValue (Node "not" (Ref [p] : _)) = fmap not (staticValue p)
+staticValue (Node "and" (Ref [p] : Ref [q] : _))
+    | staticValue p == Just False || staticValue q == Just False = Just False
+    | staticValue p == Just True  && staticValue q == Just True  = Just True
+    | complement p q = Just False
+staticValue (Node "or" (Ref [p] : Ref [q] : _))
+    | staticValue p == Just True  || staticValue q == Just True  = Just True
+    | staticValue p == Just False && staticValue q == Just False = Just False
+    | complement p q = Just True
+staticValue (Node "xor" (Ref [p] : Ref [q] : _)) = liftM2 (/=) (staticValue p) (staticValue q)
+staticValue _ = Nothing
+
+
+complement :: Node -> Node -> Bool
+complement p (Node "not" (Ref [q] : _)) | isPure p && show p == show q = True
+complement (Node "not" (Ref [p] : _)) q | isPure q && show p == show q = True
+complement _ _ = False
+
+
+-- | Predicates: simplify and reorder the operands of and/or (all pure) by
+-- rank, the cheapest and most decisive first.
+
+optPred :: Node -> Node
+optPred (Node s as) = simplify (Node s (map optArg as))
+
+
+simplify :: Node -> Node
+simplify n@(Node "and" (Ref [p] : Ref [q] : _))
+    | staticValue p == Just True = q
+    | staticValue q == Just True = p
+    | isPure p && show p == show q = p
+    | otherwise = reorder n
+simplify n@(Node "or" (Ref [p] : Ref [q] : _))
+    | staticValue p == Just False = q
+    | staticValue q == Just False = p
+    | isPure p && show p == show q = p
+    | otherwise = reorder n
+simplify (Node "not" (Ref [Node "not" (Ref [p] : _)] : _)) = p
+simplify n = n
+
+
+reorder :: Node -> Node
+reorder n@(Node op _)
+    | all isPure xs = foldr1 (combine op) (sortBy (comparing rank) xs)
+    | otherwise     = n
+    where xs = operands n
+          operands x@(Node s (Ref [p] : Ref [q] : _)) = if s == op then operands p ++ operands q else [x]
+          operands x = [x]
+          rank x = let (c, t) = estimate x
+                       d = if op == "and" then 1 - t else t
+                   in if d <= 0 then 1 / 0 else c / d
+
+
+-- | Functions: eliminate dead branches and identities, and merge
+-- consecutive filters into a single composite predicate.
+
+optArg :: Arg -> Arg
+optArg (Plain a) = Plain a
+optArg (Ref [n]) | isPure n = Ref [optPred n]
+optArg (Ref c) = Ref (optChain c)
+
+
+optChain :: Chain -> Chain
+optChain = mergeFilters . deadCode . concatMap (\(Node s as) -> optFunction (Node s (map optArg as)))
+
+
+optFunction :: Node -> Chain
+optFunction (Node "unit" _) = []
+optFunction n@(Node "filter" (Ref [p] : _)) =
+    case staticValue p of
+        Just True  -> []
+        Just False -> [dropNode]
+        Nothing    -> [n]
+optFunction n@(Node "when" (Ref [p] : Ref f : _)) =
+    case staticValue p of
+        Just True  -> f
+        Just False -> []
+        Nothing    -> if null f && isPure p then [] else [n]
+optFunction n@(Node "unless" (Ref [p] : Ref f : _)) =
+    case staticValue p of
+        Just True  -> []
+        Just False -> f
+        Nothing    -> if null f && isPure p then [] else [n]
+optFunction n@(Node "conditional" (Ref [p] : Ref f : Ref g : _)) =
+    case staticValue p of
+        Just True  -> f
+        Just False -> g
+        Nothing    -> if show f == show g && isPure p then f else [n]
+optFunction n = [n]
+
+
+deadCode :: Chain -> Chain
+deadCode xs = let (as, bs) = break ((== "drop") . symbol) xs in as ++ take 1 bs
+
+
+mergeFilters :: Chain -> Chain
+mergeFilters (Node "filter" (Ref [p] : _) : Node "filter" (Ref [q] : _) : ns) =
+    mergeFilters (Node "filter" (Ref [simplify (combine "and" p q)] : replicate 7 (Plain ArgNull)) : ns)
+mergeFilters (n : ns) = n : mergeFilters ns
+mergeFilters [] = []
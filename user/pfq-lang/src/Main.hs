@@ -52,12 +52,12 @@ main = do
         Left (NotAllowed xs)   ->  error xs
         Left (GhcException xs) ->  error xs
         Left (UnknownError xs) ->  error xs
-        Right comp -> do
+        Right descr -> do
             (case () of
-                _ | json opt'   -> runReaderT (Lang.JSON.compile comp) opt'
-                  | fdescr opt' -> runReaderT (Lang.FDescr.compile comp) opt'
+                _ | json opt'   -> runReaderT (Lang.JSON.compile descr) opt'
+                  | fdescr opt' -> runReaderT (Lang.FDescr.compile descr) opt'
                   | otherwise   -> return "") >>= hPutStr outHandle
-            when (isJust (gid opt')) $ runReaderT (Lang.Kernel.load comp) opt' >>= hPutStr stderr
+            when (isJust (gid opt')) $ runReaderT (Lang.Kernel.load descr) opt' >>= hPutStr stderr
 
       hPutStr outHandle "\n"
 
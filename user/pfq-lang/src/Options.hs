@@ -37,6 +37,7 @@ data Options = Options
     ,   json                :: Bool
     ,   fdescr              :: Bool
     ,   gid                 :: Maybe Int
+    ,   noopt               :: Bool
     -- other
     ,   verb                :: Int
     ,   file                :: Maybe FilePath
@@ -3,8 +3,14 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <cstring>
 
 #include <pfq/pfq.hpp>
+#include <pfq/lang/default.hpp>
 
 #include "yats.hpp"
 
@@ -12,6 +18,75 @@ using namespace yats;
 
 const std::string DEV("eth0");
 
+
+/* send n datagrams over the loopback */
+
+static void
+udp_load(int n)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr {};
+    char payload[64] {};
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9000);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for(int i = 0; i < n; i++)
+        sendto(sock, payload, sizeof(payload), 0, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+
+    close(sock);
+    usleep(100000);
+}
+
+
+/* send n datagrams over the loopback, each one in 3 IPv4 fragments, to 16 addresses */
+
+static void
+frag_load(int n)
+{
+    int sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+    char pkt[sizeof(iphdr) + 24];
+
+    for(int i = 0; i < n; i++)
+    {
+        sockaddr_in addr {};
+
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + (i & 15));
+
+        for(int f = 0; f < 3; f++)
+        {
+            auto ip = reinterpret_cast<iphdr *>(pkt);
+
+            memset(pkt, 0, sizeof(pkt));
+
+            ip->version  = 4;
+            ip->ihl      = 5;
+            ip->ttl      = 64;
+            ip->protocol = IPPROTO_UDP;
+            ip->id       = htons(i + 1);
+            ip->frag_off = htons((f < 2 ? 0x2000 /* MF */ : 0) | f * 3);
+            ip->saddr    = htonl(INADDR_LOOPBACK);
+            ip->daddr    = addr.sin_addr.s_addr;
+
+            if (f == 0)
+            {
+                auto udp = reinterpret_cast<udphdr *>(ip + 1);
+                udp->source = htons(10000 + i);
+                udp->dest   = htons(9000);
+                udp->len    = htons(8 + 64);
+            }
+
+            sendto(sock, pkt, sizeof(pkt), 0, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        }
+    }
+
+    close(sock);
+    usleep(100000);
+}
+
+
 auto g = Group("PFQ")
 
     .Single("default_ctor_dtor", []
@@ -569,6 +644,145 @@ auto g = Group("PFQ")
     {
         pfq::socket q(64);
         AssertNoThrow(q.egress_unbind());
+    })
+
+    .Single("map_round_trip", []
+    {
+        pfq::socket q(64);
+        pfq_map_entry e {};
+
+        e.key[0] = 10; e.key[3] = 1; e.value = 42;
+
+        AssertNoThrow(q.map_create(3, Q_MAP_HASH, 4, 16));
+        AssertNoThrow(q.map_update(3, {e}));
+        Assert(q.map_info(3).count, is_equal_to(1UL));
+
+        AssertNoThrow(q.map_delete(3, {e}));
+        Assert(q.map_info(3).count, is_equal_to(0UL));
+
+        AssertNoThrow(q.map_destroy(3));
+        AssertThrow(q.map_info(3));
+    })
+
+    .Single("sketch_round_trip", []
+    {
+        pfq::socket q(64);
+        uint64_t total = 1;
+
+        AssertNoThrow(q.sketch_create(3, Q_KEY_IP_SRC|Q_KEY_IP_DST, 1024, 4, 16));
+        Assert(q.sketch_topk(3, 16, &total).size(), is_equal_to(size_t{0}));
+        Assert(total, is_equal_to(uint64_t{0}));
+
+        AssertNoThrow(q.sketch_reset(3));
+        AssertNoThrow(q.sketch_destroy(3));
+        AssertThrow(q.sketch_topk(3, 16));
+    })
+
+    .Single("flow_ring", []
+    {
+        pfq::socket q(64);
+
+        AssertNoThrow(q.flow_slots(1024));
+        AssertThrow(q.read_flows(16));
+
+        q.enable();
+
+        Assert(q.read_flows(16).size(), is_equal_to(size_t{0}));
+        Assert(q.flow_lost(), is_equal_to(0UL));
+    })
+
+    .Single("histogram", []
+    {
+        pfq::socket q(64);
+        auto gid = q.group_id();
+
+        q.set_group_computation(gid, pfq::lang::histogram(3, {64, 128, 256}, pfq::lang::ip_tot_len) >> pfq::lang::kernel);
+
+        auto h = q.group_histogram(gid, 3);
+
+        Assert(h.first.size(), is_equal_to(size_t{3}));
+        Assert(h.first[2], is_equal_to(uint64_t{256}));
+        Assert(h.second.size(), is_equal_to(size_t{4}));
+
+        AssertThrow(q.group_histogram(gid, 4));
+    })
+
+    .Single("dedup", []
+    {
+        pfq::socket q(64);
+        auto gid = q.group_id();
+
+        q.set_group_computation(gid, pfq::lang::dedup(1000) >> pfq::lang::kernel);
+
+        /* same arguments: the window is migrated */
+
+        q.set_group_computation(gid, pfq::lang::dedup(1000) >> pfq::lang::kernel);
+
+        Assert(q.group_shed(gid).dedup, is_equal_to(0UL));
+    })
+
+    .Single("sample_flow_fragments", []
+    {
+        pfq::socket q(64);
+        auto gid = q.group_id();
+
+        /* all the fragments of a datagram are sampled in or out together */
+
+        q.bind("lo");
+        q.set_group_computation(gid, pfq::lang::filter(pfq::lang::is_frag) >> pfq::lang::sample_flow_filter(0.5) >> pfq::lang::kernel);
+        q.enable();
+
+        frag_load(64);
+
+        auto shed = q.group_shed(gid);
+
+        Assert(shed.sample_in + shed.sample_out, is_equal_to(64UL * 3));
+        Assert(shed.sample_in % 3, is_equal_to(0UL));
+    })
+
+    .Single("set_vlan_id", []
+    {
+        pfq::socket q(64);
+        auto gid = q.group_id();
+
+        /* Tx captures are shared with the other taps: tagging copies them on write */
+
+        q.bind_group_tx(gid, "lo");
+        q.set_group_computation(gid, pfq::lang::set_vlan_id(42) >> pfq::lang::unit);
+        q.enable();
+
+        udp_load(64);
+
+        auto nq = q.read(0);
+
+        Assert(nq.empty(), is_equal_to(false));
+
+        for(auto &hdr : nq)
+        {
+            Assert(static_cast<int>(hdr.info.vlan.vid), is_equal_to(42));
+            Assert(static_cast<int>(hdr.info.dir), is_equal_to(Q_DIR_TX));
+        }
+
+        Assert(q.group_stats(gid).lost, is_equal_to(0UL));
+    })
+
+    .Single("call_tracking", []
+    {
+        /* functions of the RTP module: skipped if it is not loaded */
+
+        if (access("/sys/module/RTP", F_OK) != 0)
+        {
+            std::cout << "RTP module not loaded: call_tracking skipped." << std::endl;
+            return;
+        }
+
+        pfq::socket q(64);
+        auto gid = q.group_id();
+
+        AssertNoThrow(q.set_group_computation(gid, pfq::lang::when(pfq::lang::is_call, pfq::lang::steer_call)));
+        AssertNoThrow(q.set_group_computation(gid, pfq::lang::histogram(3, {1}, pfq::lang::call_id) >> pfq::lang::steer_call));
+
+        Assert(q.group_histogram(gid, 3).second.size(), is_equal_to(size_t{2}));
     });
 
 #if 0
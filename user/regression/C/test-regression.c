@@ -1,13 +1,21 @@
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #undef NDEBUG
 #include <assert.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <pfq/pfq.h>
 
+#include <linux/bpf.h>
+
 #include <pthread.h>
 
 
@@ -608,6 +616,41 @@ void test_egress_bind()
         pfq_close(q);
 }
 
+void test_group_budget()
+{
+        pfq_t * q = pfq_open(64, 1024, 64, 1024);
+        int gid = pfq_group_id(q);
+        struct pfq_so_group_budget b;
+
+        /* unlimited by default */
+
+        assert(pfq_get_group_budget(q, gid, &b) == 0);
+        assert(b.ns_batch == 0);
+        assert(b.pkt_ms == 0);
+
+        assert(pfq_set_group_budget(q, gid, 1, 50000, 1000, Q_SHED_SAMPLE, 8) == 0);
+
+        assert(pfq_get_group_budget(q, gid, &b) == 0);
+        assert(b.gid == gid);
+        assert(b.priority == 1);
+        assert(b.ns_batch == 50000);
+        assert(b.pkt_ms == 1000);
+        assert(b.shed == Q_SHED_SAMPLE);
+        assert(b.sample == 8);
+
+        /* invalid values leave the budget untouched */
+
+        assert(pfq_set_group_budget(q, gid, 2, 100, 100, 7, 1) == -1);
+        assert(pfq_set_group_budget(q, gid, 2, 100, 100, Q_SHED_SAMPLE, 0) == -1);
+        assert(pfq_set_group_budget(q, 22, 2, 100, 100, Q_SHED_SKIP, 1) == -1);
+
+        assert(pfq_get_group_budget(q, gid, &b) == 0);
+        assert(b.priority == 1);
+        assert(b.ns_batch == 50000);
+
+        pfq_close(q);
+}
+
 void test_egress_unbind()
 {
         pfq_t * q = pfq_open(64, 1024, 64, 1024);
@@ -618,6 +661,585 @@ void test_egress_unbind()
 }
 
 
+void test_bind_group_tx()
+{
+        pfq_t * q = pfq_open(64, 1024, 64, 1024);
+        int gid = pfq_group_id(q);
+
+        assert(pfq_bind_group_tx(q, gid, "lo") == 0);
+        assert(pfq_bind_group_tx(q, gid, "unknown") == -1);
+        assert(pfq_bind_group_tx(q, 22, "lo") == -1);
+
+        assert(pfq_unbind_group_tx(q, gid, "lo") == 0);
+        assert(pfq_unbind_group_tx(q, 22, "lo") == -1);
+
+        pfq_close(q);
+}
+
+
+/* send n datagrams over the loopback, and return the packets read by the socket */
+
+static
+unsigned long udp_load(pfq_t *q, int sock, int n)
+{
+	struct sockaddr_in addr;
+	struct pfq_net_queue nq;
+	unsigned long total = 0;
+	char payload[64];
+	int i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	memset(payload, 0, sizeof(payload));
+
+	for(i = 0; i < n; i++)
+	{
+		addr.sin_port = htons(9000 + (i & 63));
+		sendto(sock, payload, sizeof(payload), 0, (struct sockaddr *)&addr, sizeof(addr));
+
+		if ((i & 63) == 63 && pfq_read(q, &nq, 0) == 0)
+			total += nq.len;
+	}
+
+	usleep(100000);
+
+	if (pfq_read(q, &nq, 0) == 0)
+		total += nq.len;
+
+	return total;
+}
+
+
+void test_egress_capture()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	int gid = pfq_group_id(q);
+	struct pfq_stats s;
+	int sock;
+
+	assert(q);
+
+	/* the socket is bound to the Tx side of the loopback only */
+
+	assert(pfq_bind_group_tx(q, gid, "lo") == 0);
+	assert(pfq_enable(q) == 0);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+
+	assert(udp_load(q, sock, 4096) > 0);
+
+	assert(pfq_get_group_stats(q, gid, &s) == 0);
+	assert(s.recv > 0);
+	assert(s.lost == 0);
+
+	/* no longer captured once unbound */
+
+	assert(pfq_unbind_group_tx(q, gid, "lo") == 0);
+	assert(udp_load(q, sock, 4096) == 0);
+
+	close(sock);
+	pfq_close(q);
+}
+
+
+void test_rx_fanout()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	struct pfq_stats s;
+	int sock, round;
+
+	assert(q);
+
+	assert(pfq_rx_fanout(q, "unknown", 1) == -1);
+
+	assert(pfq_bind(q, "lo", Q_ANY_QUEUE) == 0);
+	assert(pfq_enable(q) == 0);
+
+	if (pfq_rx_fanout(q, "lo", 1) < 0) {
+		fprintf(stdout, "    no Rx threads (see rx_cpu): skipped.\n");
+		pfq_close(q);
+		return;
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+
+	/* sustained load, well beyond the fan-out queues and the skb pools */
+
+	for(round = 0; round < 64; round++)
+		assert(udp_load(q, sock, 4096) > 0);
+
+	assert(pfq_get_stats(q, &s) == 0);
+	assert(s.recv > 0);
+
+	assert(pfq_rx_fanout(q, "lo", 0) == 0);
+
+	close(sock);
+	pfq_close(q);
+}
+
+
+void test_group_fprog()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	struct sock_filter drop[] = { { 0x06, 0, 0, 0x00000000 } };	/* ret #0 */
+	struct sock_fprog prog = { 1, drop };
+	struct pfq_stats s;
+	int gid, sock;
+
+	assert(q);
+
+	gid = pfq_group_id(q);
+
+	assert(pfq_bind(q, "lo", Q_ANY_QUEUE) == 0);
+	assert(pfq_enable(q) == 0);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+
+	/* the filter runs on skbs materialized from skb-less (XDP) frames, too */
+
+	assert(pfq_group_fprog(q, gid, &prog) == 0);
+
+	assert(udp_load(q, sock, 4096) == 0);
+
+	assert(pfq_get_group_stats(q, gid, &s) == 0);
+	assert(s.drop > 0);
+	assert(s.lost == 0);
+
+	assert(pfq_group_fprog_reset(q, gid) == 0);
+
+	assert(udp_load(q, sock, 4096) > 0);
+
+	close(sock);
+	pfq_close(q);
+}
+
+
+/* load an eBPF socket filter that returns the given verdict */
+
+int ebpf_verdict(uint32_t verdict)
+{
+	struct bpf_insn insn[2];
+	union bpf_attr attr;
+	static char license[] = "GPL";
+
+	memset(insn, 0, sizeof(insn));
+	insn[0].code = BPF_ALU | BPF_MOV | BPF_K;	/* r0 = verdict */
+	insn[0].dst_reg = BPF_REG_0;
+	insn[0].imm = (int32_t)verdict;
+	insn[1].code = BPF_JMP | BPF_EXIT;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insn_cnt = 2;
+	attr.insns = (uintptr_t)insn;
+	attr.license = (uintptr_t)license;
+
+	return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+
+unsigned long recv_of(pfq_t *q)
+{
+	struct pfq_stats s;
+	assert(pfq_get_stats(q, &s) == 0);
+	return s.recv;
+}
+
+
+void test_group_ebpf()
+{
+	pfq_t * q = pfq_open_group(Q_CLASS_DEFAULT, Q_POLICY_GROUP_SHARED, 64, 1024, 64, 1024);
+	pfq_t * o = pfq_open_nogroup(64, 1024, 64, 1024);
+	int drop  = ebpf_verdict(Q_EBPF_DROP);
+	int pass  = ebpf_verdict(Q_EBPF_PASS);
+	int one   = ebpf_verdict(1);
+	int steer = ebpf_verdict(Q_EBPF_STEER_HASH(42));
+	unsigned long rq, ro;
+	struct pfq_net_queue nq;
+	struct pfq_stats s;
+	int gid, sock;
+
+	assert(q);
+	assert(o);
+
+	gid = pfq_group_id(q);
+
+	assert(pfq_join_group(o, gid, Q_CLASS_DEFAULT, Q_POLICY_GROUP_SHARED) == gid);
+	assert(pfq_bind(q, "lo", Q_ANY_QUEUE) == 0);
+	assert(pfq_enable(q) == 0);
+	assert(pfq_enable(o) == 0);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+
+	/* not an eBPF program */
+
+	assert(pfq_group_ebpf(q, gid, sock) == -1);
+
+	if (drop < 0 || pass < 0 || one < 0 || steer < 0 || pfq_group_ebpf(q, gid, drop) < 0) {
+		fprintf(stdout, "    eBPF not supported: skipped.\n");
+		goto out;
+	}
+
+	/* drop */
+
+	assert(udp_load(q, sock, 256) == 0);
+	assert(pfq_get_group_stats(q, gid, &s) == 0);
+	assert(s.drop >= 256);
+
+	/* pass: every socket of the group gets a copy, as with any other
+	 * non-zero verdict without the steering bit */
+
+	assert(pfq_group_ebpf(q, gid, pass) == 0);
+
+	rq = recv_of(q); ro = recv_of(o);
+	udp_load(q, sock, 256);
+	pfq_read(o, &nq, 0);
+	assert(recv_of(q) - rq >= 256);
+	assert(recv_of(o) - ro >= 256);
+
+	assert(pfq_group_ebpf(q, gid, one) == 0);
+
+	rq = recv_of(q); ro = recv_of(o);
+	udp_load(q, sock, 256);
+	pfq_read(o, &nq, 0);
+	assert(recv_of(q) - rq >= 256);
+	assert(recv_of(o) - ro >= 256);
+
+	/* steer: a constant hash picks a single socket */
+
+	assert(pfq_group_ebpf(q, gid, steer) == 0);
+
+	rq = recv_of(q); ro = recv_of(o);
+	udp_load(q, sock, 256);
+	pfq_read(o, &nq, 0);
+	rq = recv_of(q) - rq; ro = recv_of(o) - ro;
+	assert((rq == 0) != (ro == 0));
+	assert(rq + ro >= 256);
+
+	assert(pfq_group_ebpf_reset(q, gid) == 0);
+out:
+	if (drop >= 0) close(drop);
+	if (pass >= 0) close(pass);
+	if (one >= 0) close(one);
+	if (steer >= 0) close(steer);
+	close(sock);
+	pfq_close(o);
+	pfq_close(q);
+}
+
+
+/* toggle the lang_profile parameter of the module, return the old value */
+
+int lang_profile(int value)
+{
+	FILE *f = fopen("/sys/module/pfq/parameters/lang_profile", "r+");
+	int old;
+
+	if (f == NULL)
+		return -1;
+
+	if (fscanf(f, "%d", &old) != 1 || fseek(f, 0, SEEK_SET) < 0 || fprintf(f, "%d\n", value) < 0)
+		old = -1;
+
+	fclose(f);
+	return old;
+}
+
+
+void test_group_profile()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	struct pfq_lang_computation_descr *comp;
+	struct pfq_lang_node_profile node[4];
+	size_t size = 4;
+	int gid, sock, old;
+
+	assert(q);
+
+	gid = pfq_group_id(q);
+
+	assert(pfq_bind(q, "lo", Q_ANY_QUEUE) == 0);
+	assert(pfq_enable(q) == 0);
+
+	/* udp >> unit */
+
+	comp = calloc(1, sizeof(*comp) + 2 * sizeof(struct pfq_lang_functional_descr));
+	assert(comp);
+
+	comp->size = 2;
+	comp->entry_point = 0;
+	comp->fun[0].symbol = "udp";
+	comp->fun[0].next = 1;
+	comp->fun[1].symbol = "unit";
+	comp->fun[1].next = -1;
+
+	/* no computation */
+
+	assert(pfq_get_group_profile(q, gid, node, &size) == -1);
+
+	old = lang_profile(0);
+	if (old < 0) {
+		fprintf(stdout, "    lang_profile not available: skipped.\n");
+		goto out;
+	}
+
+	/* computations are profiled only if loaded with lang_profile set */
+
+	assert(pfq_set_group_computation(q, gid, comp) == 0);
+	assert(pfq_get_group_profile(q, gid, node, &size) == -1);
+
+	assert(lang_profile(1) == 0);
+	assert(pfq_set_group_computation(q, gid, comp) == 0);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+
+	assert(udp_load(q, sock, 256) >= 256);
+
+	assert(pfq_get_group_profile(q, gid, node, &size) == 0);
+	assert(size == 2);
+
+	assert(node[0].run >= 256);
+	assert(node[0].pass >= 256);
+	assert(node[0].cycles > 0);
+
+	assert(node[1].run >= 256);
+	assert(node[1].drop == 0);
+
+	/* at most size nodes are returned, the computation size is reported */
+
+	size = 1;
+	assert(pfq_get_group_profile(q, gid, node, &size) == 0);
+	assert(size == 2);
+
+	close(sock);
+	lang_profile(old);
+out:
+	free(comp);
+	pfq_close(q);
+}
+
+
+void test_maps()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	pfq_t * o = pfq_open(64, 1024, 64, 1024);
+	struct pfq_map_entry e[2];
+	struct pfq_map_info info;
+
+	assert(q);
+	assert(o);
+
+	memset(e, 0, sizeof(e));
+	e[0].key[0] = 10; e[0].key[3] = 1; e[0].value = 42;
+	e[1].key[0] = 10; e[1].key[3] = 2; e[1].value = 43;
+
+	assert(pfq_map_create(q, 1, Q_MAP_HASH, 4, 1024) == 0);
+	assert(pfq_map_create(q, 1, Q_MAP_HASH, 4, 1024) == -1);
+
+	assert(pfq_map_update(q, 1, e, 2) == 0);
+
+	info.id = 1;
+	assert(pfq_get_map_info(q, 1, &info) == 0);
+	assert(info.type == Q_MAP_HASH);
+	assert(info.key_size == 4);
+	assert(info.max_entries == 1024);
+	assert(info.count == 2);
+
+	/* replace */
+
+	e[0].value = 44;
+	assert(pfq_map_update(q, 1, e, 1) == 0);
+	assert(pfq_get_map_info(q, 1, &info) == 0);
+	assert(info.count == 2);
+
+	/* owned by the creating socket */
+
+	assert(pfq_map_update(o, 1, e, 1) == -1);
+	assert(pfq_map_destroy(o, 1) == -1);
+	assert(pfq_get_map_info(o, 1, &info) == 0);
+
+	assert(pfq_map_delete(q, 1, e, 2) == 0);
+	assert(pfq_get_map_info(q, 1, &info) == 0);
+	assert(info.count == 0);
+
+	assert(pfq_map_destroy(q, 1) == 0);
+	assert(pfq_map_destroy(q, 1) == -1);
+
+	/* owned maps are destroyed with the socket */
+
+	assert(pfq_map_create(q, 2, Q_MAP_LPM, 4, 16) == 0);
+
+	pfq_close(q);
+
+	assert(pfq_get_map_info(o, 2, &info) == -1);
+	assert(pfq_map_create(o, 2, Q_MAP_ARRAY, 4, 16) == 0);
+	assert(pfq_map_destroy(o, 2) == 0);
+
+	pfq_close(o);
+}
+
+
+void test_cuckoo_maps()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	struct pfq_map_entry e[2];
+	struct pfq_map_info info;
+	int n;
+
+	assert(q);
+
+	memset(e, 0, sizeof(e));
+	e[0].key[0] = 10; e[0].key[3] = 1;
+	e[1].key[0] = 10; e[1].key[3] = 2;
+
+	/* keys are added once, and removed by a single delete */
+
+	assert(pfq_map_create(q, 3, Q_MAP_CUCKOO, 4, 1024) == 0);
+	assert(pfq_map_update(q, 3, e, 1) == 0);
+	assert(pfq_map_update(q, 3, e, 1) == 0);
+	assert(pfq_get_map_info(q, 3, &info) == 0);
+	assert(info.type == Q_MAP_CUCKOO);
+	assert(info.count == 1);
+	assert(info.slots >= 1024);
+
+	/* deleting a key that is not a member leaves the others alone */
+
+	assert(pfq_map_delete(q, 3, &e[1], 1) == 0);
+	assert(pfq_get_map_info(q, 3, &info) == 0);
+	assert(info.count == 1);
+
+	assert(pfq_map_update(q, 3, &e[1], 1) == 0);
+	assert(pfq_get_map_info(q, 3, &info) == 0);
+	assert(info.count == 2);
+
+	assert(pfq_map_delete(q, 3, e, 2) == 0);
+	assert(pfq_get_map_info(q, 3, &info) == 0);
+	assert(info.count == 0);
+
+	/* every distinct key holds its own fingerprint, up to max_entries */
+
+	for(n = 0; n < 1024; n++)
+	{
+		e[0].key[2] = (uint8_t)(n >> 8);
+		e[0].key[3] = (uint8_t)n;
+		assert(pfq_map_update(q, 3, e, 1) == 0);
+	}
+
+	assert(pfq_get_map_info(q, 3, &info) == 0);
+	assert(info.count == 1024);
+
+	e[1].key[0] = 11;
+	assert(pfq_map_update(q, 3, &e[1], 1) == -1);
+
+	assert(pfq_map_destroy(q, 3) == 0);
+
+	pfq_close(q);
+}
+
+
+void test_sketches()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	pfq_t * o = pfq_open(64, 1024, 64, 1024);
+	struct pfq_sketch_entry e[16];
+	uint64_t total = 1;
+	size_t size = 16;
+	int n;
+
+	assert(q);
+	assert(o);
+
+	assert(pfq_sketch_create(q, 1, Q_KEY_IP_SRC|Q_KEY_IP_DST, 1024, 4, 16, 0) == 0);
+	assert(pfq_sketch_create(q, 1, Q_KEY_IP_SRC|Q_KEY_IP_DST, 1024, 4, 16, 0) == -1);
+
+	assert(pfq_get_sketch_topk(q, 1, e, &size, &total) == 0);
+	assert(size == 0);
+	assert(total == 0);
+
+	/* owned by the creating socket */
+
+	assert(pfq_sketch_reset(o, 1) == -1);
+	assert(pfq_sketch_destroy(o, 1) == -1);
+	size = 16;
+	assert(pfq_get_sketch_topk(o, 1, e, &size, NULL) == 0);
+
+	assert(pfq_sketch_reset(q, 1) == 0);
+	assert(pfq_sketch_destroy(q, 1) == 0);
+	assert(pfq_sketch_destroy(q, 1) == -1);
+	assert(pfq_sketch_reset(q, 1) == -1);
+
+	/* bad geometry */
+
+	assert(pfq_sketch_create(q, 1, Q_KEY_IP_SRC, 1000, 4, 16, 0) == -1);
+
+	/* memory budget: Q_MAX_SKETCH of the largest sketches do not fit */
+
+	for(n = 0; n < Q_MAX_SKETCH; n++)
+	{
+		if (pfq_sketch_create(q, n, Q_KEY_IP_SRC, 1 << 20, 8, 16, 0) < 0)
+			break;
+	}
+
+	assert(n < Q_MAX_SKETCH);
+
+	/* ...nor does the replacement allocated by a reset */
+
+	if (n > 0)
+		assert(pfq_sketch_reset(q, 0) == -1);
+
+	while (n-- > 0)
+		assert(pfq_sketch_destroy(q, n) == 0);
+
+	/* owned sketches are destroyed with the socket */
+
+	assert(pfq_sketch_create(q, 1, Q_KEY_IP_SRC, 1024, 4, 16, 0) == 0);
+
+	pfq_close(q);
+
+	size = 16;
+	assert(pfq_get_sketch_topk(o, 1, e, &size, NULL) == -1);
+	assert(pfq_sketch_create(o, 1, Q_KEY_IP_SRC, 1024, 4, 16, 0) == 0);
+	assert(pfq_sketch_destroy(o, 1) == 0);
+
+	pfq_close(o);
+}
+
+
+void test_flow_slots()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+	struct pfq_flow_record rec[8];
+
+	assert(q);
+
+	assert(pfq_get_flow_slots(q) == 0);
+	assert(pfq_set_flow_slots(q, 1000) == 0);
+	assert(pfq_get_flow_slots(q) == 1000);
+
+	assert(pfq_read_flows(q, rec, 8) == -1);
+
+	assert(pfq_enable(q) == 0);
+	assert(pfq_set_flow_slots(q, 2048) == -1);
+
+	assert(pfq_read_flows(q, rec, 8) == 0);
+	assert(pfq_get_flow_lost(q) == 0);
+
+	assert(pfq_disable(q) == 0);
+	assert(pfq_set_flow_slots(q, 0) == 0);
+	assert(pfq_enable(q) == 0);
+	assert(pfq_read_flows(q, rec, 8) == -1);
+
+	pfq_close(q);
+}
+
+
 #define TEST(test)   fprintf(stdout, "running '%s'...\n", #test); test();
 
 int
@@ -673,8 +1295,22 @@ main(int argc __attribute__((unused)), char *argv[]__attribute__((unused)))
         TEST(test_tx_queue);
 
         TEST(test_egress_bind);
+        TEST(test_group_budget);
         TEST(test_egress_unbind);
 
+	TEST(test_bind_group_tx);
+	TEST(test_egress_capture);
+
+	TEST(test_rx_fanout);
+	TEST(test_group_fprog);
+	TEST(test_group_ebpf);
+	TEST(test_group_profile);
+
+	TEST(test_maps);
+	TEST(test_cuckoo_maps);
+	TEST(test_sketches);
+	TEST(test_flow_slots);
+
         printf("Tests successfully passed.\n");
 	return 0;
 }